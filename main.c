@@ -0,0 +1,57 @@
+/*
+ * GStreamer main.c
+ * Copyright 2016 Andreas Frisch <fraxinas@opendreambox.org>
+ *
+ * This program is licensed under the Creative Commons
+ * Attribution-NonCommercial-ShareAlike 3.0 Unported
+ * License. To view a copy of this license, visit
+ * http://creativecommons.org/licenses/by-nc-sa/3.0/ or send a letter to
+ * Creative Commons,559 Nathan Abbott Way,Stanford,California 94305,USA.
+ *
+ * This program is NOT free software. It is open source, you are allowed
+ * to modify it (if you keep the license), but it may not be commercially
+ * distributed other than under the conditions noted above.
+ */
+
+#include <signal.h>
+#include <X11/Xlib.h>
+#include "photobooth.h"
+#include "photoboothmetrics.h"
+#include "photoboothstartup.h"
+
+#define DEFAULT_CONFIG "default.ini"
+
+static gboolean photo_booth_metrics_signal (G_GNUC_UNUSED gpointer user_data)
+{
+	gchar *metrics = photo_booth_metrics_to_string (photo_booth_metrics_get_default ());
+	g_print ("%s", metrics);
+	g_free (metrics);
+	return G_SOURCE_CONTINUE;
+}
+
+int main (int argc, char *argv[])
+{
+	PhotoBooth *pb;
+	gint64 gst_start;
+	int ret;
+
+	XInitThreads();
+	// loads the plugin registry, or scans the plugins when it is stale
+	gst_start = g_get_monotonic_time ();
+	gst_init (0, NULL);
+	photo_booth_startup_add (photo_booth_startup_get_default (), "gst_init", gst_start);
+
+	pb = photo_booth_new ();
+
+	if (argc == 2)
+		photo_booth_load_settings (pb, argv[1]);
+	else
+		photo_booth_load_settings (pb, DEFAULT_CONFIG);
+
+	g_unix_signal_add (SIGINT, (GSourceFunc) photo_booth_quit_signal, pb);
+	g_unix_signal_add (SIGUSR1, (GSourceFunc) photo_booth_metrics_signal, pb);
+	ret = g_application_run (G_APPLICATION (pb), argc, argv);
+
+	g_object_unref (pb);
+	return ret;
+}
@@ -28,7 +28,6 @@
 #include <gst/video/gstvideosink.h>
 #include <gst/app/app.h>
 #include <curl/curl.h>
-#include <X11/Xlib.h>
 
 // #ifdef HAVE_LIBCANBERRA
 #include <canberra-gtk.h>
@@ -37,6 +36,16 @@
 #include "photoboothwin.h"
 #include "photoboothled.h"
 #include "photoboothmasquerade.h"
+#include "photoboothcompositor.h"
+#include "photoboothfacedetect.h"
+#include "photoboothpublish.h"
+#include "photoboothmetrics.h"
+#include "photoboothtrace.h"
+#include "photoboothwatchdog.h"
+#include "photoboothframetiming.h"
+#include "photoboothmemory.h"
+#include "photoboothstartup.h"
+#include "photoboothprintqueue.h"
 
 #include <glib/gstdio.h>
 #include <gio/gio.h>
@@ -51,9 +60,32 @@ typedef enum { NONE, ACK_SOUND, ERROR_SOUND } sound_t;
 typedef enum { SAVE_NEVER, SAVE_ASK, SAVE_PRINTED, SAVE_ALL } save_t;
 typedef enum { UPLOAD_NEVER, UPLOAD_ASK, UPLOAD_PRINTED, UPLOAD_ALL } upload_t;
 typedef enum { FACEDETECT_DISABLED, FACEDETECT_ENABLEABLE, FACEDETECT_ENABLED } facedetect_t;
+typedef enum { FRAME_TIMING_OFF, FRAME_TIMING_METRICS, FRAME_TIMING_HUD } frame_timing_t;
 
 typedef struct _PhotoBoothPrivate PhotoBoothPrivate;
 
+typedef struct
+{
+	GMutex             lock;
+	guint              idle_id;
+	gint64             total, current;
+	gdouble            rate;
+	gint               eta;
+	gdouble            last_rate;
+} UploadProgressChannel;
+
+typedef struct
+{
+	gchar             *label;
+	gint               remain;
+	gboolean           online;
+} PhotoBoothPrinterStatus;
+
+typedef struct
+{
+	GdkPixbuf         *screen, *print;
+} PhotoBoothDecodedOverlay;
+
 struct _PhotoBoothPrivate
 {
 	PhotoboothState    state;
@@ -62,29 +94,44 @@ struct _PhotoBoothPrivate
 
 	GThread           *capture_thread;
 	gulong             video_block_id, photo_block_id, sink_block_id;
-	gint               state_change_watchdog_timeout_id;
+	PhotoBoothWatchdog *watchdog;
+	gint               camera_timeout, capture_timeout, video_timeout, processing_timeout, print_timeout;
+	gint               camera_reinit;
+	frame_timing_t     frame_timing_mode;
+	PhotoBoothFrameTiming *frame_timing;
+	guint              hud_id;
 
 	guint32            countdown;
 	gint               preview_timeout;
 	gulong             preview_timeout_id;
 	gchar             *overlay_image;
+	GdkPixbuf         *overlay_pixbuf;
+	gboolean           overlay_pending;
 	gboolean           do_flip;
 	gboolean           hide_cursor;
 
 	save_t             do_save_photos;
 	gchar             *save_path_template;
 	guint              photos_taken, photos_printed;
+	gint64             processing_start;
+	gint               linx_queue_depth;
 	guint              save_filename_count;
 
-	gchar             *printer_backend;
+	gchar            **printer_backends;
 	gchar             *gutenprint_path;
 	gint               print_copies_min, print_copies_default, print_copies_max, print_copies;
-	gint               print_dpi, print_width, print_height;
+	gint               print_dpi, print_width, print_height, print_seconds;
 	gdouble            print_x_offset, print_y_offset;
 	gchar             *print_icc_profile;
 	gint               prints_remaining;
 	GstBuffer         *print_buffer;
-	GtkPrintSettings  *printer_settings;
+	PhotoBoothPrintQueue *print_queue;
+	gchar             *printer_status;
+	gchar             *print_failure;
+	guint              printer_poll_id;
+	GThread           *printer_probe_thread;
+	GPtrArray         *printer_probe_result;
+	gboolean           printer_probe_again;
 	GMutex             processing_mutex;
 	gboolean           drop_thumbnails;
 
@@ -92,6 +139,7 @@ struct _PhotoBoothPrivate
 	gboolean           cam_reeinit_before_snapshot, cam_reeinit_after_snapshot;
 	gboolean           cam_keep_files;
 	gchar             *cam_icc_profile;
+	PhotoBoothCamera  *camera;
 
 	GstElement        *audio_pipeline;
 	GstElement        *audio_playbin;
@@ -113,17 +161,18 @@ struct _PhotoBoothPrivate
 	gchar             *linx_put_uri;
 	gchar             *linx_api_key;
 	gint               linx_expiry;
+	gint               linx_chunk_size, linx_chunk_retries;
+	gint               upload_speed_busy, upload_speed_preview, upload_speed_idle;
 	GThread           *linx_upload_thread;
 	gchar             *uuid;
-	gchar             *facebook_put_uri;
-	gchar             *imgur_album_id;
-	gchar             *imgur_access_token;
-	gchar             *imgur_description;
+	PhotoBoothPublisher *publisher;
 	GThread           *publish_thread;
-	GMutex             upload_mutex;
+	GMutex             files_mutex;
+	GHashTable        *files_in_use, *files_doomed;
+	GMutex             linx_mutex;
+	GHashTable        *linx_failed;
 	gboolean           curl_cancelled;
-	gchar             *twitter_bridge_host;
-	guint              twitter_bridge_port;
+	UploadProgressChannel upload_progress;
 
 	gboolean           do_qrcode;
 	gchar             *qrcode_base_uri;
@@ -133,17 +182,21 @@ struct _PhotoBoothPrivate
 
 	PhotoBoothMasquerade *masquerade;
 	facedetect_t       enable_facedetect;
+	gint               facedetect_fps, facedetect_width, photo_facedetect_width;
+	gdouble            facedetect_scale, photo_facedetect_scale;
+	gint               photo_detect_pending;
+	gchar              *facedetect_model;
 	gboolean           do_masquerade;
 	gchar              *masks_dir;
 	gchar              *masks_json;
-	GstElement         *mask_bin;
+	gint               masks_cache_size;
+	GstElement         *photo_compositor;
 	gboolean           enable_repositioning;
 
 	PhotoBoothLed     *led;
 };
 
 #define MOVIEPIPE "moviepipe.mjpg"
-#define DEFAULT_CONFIG "default.ini"
 #define PREVIEW_FPS 19
 #define DEFAULT_COUNTDOWN 5
 #define DEFAULT_SAVE_PHOTOS SAVE_NEVER
@@ -152,23 +205,50 @@ struct _PhotoBoothPrivate
 #define DEFAULT_FLIP TRUE
 #define DEFAULT_HIDE_CURSOR TRUE
 #define DEFAULT_FACEDETECT FACEDETECT_DISABLED
+#define DEFAULT_FACEDETECT_FPS 5
+#define DEFAULT_FACEDETECT_WIDTH 320
+#define DEFAULT_PHOTO_FACEDETECT_WIDTH 640
 #define DEFAULT_ENABLE_REPOSITIONING FALSE
+#define DEFAULT_MASKS_CACHE_SIZE 8
 #define DEFAULT_GUTENPRINT_PATH  "/usr/lib/cups/backend/gutenprint53+usb"
 #define PRINT_DPI 346
 #define PRINT_WIDTH 2076
 #define PRINT_HEIGHT 1384
 #define PREVIEW_WIDTH 640
 #define PREVIEW_HEIGHT 424
-#define PT_PER_IN 72
-#define IMGUR_UPLOAD_URI "https://api.imgur.com/3/upload"
-#define DEFAULT_TWITTER_BRIDGE_HOST NULL
-#define DEFAULT_TWITTER_BRIDGE_PORT 0
 #define DEFAULT_QRCODE FALSE
 #define DEFAULT_QRCODE_X -1
 #define DEFAULT_QRCODE_Y -1
 #define DEFAULT_QRCODE_SCALE 4.0
 #define DEFAULT_QRCODE_BASE_URI NULL
 #define DEFAULT_LINX_UPLOAD UPLOAD_NEVER
+#define DEFAULT_LINX_CHUNK_SIZE 0
+#define DEFAULT_LINX_CHUNK_RETRIES 5
+#define DEFAULT_UPLOAD_SPEED_BUSY 32
+#define DEFAULT_UPLOAD_SPEED_PREVIEW 0
+#define DEFAULT_UPLOAD_SPEED_IDLE 0
+#define LINX_RESUME_SUFFIX ".upload"
+#define LINX_RESUME_BACKOFF 60
+#define LINX_RESUME_BACKOFF_MAX 1800
+#define UPLOAD_PROGRESS_INTERVAL (50 * G_TIME_SPAN_MILLISECOND)
+#define DEFAULT_CAMERA_TIMEOUT 5
+#define DEFAULT_CAPTURE_TIMEOUT 20
+#define DEFAULT_VIDEO_TIMEOUT 5
+#define DEFAULT_PROCESSING_TIMEOUT 30
+#define DEFAULT_PRINT_TIMEOUT 120
+#define PRINTER_POLL_INTERVAL 30
+#define WATCHDOG_INTERVAL 500
+#define DEFAULT_FRAME_TIMING FRAME_TIMING_OFF
+#define DEFAULT_MEMORY_LOG_INTERVAL 60
+#define HUD_INTERVAL 500
+
+/* the watchdog's stages, added in this order */
+typedef enum
+{
+	WATCHDOG_CAMERA = 0,
+	WATCHDOG_VIDEO,
+	WATCHDOG_PHOTO
+} watchdog_stage_t;
 
 gchar *G_template_filename;
 gchar *G_stylesheet_filename;
@@ -193,10 +273,10 @@ void photo_booth_cancel (PhotoBooth *pb);
 /* general private functions */
 const gchar* photo_booth_state_get_name (PhotoboothState state);
 static void photo_booth_change_state (PhotoBooth *pb, PhotoboothState state);
-static gboolean photo_booth_quit_signal (gpointer);
 static void photo_booth_window_destroyed_signal (PhotoBoothWindow *win, PhotoBooth *pb);
 static void photo_booth_setup_window (PhotoBooth *pb);
 static gboolean photo_booth_video_widget_ready (PhotoBooth *pb);
+static void photo_booth_show_overlay (PhotoBooth *pb);
 static gboolean photo_booth_preview (PhotoBooth *pb);
 static gboolean photo_booth_preview_ready (PhotoBooth *pb);
 static void photo_booth_snapshot_start (PhotoBooth *pb);
@@ -205,13 +285,14 @@ static gboolean photo_booth_snapshot_trigger (PhotoBooth *pb);
 static gboolean photo_booth_snapshot_taken (PhotoBooth *pb);
 static gboolean photo_booth_screensaver (PhotoBooth *pb);
 static gboolean photo_booth_screensaver_stop (PhotoBooth *pb);
-static gboolean photo_booth_watchdog_timedout (PhotoBooth *pb);
+static void photo_booth_setup_watchdog (PhotoBooth *pb);
+static gboolean photo_booth_video_drawn (GtkWidget *widget, cairo_t *cr, PhotoBooth *pb);
+static gboolean photo_booth_update_hud (PhotoBooth *pb);
 static gboolean photo_booth_capture_paused_cb (PhotoBooth *pb);
 
 /* libgphoto2 */
-static gboolean photo_booth_cam_init (CameraInfo **cam_info);
+static gboolean photo_booth_cam_init (CameraInfo **cam_info, PhotoBoothCamera *camera);
 static gboolean photo_booth_cam_close (CameraInfo **cam_info);
-static gboolean photo_booth_focus (CameraInfo *cam_info);
 static gboolean photo_booth_take_photo (PhotoBooth *pb);
 static void photo_booth_flush_pipe (int fd);
 static gpointer photo_booth_capture_thread_func (gpointer user_data);
@@ -219,33 +300,46 @@ static void _gphoto_err(GPLogLevel level, const char *domain, const char *str, v
 
 /* gstreamer functions */
 static GstElement *build_video_bin (PhotoBooth *pb);
-static GstElement *build_photo_bin (PhotoBooth *pb);
+GstElement *photo_booth_build_photo_bin (PhotoBooth *pb);
 static gboolean photo_booth_setup_gstreamer (PhotoBooth *pb);
 static gboolean photo_booth_bus_callback (GstBus *bus, GstMessage *message, PhotoBooth *pb);
+static GstBusSyncReply photo_booth_bus_sync_handler (GstBus *bus, GstMessage *message, PhotoBooth *pb);
+static void photo_booth_video_overlay_draw (GstElement *overlay, cairo_t *cr, guint64 timestamp, guint64 duration, PhotoBooth *pb);
 static GstPadProbeReturn photo_booth_drop_thumbnails (GstPad * pad, GstPadProbeInfo * info, gpointer user_data);
 static GstPadProbeReturn photo_booth_catch_photo_buffer (GstPad * pad, GstPadProbeInfo * info, gpointer user_data);
 static gboolean photo_booth_process_photo_plug_elements (PhotoBooth *pb);
-static gboolean photo_booth_push_photo_buffer (gpointer user_data);
+gboolean photo_booth_push_photo_buffer (gpointer user_data);
 static GstFlowReturn photo_booth_catch_print_buffer (GstElement * appsink, gpointer user_data);
 static gboolean photo_booth_process_photo_remove_elements (PhotoBooth *pb);
+void photo_booth_photo_bin_plug_outputs (PhotoBooth *pb);
+void photo_booth_photo_bin_unplug_outputs (PhotoBooth *pb);
 static GstPadProbeReturn photo_booth_screensaver_unplug_continue (GstPad * pad, GstPadProbeInfo * info, gpointer user_data);
 static gboolean photo_booth_preview_timedout (PhotoBooth *pb);
 
 /* printing functions */
 static gboolean photo_booth_get_printer_status (PhotoBooth *pb);
+static GPtrArray *photo_booth_probe_printers (PhotoBooth *pb);
+static void photo_booth_printer_status_apply (GPtrArray *statuses, PhotoBooth *pb);
 void photo_booth_button_print_clicked (GtkButton *button, PhotoBoothWindow *win);
 static gboolean photo_booth_print (gpointer user_data);
-static void photo_booth_begin_print (GtkPrintOperation *operation, GtkPrintContext *context, gpointer user_data);
-static void photo_booth_draw_page (GtkPrintOperation *operation, GtkPrintContext *context, int page_nr, gpointer user_data);
-static void photo_booth_print_done (GtkPrintOperation *operation, GtkPrintOperationResult result, gpointer user_data);
-static void photo_booth_printing_error_dialog (PhotoBoothWindow *window, GError *print_error);
+static void photo_booth_show_printer_status (PhotoBooth *pb);
+static void photo_booth_print_job_done (PhotoBoothPrintQueue *queue, PhotoBoothPrintJob *job, PhotoBooth *pb);
 
 /* upload functions */
 void photo_booth_button_upload_clicked (GtkButton *button, PhotoBoothWindow *win);
 void photo_booth_button_publish_clicked (GtkButton *button, PhotoBoothWindow *win);
 static gpointer photo_booth_public_post_thread_func (gpointer user_data);
+static void photo_booth_setup_publish_targets (PhotoBooth *pb, GKeyFile *gkf);
+static void photo_booth_publish_progress (gint64 total, gint64 current, PhotoBooth *pb);
+static curl_off_t photo_booth_upload_speed_limit (PhotoBooth *pb);
+static void photo_booth_spawn_worker (PhotoBooth *pb, GThread **thread, const gchar *name, GThreadFunc func);
 static gpointer photo_booth_linx_post_thread_func (gpointer user_data);
+static gboolean photo_booth_linx_upload_single (PhotoBooth *pb, const gchar *filename, const gchar *put_uri);
+static gboolean photo_booth_linx_upload_chunked (PhotoBooth *pb, const gchar *filename, const gchar *put_uri);
+static void photo_booth_linx_resume_pending (PhotoBooth *pb);
 static gboolean photo_booth_publish_timedout (PhotoBooth *pb);
+static void photo_booth_upload_progress_post (PhotoBooth *pb, gint64 total, gint64 current, gdouble rate, gint eta);
+static gboolean photo_booth_upload_progress_dispatch (PhotoBooth *pb);
 
 static void photo_booth_class_init (PhotoBoothClass *klass)
 {
@@ -315,15 +409,26 @@ static void photo_booth_init (PhotoBooth *pb)
 	priv->print_dpi = PRINT_DPI;
 	priv->print_width = PRINT_WIDTH;
 	priv->print_height = PRINT_HEIGHT;
+	priv->print_seconds = 0;
 	priv->print_x_offset = priv->print_y_offset = 0;
 	priv->print_buffer = NULL;
 	priv->print_icc_profile = NULL;
 	priv->cam_icc_profile = NULL;
 	priv->cam_keep_files = FALSE;
-	priv->printer_backend = NULL;
-	priv->gutenprint_path = DEFAULT_GUTENPRINT_PATH;
-	priv->printer_settings = NULL;
+	priv->camera = NULL;
+	priv->printer_backends = NULL;
+	priv->gutenprint_path = g_strdup (DEFAULT_GUTENPRINT_PATH);
+	priv->print_queue = photo_booth_print_queue_new ();
+	photo_booth_print_queue_set_callbacks (priv->print_queue, NULL, (PhotoBoothPrintJobFunc) photo_booth_print_job_done, pb);
+	priv->printer_status = NULL;
+	priv->print_failure = NULL;
+	priv->printer_poll_id = 0;
+	priv->printer_probe_thread = NULL;
+	priv->printer_probe_result = NULL;
+	priv->printer_probe_again = FALSE;
 	priv->overlay_image = NULL;
+	priv->overlay_pixbuf = NULL;
+	priv->overlay_pending = FALSE;
 	priv->countdown_audio_uri = NULL;
 	priv->ack_sound = NULL;
 	priv->error_sound = NULL;
@@ -334,31 +439,52 @@ static void photo_booth_init (PhotoBooth *pb)
 	priv->last_play_pos = GST_CLOCK_TIME_NONE;
 	priv->save_path_template = g_strdup (DEFAULT_SAVE_PATH_TEMPLATE);
 	priv->photos_taken = priv->photos_printed = 0;
+	priv->processing_start = 0;
+	priv->linx_queue_depth = 0;
 	priv->save_filename_count = 0;
 	priv->upload_timeout = 0;
 	priv->do_linx_upload = DEFAULT_LINX_UPLOAD;
 	priv->linx_put_uri = NULL;
 	priv->linx_api_key = NULL;
 	priv->linx_expiry = 60;
+	priv->linx_chunk_size = DEFAULT_LINX_CHUNK_SIZE;
+	priv->linx_chunk_retries = DEFAULT_LINX_CHUNK_RETRIES;
+	priv->upload_speed_busy = DEFAULT_UPLOAD_SPEED_BUSY;
+	priv->upload_speed_preview = DEFAULT_UPLOAD_SPEED_PREVIEW;
+	priv->upload_speed_idle = DEFAULT_UPLOAD_SPEED_IDLE;
 	priv->linx_upload_thread = NULL;
-	priv->facebook_put_uri = NULL;
-	priv->imgur_album_id = NULL;
-	priv->imgur_access_token = NULL;
-	priv->imgur_description = NULL;
+	priv->publisher = photo_booth_publisher_new ();
+	photo_booth_publisher_set_progress_func (priv->publisher, (PhotoBoothPublishProgressFunc) photo_booth_publish_progress, pb);
+	photo_booth_publisher_set_limit_func (priv->publisher, (PhotoBoothUploadLimitFunc) photo_booth_upload_speed_limit, pb);
 	priv->publish_thread = NULL;
-	priv->twitter_bridge_host = g_strdup (DEFAULT_TWITTER_BRIDGE_HOST);
-	priv->twitter_bridge_port = DEFAULT_TWITTER_BRIDGE_PORT;
 	priv->do_qrcode = DEFAULT_QRCODE;
 	priv->qrcode_x_offset = DEFAULT_QRCODE_X;
 	priv->qrcode_y_offset = DEFAULT_QRCODE_Y;
 	priv->qrcode_scale = DEFAULT_QRCODE_SCALE;
 	priv->qrcode_base_uri = DEFAULT_QRCODE_BASE_URI;
-	priv->state_change_watchdog_timeout_id = 0;
+	priv->watchdog = NULL;
+	priv->camera_timeout = DEFAULT_CAMERA_TIMEOUT;
+	priv->capture_timeout = DEFAULT_CAPTURE_TIMEOUT;
+	priv->video_timeout = DEFAULT_VIDEO_TIMEOUT;
+	priv->processing_timeout = DEFAULT_PROCESSING_TIMEOUT;
+	priv->print_timeout = DEFAULT_PRINT_TIMEOUT;
+	priv->camera_reinit = FALSE;
+	priv->frame_timing_mode = DEFAULT_FRAME_TIMING;
+	priv->frame_timing = NULL;
+	priv->hud_id = 0;
 	priv->enable_facedetect = DEFAULT_FACEDETECT;
+	priv->facedetect_fps = DEFAULT_FACEDETECT_FPS;
+	priv->facedetect_width = DEFAULT_FACEDETECT_WIDTH;
+	priv->facedetect_scale = 1.0;
+	priv->photo_facedetect_width = DEFAULT_PHOTO_FACEDETECT_WIDTH;
+	priv->photo_facedetect_scale = 1.0;
+	priv->photo_detect_pending = FALSE;
+	priv->facedetect_model = NULL;
 	priv->do_masquerade = FALSE;
 	priv->masquerade = NULL;
 	priv->masks_dir = NULL;
 	priv->masks_json = NULL;
+	priv->masks_cache_size = DEFAULT_MASKS_CACHE_SIZE;
 	priv->enable_repositioning = DEFAULT_ENABLE_REPOSITIONING;
 	priv->led = photo_booth_led_new ();
 
@@ -367,7 +493,14 @@ static void photo_booth_init (PhotoBooth *pb)
 
 	G_strings_table = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, g_free);
 	g_mutex_init (&priv->processing_mutex);
-	g_mutex_init (&priv->upload_mutex);
+	g_mutex_init (&priv->files_mutex);
+	priv->files_in_use = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, NULL);
+	priv->files_doomed = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, NULL);
+	g_mutex_init (&priv->linx_mutex);
+	priv->linx_failed = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, g_free);
+	g_mutex_init (&priv->upload_progress.lock);
+	priv->upload_progress.idle_id = 0;
+	priv->upload_progress.last_rate = 0.0;
 }
 
 static void photo_booth_change_state (PhotoBooth *pb, PhotoboothState newstate)
@@ -378,25 +511,131 @@ static void photo_booth_change_state (PhotoBooth *pb, PhotoboothState newstate)
 	gchar *dot_filename = g_strdup_printf ("state_change_%s_to_%s", photo_booth_state_get_name (priv->state), photo_booth_state_get_name (newstate));
 	GST_DEBUG_BIN_TO_DOT_FILE_WITH_TS (GST_BIN (pb->pipeline), GST_DEBUG_GRAPH_SHOW_ALL, dot_filename);
 	g_free (dot_filename);
-	priv->state = newstate;
-	if (priv->state_change_watchdog_timeout_id)
+	photo_booth_trace_state (photo_booth_trace_get_default (), photo_booth_state_get_name (newstate));
+	if (priv->watchdog)
+	{
+		// frames are only expected out of the video-bin while the live view is on screen
+		gboolean was_live = priv->state == PB_STATE_PREVIEW || priv->state == PB_STATE_COUNTDOWN;
+		gboolean is_live = newstate == PB_STATE_PREVIEW || newstate == PB_STATE_COUNTDOWN;
+		if (is_live && !was_live)
+			photo_booth_watchdog_arm (priv->watchdog, WATCHDOG_VIDEO, "video-bin");
+		else if (!is_live)
+			photo_booth_watchdog_disarm (priv->watchdog, WATCHDOG_VIDEO);
+	}
+	g_atomic_int_set ((gint *) &priv->state, newstate);
+}
+
+/* the plugins' shared objects (and whatever they link, opencv, lcms, gtk's gl...) are loaded
+ * while the window is built, instead of one by one when the bins are */
+static const gchar *preload_factories[] = {
+	"fdsrc", "jpegparse", "jpegdec", "videoscale", "videoconvert", "videoflip", "videorate", "capsfilter",
+	"tee", "queue", "gtksink", "cairooverlay", "jpegenc", "filesink", "appsrc", "appsink", "lcms", "qroverlay",
+	"gamma", "playbin", NULL
+};
+
+static void _preload_factory (const gchar *name)
+{
+	GstElementFactory *factory = gst_element_factory_find (name);
+	GstPluginFeature *loaded;
+	if (!factory)
 	{
-		GST_LOG ("removed watchdog timeout");
-		g_source_remove (priv->state_change_watchdog_timeout_id);
-		priv->state_change_watchdog_timeout_id = 0;
+		GST_DEBUG ("no %s element to preload", name);
+		return;
+	}
+	loaded = gst_plugin_feature_load (GST_PLUGIN_FEATURE (factory));
+	if (loaded)
+		gst_object_unref (loaded);
+	gst_object_unref (factory);
+}
+
+static gpointer photo_booth_preload_plugins (PhotoBooth *pb)
+{
+	PhotoBoothPrivate *priv = photo_booth_get_instance_private (pb);
+	guint i;
+	for (i = 0; preload_factories[i]; i++)
+		_preload_factory (preload_factories[i]);
+	// the opencv one, which takes longest by far
+	if (priv->enable_facedetect >= FACEDETECT_ENABLEABLE && !priv->facedetect_model)
+		_preload_factory ("facedetect");
+	return NULL;
+}
+
+static void photo_booth_decoded_overlay_free (PhotoBoothDecodedOverlay *overlay)
+{
+	g_object_unref (overlay->screen);
+	g_object_unref (overlay->print);
+	g_free (overlay);
+}
+
+/* decoded once for both the live view and the print */
+static gpointer photo_booth_decode_overlay (PhotoBooth *pb)
+{
+	PhotoBoothPrivate *priv = photo_booth_get_instance_private (pb);
+	PhotoBoothDecodedOverlay *overlay;
+	GError *error = NULL;
+	GdkPixbuf *pixbuf = gdk_pixbuf_new_from_file (priv->overlay_image, &error);
+	if (error) {
+		GST_ERROR ("couldn't load overlay image '%s': %s", priv->overlay_image, error->message);
+		g_error_free (error);
+		return NULL;
 	}
+	overlay = g_new (PhotoBoothDecodedOverlay, 1);
+	overlay->screen = pixbuf;
+	overlay->print = gdk_pixbuf_scale_simple (pixbuf, priv->print_width, priv->print_height, GDK_INTERP_BILINEAR);
+	return overlay;
+}
+
+static void photo_booth_overlay_decoded (PhotoBoothDecodedOverlay *overlay, PhotoBooth *pb)
+{
+	PhotoBoothPrivate *priv = photo_booth_get_instance_private (pb);
+	priv->overlay_pending = FALSE;
+	if (!overlay)
+		return;
+	if (priv->photo_compositor)
+		photo_booth_compositor_set_frame (PHOTO_BOOTH_COMPOSITOR (priv->photo_compositor), overlay->print);
+	priv->overlay_pixbuf = g_object_ref (overlay->screen);
+	photo_booth_decoded_overlay_free (overlay);
+	photo_booth_show_overlay (pb);
 }
 
+/* the window is shown right away and fills in as the steps running alongside are done:
+ * the live view once the camera is up, the printer status, the overlay and the masks */
 static void photo_booth_setup_window (PhotoBooth *pb)
 {
 	PhotoBoothPrivate *priv;
+	PhotoBoothStartup *startup = photo_booth_startup_get_default ();
 	priv = photo_booth_get_instance_private (pb);
+	photo_booth_startup_run (startup, "plugins", (GThreadFunc) photo_booth_preload_plugins, NULL, NULL, pb);
+	if (priv->overlay_image)
+	{
+		priv->overlay_pending = TRUE;
+		photo_booth_startup_run (startup, "overlay", (GThreadFunc) photo_booth_decode_overlay,
+			(PhotoBoothStartupDoneFunc) photo_booth_overlay_decoded, (GDestroyNotify) photo_booth_decoded_overlay_free, pb);
+	}
+	photo_booth_startup_begin (startup, "window");
 	priv->win = photo_booth_window_new (pb);
 	gtk_window_present (GTK_WINDOW (priv->win));
 	g_signal_connect (G_OBJECT (priv->win), "destroy", G_CALLBACK (photo_booth_window_destroyed_signal), pb);
+	photo_booth_print_queue_set_parent (priv->print_queue, GTK_WINDOW (priv->win));
+	photo_booth_print_queue_set_timeout (priv->print_queue, priv->print_timeout);
+	photo_booth_startup_end (startup, "window");
+	if (!priv->camera)
+		priv->camera = photo_booth_camera_gphoto_new (priv->cam_keep_files);
+	photo_booth_setup_watchdog (pb);
+	if (priv->frame_timing_mode > FRAME_TIMING_OFF)
+		priv->frame_timing = photo_booth_frame_timing_new ();
 	priv->capture_thread = g_thread_try_new ("gphoto-capture", (GThreadFunc) photo_booth_capture_thread_func, pb, NULL);
+	photo_booth_startup_begin (startup, "gstreamer");
 	photo_booth_setup_gstreamer (pb);
-	photo_booth_get_printer_status (pb);
+	photo_booth_startup_end (startup, "gstreamer");
+	if (priv->printer_backends)
+	{
+		gtk_label_set_text (priv->win->status_printer, _("Checking printer..."));
+		photo_booth_startup_run (startup, "printer", (GThreadFunc) photo_booth_probe_printers,
+			(PhotoBoothStartupDoneFunc) photo_booth_printer_status_apply, (GDestroyNotify) g_ptr_array_unref, pb);
+	}
+	else
+		photo_booth_get_printer_status (pb);
 	gtk_toggle_button_set_active (priv->win->toggle_flip, priv->do_flip);
 }
 
@@ -420,9 +659,17 @@ static void photo_booth_finalize (GObject *object)
 	GST_INFO_OBJECT (pb, "finalize");
 	SEND_COMMAND (pb, CONTROL_QUIT);
 	photo_booth_flush_pipe (pb->video_fd);
-	g_thread_join (priv->capture_thread);
+	if (priv->watchdog)
+		photo_booth_watchdog_stop (priv->watchdog);
+	// a hanging camera call would keep the capture thread from ever seeing the quit
+	if (priv->camera)
+		photo_booth_camera_cancel (priv->camera);
+	if (priv->capture_thread)
+		g_thread_join (priv->capture_thread);
 	if (pb->cam_info)
 		photo_booth_cam_close (&pb->cam_info);
+	if (priv->camera)
+		g_object_unref (priv->camera);
 	if (pb->video_fd)
 	{
 		close (pb->video_fd);
@@ -432,6 +679,9 @@ static void photo_booth_finalize (GObject *object)
 		g_thread_join (priv->publish_thread);
 	if (priv->linx_upload_thread)
 		g_thread_join (priv->linx_upload_thread);
+	photo_booth_trace_end_session (photo_booth_trace_get_default ());
+	photo_booth_metrics_stop (photo_booth_metrics_get_default ());
+	photo_booth_memory_stop (photo_booth_memory_get_default ());
 	if (priv->audio_pipeline) {
 		gst_element_set_state (priv->audio_pipeline, GST_STATE_NULL);
 		gst_object_unref (priv->audio_pipeline);
@@ -440,6 +690,12 @@ static void photo_booth_finalize (GObject *object)
 		gst_element_set_state (pb->pipeline, GST_STATE_NULL);
 		gst_object_unref (pb->pipeline);
 	}
+	if (priv->watchdog)
+		g_object_unref (priv->watchdog);
+	if (priv->hud_id)
+		g_source_remove (priv->hud_id);
+	if (priv->frame_timing)
+		g_object_unref (priv->frame_timing);
 	g_object_unref (priv->led);
 }
 
@@ -447,10 +703,30 @@ static void photo_booth_dispose (GObject *object)
 {
 	PhotoBoothPrivate *priv;
 	priv = photo_booth_get_instance_private (PHOTO_BOOTH (object));
-	g_free (priv->printer_backend);
+	// the startup steps still running in their threads use the settings
+	photo_booth_startup_cancel (photo_booth_startup_get_default ());
+	if (priv->printer_poll_id)
+		g_source_remove (priv->printer_poll_id);
+	// the probe reads the backends and the gutenprint path, its result is thrown away
+	if (priv->printer_probe_thread)
+	{
+		g_thread_join (priv->printer_probe_thread);
+		priv->printer_probe_thread = NULL;
+	}
+	if (priv->printer_probe_result)
+		g_ptr_array_unref (priv->printer_probe_result);
+	priv->printer_probe_result = NULL;
+	g_strfreev (priv->printer_backends);
 	g_free (priv->gutenprint_path);
-	if (priv->printer_settings != NULL)
-		g_object_unref (priv->printer_settings);
+	g_clear_object (&priv->print_queue);
+	g_free (priv->printer_status);
+	g_free (priv->print_failure);
+	if (priv->print_buffer)
+	{
+		photo_booth_memory_untrack (photo_booth_memory_get_default (), priv->print_buffer);
+		gst_buffer_unref (priv->print_buffer);
+		priv->print_buffer = NULL;
+	}
 	g_free (priv->countdown_audio_uri);
 	g_free (priv->ack_sound);
 	g_free (priv->error_sound);
@@ -458,14 +734,14 @@ static void photo_booth_dispose (GObject *object)
 	g_free (priv->print_icc_profile);
 	g_free (priv->cam_icc_profile);
 	g_free (priv->overlay_image);
+	g_clear_object (&priv->overlay_pixbuf);
+	g_free (priv->facedetect_model);
 	g_free (priv->save_path_template);
 	g_free (priv->linx_put_uri);
 	g_free (priv->linx_api_key);
-	g_free (priv->facebook_put_uri);
-	g_free (priv->imgur_album_id);
-	g_free (priv->imgur_access_token);
-	g_free (priv->imgur_description);
-	g_free (priv->twitter_bridge_host);
+	if (priv->publisher)
+		g_object_unref (priv->publisher);
+	priv->publisher = NULL;
 	g_free (priv->qrcode_base_uri);
 	g_free (priv->masks_dir);
 	g_free (priv->masks_json);
@@ -474,7 +750,14 @@ static void photo_booth_dispose (GObject *object)
 	g_hash_table_destroy (G_strings_table);
 	G_strings_table = NULL;
 	g_mutex_clear (&priv->processing_mutex);
-	g_mutex_clear (&priv->upload_mutex);
+	g_mutex_clear (&priv->files_mutex);
+	g_hash_table_destroy (priv->files_in_use);
+	g_hash_table_destroy (priv->files_doomed);
+	g_mutex_clear (&priv->linx_mutex);
+	g_hash_table_destroy (priv->linx_failed);
+	if (priv->upload_progress.idle_id)
+		g_source_remove (priv->upload_progress.idle_id);
+	g_mutex_clear (&priv->upload_progress.lock);
 	G_OBJECT_CLASS (photo_booth_parent_class)->dispose (object);
 	g_free (G_stylesheet_filename);
 	g_free (G_template_filename);
@@ -524,6 +807,110 @@ static void photo_booth_dispose (GObject *object)
   }                                                                                    \
 }
 
+static void photo_booth_setup_publish_targets (PhotoBooth *pb, GKeyFile *gkf)
+{
+	PhotoBoothPrivate *priv;
+	gchar *imgur_upload_uri = NULL, *imgur_album_id = NULL, *imgur_access_token = NULL, *imgur_description = NULL;
+	gchar *facebook_put_uri = NULL, *twitter_bridge_host = NULL;
+	gint twitter_bridge_port = 0;
+	gboolean publish_all = FALSE, to_imgur;
+	gchar **webhook_uris;
+	guint i;
+
+	priv = photo_booth_get_instance_private (pb);
+	READ_STR_INI_KEY (facebook_put_uri, gkf, "upload", "facebook_put_uri");
+	READ_STR_INI_KEY (imgur_upload_uri, gkf, "upload", "imgur_upload_uri");
+	READ_STR_INI_KEY (imgur_album_id, gkf, "upload", "imgur_album_id");
+	READ_STR_INI_KEY (imgur_access_token, gkf, "upload", "imgur_access_token");
+	READ_STR_INI_KEY (imgur_description, gkf, "upload", "imgur_description");
+	READ_STR_INI_KEY (twitter_bridge_host, gkf, "upload", "twitter_bridge_host");
+	READ_INT_INI_KEY (twitter_bridge_port, gkf, "upload", "twitter_bridge_port");
+	READ_BOOL_INI_KEY (publish_all, gkf, "upload", "publish_all");
+
+	// imgur used to win over facebook, both only get the photo when asked for
+	to_imgur = imgur_album_id && imgur_access_token;
+	if (to_imgur)
+		photo_booth_publisher_add_target (priv->publisher, photo_booth_publish_target_imgur_new (imgur_upload_uri, imgur_access_token, imgur_album_id, imgur_description));
+	if (facebook_put_uri && *facebook_put_uri)
+	{
+		if (!to_imgur || publish_all)
+			photo_booth_publisher_add_target (priv->publisher, photo_booth_publish_target_facebook_new (facebook_put_uri));
+		else
+			GST_INFO ("publishing to imgur only, set publish_all to also post to facebook_put_uri");
+	}
+	webhook_uris = g_key_file_get_string_list (gkf, "upload", "webhook_uri", NULL, NULL);
+	for (i = 0; webhook_uris && webhook_uris[i]; i++)
+	{
+		g_strstrip (webhook_uris[i]);
+		if (*webhook_uris[i])
+			photo_booth_publisher_add_target (priv->publisher, photo_booth_publish_target_webhook_new (webhook_uris[i]));
+	}
+	// the twitter bridge now takes the photo itself over http on the same port
+	if (twitter_bridge_host && *twitter_bridge_host && twitter_bridge_port > 0)
+	{
+		gchar *bridge_uri = g_strdup_printf ("http://%s:%i/", twitter_bridge_host, twitter_bridge_port);
+		GST_INFO ("twitter_bridge_host is deprecated, publishing to the bridge as webhook %s", bridge_uri);
+		photo_booth_publisher_add_target (priv->publisher, photo_booth_publish_target_webhook_new (bridge_uri));
+		g_free (bridge_uri);
+	}
+	else if (twitter_bridge_host && *twitter_bridge_host)
+		GST_WARNING ("twitter_bridge_host is set without a twitter_bridge_port, not publishing to the twitter bridge");
+
+	g_strfreev (webhook_uris);
+	g_free (twitter_bridge_host);
+	g_free (imgur_upload_uri);
+	g_free (imgur_album_id);
+	g_free (imgur_access_token);
+	g_free (imgur_description);
+	g_free (facebook_put_uri);
+}
+
+/* backend = a;b;c makes a pool of printers, cups_printer lists their cups printers in the same order */
+static void photo_booth_setup_printers (PhotoBooth *pb, GKeyFile *gkf)
+{
+	PhotoBoothPrivate *priv;
+	gchar **backends, **cups_printers;
+	GPtrArray *names;
+	guint i, n_cups;
+
+	priv = photo_booth_get_instance_private (pb);
+	backends = g_key_file_get_string_list (gkf, "printer", "backend", NULL, NULL);
+	cups_printers = g_key_file_get_string_list (gkf, "printer", "cups_printer", NULL, NULL);
+	n_cups = cups_printers ? g_strv_length (cups_printers) : 0;
+	names = g_ptr_array_new ();
+	for (i = 0; backends && backends[i]; i++)
+	{
+		const gchar *cups_printer = names->len < n_cups ? g_strstrip (cups_printers[names->len]) : NULL;
+		g_strstrip (backends[i]);
+		if (!*backends[i])
+			continue;
+		photo_booth_print_queue_add_printer (priv->print_queue, backends[i], cups_printer, priv->print_seconds);
+		g_ptr_array_add (names, g_strdup (backends[i]));
+	}
+	// they would all print to the printer of [print_settings] or bring up the dialog one after the other
+	if (names->len > 1 && n_cups < names->len)
+		GST_WARNING ("%u printers but only %u cups_printer, the rest print to the printer of [print_settings] or ask in the print dialog", names->len, n_cups);
+	g_strfreev (priv->printer_backends);
+	priv->printer_backends = NULL;
+	if (names->len)
+	{
+		g_ptr_array_add (names, NULL);
+		priv->printer_backends = (gchar **) g_ptr_array_free (names, FALSE);
+	}
+	else
+		g_ptr_array_free (names, TRUE);
+	g_strfreev (backends);
+	g_strfreev (cups_printers);
+}
+
+static gint _match_int (GMatchInfo *match_info, const gchar *name)
+{
+	gchar *str = g_match_info_fetch_named (match_info, name);
+	gint value = str ? atoi (str) : -1;
+	g_free (str);
+	return value;
+}
+
 void photo_booth_load_settings (PhotoBooth *pb, const gchar *filename)
 {
 	GKeyFile* gkf;
@@ -562,7 +949,9 @@ void photo_booth_load_settings (PhotoBooth *pb, const gchar *filename)
 		}
 		if (g_key_file_has_group (gkf, "general"))
 		{
-			gchar *screensaverfile = NULL, *save_path_template = NULL;
+			gchar *screensaverfile = NULL, *save_path_template = NULL, *trace_file = NULL, *metrics_socket = NULL, *memory_log = NULL, *startup_trace = NULL;
+			gint metrics_port = 0, memory_log_interval = DEFAULT_MEMORY_LOG_INTERVAL;
+			gboolean serve_metrics;
 			READ_STR_INI_KEY (G_template_filename, gkf, "general", "template");
 			READ_STR_INI_KEY (G_stylesheet_filename, gkf, "general", "stylesheet");
 			READ_INT_INI_KEY (priv->countdown, gkf, "general", "countdown");
@@ -571,7 +960,45 @@ void photo_booth_load_settings (PhotoBooth *pb, const gchar *filename)
 			READ_INT_INI_KEY (priv->screensaver_timeout, gkf, "general", "screensaver_timeout");
 			READ_STR_INI_KEY (screensaverfile, gkf, "general", "screensaver_file");
 			READ_INT_INI_KEY (priv->enable_facedetect, gkf, "general", "facedetection");
+			READ_INT_INI_KEY (priv->facedetect_fps, gkf, "general", "facedetect_fps");
+			READ_INT_INI_KEY (priv->facedetect_width, gkf, "general", "facedetect_width");
+			READ_INT_INI_KEY (priv->photo_facedetect_width, gkf, "general", "photo_facedetect_width");
+			READ_STR_INI_KEY (priv->facedetect_model, gkf, "general", "facedetect_model");
 			READ_BOOL_INI_KEY (priv->hide_cursor, gkf, "general", "hide_cursor");
+			READ_STR_INI_KEY (trace_file, gkf, "general", "trace_file");
+			READ_INT_INI_KEY (metrics_port, gkf, "general", "metrics_port");
+			READ_STR_INI_KEY (metrics_socket, gkf, "general", "metrics_socket");
+			READ_INT_INI_KEY (priv->frame_timing_mode, gkf, "general", "frame_timing");
+			READ_STR_INI_KEY (memory_log, gkf, "general", "memory_log");
+			READ_INT_INI_KEY (memory_log_interval, gkf, "general", "memory_log_interval");
+			READ_STR_INI_KEY (startup_trace, gkf, "general", "startup_trace");
+			if (trace_file)
+			{
+				photo_booth_trace_set_location (photo_booth_trace_get_default (), trace_file);
+				g_free (trace_file);
+			}
+			if (startup_trace)
+			{
+				photo_booth_startup_set_location (photo_booth_startup_get_default (), startup_trace);
+				g_free (startup_trace);
+			}
+			serve_metrics = metrics_port > 0 || metrics_socket;
+			if (serve_metrics)
+			{
+				GError *metrics_error = NULL;
+				if (!photo_booth_metrics_serve (photo_booth_metrics_get_default (), CLAMP (metrics_port, 0, G_MAXUINT16), metrics_socket, &metrics_error))
+				{
+					GST_WARNING ("can't serve metrics: %s", metrics_error->message);
+					g_error_free (metrics_error);
+				}
+				g_free (metrics_socket);
+			}
+			// the memory gauges are only current while snapshots are taken
+			if (memory_log || serve_metrics)
+			{
+				photo_booth_memory_start (photo_booth_memory_get_default (), memory_log, MAX (memory_log_interval, 1));
+				g_free (memory_log);
+			}
 
 			if (screensaverfile)
 			{
@@ -631,7 +1058,6 @@ void photo_booth_load_settings (PhotoBooth *pb, const gchar *filename)
 		}
 		if (g_key_file_has_group (gkf, "printer"))
 		{
-			READ_STR_INI_KEY (priv->printer_backend, gkf, "printer", "backend");
 			READ_STR_INI_KEY (priv->gutenprint_path, gkf, "printer", "gutenprint_path");
 			READ_INT_INI_KEY (priv->print_copies_min, gkf, "printer", "copies_min");
 			READ_INT_INI_KEY (priv->print_copies_max, gkf, "printer", "copies_max");
@@ -642,7 +1068,27 @@ void photo_booth_load_settings (PhotoBooth *pb, const gchar *filename)
 			READ_STR_INI_KEY (priv->print_icc_profile, gkf, "printer", "icc_profile");
 			READ_DBL_INI_KEY (priv->print_x_offset, gkf, "printer", "offset_x");
 			READ_DBL_INI_KEY (priv->print_y_offset, gkf, "printer", "offset_y");
+			READ_INT_INI_KEY (priv->print_seconds, gkf, "printer", "seconds_per_print");
+			photo_booth_setup_printers (pb, gkf);
+		}
+		photo_booth_print_queue_set_layout (priv->print_queue, priv->print_width, priv->print_height, priv->print_dpi, priv->print_x_offset, priv->print_y_offset);
+		if (g_key_file_has_group (gkf, "print_settings"))
+		{
+			// preset GtkPrintSettings skip the print dialog at the first print
+			GError *print_error = NULL;
+			GtkPrintSettings *print_settings = gtk_print_settings_new_from_key_file (gkf, "print_settings", &print_error);
+			if (print_settings)
+			{
+				photo_booth_print_queue_set_settings (priv->print_queue, print_settings);
+				g_object_unref (print_settings);
+			}
+			else
+			{
+				GST_WARNING ("can't read [print_settings]: %s", print_error->message);
+				g_error_free (print_error);
+			}
 		}
+		gchar *camera_backend = NULL;
 		if (g_key_file_has_group (gkf, "camera"))
 		{
 			READ_INT_INI_KEY (priv->preview_fps, gkf, "camera", "preview_fps")
@@ -651,6 +1097,46 @@ void photo_booth_load_settings (PhotoBooth *pb, const gchar *filename)
 			READ_BOOL_INI_KEY (priv->cam_reeinit_before_snapshot, gkf, "camera", "cam_reeinit_before_snapshot");
 			READ_BOOL_INI_KEY (priv->cam_reeinit_after_snapshot, gkf, "camera", "cam_reeinit_after_snapshot");
 			READ_BOOL_INI_KEY (priv->cam_keep_files, gkf, "camera", "cam_keep_files");
+			READ_STR_INI_KEY (camera_backend, gkf, "camera", "backend");
+		}
+		if (g_strcmp0 (camera_backend, "simulated") == 0)
+		{
+			gchar *preview_dir = NULL, *photo_dir = NULL;
+			gint preview_fps = 0, capture_delay = 0, download_delay = 0;
+			gint preview_error_rate = 0, capture_error_rate = 0, error_code = GP_ERROR_IO, seed = 0;
+			gint preview_hang_rate = 0, capture_hang_rate = 0;
+			READ_STR_INI_KEY (preview_dir, gkf, "simulated_camera", "preview_dir");
+			READ_STR_INI_KEY (photo_dir, gkf, "simulated_camera", "photo_dir");
+			READ_INT_INI_KEY (preview_fps, gkf, "simulated_camera", "preview_fps");
+			READ_INT_INI_KEY (capture_delay, gkf, "simulated_camera", "capture_delay");
+			READ_INT_INI_KEY (download_delay, gkf, "simulated_camera", "download_delay");
+			READ_INT_INI_KEY (preview_error_rate, gkf, "simulated_camera", "preview_error_rate");
+			READ_INT_INI_KEY (capture_error_rate, gkf, "simulated_camera", "capture_error_rate");
+			READ_INT_INI_KEY (error_code, gkf, "simulated_camera", "error_code");
+			READ_INT_INI_KEY (seed, gkf, "simulated_camera", "seed");
+			READ_INT_INI_KEY (preview_hang_rate, gkf, "simulated_camera", "preview_hang_rate");
+			READ_INT_INI_KEY (capture_hang_rate, gkf, "simulated_camera", "capture_hang_rate");
+			if (preview_dir)
+			{
+				priv->camera = photo_booth_camera_simulated_new (preview_dir, photo_dir);
+				photo_booth_camera_simulated_set_timing (priv->camera, preview_fps, capture_delay, download_delay);
+				photo_booth_camera_simulated_set_failures (priv->camera, preview_error_rate, capture_error_rate, error_code, seed);
+				photo_booth_camera_simulated_set_hangs (priv->camera, preview_hang_rate, capture_hang_rate);
+				GST_INFO ("using simulated camera with live view from '%s'", preview_dir);
+			}
+			else
+				GST_WARNING ("simulated camera needs [simulated_camera] preview_dir, falling back to gphoto");
+			g_free (preview_dir);
+			g_free (photo_dir);
+		}
+		g_free (camera_backend);
+		if (g_key_file_has_group (gkf, "watchdog"))
+		{
+			READ_INT_INI_KEY (priv->camera_timeout, gkf, "watchdog", "camera_timeout");
+			READ_INT_INI_KEY (priv->capture_timeout, gkf, "watchdog", "capture_timeout");
+			READ_INT_INI_KEY (priv->video_timeout, gkf, "watchdog", "video_timeout");
+			READ_INT_INI_KEY (priv->processing_timeout, gkf, "watchdog", "processing_timeout");
+			READ_INT_INI_KEY (priv->print_timeout, gkf, "watchdog", "print_timeout");
 		}
 		if (g_key_file_has_group (gkf, "upload"))
 		{
@@ -662,19 +1148,20 @@ void photo_booth_load_settings (PhotoBooth *pb, const gchar *filename)
 			READ_STR_INI_KEY (priv->linx_put_uri, gkf, "upload", "linx_put_uri");
 			READ_STR_INI_KEY (priv->linx_api_key, gkf, "upload", "linx_api_key");
 			READ_INT_INI_KEY (priv->linx_expiry, gkf, "upload", "linx_expiry");
+			READ_INT_INI_KEY (priv->linx_chunk_size, gkf, "upload", "linx_chunk_size");
+			READ_INT_INI_KEY (priv->linx_chunk_retries, gkf, "upload", "linx_chunk_retries");
+			READ_INT_INI_KEY (priv->upload_speed_busy, gkf, "upload", "upload_speed_busy");
+			READ_INT_INI_KEY (priv->upload_speed_preview, gkf, "upload", "upload_speed_preview");
+			READ_INT_INI_KEY (priv->upload_speed_idle, gkf, "upload", "upload_speed_idle");
 			READ_INT_INI_KEY (priv->upload_timeout, gkf, "upload", "upload_timeout");
-			READ_STR_INI_KEY (priv->facebook_put_uri, gkf, "upload", "facebook_put_uri");
-			READ_STR_INI_KEY (priv->imgur_album_id, gkf, "upload", "imgur_album_id");
-			READ_STR_INI_KEY (priv->imgur_access_token, gkf, "upload", "imgur_access_token");
-			READ_STR_INI_KEY (priv->imgur_description, gkf, "upload", "imgur_description");
-			READ_STR_INI_KEY (priv->twitter_bridge_host, gkf, "upload", "twitter_bridge_host");
-			READ_INT_INI_KEY (priv->twitter_bridge_port, gkf, "upload", "twitter_bridge_port");
+			photo_booth_setup_publish_targets (pb, gkf);
 			priv->do_qrcode = !!priv->qrcode_base_uri;
 		}
 		if (g_key_file_has_group (gkf, "masks"))
 		{
 			READ_STR_INI_KEY (priv->masks_dir, gkf, "masks", "directory");
 			READ_STR_INI_KEY (priv->masks_json, gkf, "masks", "list");
+			READ_INT_INI_KEY (priv->masks_cache_size, gkf, "masks", "cache_size");
 		}
 	}
 
@@ -685,27 +1172,29 @@ void photo_booth_load_settings (PhotoBooth *pb, const gchar *filename)
 		gchar *filenameprefix = g_strndup (save_path_basename, pos-save_path_basename);
 		GDir *save_dir;
 		GError *error = NULL;
-		const gchar *save_path_dirname = g_path_get_dirname (priv->save_path_template);
+		gchar *save_path_dirname = g_path_get_dirname (priv->save_path_template);
 		save_dir = g_dir_open (save_path_dirname, 0, &error);
 		if (error) {
 			GST_WARNING ("couldn't open save directory '%s': %s", priv->save_path_template, error->message);
+			g_error_free (error);
 		}
 		else if (save_dir)
 		{
 			const gchar *filename;
 			GMatchInfo *match_info;
 			GRegex *regex;
-			const gchar *pattern = g_strdup_printf("(?<filename>%s)(?<number>\\d+)", filenameprefix);
+			gchar *pattern = g_strdup_printf("(?<filename>%s)(?<number>\\d+)", filenameprefix);
 			GST_TRACE ("save_path_base_name regex pattern = '%s'", pattern);
 			regex = g_regex_new (pattern, 0, 0, &error);
 			if (error) {
 				g_critical ("%s\n", error->message);
+				g_error_free (error);
 			}
 			while ((filename = g_dir_read_name (save_dir)))
 			{
 				if (g_regex_match (regex, filename, 0, &match_info))
 				{
-					gint count = atoi(g_match_info_fetch_named (match_info, "number"));
+					gint count = _match_int (match_info, "number");
 					gchar *name = g_match_info_fetch_named (match_info, "filename");
 					if (count > (int) priv->save_filename_count)
 						priv->save_filename_count = count;
@@ -714,10 +1203,16 @@ void photo_booth_load_settings (PhotoBooth *pb, const gchar *filename)
 				}
 				else
 					GST_TRACE ("save_path_template unmatched file %s", filename);
+				g_match_info_free (match_info);
 			}
 			g_dir_close (save_dir);
+			if (regex)
+				g_regex_unref (regex);
+			g_free (pattern);
 		}
 		GST_WARNING ("save_path_dirname %s", save_path_dirname);
+		g_free (save_path_dirname);
+		g_free (filenameprefix);
 	}
 	g_free (save_path_basename);
 
@@ -773,18 +1268,70 @@ void _play_event_sound (PhotoBoothPrivate *priv, sound_t sound)
 		ca_context_play (ca_gtk_context_get(), 0, CA_PROP_MEDIA_FILENAME, soundfile, NULL);
 }
 
-static void photo_booth_delete_file (PhotoBooth *pb)
+static void photo_booth_unlink_file (const gchar *filename)
 {
-	PhotoBoothPrivate *priv = photo_booth_get_instance_private (pb);
-	g_mutex_lock (&priv->upload_mutex);
-	const gchar *filename = g_strdup_printf (priv->save_path_template, priv->save_filename_count);
 	if (g_unlink (filename)) {
 		GST_ERROR ("error deleting file '%s': %s (%i)", filename, strerror(errno), errno);
 	}
-	g_mutex_unlock (&priv->upload_mutex);
 }
 
-static gboolean photo_booth_cam_init (CameraInfo **cam_info)
+/* files_mutex is only held for the bookkeeping, never across an upload.
+ * a photo that is still being uploaded or published when it should be deleted
+ * is unlinked by the last photo_booth_file_release instead */
+static void photo_booth_delete_file (PhotoBooth *pb)
+{
+	PhotoBoothPrivate *priv = photo_booth_get_instance_private (pb);
+	gchar *filename;
+	g_mutex_lock (&priv->files_mutex);
+	filename = g_strdup_printf (priv->save_path_template, priv->save_filename_count);
+	if (g_hash_table_contains (priv->files_in_use, filename))
+	{
+		GST_INFO ("'%s' is still being uploaded, delete it afterwards", filename);
+		g_hash_table_add (priv->files_doomed, filename);
+		filename = NULL;
+	}
+	g_mutex_unlock (&priv->files_mutex);
+	if (filename)
+	{
+		photo_booth_unlink_file (filename);
+		g_free (filename);
+	}
+}
+
+static gchar *photo_booth_file_acquire (PhotoBooth *pb)
+{
+	PhotoBoothPrivate *priv = photo_booth_get_instance_private (pb);
+	gchar *filename;
+	guint users;
+	g_mutex_lock (&priv->files_mutex);
+	filename = g_strdup_printf (priv->save_path_template, priv->save_filename_count);
+	users = GPOINTER_TO_UINT (g_hash_table_lookup (priv->files_in_use, filename));
+	g_hash_table_insert (priv->files_in_use, g_strdup (filename), GUINT_TO_POINTER (users + 1));
+	g_mutex_unlock (&priv->files_mutex);
+	return filename;
+}
+
+static void photo_booth_file_release (PhotoBooth *pb, gchar *filename)
+{
+	PhotoBoothPrivate *priv = photo_booth_get_instance_private (pb);
+	gboolean doomed = FALSE;
+	guint users;
+	g_mutex_lock (&priv->files_mutex);
+	users = GPOINTER_TO_UINT (g_hash_table_lookup (priv->files_in_use, filename));
+	if (users > 1)
+		g_hash_table_insert (priv->files_in_use, g_strdup (filename), GUINT_TO_POINTER (users - 1));
+	else
+	{
+		g_hash_table_remove (priv->files_in_use, filename);
+		doomed = g_hash_table_remove (priv->files_doomed, filename);
+	}
+	g_mutex_unlock (&priv->files_mutex);
+	if (doomed)
+		photo_booth_unlink_file (filename);
+	g_free (filename);
+}
+
+static gboolean photo_booth_cam_init (CameraInfo **cam_info, PhotoBoothCamera *camera)
 {
 	int retval;
 	if (*cam_info)
@@ -801,10 +1348,9 @@ static gboolean photo_booth_cam_init (CameraInfo **cam_info)
 	(*cam_info)->preview_capture_count = 0;
 	(*cam_info)->size = 0;
 	(*cam_info)->data = NULL;
-	(*cam_info)->context = gp_context_new();
-	gp_camera_new (&(*cam_info)->camera);
-	retval = gp_camera_init ((*cam_info)->camera, (*cam_info)->context);
-	GST_DEBUG ("gp_camera_init returned %d cam_info@%p camera@%p", retval, (void*) *cam_info, cam_info ? (void*) (*cam_info)->camera : NULL);
+	(*cam_info)->camera = g_object_ref (camera);
+	retval = photo_booth_camera_open (camera);
+	GST_DEBUG ("%s camera open returned %d cam_info@%p", camera->name, retval, (void*) *cam_info);
 	g_mutex_unlock (&(*cam_info)->mutex);
 	if (retval == GP_ERROR_IO_USB_CLAIM)
 	{
@@ -821,17 +1367,16 @@ static gboolean photo_booth_cam_init (CameraInfo **cam_info)
 
 static gboolean photo_booth_cam_close (CameraInfo **cam_info)
 {
-	int retval;
 	if (*cam_info == NULL)
 	{
 		GST_ERROR ("tried to close cam when cam_info == NULL");
 		return FALSE;
 	}
 	g_mutex_lock (&(*cam_info)->mutex);
-	retval = gp_camera_exit((*cam_info)->camera, (*cam_info)->context);
-	GST_DEBUG ("gp_camera_exit returned %i", retval);
-	gp_camera_free ((*cam_info)->camera);
-	gp_context_unref ((*cam_info)->context);
+	photo_booth_camera_close ((*cam_info)->camera);
+	g_object_unref ((*cam_info)->camera);
+	photo_booth_memory_untrack (photo_booth_memory_get_default (), (*cam_info)->data);
+	g_free ((*cam_info)->data);
 	g_mutex_unlock (&(*cam_info)->mutex);
 	g_mutex_clear (&(*cam_info)->mutex);
 	free (*cam_info);
@@ -839,73 +1384,6 @@ static gboolean photo_booth_cam_close (CameraInfo **cam_info)
 	return GP_OK ? TRUE : FALSE;
 }
 
-static void photo_booth_cam_config (PhotoBooth *pb)
-{
-	PhotoBoothPrivate *priv = photo_booth_get_instance_private (pb);
-	int ret;
-	CameraWidgetType	type;
-	CameraWidget *rootconfig = NULL, *child;
-	const char *name = "capturetarget";
-	const char *value = priv->cam_keep_files ? "1" : "0";
-	ret = gp_camera_get_single_config (pb->cam_info->camera, name, &child, pb->cam_info->context);
-	rootconfig = child;
-	if (ret != GP_OK)
-		goto fail;
-	ret = gp_widget_get_child_by_name (rootconfig, name, &child);
-	if (ret != GP_OK)
-		goto fail;
-	ret = gp_widget_get_type (child, &type);
-	if (ret != GP_OK)
-		goto fail;
-	if (type == GP_WIDGET_RADIO)
-	{
-		int cnt, i;
-		char *endptr;
-		cnt = gp_widget_count_choices (child);
-		if (cnt < GP_OK) {
-			ret = cnt;
-			goto fail;
-		}
-		ret = GP_ERROR_BAD_PARAMETERS;
-		for ( i=0; i<cnt; i++) {
-			const char *choice;
-
-			ret = gp_widget_get_choice (child, i, &choice);
-			if (ret != GP_OK)
-				continue;
-			if (!strcmp (choice, value)) {
-				ret = gp_widget_set_value (child, value);
-				break;
-			}
-		}
-		if (i != cnt)
-			goto fail;
-		i = strtol (value, &endptr, 10);
-		if ((value != endptr) && (*endptr == '\0')) {
-			if ((i>= 0) && (i < cnt)) {
-				const char *choice;
-				ret = gp_widget_get_choice (child, i, &choice);
-				if (ret == GP_OK)
-					ret = gp_widget_set_value (child, choice);
-			}
-		}
-		ret = gp_widget_set_value (child, value);
-		if (ret != GP_OK)
-			goto fail;
-		ret = gp_camera_set_single_config (pb->cam_info->camera, name, child, pb->cam_info->context);
-		if (ret != GP_OK)
-			goto fail;
-		GST_INFO ("capturetarget configured to %s in camera", value);
-		gp_widget_free (rootconfig);
-		return;
-	}
-
-fail:
-	GST_WARNING ("couldn't set %s config!", name);
-	if (rootconfig)
-		gp_widget_free (rootconfig);
-}
-
 static void photo_booth_flush_pipe (int fd)
 {
 	int rlen = 0;
@@ -919,7 +1397,7 @@ static void photo_booth_flush_pipe (int fd)
 	fcntl (fd, F_SETFL, flags ^ O_NONBLOCK);
 }
 
-static gboolean photo_booth_quit_signal (gpointer user_data)
+gboolean photo_booth_quit_signal (gpointer user_data)
 {
 	PhotoBooth *pb = PHOTO_BOOTH (user_data);
 	GST_INFO ("caught SIGINT! exit...");
@@ -938,16 +1416,12 @@ static gpointer photo_booth_capture_thread_func (gpointer user_data)
 	PhotoBooth *pb = PHOTO_BOOTH (user_data);
 	PhotoboothCaptureThreadState state = CAPTURE_INIT;
 	PhotoBoothPrivate *priv = photo_booth_get_instance_private (pb);
-	CameraFile *gp_file = NULL;
-	int gpret, captured_frames = 0;
+	int gpret, captured_frames = 0, fps_frames = 0;
+	gint64 fps_start = g_get_monotonic_time ();
+	gboolean starting = TRUE;
 
 	GST_DEBUG ("enter capture thread fd = %d", pb->video_fd);
-
-	if (gp_file_new_from_fd (&gp_file, pb->video_fd) != GP_OK)
-	{
-		GST_ERROR ("couldn't start capture thread because gp_file_new_from_fd (%d) failed!", pb->video_fd);
-		goto quit_thread;
-	}
+	photo_booth_startup_begin (photo_booth_startup_get_default (), "camera");
 
 	while (TRUE) {
 		if (state == CAPTURE_QUIT)
@@ -962,15 +1436,12 @@ static gpointer photo_booth_capture_thread_func (gpointer user_data)
 		{
 			if (pb->cam_info == NULL)
 			{
-				if (photo_booth_cam_init (&pb->cam_info))
+				if (photo_booth_cam_init (&pb->cam_info, priv->camera))
 				{
-					static gsize cam_configured = 0;
 					GST_INFO ("photo_booth_cam_inited @ %p", (void *)pb->cam_info);
-					if (g_once_init_enter (&cam_configured))
-					{
-						photo_booth_cam_config (pb);
-						g_once_init_leave (&cam_configured, 1);
-					}
+					if (starting)
+						photo_booth_startup_end (photo_booth_startup_get_default (), "camera");
+					starting = FALSE;
 					if (state == CAPTURE_FAILED)
 					{
 						photo_booth_window_set_spinner (priv->win, FALSE);
@@ -1004,14 +1475,28 @@ static gpointer photo_booth_capture_thread_func (gpointer user_data)
 		}
 		else if (ret == 0 && state == CAPTURE_VIDEO)
 		{
-			const char *mime;
 			if (pb->cam_info)
 			{
+				gint64 capture_start = g_get_monotonic_time ();
 				g_mutex_lock (&pb->cam_info->mutex);
-				gpret = gp_camera_capture_preview (pb->cam_info->camera, gp_file, pb->cam_info->context);
+				photo_booth_watchdog_arm (priv->watchdog, WATCHDOG_CAMERA, "capture_preview");
+				gpret = photo_booth_camera_capture_preview (pb->cam_info->camera, pb->video_fd);
+				photo_booth_watchdog_disarm (priv->watchdog, WATCHDOG_CAMERA);
 				g_mutex_unlock (&pb->cam_info->mutex);
+				if (g_atomic_int_compare_and_exchange (&priv->camera_reinit, TRUE, FALSE))
+				{
+					GST_WARNING ("reinitializing the camera after it stalled in live view");
+					photo_booth_cam_close (&pb->cam_info);
+					if (!photo_booth_cam_init (&pb->cam_info, priv->camera))
+					{
+						state = CAPTURE_FAILED;
+						photo_booth_change_state (pb, PB_STATE_NONE);
+					}
+					continue;
+				}
 				if (gpret < 0) {
 					GST_ERROR ("Movie capture error %d", gpret);
+					photo_booth_metrics_counter_add (photo_booth_metrics_get_default (), "photobooth_preview_errors_total", NULL, 1);
 					if (gpret == -7)
 					{
 						state = CAPTURE_FAILED;
@@ -1022,26 +1507,36 @@ static gpointer photo_booth_capture_thread_func (gpointer user_data)
 					continue;
 				}
 				else {
-					gp_file_get_mime_type (gp_file, &mime);
-					if (strcmp (mime, GP_MIME_JPEG)) {
-						GST_ERROR ("Movie capture error... Unhandled MIME type '%s'.", mime);
-						continue;
-					}
+					photo_booth_watchdog_feed (priv->watchdog, WATCHDOG_CAMERA, "capture_preview");
+					if (priv->frame_timing)
+						photo_booth_frame_timing_captured (priv->frame_timing, capture_start, g_get_monotonic_time ());
 					captured_frames++;
+					fps_frames++;
 					GST_LOG ("captured frame (%d frames total)", captured_frames);
 				}
+				gint64 now = g_get_monotonic_time ();
+				if (now - fps_start >= G_USEC_PER_SEC)
+				{
+					photo_booth_metrics_gauge_set (photo_booth_metrics_get_default (), "photobooth_preview_fps", NULL, (gdouble) fps_frames * G_USEC_PER_SEC / (now - fps_start));
+					fps_frames = 0;
+					fps_start = now;
+				}
 			}
 		}
 		else if (ret == 0 && state == CAPTURE_PRETRIGGER)
 		{
 			gtk_label_set_text (priv->win->status, _("Focussing..."));
-			if (0)
-				photo_booth_focus (pb->cam_info);
+			if (0 && pb->cam_info)
+			{
+				g_mutex_lock (&pb->cam_info->mutex);
+				photo_booth_camera_focus (pb->cam_info->camera);
+				g_mutex_unlock (&pb->cam_info->mutex);
+			}
 			if (priv->cam_reeinit_before_snapshot)
 			{
 				GST_WARNING ("calling photo_booth_cam_close because cam_reeinit_before_snapshot");
 				photo_booth_cam_close (&pb->cam_info);
-				photo_booth_cam_init (&pb->cam_info);
+				photo_booth_cam_init (&pb->cam_info, priv->camera);
 			}
 		}
 		else if (ret == 0 && state == CAPTURE_PHOTO)
@@ -1051,6 +1546,14 @@ static gpointer photo_booth_capture_thread_func (gpointer user_data)
 				gtk_label_set_text (priv->win->status, _("Taking photo..."));
 				photo_booth_led_flash (priv->led);
 				ret = photo_booth_take_photo (pb);
+				if (!ret && g_atomic_int_compare_and_exchange (&priv->camera_reinit, TRUE, FALSE))
+				{
+					// the watchdog had to cancel a hanging camera, the guest is still posing so try once more
+					GST_WARNING ("camera stalled taking the photo, reinitializing it for another try");
+					photo_booth_cam_close (&pb->cam_info);
+					if (photo_booth_cam_init (&pb->cam_info, priv->camera))
+						ret = photo_booth_take_photo (pb);
+				}
 				photo_booth_led_black (priv->led);
 				if (ret && pb->cam_info->size)
 				{
@@ -1061,6 +1564,7 @@ static gpointer photo_booth_capture_thread_func (gpointer user_data)
 					gtk_label_set_text (priv->win->status, _("Taking photo failed!"));
 					_play_event_sound (priv, ERROR_SOUND);
 					GST_ERROR ("Taking photo failed!");
+					g_atomic_int_set (&priv->camera_reinit, FALSE);
 					photo_booth_cam_close (&pb->cam_info);
 					photo_booth_change_state (pb, PB_STATE_NONE);
 					gtk_widget_show (GTK_WIDGET (priv->win->gtkgstwidget));
@@ -1101,7 +1605,7 @@ static gpointer photo_booth_capture_thread_func (gpointer user_data)
 				{
 					GST_WARNING ("CONTROL_REINIT!");
 					photo_booth_cam_close (&pb->cam_info);
-					photo_booth_cam_init (&pb->cam_info);
+					photo_booth_cam_init (&pb->cam_info, priv->camera);
 					break;
 				}
 				default:
@@ -1130,18 +1634,83 @@ static gpointer photo_booth_capture_thread_func (gpointer user_data)
 
 	quit_thread:
 	{
-		if (gp_file)
-			gp_file_unref (gp_file);
 		GST_DEBUG ("stop running, exit thread, %d frames captured", captured_frames);
 		return NULL;
 	}
 }
 
+/* the in-tree cascade detector when a trained model is configured, opencv's facedetect element when
+ * none is or it can't be loaded. format is set to the raw format the detection branch has to deliver */
+static GstElement *photo_booth_make_facedetect (PhotoBooth *pb, const gchar *name, gint min_size, const gchar **format)
+{
+	PhotoBoothPrivate *priv = photo_booth_get_instance_private (pb);
+	GstElement *facedetect;
+
+	if (priv->facedetect_model)
+	{
+		GError *error = NULL;
+		facedetect = photo_booth_face_detect_new (name, priv->facedetect_model, &error);
+		if (facedetect)
+		{
+			photo_booth_face_detect_set_min_size (PHOTO_BOOTH_FACE_DETECT (facedetect), min_size);
+			*format = PHOTO_BOOTH_FACE_DETECT_FORMAT;
+			return facedetect;
+		}
+		GST_WARNING ("couldn't load face detection model '%s': %s. trying opencv facedetect instead", priv->facedetect_model, error->message);
+		g_error_free (error);
+	}
+
+	facedetect = gst_element_factory_make ("facedetect", name);
+	if (facedetect)
+		g_object_set (G_OBJECT (facedetect), "updates", 0, "display", FALSE, "min-size-width", min_size, "min-stddev", 10, NULL);
+	// the opencv element only takes RGB and converts to grey itself, so the branch only saves it the scaling
+	*format = "RGB";
+	return facedetect;
+}
+
+/* every decoded live view frame tells the watchdog that fdsrc and decoder are alive */
+static GstPadProbeReturn photo_booth_video_progress_probe (G_GNUC_UNUSED GstPad *pad, G_GNUC_UNUSED GstPadProbeInfo *info, gpointer user_data)
+{
+	PhotoBoothPrivate *priv = photo_booth_get_instance_private (PHOTO_BOOTH (user_data));
+	if (priv->watchdog)
+		photo_booth_watchdog_feed (priv->watchdog, WATCHDOG_VIDEO, "video-bin");
+	return GST_PAD_PROBE_OK;
+}
+
+/* the photo-bin's elements report every buffer they put out, so a stall can be pinned on the element after the last one */
+static GstPadProbeReturn photo_booth_photo_progress_probe (GstPad *pad, G_GNUC_UNUSED GstPadProbeInfo *info, gpointer user_data)
+{
+	PhotoBoothPrivate *priv = photo_booth_get_instance_private (PHOTO_BOOTH (user_data));
+	if (priv->watchdog)
+		photo_booth_watchdog_feed (priv->watchdog, WATCHDOG_PHOTO, g_intern_string (GST_OBJECT_NAME (GST_OBJECT_PARENT (pad))));
+	return GST_PAD_PROBE_OK;
+}
+
+static void photo_booth_watch_photo_element (PhotoBooth *pb, GstElement *element)
+{
+	GstPad *pad = element ? gst_element_get_static_pad (element, "src") : NULL;
+	if (!pad)
+		return;
+	gst_pad_add_probe (pad, GST_PAD_PROBE_TYPE_BUFFER, photo_booth_photo_progress_probe, pb, NULL);
+	gst_object_unref (pad);
+}
+
+static void photo_booth_watch_frame_stage (PhotoBooth *pb, GstElement *element, PhotoBoothFrameStage stage, PhotoBoothFrameStage after)
+{
+	PhotoBoothPrivate *priv = photo_booth_get_instance_private (pb);
+	GstPad *pad = element ? gst_element_get_static_pad (element, "src") : NULL;
+	if (!pad)
+		return;
+	photo_booth_frame_timing_watch (priv->frame_timing, pad, stage, after);
+	gst_object_unref (pad);
+}
+
 static GstElement *build_video_bin (PhotoBooth *pb)
 {
 	PhotoBoothPrivate *priv;
 	GstElement *video_bin;
 	GstElement *mjpeg_source, *mjpeg_filter, *mjpeg_parser, *mjpeg_decoder, *video_filter, *video_scale, *video_flip, *video_convert, *video_facedetect = NULL;
+	const gchar *detect_format = NULL;
 	GstCaps *caps;
 	GstPad *ghost, *pad;
 
@@ -1170,7 +1739,7 @@ static GstElement *build_video_bin (PhotoBooth *pb)
 	gst_caps_unref (caps);
 
 	if (priv->enable_facedetect > FACEDETECT_DISABLED)
-		video_facedetect = gst_element_factory_make ("facedetect", "video-facedetect");
+		video_facedetect = photo_booth_make_facedetect (pb, "video-facedetect", 100 * CLAMP (priv->facedetect_width, 16, priv->preview_width) / priv->preview_width, &detect_format);
 
 	if (!(mjpeg_source && mjpeg_filter && mjpeg_parser && mjpeg_decoder && video_scale && video_convert && video_flip && video_filter))
 	{
@@ -1181,21 +1750,55 @@ static GstElement *build_video_bin (PhotoBooth *pb)
 
 	gst_bin_add_many (GST_BIN (video_bin), mjpeg_source, mjpeg_filter, mjpeg_parser, mjpeg_decoder, video_scale, video_convert, video_flip, video_filter, NULL);
 
+	/* the preview goes straight on to the sink, face detection gets a decimated, downscaled copy
+	 * of the frames on a leaky side branch so that it can never hold up the display */
 	if (video_facedetect)
 	{
-		GstElement *detect_convert = gst_element_factory_make ("videoconvert", "facedetect-videoconvert");
-		gst_bin_add_many (GST_BIN (video_bin), detect_convert, video_facedetect, NULL);
-		g_object_set (G_OBJECT (video_facedetect), "updates", 0, "display", FALSE, "min-size-width", 100, "min-stddev", 10, NULL);
-		if (gst_element_link_many (mjpeg_source, mjpeg_filter, mjpeg_parser, mjpeg_decoder, video_scale, video_convert, video_flip, video_filter, video_facedetect, detect_convert, NULL))
+		GstElement *video_tee, *display_queue, *mask_overlay, *detect_queue, *detect_rate, *detect_scale, *detect_convert, *detect_filter, *detect_sink;
+		gint detect_width = CLAMP (priv->facedetect_width, 16, priv->preview_width);
+		gint detect_height = priv->preview_height * detect_width / priv->preview_width;
+
+		video_tee = gst_element_factory_make ("tee", "video-tee");
+		display_queue = gst_element_factory_make ("queue", "video-display-queue");
+		mask_overlay = gst_element_factory_make ("cairooverlay", "video-mask-overlay");
+		detect_queue = gst_element_factory_make ("queue", "facedetect-queue");
+		detect_rate = gst_element_factory_make ("videorate", "facedetect-videorate");
+		detect_scale = gst_element_factory_make ("videoscale", "facedetect-videoscale");
+		detect_convert = gst_element_factory_make ("videoconvert", "facedetect-videoconvert");
+		detect_filter = gst_element_factory_make ("capsfilter", "facedetect-capsfilter");
+		detect_sink = gst_element_factory_make ("fakesink", "facedetect-fakesink");
+
+		if (video_tee && display_queue && mask_overlay && detect_queue && detect_rate && detect_scale && detect_convert && detect_filter && detect_sink)
+		{
+			// the live masks are drawn into the preview frames in the streaming thread, right where the tracker expects the faces
+			g_signal_connect (mask_overlay, "draw", G_CALLBACK (photo_booth_video_overlay_draw), pb);
+			g_object_set (G_OBJECT (display_queue), "max-size-buffers", 2, "max-size-bytes", 0, "max-size-time", (guint64) 0, NULL);
+			g_object_set (G_OBJECT (detect_queue), "leaky", 2, "max-size-buffers", 1, "max-size-bytes", 0, "max-size-time", (guint64) 0, NULL);
+			g_object_set (G_OBJECT (detect_rate), "drop-only", TRUE, "max-rate", MAX (priv->facedetect_fps, 1), NULL);
+			caps = gst_caps_new_simple ("video/x-raw", "format", G_TYPE_STRING, detect_format, "width", G_TYPE_INT, detect_width, "height", G_TYPE_INT, detect_height, NULL);
+			g_object_set (G_OBJECT (detect_filter), "caps", caps, NULL);
+			gst_caps_unref (caps);
+			g_object_set (G_OBJECT (detect_sink), "sync", FALSE, "async", FALSE, NULL);
+			gst_bin_add_many (GST_BIN (video_bin), video_tee, display_queue, mask_overlay, detect_queue, detect_rate, detect_scale, detect_convert, detect_filter, video_facedetect, detect_sink, NULL);
+		}
+		else
+		{
+			GST_WARNING_OBJECT (video_bin, "Failed to make face detection branch element(s)");
+			gst_object_unref (video_facedetect);
+			video_facedetect = NULL;
+		}
+
+		if (video_facedetect && gst_element_link_many (mjpeg_source, mjpeg_filter, mjpeg_parser, mjpeg_decoder, video_scale, video_convert, video_flip, video_filter, video_tee, display_queue, mask_overlay, NULL)
+			&& gst_element_link_many (video_tee, detect_queue, detect_rate, detect_scale, detect_convert, detect_filter, video_facedetect, detect_sink, NULL))
 		{
-			GST_INFO_OBJECT (priv->masquerade, "facedetect plugin will be used!");
+			GST_INFO_OBJECT (priv->masquerade, "facedetect plugin will be used at %d fps on %dx%d!", priv->facedetect_fps, detect_width, detect_height);
+			priv->facedetect_scale = (gdouble) priv->preview_width / detect_width;
 			if (priv->enable_facedetect == FACEDETECT_ENABLED) {
 				gtk_combo_box_set_active (priv->win->combo_masquerade, 1);;
 			}
-			pad = gst_element_get_static_pad (detect_convert, "src");
-		} else {
-			gst_object_unref (video_facedetect);
-			gst_object_unref (detect_convert);
+			pad = gst_element_get_static_pad (mask_overlay, "src");
+		} else if (video_facedetect) {
+			gst_bin_remove_many (GST_BIN (video_bin), video_tee, display_queue, mask_overlay, detect_queue, detect_rate, detect_scale, detect_convert, detect_filter, video_facedetect, detect_sink, NULL);
 			video_facedetect = NULL;
 		}
 	}
@@ -1211,6 +1814,16 @@ static GstElement *build_video_bin (PhotoBooth *pb)
 		gtk_widget_hide (GTK_WIDGET (priv->win->combo_masquerade));
 	}
 
+	gst_pad_add_probe (pad, GST_PAD_PROBE_TYPE_BUFFER, photo_booth_video_progress_probe, pb, NULL);
+	if (priv->frame_timing)
+	{
+		photo_booth_watch_frame_stage (pb, mjpeg_parser, FRAME_STAGE_FIFO, FRAME_STAGE_CAPTURE);
+		photo_booth_watch_frame_stage (pb, mjpeg_decoder, FRAME_STAGE_DECODE, FRAME_STAGE_FIFO);
+		photo_booth_watch_frame_stage (pb, video_scale, FRAME_STAGE_SCALE, FRAME_STAGE_DECODE);
+		photo_booth_watch_frame_stage (pb, video_convert, FRAME_STAGE_CONVERT, FRAME_STAGE_SCALE);
+		photo_booth_watch_frame_stage (pb, video_filter, FRAME_STAGE_FLIP, FRAME_STAGE_CONVERT);
+		photo_booth_watch_frame_stage (pb, video_facedetect, FRAME_STAGE_FACEDETECT, FRAME_STAGE_FLIP);
+	}
 	ghost = gst_ghost_pad_new ("src", pad);
 	gst_object_unref (pad);
 	gst_pad_set_active (ghost, TRUE);
@@ -1218,12 +1831,22 @@ static GstElement *build_video_bin (PhotoBooth *pb)
 	return video_bin;
 }
 
-static GstElement *build_photo_bin (PhotoBooth *pb)
+/* only the first pass of a captured frame through the photo-bin needs detecting */
+static GstPadProbeReturn photo_booth_photo_detect_probe (G_GNUC_UNUSED GstPad *pad, G_GNUC_UNUSED GstPadProbeInfo *info, gpointer user_data)
+{
+	PhotoBoothPrivate *priv = photo_booth_get_instance_private (PHOTO_BOOTH (user_data));
+	if (g_atomic_int_compare_and_exchange (&priv->photo_detect_pending, TRUE, FALSE))
+		return GST_PAD_PROBE_PASS;
+	return GST_PAD_PROBE_DROP;
+}
+
+GstElement *photo_booth_build_photo_bin (PhotoBooth *pb)
 {
 	PhotoBoothPrivate *priv;
 	GstElement *photo_bin;
 	GstElement *photo_source, *photo_decoder, *photo_scale, *photo_filter, *photo_overlay, *photo_convert, *photo_gamma, *photo_tee;
 	GstElement *photo_facedetect = NULL, *qr_overlay = NULL;
+	const gchar *detect_format = NULL;
 	GstCaps *caps;
 	GstPad *ghost, *pad;
 	gboolean ret;
@@ -1238,18 +1861,32 @@ static GstElement *build_photo_bin (PhotoBooth *pb)
 	pad = gst_element_get_static_pad (photo_decoder, "src");
 	gulong probeid = gst_pad_add_probe (pad, GST_PAD_PROBE_TYPE_BUFFER, photo_booth_drop_thumbnails, pb, NULL);
 	g_assert (probeid);
+	gst_object_unref (pad);
 
 	photo_filter = gst_element_factory_make ("capsfilter", "photo-capsfilter");
 	caps = gst_caps_new_simple ("video/x-raw", "width", G_TYPE_INT, priv->print_width, "height", G_TYPE_INT, priv->print_height, NULL);
 	g_object_set (G_OBJECT (photo_filter), "caps", caps, NULL);
 	gst_caps_unref (caps);
 
-	photo_overlay = gst_element_factory_make ("gdkpixbufoverlay", "photo-overlay");
-	g_assert (photo_overlay);
-	if (priv->overlay_image)
-		g_object_set (photo_overlay, "location", priv->overlay_image, NULL);
-	g_object_set (photo_overlay, "overlay-width", priv->print_width, NULL);
-	g_object_set (photo_overlay, "overlay-height", priv->print_height, NULL);
+	/* frame overlay and masks are blended by the same element in one pass */
+	photo_overlay = photo_booth_compositor_new ("photo-compositor");
+	// unless it's being decoded at startup already
+	if (priv->overlay_image && !priv->overlay_pending)
+	{
+		GError *error = NULL;
+		GdkPixbuf *frame = gdk_pixbuf_new_from_file_at_scale (priv->overlay_image, priv->print_width, priv->print_height, FALSE, &error);
+		if (frame)
+		{
+			photo_booth_compositor_set_frame (PHOTO_BOOTH_COMPOSITOR (photo_overlay), frame);
+			g_object_unref (frame);
+		}
+		else
+		{
+			GST_WARNING ("couldn't load overlay image '%s': %s", priv->overlay_image, error->message);
+			g_error_free (error);
+		}
+	}
+	priv->photo_compositor = photo_overlay;
 
 	photo_convert = gst_element_factory_make ("videoconvert", "photo-convert");
 	photo_gamma = gst_element_factory_make ("gamma", "photo-gamma");
@@ -1257,7 +1894,7 @@ static GstElement *build_photo_bin (PhotoBooth *pb)
 	photo_tee = gst_element_factory_make ("tee", "photo-tee");
 
 	if (priv->enable_facedetect > FACEDETECT_DISABLED)
-		photo_facedetect = gst_element_factory_make ("facedetect", "photo-facedetect");
+		photo_facedetect = photo_booth_make_facedetect (pb, "photo-facedetect", 100 * CLAMP (priv->photo_facedetect_width, 16, priv->print_width) / priv->print_width, &detect_format);
 
 	if (!(photo_bin && photo_source && photo_decoder && photo_scale && photo_filter && photo_overlay && photo_convert && photo_tee))
 	{
@@ -1266,7 +1903,54 @@ static GstElement *build_photo_bin (PhotoBooth *pb)
 	}
 
 	gst_bin_add_many (GST_BIN (photo_bin), photo_source, photo_decoder, photo_scale, photo_filter, photo_overlay, photo_gamma, photo_convert, photo_tee, NULL);
-	ret = gst_element_link_many (photo_source, photo_decoder, photo_scale, photo_filter, photo_overlay, NULL);
+	ret = gst_element_link_many (photo_source, photo_decoder, photo_scale, photo_filter, NULL);
+
+	/* the captured frame is detected once on a downscaled copy, before any overlay is drawn.
+	 * the branch has no queue on purpose: the results have to be posted before the frame
+	 * reaches the photo-bin's src pad probe which moves the state machine on */
+	if (photo_facedetect)
+	{
+		GstElement *detect_tee, *detect_scale, *detect_convert, *detect_filter, *detect_sink;
+		gint detect_width = CLAMP (priv->photo_facedetect_width, 16, priv->print_width);
+		gint detect_height = priv->print_height * detect_width / priv->print_width;
+
+		detect_tee = gst_element_factory_make ("tee", "photo-detect-tee");
+		detect_scale = gst_element_factory_make ("videoscale", "photo-facedetect-videoscale");
+		detect_convert = gst_element_factory_make ("videoconvert", "photo-facedetect-videoconvert");
+		detect_filter = gst_element_factory_make ("capsfilter", "photo-facedetect-capsfilter");
+		detect_sink = gst_element_factory_make ("fakesink", "photo-facedetect-fakesink");
+		if (detect_tee && detect_scale && detect_convert && detect_filter && detect_sink)
+		{
+			caps = gst_caps_new_simple ("video/x-raw", "format", G_TYPE_STRING, detect_format, "width", G_TYPE_INT, detect_width, "height", G_TYPE_INT, detect_height, NULL);
+			g_object_set (G_OBJECT (detect_filter), "caps", caps, NULL);
+			gst_caps_unref (caps);
+			g_object_set (G_OBJECT (detect_sink), "sync", FALSE, "async", FALSE, NULL);
+			gst_bin_add_many (GST_BIN (photo_bin), detect_tee, detect_scale, detect_convert, detect_filter, photo_facedetect, detect_sink, NULL);
+			// request the detection pad first, tee pushes to its src pads in order
+			if (gst_element_link_many (photo_filter, detect_tee, detect_scale, detect_convert, detect_filter, photo_facedetect, detect_sink, NULL)
+				&& gst_element_link (detect_tee, photo_overlay))
+			{
+				pad = gst_element_get_static_pad (detect_scale, "sink");
+				gst_pad_add_probe (pad, GST_PAD_PROBE_TYPE_BUFFER, photo_booth_photo_detect_probe, pb, NULL);
+				gst_object_unref (pad);
+				priv->photo_facedetect_scale = (gdouble) priv->print_width / detect_width;
+				GST_INFO_OBJECT (photo_bin, "facedetect plugin will be used on %dx%d copies of the photo!", detect_width, detect_height);
+			}
+			else
+			{
+				GST_ERROR_OBJECT (photo_bin, "couldn't link photo face detection elements!");
+				return FALSE;
+			}
+		}
+		else
+		{
+			GST_WARNING_OBJECT (photo_bin, "Failed to make photo face detection branch element(s)");
+			gst_object_unref (photo_facedetect);
+			photo_facedetect = NULL;
+		}
+	}
+	if (!photo_facedetect)
+		ret &= gst_element_link (photo_filter, photo_overlay);
 
 	if (priv->do_qrcode)
 	{
@@ -1287,54 +1971,19 @@ static GstElement *build_photo_bin (PhotoBooth *pb)
 	{
 		ret |= gst_element_link (photo_overlay, photo_gamma);
 	}
-	if (!ret)
+	if (!ret || !gst_element_link_many (photo_gamma, photo_convert, photo_tee, NULL))
 	{
 		GST_ERROR_OBJECT (photo_bin, "couldn't link photobin elements!");
 		return FALSE;
 	}
-
-	if (photo_facedetect)
-	{
-		GstPad *masksinkpad, *masksrcpad;
-		priv->mask_bin = gst_element_factory_make ("bin", "photo-mask-bin");
-		GstElement *detect_convert = gst_element_factory_make ("videoconvert", "facedetect-photoconvert");
-		gchar *overlay_name = g_strdup_printf (PHOTO_MASKOVERLAY_NAME_TEMPLATE, 0);
-		GstElement *photo_maskoverlay = gst_element_factory_make ("gdkpixbufoverlay", overlay_name);
-		g_free (overlay_name);
-		g_assert (priv->mask_bin);
-		g_assert (detect_convert);
-		g_assert (photo_maskoverlay);
-		ret = gst_bin_add (GST_BIN (priv->mask_bin), photo_maskoverlay);
-		g_assert (ret);
-		g_object_set (G_OBJECT (photo_facedetect), "updates", 0, "display", FALSE, "min-size-width", 100, "min-stddev", 10, NULL);
-		pad = gst_element_get_static_pad (photo_maskoverlay, "sink");
-		g_assert (pad);
-		masksinkpad = gst_ghost_pad_new ("sink", pad);
-		g_assert (masksinkpad);
-		gst_element_add_pad (priv->mask_bin, masksinkpad);
-		gst_pad_set_active (masksinkpad, TRUE);
-		gst_object_unref (pad);
-		pad = gst_element_get_static_pad (photo_maskoverlay, "src");
-		g_assert (pad);
-		masksrcpad = gst_ghost_pad_new ("src", pad);
-		g_assert (masksrcpad);
-		gst_element_add_pad (priv->mask_bin, masksrcpad);
-		gst_pad_set_active (masksrcpad, TRUE);
-		gst_object_unref (pad);
-		gst_bin_add_many (GST_BIN (photo_bin), priv->mask_bin, photo_facedetect, detect_convert, NULL);
-		ret = gst_element_link_many (photo_gamma, priv->mask_bin, photo_convert, photo_facedetect, detect_convert, photo_tee, NULL);
-		g_assert (ret);
-		GST_INFO_OBJECT (photo_bin, "facedetect plugin will be used!");
-	}
-
-	if (!photo_facedetect)
-	{
-		if (!gst_element_link_many (photo_gamma, photo_convert, photo_tee, NULL))
-		{
-			GST_ERROR_OBJECT (photo_bin, "couldn't link photobin elements!");
-			return FALSE;
-		}
-	}
+	photo_booth_watch_photo_element (pb, photo_source);
+	photo_booth_watch_photo_element (pb, photo_decoder);
+	photo_booth_watch_photo_element (pb, photo_scale);
+	photo_booth_watch_photo_element (pb, photo_filter);
+	photo_booth_watch_photo_element (pb, photo_overlay);
+	photo_booth_watch_photo_element (pb, qr_overlay);
+	photo_booth_watch_photo_element (pb, photo_gamma);
+	photo_booth_watch_photo_element (pb, photo_convert);
 
 	pad = gst_element_get_request_pad (photo_tee, "src_%u");
 	ghost = gst_ghost_pad_new ("src", pad);
@@ -1353,7 +2002,7 @@ static gboolean photo_booth_setup_gstreamer (PhotoBooth *pb)
 	priv = photo_booth_get_instance_private (pb);
 
 	pb->video_bin  = build_video_bin (pb);
-	pb->photo_bin  = build_photo_bin (pb);
+	pb->photo_bin  = photo_booth_build_photo_bin (pb);
 
 	pb->pipeline = gst_pipeline_new ("photobooth-pipeline");
 
@@ -1370,6 +2019,16 @@ static gboolean photo_booth_setup_gstreamer (PhotoBooth *pb)
 	photo_booth_window_add_gtkgstwidget (priv->win, gtkgstwidget);
 	g_object_unref (gtkgstwidget);
 
+	if (priv->frame_timing)
+	{
+		GstPad *pad = gst_element_get_static_pad (pb->video_sink, "sink");
+		photo_booth_frame_timing_watch (priv->frame_timing, pad, FRAME_STAGE_SINK, FRAME_STAGE_FLIP);
+		gst_object_unref (pad);
+		g_signal_connect_after (gtkgstwidget, "draw", G_CALLBACK (photo_booth_video_drawn), pb);
+		if (priv->frame_timing_mode == FRAME_TIMING_HUD)
+			priv->hud_id = g_timeout_add (HUD_INTERVAL, (GSourceFunc) photo_booth_update_hud, pb);
+	}
+
 	gst_element_set_state (pb->pipeline, GST_STATE_PLAYING);
 	gst_element_set_state (pb->video_sink, GST_STATE_PLAYING);
 
@@ -1378,6 +2037,7 @@ static gboolean photo_booth_setup_gstreamer (PhotoBooth *pb)
 	/* add watch for messages */
 	bus = gst_pipeline_get_bus (GST_PIPELINE (pb->pipeline));
 	gst_bus_add_watch (bus, (GstBusFunc) photo_booth_bus_callback, pb);
+	gst_bus_set_sync_handler (bus, (GstBusSyncHandler) photo_booth_bus_sync_handler, pb, NULL);
 	gst_object_unref (GST_OBJECT (bus));
 
 	priv->audio_pipeline = gst_pipeline_new ("audio-pipeline");
@@ -1387,10 +2047,41 @@ static gboolean photo_booth_setup_gstreamer (PhotoBooth *pb)
 	return TRUE;
 }
 
-static gboolean photo_booth_bus_callback (G_GNUC_UNUSED GstBus *bus, GstMessage *message, PhotoBooth *pb)
+/* live view detections are handed to the masquerade in the detector's streaming thread,
+ * so the masks drawn into the preview never wait for the main loop */
+static GstBusSyncReply photo_booth_bus_sync_handler (G_GNUC_UNUSED GstBus *bus, GstMessage *message, PhotoBooth *pb)
 {
-	GstObject *src = GST_MESSAGE_SRC (message);
-	PhotoBoothPrivate *priv;
+	PhotoBoothPrivate *priv = photo_booth_get_instance_private (pb);
+	const GstStructure *structure;
+
+	if (GST_MESSAGE_TYPE (message) != GST_MESSAGE_ELEMENT || !g_str_has_prefix (GST_OBJECT_NAME (GST_MESSAGE_SRC (message)), "video"))
+		return GST_BUS_PASS;
+	structure = gst_message_get_structure (message);
+	if (!structure || strcmp (gst_structure_get_name (structure), "facedetect"))
+		return GST_BUS_PASS;
+
+	if (priv->do_masquerade && priv->masquerade)
+	{
+		GstStructure *new_s = gst_structure_copy (structure);
+		gst_structure_set (new_s, "state", G_TYPE_INT, priv->state, "is-video", G_TYPE_BOOLEAN, TRUE, "detect-scale", G_TYPE_DOUBLE, priv->facedetect_scale, NULL);
+		photo_booth_masquerade_facedetect_update (priv->masquerade, new_s);
+		gst_structure_free (new_s);
+	}
+	gst_message_unref (message);
+	return GST_BUS_DROP;
+}
+
+static void photo_booth_video_overlay_draw (G_GNUC_UNUSED GstElement *overlay, cairo_t *cr, guint64 timestamp, G_GNUC_UNUSED guint64 duration, PhotoBooth *pb)
+{
+	PhotoBoothPrivate *priv = photo_booth_get_instance_private (pb);
+	if (priv->do_masquerade && priv->masquerade)
+		photo_booth_masquerade_draw_live (priv->masquerade, cr, timestamp);
+}
+
+static gboolean photo_booth_bus_callback (G_GNUC_UNUSED GstBus *bus, GstMessage *message, PhotoBooth *pb)
+{
+	GstObject *src = GST_MESSAGE_SRC (message);
+	PhotoBoothPrivate *priv;
 	priv = photo_booth_get_instance_private (pb);
 	switch (GST_MESSAGE_TYPE (message))
 	{
@@ -1469,10 +2160,15 @@ static gboolean photo_booth_bus_callback (G_GNUC_UNUSED GstBus *bus, GstMessage
 			structure = gst_message_get_structure (message);
 			if (!structure || strcmp (gst_structure_get_name (structure), "facedetect"))
 				break;
+			// live view detections never get here, the sync handler took them already
 			gboolean is_video = g_str_has_prefix (GST_ELEMENT_NAME (src), "video");
+			// the photo is detected once per capture, its results belong to the capture even if the state machine moved on since
+			if (!is_video && (priv->state < PB_STATE_TAKING_PHOTO || priv->state > PB_STATE_MASQUERADE_PHOTO))
+				break;
 			GstStructure *new_s = gst_structure_copy (structure);
-			gst_structure_set (new_s, "state", G_TYPE_INT, priv->state, NULL);
+			gst_structure_set (new_s, "state", G_TYPE_INT, is_video ? priv->state : PB_STATE_TAKING_PHOTO, NULL);
 			gst_structure_set (new_s, "is-video", G_TYPE_BOOLEAN, is_video, NULL);
+			gst_structure_set (new_s, "detect-scale", G_TYPE_DOUBLE, is_video ? priv->facedetect_scale : priv->photo_facedetect_scale, NULL);
 			photo_booth_masquerade_facedetect_update (priv->masquerade, new_s);
 			gst_structure_free (new_s);
 // 			if (priv->state == PB_STATE_PREVIEW || priv->state == PB_STATE_COUNTDOWN) || priv->state == PB_STATE_PROCESS_PHOTO) &&  && strcmp (gst_structure_get_name (structure), "facedetect") && )
@@ -1494,8 +2190,6 @@ static gboolean photo_booth_video_widget_ready (PhotoBooth *pb)
 	GstVideoRectangle s1, s2, rect;
 	GstElement *element;
 	GstCaps *caps;
-	GdkPixbuf *overlay_pixbuf;
-	GError *error = NULL;
 
 	priv = photo_booth_get_instance_private (pb);
 	gtk_widget_get_preferred_size (priv->win->gtkgstwidget, NULL, &size);
@@ -1517,22 +2211,11 @@ static gboolean photo_booth_video_widget_ready (PhotoBooth *pb)
 	GST_DEBUG ("gtksink widget is ready. output dimensions: %dx%d", rect.w, rect.h);
 	priv->video_size = rect;
 
-	overlay_pixbuf = gdk_pixbuf_new_from_file_at_size (priv->overlay_image, rect.w, rect.h, &error);
-	if (error) {
-		GST_ERROR ("%s\n", error->message);
-		return FALSE;
-	}
-	if (gdk_pixbuf_get_width (overlay_pixbuf) != rect.w || gdk_pixbuf_get_height (overlay_pixbuf) != rect.h)
-	{
-		GST_DEBUG ("overlay_image original dimensions %dx%d. aspect mismatch -> we need to scale!", gdk_pixbuf_get_width (overlay_pixbuf), gdk_pixbuf_get_height (overlay_pixbuf));
-		overlay_pixbuf = gdk_pixbuf_scale_simple (overlay_pixbuf, rect.w, rect.h, GDK_INTERP_BILINEAR);
-	}
-	rect.x = (size2.width-gdk_pixbuf_get_width (overlay_pixbuf))/2;
-	rect.y = (size2.height-gdk_pixbuf_get_height (overlay_pixbuf))/2;
-	GST_DEBUG ("overlay_image's pixbuf dimensions %dx%d pos@%d,%d", gdk_pixbuf_get_width (overlay_pixbuf), gdk_pixbuf_get_height (overlay_pixbuf), rect.x, rect.y);
-	gtk_image_set_from_pixbuf (priv->win->image, overlay_pixbuf);
+	// the overlay covers the video exactly, it is put in place when it has been decoded
+	rect.x = (size2.width - rect.w) / 2;
+	rect.y = (size2.height - rect.h) / 2;
 	gtk_fixed_move (priv->win->fixed, GTK_WIDGET (priv->win->image), rect.x, 0);
-	g_object_unref (overlay_pixbuf);
+	photo_booth_show_overlay (pb);
 
 	if (priv->enable_facedetect >= FACEDETECT_ENABLEABLE && priv->masquerade == NULL) {
 		g_object_set_data (G_OBJECT (priv->win->fixed), "screen-offset-y", GINT_TO_POINTER (rect.y));
@@ -1546,6 +2229,7 @@ static gboolean photo_booth_video_widget_ready (PhotoBooth *pb)
 		gdouble yfactor = (gdouble) priv->video_size.h / priv->print_height;
 		GST_DEBUG ("initialize masquerade with container %" GST_PTR_FORMAT " print xfactor=%f yfactor=%f", priv->win->fixed, xfactor, yfactor);
 		priv->masquerade = photo_booth_masquerade_new ();
+		photo_booth_masquerade_set_cache_size (priv->masquerade, MAX (priv->masks_cache_size, 1));
 		photo_booth_masquerade_init_masks (priv->masquerade, priv->win->fixed, priv->masks_dir, priv->masks_json, xfactor);
 		photo_booth_window_init_masq_combobox (priv->win, priv->masquerade->store);
 	}
@@ -1553,6 +2237,42 @@ static gboolean photo_booth_video_widget_ready (PhotoBooth *pb)
 	return FALSE;
 }
 
+/* once both the overlay is decoded and the video's size is known */
+static void photo_booth_show_overlay (PhotoBooth *pb)
+{
+	PhotoBoothPrivate *priv = photo_booth_get_instance_private (pb);
+	GdkPixbuf *scaled;
+	if (!priv->overlay_pixbuf || priv->video_size.w <= 0 || priv->video_size.h <= 0)
+		return;
+	GST_DEBUG ("overlay_image original dimensions %dx%d, scaled to %dx%d", gdk_pixbuf_get_width (priv->overlay_pixbuf), gdk_pixbuf_get_height (priv->overlay_pixbuf), priv->video_size.w, priv->video_size.h);
+	scaled = gdk_pixbuf_scale_simple (priv->overlay_pixbuf, priv->video_size.w, priv->video_size.h, GDK_INTERP_BILINEAR);
+	gtk_image_set_from_pixbuf (priv->win->image, scaled);
+	g_object_unref (scaled);
+}
+
+/* the frame gtksink was handed last has made it onto the screen */
+static gboolean photo_booth_video_drawn (G_GNUC_UNUSED GtkWidget *widget, G_GNUC_UNUSED cairo_t *cr, PhotoBooth *pb)
+{
+	PhotoBoothPrivate *priv = photo_booth_get_instance_private (pb);
+	photo_booth_frame_timing_rendered (priv->frame_timing);
+	return FALSE;
+}
+
+static gboolean photo_booth_update_hud (PhotoBooth *pb)
+{
+	PhotoBoothPrivate *priv = photo_booth_get_instance_private (pb);
+	gchar *text;
+	if (priv->state != PB_STATE_PREVIEW && priv->state != PB_STATE_COUNTDOWN)
+	{
+		photo_booth_window_set_hud (priv->win, NULL);
+		return G_SOURCE_CONTINUE;
+	}
+	text = photo_booth_frame_timing_describe (priv->frame_timing);
+	photo_booth_window_set_hud (priv->win, text);
+	g_free (text);
+	return G_SOURCE_CONTINUE;
+}
+
 static gboolean photo_booth_preview (PhotoBooth *pb)
 {
 	PhotoBoothPrivate *priv = photo_booth_get_instance_private (pb);
@@ -1591,6 +2311,8 @@ static gboolean photo_booth_preview (PhotoBooth *pb)
 	}
 	int ret = gst_element_link (pb->video_bin, pb->video_sink);
 	GST_LOG ("linked video-bin ! video-sink ret=%i", ret);
+	if (priv->frame_timing)
+		photo_booth_frame_timing_reset (priv->frame_timing);
 	gst_element_set_state (pb->video_bin, GST_STATE_PLAYING);
 	int cooldown_delay = 2000;
 	if (priv->state == PB_STATE_NONE)
@@ -1625,6 +2347,9 @@ static gboolean photo_booth_preview_ready (PhotoBooth *pb)
 		return FALSE;
 	}
 	photo_booth_change_state (pb, PB_STATE_PREVIEW);
+	photo_booth_startup_ready (photo_booth_startup_get_default ());
+	// a still running upload keeps the session open until it is done
+	photo_booth_trace_end_session (photo_booth_trace_get_default ());
 	gtk_label_set_text (priv->win->status, _("Touch screen to take a photo!"));
 	if (priv->hide_cursor)
 		photo_booth_window_hide_cursor (priv->win);
@@ -1762,9 +2487,8 @@ void photo_booth_background_clicked (G_GNUC_UNUSED GtkWidget *widget, G_GNUC_UNU
 		case PB_STATE_PROCESS_PHOTO:
 		case PB_STATE_PRINTING:
 		{
-			GST_DEBUG ("BUSY... install watchdog timeout");
-			if (!priv->state_change_watchdog_timeout_id)
-				priv->state_change_watchdog_timeout_id = g_timeout_add_seconds (5, (GSourceFunc) photo_booth_watchdog_timedout, pb);
+			// a stall is picked up by the watchdog, whether or not the guest keeps tapping
+			GST_DEBUG ("BUSY... ignore");
 			_play_event_sound (priv, ERROR_SOUND);
 			break;
 		}
@@ -1835,41 +2559,56 @@ void photo_booth_masq_changed (GtkComboBox *widget, PhotoBoothWindow *win)
 	_restart_screensaver_timeout (pb);
 }
 
-static gboolean photo_booth_get_printer_status (PhotoBooth *pb)
+static void photo_booth_printer_status_free (PhotoBoothPrinterStatus *status)
+{
+	if (!status)
+		return;
+	g_free (status->label);
+	g_free (status);
+}
+
+/* runs the backend's status query, doesn't touch the ui so it can be called from any thread */
+static PhotoBoothPrinterStatus *photo_booth_probe_printer (PhotoBooth *pb, const gchar *backend)
 {
 	PhotoBoothPrivate *priv = photo_booth_get_instance_private (pb);
+	PhotoBoothPrinterStatus *status;
 	gchar *label_string;
-	gchar *backend_environment = g_strdup_printf ("BACKEND=%s", priv->printer_backend);
+	gchar *backend_environment = g_strdup_printf ("BACKEND=%s", backend);
 	gchar *argv[] = { priv->gutenprint_path, "-m", NULL };
 	gchar *envp[] = { backend_environment, NULL };
 	gchar *output = NULL;
 	GError *error = NULL;
 	gint remain = -1;
 	gint ret = 0;
+	gboolean online = TRUE;
 
-	if (!priv->printer_backend)
+	if (!backend)
 	{
 		label_string = g_strdup (_("No printer configured!"));
 	}
 	else if (g_spawn_sync (NULL, argv, envp, G_SPAWN_DEFAULT, NULL, NULL, NULL, &output, &ret, &error))
 	{
-		GMatchInfo *match_info;
+		GMatchInfo *match_info = NULL;
 		GRegex *regex;
 		if (ret == 0)
 		{
 			regex = g_regex_new ("INFO: Media type\\s.*?: (?<code>\\d+) \\((?<size>.*?)\\)\nINFO: Media remaining\\s.*?: (?<remain>\\d{3})/(?<total>\\d{3})\n", G_REGEX_MULTILINE|G_REGEX_DOTALL, 0, &error);
 			if (error) {
 				g_critical ("%s\n", error->message);
-				return FALSE;
+				g_error_free (error);
+				g_free (output);
+				g_free (backend_environment);
+				return NULL;
 			}
 			if (g_regex_match (regex, output, 0, &match_info))
 			{
-				guint code = atoi(g_match_info_fetch_named(match_info, "code"));
-				gchar *size = g_match_info_fetch_named(match_info, "size");
-				remain = atoi(g_match_info_fetch_named(match_info, "remain"));
-				guint total = atoi(g_match_info_fetch_named(match_info, "total"));
-				label_string = g_strdup_printf(_("Printer %s online. %i prints (%s) remaining"), priv->printer_backend, remain, size);
-				GST_INFO ("printer %s status: media code %i (%s) prints remaining %i of %i", priv->printer_backend, code, size, remain, total);
+				gint code = _match_int (match_info, "code");
+				gchar *size = g_match_info_fetch_named (match_info, "size");
+				gint total = _match_int (match_info, "total");
+				remain = _match_int (match_info, "remain");
+				label_string = g_strdup_printf(_("Printer %s online. %i prints (%s) remaining"), backend, remain, size);
+				GST_INFO ("printer %s status: media code %i (%s) prints remaining %i of %i", backend, code, size, remain, total);
+				g_free (size);
 			}
 			else {
 				label_string = g_strdup (_("Can't parse printer backend output"));
@@ -1881,8 +2620,9 @@ static gboolean photo_booth_get_printer_status (PhotoBooth *pb)
 			regex = g_regex_new ("ERROR: Printer open failure", G_REGEX_MULTILINE|G_REGEX_DOTALL, 0, &error);
 			if (g_regex_match (regex, output, 0, &match_info))
 			{
-				label_string = g_strdup_printf(_("Printer %s off-line"), priv->printer_backend);
+				label_string = g_strdup_printf(_("Printer %s off-line"), backend);
 				GST_WARNING ("%s", label_string);
+				online = FALSE;
 			}
 			else {
 				label_string = g_strdup (_("can't parse printer backend output"));
@@ -1898,13 +2638,144 @@ static gboolean photo_booth_get_printer_status (PhotoBooth *pb)
 		GST_ERROR ("%s  %s %s (%s)", label_string, argv[1], envp[0], error->message);
 		g_error_free (error);
 	}
-	priv->prints_remaining = remain;
-	gtk_label_set_text (priv->win->status_printer, label_string);
-	g_free (label_string);
 	g_free (backend_environment);
+	status = g_new (PhotoBoothPrinterStatus, 1);
+	status->label = label_string;
+	status->remain = remain;
+	status->online = online;
+	return status;
+}
+
+/* the status of every printer in the order they were configured, or the one "not configured" */
+static GPtrArray *photo_booth_probe_printers (PhotoBooth *pb)
+{
+	PhotoBoothPrivate *priv = photo_booth_get_instance_private (pb);
+	GPtrArray *statuses = g_ptr_array_new_with_free_func ((GDestroyNotify) photo_booth_printer_status_free);
+	guint i;
+	if (!priv->printer_backends)
+		g_ptr_array_add (statuses, photo_booth_probe_printer (pb, NULL));
+	for (i = 0; priv->printer_backends && priv->printer_backends[i]; i++)
+		g_ptr_array_add (statuses, photo_booth_probe_printer (pb, priv->printer_backends[i]));
+	return statuses;
+}
+
+static void photo_booth_printer_status_apply (GPtrArray *statuses, PhotoBooth *pb)
+{
+	PhotoBoothPrivate *priv = photo_booth_get_instance_private (pb);
+	GPtrArray *printers = photo_booth_print_queue_get_printers (priv->print_queue);
+	GString *label = g_string_new (NULL);
+	gint remain = -1;
+	guint i;
+
+	for (i = 0; i < statuses->len; i++)
+	{
+		PhotoBoothPrinterStatus *status = g_ptr_array_index (statuses, i);
+		if (!status)
+			continue;
+		if (priv->printer_backends && i < printers->len)
+			photo_booth_print_queue_set_status (priv->print_queue, g_ptr_array_index (printers, i), status->online, status->remain);
+		// what all the printers that can print have left together
+		if (status->online && status->remain >= 0)
+			remain = MAX (remain, 0) + status->remain;
+		g_string_append_printf (label, "%s%s", label->len ? "\n" : "", status->label);
+	}
+	priv->prints_remaining = remain;
+	photo_booth_metrics_gauge_set (photo_booth_metrics_get_default (), "photobooth_prints_remaining", NULL, remain);
+	g_free (priv->printer_status);
+	priv->printer_status = g_string_free (label, FALSE);
+	photo_booth_show_printer_status (pb);
+	g_ptr_array_unref (statuses);
+	if (priv->printer_probe_again)
+	{
+		priv->printer_probe_again = FALSE;
+		photo_booth_get_printer_status (pb);
+	}
+}
+
+/* the last status the backend reported, how many prints are waiting for the printer and the last failed job */
+static void photo_booth_show_printer_status (PhotoBooth *pb)
+{
+	PhotoBoothPrivate *priv = photo_booth_get_instance_private (pb);
+	guint depth = photo_booth_print_queue_get_depth (priv->print_queue);
+	gchar *label;
+	if (!priv->win)
+		return;
+	if (depth)
+		label = g_strdup_printf (_("%s, %u print jobs queued"), priv->printer_status ? priv->printer_status : "", depth);
+	else
+		label = g_strdup (priv->printer_status ? priv->printer_status : "");
+	if (priv->print_failure)
+	{
+		gchar *with_failure = g_strdup_printf ("%s\n%s", label, priv->print_failure);
+		g_free (label);
+		label = with_failure;
+	}
+	gtk_label_set_text (priv->win->status_printer, label);
+	g_free (label);
+}
+
+static gboolean photo_booth_printer_probe_done (PhotoBooth *pb)
+{
+	PhotoBoothPrivate *priv = photo_booth_get_instance_private (pb);
+	GPtrArray *statuses = priv->printer_probe_result;
+	priv->printer_probe_result = NULL;
+	if (!priv->printer_probe_thread)
+	{
+		// joined by dispose, the booth is going away
+		if (statuses)
+			g_ptr_array_unref (statuses);
+		return G_SOURCE_REMOVE;
+	}
+	g_thread_join (priv->printer_probe_thread);
+	priv->printer_probe_thread = NULL;
+	photo_booth_printer_status_apply (statuses, pb);
+	return G_SOURCE_REMOVE;
+}
+
+static gpointer photo_booth_printer_probe_thread_func (PhotoBooth *pb)
+{
+	PhotoBoothPrivate *priv = photo_booth_get_instance_private (pb);
+	priv->printer_probe_result = photo_booth_probe_printers (pb);
+	g_main_context_invoke (NULL, (GSourceFunc) photo_booth_printer_probe_done, pb);
+	return NULL;
+}
+
+/* gutenprint takes seconds per printer and longer for one that is off-line, so the backends are
+ * asked in a thread and the status is applied in the main loop. a request while a probe is
+ * running, this one or the startup's that hasn't reported yet, makes one more probe after it
+ * instead of a second one alongside */
+static gboolean photo_booth_get_printer_status (PhotoBooth *pb)
+{
+	PhotoBoothPrivate *priv = photo_booth_get_instance_private (pb);
+	if (priv->printer_probe_thread || (priv->printer_backends && !priv->printer_status))
+	{
+		priv->printer_probe_again = TRUE;
+		return FALSE;
+	}
+	if (priv->printer_backends)
+		priv->printer_probe_thread = g_thread_try_new ("printer-status", (GThreadFunc) photo_booth_printer_probe_thread_func, pb, NULL);
+	if (!priv->printer_probe_thread)
+	{
+		if (priv->printer_backends)
+			GST_WARNING ("can't start a thread for the printer status, asking the printers in place");
+		photo_booth_printer_status_apply (photo_booth_probe_printers (pb), pb);
+	}
 	return FALSE;
 }
 
+/* while prints are waiting the printers are asked regularly, so one that is back on-line gets jobs again */
+static gboolean photo_booth_poll_printers (PhotoBooth *pb)
+{
+	PhotoBoothPrivate *priv = photo_booth_get_instance_private (pb);
+	if (photo_booth_print_queue_get_depth (priv->print_queue))
+	{
+		photo_booth_get_printer_status (pb);
+		return G_SOURCE_CONTINUE;
+	}
+	priv->printer_poll_id = 0;
+	return G_SOURCE_REMOVE;
+}
+
 static void photo_booth_snapshot_start (PhotoBooth *pb)
 {
 	PhotoBoothPrivate *priv;
@@ -1912,6 +2783,7 @@ static void photo_booth_snapshot_start (PhotoBooth *pb)
 	guint snapshot_delay   = 2;
 
 	priv = photo_booth_get_instance_private (pb);
+	photo_booth_trace_begin_session (photo_booth_trace_get_default ());
 	photo_booth_change_state (pb, PB_STATE_COUNTDOWN);
 	photo_booth_window_start_countdown (priv->win, priv->countdown);
 	gtk_widget_hide (GTK_WIDGET (priv->win->toggle_flip));
@@ -1944,6 +2816,7 @@ static gboolean photo_booth_snapshot_prepare (PhotoBooth *pb)
 	photo_booth_change_state (pb, PB_STATE_TAKING_PHOTO);
 
 	priv = photo_booth_get_instance_private (pb);
+	g_atomic_int_set (&priv->photo_detect_pending, TRUE);
 	photo_booth_window_set_spinner (priv->win, TRUE);
 
 	SEND_COMMAND (pb, CONTROL_PRETRIGGER);
@@ -1967,94 +2840,57 @@ static gboolean photo_booth_snapshot_trigger (PhotoBooth *pb)
 		photo_booth_masquerade_facedetect_update (priv->masquerade, NULL); // hide all masks
 
 	SEND_COMMAND (pb, CONTROL_PHOTO);
+	photo_booth_trace_mark (photo_booth_trace_get_default (), "control_photo_sent");
 
 	GST_DEBUG ("preparing for snapshot...");
 
 	return FALSE;
 }
 
-extern int camera_auto_focus (Camera *list, GPContext *context, int onoff);
-
-static gboolean photo_booth_focus (CameraInfo *cam_info)
-{
-	int gpret;
-	CameraEventType evttype;
-	void *evtdata;
-
-
-	do {
-		g_mutex_lock (&cam_info->mutex);
-		gpret = gp_camera_wait_for_event (cam_info->camera, 10, &evttype, &evtdata, cam_info->context);
-		g_mutex_unlock (&cam_info->mutex);
-		GST_DEBUG ("gp_camera_wait_for_event gpret=%i", gpret);
-	} while ((gpret == GP_OK) && (evttype != GP_EVENT_TIMEOUT));
-
-	g_mutex_lock (&cam_info->mutex);
-	gpret = camera_auto_focus (cam_info->camera, cam_info->context, 1);
-	g_mutex_unlock (&cam_info->mutex);
-	if (gpret != GP_OK) {
-		GST_WARNING ("gphoto error: %s\n", gp_result_as_string(gpret));
-		return FALSE;
-	}
-
-	do {
-		GST_DEBUG ("gp_camera_wait_for_event gpret=%i", gpret);
-		g_mutex_lock (&cam_info->mutex);
-		gpret = gp_camera_wait_for_event (cam_info->camera, 10, &evttype, &evtdata, cam_info->context);
-		g_mutex_unlock (&cam_info->mutex);
-	} while ((gpret == GP_OK) && (evttype != GP_EVENT_TIMEOUT));
-
-	g_mutex_lock (&cam_info->mutex);
-	gpret = camera_auto_focus (cam_info->camera, cam_info->context, 0);
-	g_mutex_unlock (&cam_info->mutex);
-	if (gpret != GP_OK) {
-		GST_WARNING ("gphoto error: %s\n", gp_result_as_string(gpret));
-	}
-	return TRUE;
-}
-
 static gboolean photo_booth_take_photo (PhotoBooth *pb)
 {
-	int gpret;
-	CameraFile *file;
-	CameraFilePath camera_file_path;
 	PhotoBoothPrivate *priv = photo_booth_get_instance_private (pb);
+	int gpret;
+	gint64 start = g_get_monotonic_time (), captured;
 
 	g_mutex_lock (&pb->cam_info->mutex);
-	gpret = gp_camera_capture (pb->cam_info->camera, GP_CAPTURE_IMAGE, &camera_file_path, pb->cam_info->context);
-	GST_DEBUG ("gp_camera_capture gpret=%i Pathname on the camera: %s/%s", gpret, camera_file_path.folder, camera_file_path.name);
-	if (gpret < 0)
-		goto fail;
-
-	gpret = gp_file_new (&file);
-	GST_DEBUG ("gp_file_new gpret=%i", gpret);
-
-	gpret = gp_camera_file_get (pb->cam_info->camera, camera_file_path.folder, camera_file_path.name, GP_FILE_TYPE_NORMAL, file, pb->cam_info->context);
-	GST_DEBUG ("gp_camera_file_get gpret=%i", gpret);
+	photo_booth_watchdog_arm_timeout (priv->watchdog, WATCHDOG_CAMERA, "capture", priv->capture_timeout * 1000);
+	gpret = photo_booth_camera_capture (pb->cam_info->camera);
 	if (gpret < 0)
 		goto fail;
-	gp_file_get_data_and_size (file, (const char**)&(pb->cam_info->data), &(pb->cam_info->size));
+	photo_booth_watchdog_feed (priv->watchdog, WATCHDOG_CAMERA, "capture");
+	photo_booth_trace_mark (photo_booth_trace_get_default (), "capture_returned");
+	captured = g_get_monotonic_time ();
+	photo_booth_metrics_histogram_observe (photo_booth_metrics_get_default (), "photobooth_capture_seconds", NULL, (gdouble) (captured - start) / G_USEC_PER_SEC);
+
+	photo_booth_watchdog_arm_timeout (priv->watchdog, WATCHDOG_CAMERA, "download", priv->capture_timeout * 1000);
+	photo_booth_memory_untrack (photo_booth_memory_get_default (), pb->cam_info->data);
+	g_free (pb->cam_info->data);
+	pb->cam_info->data = NULL;
+	gpret = photo_booth_camera_download (pb->cam_info->camera, &pb->cam_info->data, &pb->cam_info->size);
 	if (gpret < 0)
 		goto fail;
-
-	if (!priv->cam_keep_files)
-	{
-		gpret = gp_camera_file_delete (pb->cam_info->camera, camera_file_path.folder, camera_file_path.name, pb->cam_info->context);
-		GST_DEBUG ("gp_camera_file_delete gpret=%i", gpret);
-	}
+	photo_booth_memory_track (photo_booth_memory_get_default (), MEMORY_CAPTURE, pb->cam_info->data, pb->cam_info->size);
+	photo_booth_watchdog_feed (priv->watchdog, WATCHDOG_CAMERA, "download");
+	photo_booth_trace_mark (photo_booth_trace_get_default (), "file_downloaded");
+	photo_booth_metrics_histogram_observe (photo_booth_metrics_get_default (), "photobooth_download_seconds", NULL, (gdouble) (g_get_monotonic_time () - captured) / G_USEC_PER_SEC);
 
 	if (pb->cam_info->size <= 0)
 		goto fail;
 
+	photo_booth_watchdog_disarm (priv->watchdog, WATCHDOG_CAMERA);
 	g_mutex_unlock (&pb->cam_info->mutex);
 	return TRUE;
 
 fail:
+	photo_booth_watchdog_disarm (priv->watchdog, WATCHDOG_CAMERA);
+	GST_WARNING ("taking photo failed: %s", gp_result_as_string (gpret));
+	photo_booth_metrics_counter_add (photo_booth_metrics_get_default (), "photobooth_capture_errors_total", NULL, 1);
 	g_mutex_unlock (&pb->cam_info->mutex);
 	return FALSE;
 }
 
-static gboolean photo_booth_push_photo_buffer (gpointer user_data)
+gboolean photo_booth_push_photo_buffer (gpointer user_data)
 {
 	PhotoBooth *pb = PHOTO_BOOTH (user_data);
 	GstElement *appsrc;
@@ -2063,7 +2899,8 @@ static gboolean photo_booth_push_photo_buffer (gpointer user_data)
 	PhotoBoothPrivate *priv = photo_booth_get_instance_private (pb);
 
 	appsrc = gst_bin_get_by_name (GST_BIN (pb->photo_bin), "photo-appsrc");
-	buffer = gst_buffer_new_wrapped (pb->cam_info->data, pb->cam_info->size);
+	// the same photo is pushed for every pass through the photo-bin, so it stays with cam_info
+	buffer = gst_buffer_new_wrapped_full (GST_MEMORY_FLAG_READONLY, pb->cam_info->data, pb->cam_info->size, 0, pb->cam_info->size, NULL, NULL);
 	g_signal_emit_by_name (appsrc, "push-buffer", buffer, &flowret);
 	GST_DEBUG_OBJECT (appsrc, "PUSHING %" GST_PTR_FORMAT " to appsrc", buffer);
 
@@ -2098,9 +2935,11 @@ static gboolean photo_booth_snapshot_taken (PhotoBooth *pb)
 	gst_element_set_state (pb->photo_bin, GST_STATE_PLAYING);
 
 	priv->photos_taken++;
+	photo_booth_metrics_counter_add (photo_booth_metrics_get_default (), "photobooth_photos_taken_total", NULL, 1);
 	GST_DEBUG ("photo_booth_snapshot_taken size=%lu photos_taken=%i", pb->cam_info->size, priv->photos_taken);
 	gtk_label_set_text (priv->win->status, _("Processing photo..."));
 
+	photo_booth_watchdog_arm (priv->watchdog, WATCHDOG_PHOTO, "photo-appsrc");
 	photo_booth_push_photo_buffer (pb);
 
 	gst_element_set_state (pb->photo_bin, GST_STATE_PLAYING);
@@ -2135,10 +2974,12 @@ static GstPadProbeReturn photo_booth_catch_photo_buffer (G_GNUC_UNUSED GstPad *
 
 	GST_DEBUG ("probe function in state %s... locking payload: %" GST_PTR_FORMAT, photo_booth_state_get_name (priv->state), gst_pad_probe_info_get_buffer (info));
 	g_mutex_lock (&priv->processing_mutex);
+	photo_booth_watchdog_feed (priv->watchdog, WATCHDOG_PHOTO, "photo-bin");
 	switch (priv->state) {
 		case PB_STATE_TAKING_PHOTO:
 		{
 			GST_DEBUG ("PB_STATE_TAKING_PHOTO first buffer caught -> display in sink");
+			photo_booth_trace_mark (photo_booth_trace_get_default (), "photo_displayed");
 			if (priv->print_copies_max) {
 				gtk_widget_show (GTK_WIDGET (priv->win->button_print));
 			}
@@ -2154,6 +2995,8 @@ static GstPadProbeReturn photo_booth_catch_photo_buffer (G_GNUC_UNUSED GstPad *
 
 			if (priv->do_masquerade && priv->enable_repositioning) {
 				photo_booth_change_state (pb, PB_STATE_MASQUERADE_PHOTO);
+				// the guest takes as long as they like
+				photo_booth_watchdog_disarm (priv->watchdog, WATCHDOG_PHOTO);
 				GST_DEBUG ("waiting for user to place masks");
 			} else {
 				photo_booth_change_state (pb, PB_STATE_PROCESS_PHOTO);
@@ -2184,18 +3027,19 @@ static GstPadProbeReturn photo_booth_catch_photo_buffer (G_GNUC_UNUSED GstPad *
 		}
 		case PB_STATE_ASK_PRINT:
 		{
+			photo_booth_watchdog_disarm (priv->watchdog, WATCHDOG_PHOTO);
 			g_main_context_invoke (NULL, (GSourceFunc) photo_booth_process_photo_remove_elements, pb);
 			if (priv->do_masquerade && priv->enable_repositioning) {
 				GST_DEBUG ("third buffer caught -> okay this is enough, remove processing elements and probe and open print dialoge");
 				g_main_context_invoke (NULL, (GSourceFunc) photo_booth_print, pb);
-				photo_booth_masquerade_clear_mask_bin (priv->masquerade, priv->mask_bin);
+				photo_booth_masquerade_clear_overlays (priv->masquerade, priv->photo_compositor);
 			} else {
 				GST_DEBUG ("third buffer caught -> okay this is enough, remove processing elements and probe");
 			}
 			if (priv->cam_reeinit_after_snapshot)
 				SEND_COMMAND (pb, CONTROL_REINIT);
 			if (priv->do_linx_upload == UPLOAD_ALL) {
-				priv->linx_upload_thread = g_thread_try_new ("upload_linx", (GThreadFunc) photo_booth_linx_post_thread_func, pb, NULL);
+				photo_booth_spawn_worker (pb, &priv->linx_upload_thread, "upload_linx", (GThreadFunc) photo_booth_linx_post_thread_func);
 			}
 			ret = GST_PAD_PROBE_REMOVE;
 			break;
@@ -2211,24 +3055,11 @@ static GstPadProbeReturn photo_booth_catch_photo_buffer (G_GNUC_UNUSED GstPad *
 static gboolean photo_booth_process_photo_plug_elements (PhotoBooth *pb)
 {
 	PhotoBoothPrivate *priv;
-	GstElement *tee, *encoder, *filesink, *lcms, *appsink, *qr_overlay;
+	GstElement *qr_overlay;
 	priv = photo_booth_get_instance_private (pb);
 
 	GST_DEBUG ("plugging photo processing elements. locking...");
 	g_mutex_lock (&priv->processing_mutex);
-	tee = gst_bin_get_by_name (GST_BIN (pb->photo_bin), "photo-tee");
-
-	encoder = gst_element_factory_make ("jpegenc", "photo-encoder");
-	filesink = gst_element_factory_make ("filesink", "photo-filesink");
-	if (!encoder || !filesink)
-		GST_ERROR_OBJECT (pb->photo_bin, "Failed to make photo encoder");
-	g_mutex_lock (&priv->upload_mutex);
-	priv->save_filename_count++;
-	gchar *filename = g_strdup_printf (priv->save_path_template, priv->save_filename_count);
-	GST_INFO_OBJECT (pb->photo_bin, "saving photo to '%s'", filename);
-	g_mutex_unlock (&priv->upload_mutex);
-	g_object_set (filesink, "location", filename, NULL);
-	g_free (filename);
 
 	qr_overlay = gst_bin_get_by_name (GST_BIN (pb->photo_bin), "qr-overlay");
 	if (qr_overlay && priv->do_linx_upload)
@@ -2243,17 +3074,61 @@ static gboolean photo_booth_process_photo_plug_elements (PhotoBooth *pb)
 		g_free (uri);
 	}
 
+	photo_booth_photo_bin_plug_outputs (pb);
+	priv->processing_start = g_get_monotonic_time ();
+	photo_booth_watchdog_arm (priv->watchdog, WATCHDOG_PHOTO, "photo-appsrc");
+
+	if (priv->do_masquerade) {
+		photo_booth_masquerade_create_overlays (priv->masquerade, priv->photo_compositor);
+	}
+
+	gst_element_set_state (pb->photo_bin, GST_STATE_PLAYING);
+
+	GST_DEBUG_BIN_TO_DOT_FILE_WITH_TS (GST_BIN (pb->pipeline), GST_DEBUG_GRAPH_SHOW_ALL, "photo_booth_process_photo_plug_elements");
+
+	photo_booth_push_photo_buffer (pb);
+
+	g_mutex_unlock (&priv->processing_mutex);
+	GST_DEBUG ("plugged photo processing elements and unlocked.");
+	return FALSE;
+}
+
+/* tee ! jpegenc ! filesink for the saved photo and tee ! lcms ! appsink for the print buffer.
+ * called with the processing lock held */
+void photo_booth_photo_bin_plug_outputs (PhotoBooth *pb)
+{
+	PhotoBoothPrivate *priv;
+	GstElement *tee, *encoder, *filesink, *lcms, *appsink;
+	priv = photo_booth_get_instance_private (pb);
+
+	encoder = gst_element_factory_make ("jpegenc", "photo-encoder");
+	filesink = gst_element_factory_make ("filesink", "photo-filesink");
+	if (!encoder || !filesink)
+		GST_ERROR_OBJECT (pb->photo_bin, "Failed to make photo encoder");
+	g_mutex_lock (&priv->files_mutex);
+	priv->save_filename_count++;
+	gchar *filename = g_strdup_printf (priv->save_path_template, priv->save_filename_count);
+	GST_INFO_OBJECT (pb->photo_bin, "saving photo to '%s'", filename);
+	g_mutex_unlock (&priv->files_mutex);
+	g_object_set (filesink, "location", filename, NULL);
+	g_free (filename);
+
 	gst_bin_add_many (GST_BIN (pb->photo_bin), encoder, filesink, NULL);
+	photo_booth_memory_track_object (photo_booth_memory_get_default (), MEMORY_PHOTO_BIN, encoder, 0);
+	photo_booth_memory_track_object (photo_booth_memory_get_default (), MEMORY_PHOTO_BIN, filesink, 0);
+	photo_booth_watch_photo_element (pb, encoder);
 	tee = gst_bin_get_by_name (GST_BIN (pb->photo_bin), "photo-tee");
 	if (!gst_element_link_many (tee, encoder, filesink, NULL))
 		GST_ERROR_OBJECT (pb->photo_bin, "couldn't link photobin filewrite elements!");
 
+	// lcms stays in the bin between photos, either way there is one ref to drop at the end
 	lcms = gst_bin_get_by_name (GST_BIN (pb->photo_bin), "print-lcms");
 	if (!lcms)
 	{
 		lcms = gst_element_factory_make ("lcms", "print-lcms");
 		if (lcms)
 		{
+			gst_object_ref (lcms);
 			g_object_set (G_OBJECT (lcms), "intent", 0, NULL);
 			g_object_set (G_OBJECT (lcms), "lookup", 2, NULL);
 			if (priv->cam_icc_profile)
@@ -2262,6 +3137,7 @@ static gboolean photo_booth_process_photo_plug_elements (PhotoBooth *pb)
 				g_object_set (G_OBJECT (lcms), "dest-profile", priv->print_icc_profile, NULL);
 			g_object_set (G_OBJECT (lcms), "preserve-black", TRUE, NULL);
 			gst_bin_add (GST_BIN (pb->photo_bin), lcms);
+			photo_booth_watch_photo_element (pb, lcms);
 		}
 		else
 			GST_WARNING_OBJECT (pb->photo_bin, "no lcms pluing found, ICC color correction unavailable!");
@@ -2272,6 +3148,7 @@ static gboolean photo_booth_process_photo_plug_elements (PhotoBooth *pb)
 		GST_ERROR_OBJECT (pb->photo_bin, "Failed to make photo print processing element(s): %s", appsink?"":" appsink");
 
 	gst_bin_add (GST_BIN (pb->photo_bin), appsink);
+	photo_booth_memory_track_object (photo_booth_memory_get_default (), MEMORY_PHOTO_BIN, appsink, 0);
 	if (lcms)
 	{
 		if (!gst_element_link_many (tee, lcms, appsink, NULL))
@@ -2286,21 +3163,9 @@ static gboolean photo_booth_process_photo_plug_elements (PhotoBooth *pb)
 	g_object_set (G_OBJECT (appsink), "enable-last-sample", FALSE, NULL);
 	g_signal_connect (appsink, "new-sample", G_CALLBACK (photo_booth_catch_print_buffer), pb);
 
+	if (lcms)
+		gst_object_unref (lcms);
 	gst_object_unref (tee);
-
-	if (priv->do_masquerade) {
-		photo_booth_masquerade_create_overlays (priv->masquerade, priv->mask_bin);
-	}
-
-	gst_element_set_state (pb->photo_bin, GST_STATE_PLAYING);
-
-	GST_DEBUG_BIN_TO_DOT_FILE_WITH_TS (GST_BIN (pb->pipeline), GST_DEBUG_GRAPH_SHOW_ALL, "photo_booth_process_photo_plug_elements");
-
-	photo_booth_push_photo_buffer (pb);
-
-	g_mutex_unlock (&priv->processing_mutex);
-	GST_DEBUG ("plugged photo processing elements and unlocked.");
-	return FALSE;
 }
 
 static GstFlowReturn photo_booth_catch_print_buffer (GstElement * appsink, gpointer user_data)
@@ -2314,12 +3179,27 @@ static GstFlowReturn photo_booth_catch_print_buffer (GstElement * appsink, gpoin
 	priv = photo_booth_get_instance_private (pb);
 	g_mutex_lock (&priv->processing_mutex);
 	sample = gst_app_sink_pull_sample (GST_APP_SINK (appsink));
+	if (priv->print_buffer)
+	{
+		photo_booth_memory_untrack (photo_booth_memory_get_default (), priv->print_buffer);
+		gst_buffer_unref (priv->print_buffer);
+	}
 	priv->print_buffer = gst_buffer_ref (gst_sample_get_buffer (sample));
+	photo_booth_memory_track (photo_booth_memory_get_default (), MEMORY_PRINT, priv->print_buffer, gst_buffer_get_size (priv->print_buffer));
+	photo_booth_trace_mark (photo_booth_trace_get_default (), "print_buffer_caught");
+	if (priv->watchdog)
+		photo_booth_watchdog_feed (priv->watchdog, WATCHDOG_PHOTO, "print-appsink");
+	if (priv->processing_start)
+	{
+		photo_booth_metrics_histogram_observe (photo_booth_metrics_get_default (), "photobooth_processing_seconds", NULL, (gdouble) (g_get_monotonic_time () - priv->processing_start) / G_USEC_PER_SEC);
+		priv->processing_start = 0;
+	}
 
 	pad = gst_element_get_static_pad (appsink, "sink");
 	GstCaps *caps = gst_pad_get_current_caps (pad);
 	GST_DEBUG ("got photo for printer: %" GST_PTR_FORMAT ". caps = %" GST_PTR_FORMAT "", priv->print_buffer, caps);
 	gst_caps_unref (caps);
+	gst_object_unref (pad);
 	gst_sample_unref (sample);
 	g_mutex_unlock (&priv->processing_mutex);
 	return GST_FLOW_OK;
@@ -2328,13 +3208,29 @@ static GstFlowReturn photo_booth_catch_print_buffer (GstElement * appsink, gpoin
 static gboolean photo_booth_process_photo_remove_elements (PhotoBooth *pb)
 {
 	PhotoBoothPrivate *priv;
-	GstElement *tee, *encoder, *filesink, *appsink, *lcms;
 	priv = photo_booth_get_instance_private (pb);
 
 	GST_DEBUG ("remove output file encoder and writer elements and pause. locking...");
 	g_mutex_lock (&priv->processing_mutex);
 
 	gst_element_set_state (pb->photo_bin, GST_STATE_READY);
+	photo_booth_photo_bin_unplug_outputs (pb);
+	photo_booth_watchdog_disarm (priv->watchdog, WATCHDOG_PHOTO);
+
+	priv->photo_block_id = 0;
+
+	g_mutex_unlock (&priv->processing_mutex);
+	gtk_widget_hide (GTK_WIDGET (priv->win->image));
+	gtk_widget_show (GTK_WIDGET (priv->win->gtkgstwidget));
+	GST_DEBUG ("removed output file encoder and writer elements and paused and unlocked.");
+	return FALSE;
+}
+
+/* counterpart of photo_booth_photo_bin_plug_outputs, the photo-bin must not be playing */
+void photo_booth_photo_bin_unplug_outputs (PhotoBooth *pb)
+{
+	GstElement *tee, *encoder, *filesink, *appsink, *lcms;
+
 	tee = gst_bin_get_by_name (GST_BIN (pb->photo_bin), "photo-tee");
 	encoder = gst_bin_get_by_name (GST_BIN (pb->photo_bin), "photo-encoder");
 	filesink = gst_bin_get_by_name (GST_BIN (pb->photo_bin), "photo-filesink");
@@ -2345,6 +3241,8 @@ static gboolean photo_booth_process_photo_remove_elements (PhotoBooth *pb)
 		gst_element_set_state (encoder, GST_STATE_NULL);
 		gst_object_unref (encoder);
 		gst_object_unref (filesink);
+		// the file is only complete once the sink has closed it
+		photo_booth_trace_mark (photo_booth_trace_get_default (), "jpeg_written");
 	}
 
 	appsink = gst_bin_get_by_name (GST_BIN (pb->photo_bin), "print-appsink");
@@ -2358,24 +3256,19 @@ static gboolean photo_booth_process_photo_remove_elements (PhotoBooth *pb)
 		}
 		gst_bin_remove (GST_BIN (pb->photo_bin), appsink);
 		gst_element_set_state (appsink, GST_STATE_NULL);
+		gst_object_unref (appsink);
+		if (lcms)
+			gst_object_unref (lcms);
 	}
 
 	gst_object_unref (tee);
-
-	priv->photo_block_id = 0;
-
-	g_mutex_unlock (&priv->processing_mutex);
-	gtk_widget_hide (GTK_WIDGET (priv->win->image));
-	gtk_widget_show (GTK_WIDGET (priv->win->gtkgstwidget));
-	GST_DEBUG ("removed output file encoder and writer elements and paused and unlocked.");
-	return FALSE;
 }
 
 static void photo_booth_ask_for_publishing (PhotoBooth *pb)
 {
 	PhotoBoothPrivate *priv;
 	priv = photo_booth_get_instance_private (pb);
-	if (priv->do_save_photos == SAVE_ASK || (priv->imgur_album_id && priv->imgur_access_token) || priv->facebook_put_uri)
+	if (priv->do_save_photos == SAVE_ASK || photo_booth_publisher_get_n_targets (priv->publisher))
 	{
 		gtk_widget_show (GTK_WIDGET (priv->win->button_publish));
 		g_timeout_add_seconds (priv->upload_timeout, (GSourceFunc) photo_booth_publish_timedout, pb);
@@ -2398,7 +3291,7 @@ void photo_booth_button_print_clicked (G_GNUC_UNUSED GtkButton *button, PhotoBoo
 	{
 		_play_event_sound (priv, ACK_SOUND);
 		if (priv->linx_put_uri && (priv->do_linx_upload == UPLOAD_PRINTED || priv->do_linx_upload == UPLOAD_ASK)) {
-			priv->linx_upload_thread = g_thread_try_new ("upload_linx", (GThreadFunc) photo_booth_linx_post_thread_func, pb, NULL);
+			photo_booth_spawn_worker (pb, &priv->linx_upload_thread, "upload_linx", (GThreadFunc) photo_booth_linx_post_thread_func);
 		}
 		photo_booth_print (pb);
 	}
@@ -2419,7 +3312,7 @@ void photo_booth_button_upload_clicked (G_GNUC_UNUSED GtkButton *button, PhotoBo
 		_play_event_sound (priv, ACK_SOUND);
 		photo_booth_window_set_spinner (priv->win, TRUE);
 		gtk_label_set_text (priv->win->status, _("Uploading..."));
-		priv->linx_upload_thread = g_thread_try_new ("upload_linx", (GThreadFunc) photo_booth_linx_post_thread_func, pb, NULL);
+		photo_booth_spawn_worker (pb, &priv->linx_upload_thread, "upload_linx", (GThreadFunc) photo_booth_linx_post_thread_func);
 		photo_booth_ask_for_publishing (pb);
 	}
 }
@@ -2436,7 +3329,7 @@ void photo_booth_button_publish_clicked (G_GNUC_UNUSED GtkButton *button, PhotoB
 		photo_booth_window_set_spinner (priv->win, TRUE);
 		gtk_label_set_text (priv->win->status, _("Publishing..."));
 		gtk_widget_hide (GTK_WIDGET (priv->win->button_publish));
-		priv->publish_thread = g_thread_try_new ("publish", (GThreadFunc) photo_booth_public_post_thread_func, pb, NULL);
+		photo_booth_spawn_worker (pb, &priv->publish_thread, "publish", (GThreadFunc) photo_booth_public_post_thread_func);
 		photo_booth_cancel (pb);
 	}
 }
@@ -2448,6 +3341,7 @@ void photo_booth_button_cancel_clicked (GtkButton *button, PhotoBoothWindow *win
 	priv = photo_booth_get_instance_private (pb);
 	GST_DEBUG_OBJECT (button, "photo_booth_button_cancel_clicked");
 	priv->curl_cancelled = TRUE;
+	photo_booth_publisher_cancel (priv->publisher);
 	_play_event_sound (photo_booth_get_instance_private (pb), ACK_SOUND);
 	if (priv->do_save_photos < SAVE_ALL) {
 		photo_booth_delete_file (pb);
@@ -2460,6 +3354,7 @@ void photo_booth_cancel (PhotoBooth *pb)
 	PhotoBoothPrivate *priv;
 	priv = photo_booth_get_instance_private (pb);
 	GST_INFO ("cancelled in state %s", photo_booth_state_get_name (priv->state));
+	photo_booth_watchdog_disarm (priv->watchdog, WATCHDOG_PHOTO);
 	switch (priv->state) {
 		case PB_STATE_PROCESS_PHOTO:
 			photo_booth_process_photo_remove_elements (pb);
@@ -2501,7 +3396,7 @@ static gboolean photo_booth_print (gpointer user_data)
 	PhotoBoothPrivate *priv;
 	priv = photo_booth_get_instance_private (pb);
 	GST_DEBUG_BIN_TO_DOT_FILE_WITH_TS (GST_BIN (pb->pipeline), GST_DEBUG_GRAPH_SHOW_ALL, "photo_booth_photo_print");
-	photo_booth_get_printer_status (pb);
+	// the printers' status is kept current by the print queue's poll, querying them all here would hold up the guest
 	GST_INFO ("PRINT! prints_remaining=%i", priv->prints_remaining);
 	priv->print_copies = photo_booth_window_get_copies_hide (priv->win);
 	gtk_widget_hide (GTK_WIDGET (priv->win->button_print));
@@ -2513,60 +3408,21 @@ static gboolean photo_booth_print (gpointer user_data)
 	if (priv->prints_remaining > priv->print_copies)
 #endif
 	{
-		gtk_label_set_text (priv->win->status, _("Printing..."));
-		photo_booth_change_state (pb, PB_STATE_PRINTING);
-		PhotoBoothPrivate *priv;
-		GtkPrintOperation *printop;
-		GtkPrintOperationResult res;
-		GtkPageSetup *page_setup;
-		GtkPaperSize *paper_size;
-		GError *print_error;
-		GtkPrintOperationAction action;
-
-		priv = photo_booth_get_instance_private (pb);
-		printop = gtk_print_operation_new ();
-
-		if (priv->printer_settings != NULL)
-			action = GTK_PRINT_OPERATION_ACTION_PRINT;
-		else
-		{
-			priv->printer_settings = gtk_print_settings_new ();
-			action = GTK_PRINT_OPERATION_ACTION_PRINT_DIALOG;
-		}
-
-		gtk_print_operation_set_print_settings (printop, priv->printer_settings);
-		g_signal_connect (printop, "begin_print", G_CALLBACK (photo_booth_begin_print), pb);
-		g_signal_connect (printop, "draw_page", G_CALLBACK (photo_booth_draw_page), pb);
-		g_signal_connect (printop, "done", G_CALLBACK (photo_booth_print_done), pb);
-
-		page_setup = gtk_page_setup_new();
-		paper_size = gtk_paper_size_new_custom("custom", "custom", PT_PER_IN*4.0, PT_PER_IN*6.0, GTK_UNIT_POINTS);
-		gtk_page_setup_set_orientation (page_setup, GTK_PAGE_ORIENTATION_LANDSCAPE);
-
-		gtk_page_setup_set_paper_size (page_setup, paper_size);
-		gtk_print_operation_set_default_page_setup (printop, page_setup);
-		gtk_print_operation_set_use_full_page (printop, TRUE);
-		gtk_print_operation_set_unit (printop, GTK_UNIT_POINTS);
-
-		res = gtk_print_operation_run (printop, action, GTK_WINDOW (priv->win), &print_error);
-		if (res == GTK_PRINT_OPERATION_RESULT_ERROR)
+		if (!GST_IS_BUFFER (priv->print_buffer))
 		{
-			photo_booth_printing_error_dialog (priv->win, print_error);
-			g_error_free (print_error);
-		}
-		else if (res == GTK_PRINT_OPERATION_RESULT_CANCEL)
-		{
-			gtk_label_set_text (priv->win->status, _("Printing cancelled"));
-			g_object_unref (priv->printer_settings);
-			priv->printer_settings = NULL;
-			GST_INFO ("print cancelled");
-		}
-		else if (res == GTK_PRINT_OPERATION_RESULT_APPLY)
-		{
-			g_object_unref (priv->printer_settings);
-			priv->printer_settings = g_object_ref (gtk_print_operation_get_print_settings (printop));
+			GST_ERROR ("can't print because we have no photo buffer!");
+			return FALSE;
 		}
-		g_object_unref (printop);
+		// the print queue owns the buffer from here on, the guest can go on right away
+		photo_booth_print_queue_enqueue (priv->print_queue, priv->print_buffer, priv->print_copies);
+		if (priv->printer_backends && !priv->printer_poll_id)
+			priv->printer_poll_id = g_timeout_add_seconds (PRINTER_POLL_INTERVAL, (GSourceFunc) photo_booth_poll_printers, pb);
+		photo_booth_memory_untrack (photo_booth_memory_get_default (), priv->print_buffer);
+		gst_buffer_unref (priv->print_buffer);
+		priv->print_buffer = NULL;
+		photo_booth_show_printer_status (pb);
+		gtk_label_set_text (priv->win->status, _("Printing..."));
+		photo_booth_ask_for_publishing (pb);
 	}
 	else if (priv->prints_remaining == -1) {
 		gtk_label_set_text (priv->win->status, _("Can't print, no printer connected!"));
@@ -2576,92 +3432,34 @@ static gboolean photo_booth_print (gpointer user_data)
 	return FALSE;
 }
 
-static void photo_booth_begin_print (GtkPrintOperation *operation, G_GNUC_UNUSED GtkPrintContext *context, gpointer user_data)
-{
-	PhotoBooth *pb;
-	PhotoBoothPrivate *priv;
-
-	pb = PHOTO_BOOTH (user_data);
-
-	priv = photo_booth_get_instance_private (pb);
-
-	GST_INFO ("photo_booth_begin_print %i copies", priv->print_copies);
-	gtk_print_operation_set_n_pages (operation, priv->print_copies);
-}
-
-static void photo_booth_draw_page (G_GNUC_UNUSED GtkPrintOperation *operation, GtkPrintContext *context, int page_nr, gpointer user_data)
-{
-	PhotoBooth *pb;
-	PhotoBoothPrivate *priv;
-	GstMapInfo map;
-
-	pb = PHOTO_BOOTH (user_data);
-	priv = photo_booth_get_instance_private (pb);
-
-	if (!GST_IS_BUFFER (priv->print_buffer))
-	{
-		GST_ERROR_OBJECT (context, "can't draw because we have no photo buffer!");
-		return;
-	}
-	GST_DEBUG_OBJECT (context, "draw_page no. %i . %" GST_PTR_FORMAT " size %dx%d, %i dpi, offsets (%.2f, %.2f)", page_nr, priv->print_buffer, priv->print_width, priv->print_height, priv->print_dpi, priv->print_x_offset, priv->print_y_offset);
-
-	gst_buffer_map(priv->print_buffer, &map, GST_MAP_READ);
-
-	int stride = cairo_format_stride_for_width (CAIRO_FORMAT_RGB24, priv->print_width);
-	cairo_surface_t *cairosurface = cairo_image_surface_create_for_data (map.data, CAIRO_FORMAT_RGB24, priv->print_width, priv->print_height, stride);
-	cairo_t *cr = gtk_print_context_get_cairo_context (context);
-	cairo_matrix_t m;
-	cairo_get_matrix(cr, &m);
-
-	float scale = (float) PT_PER_IN / (float) priv->print_dpi;
-	cairo_scale(cr, scale, scale);
-	cairo_set_source_surface(cr, cairosurface, priv->print_x_offset, priv->print_y_offset);
-	cairo_paint(cr);
-	cairo_set_matrix(cr, &m);
-
-	gst_buffer_unmap (priv->print_buffer, &map);
-}
-
-static void photo_booth_printing_error_dialog (PhotoBoothWindow *window, GError *print_error)
-{
-	GtkWidget *error_dialog;
-	gchar *error_string;
-	error_string = g_strdup_printf(_("Failed to print! Error message: %s"), print_error->message);
-	GST_ERROR_OBJECT (window, error_string);
-	error_dialog = gtk_message_dialog_new (GTK_WINDOW (window), GTK_DIALOG_DESTROY_WITH_PARENT, GTK_MESSAGE_ERROR, GTK_BUTTONS_CLOSE, error_string);
-	g_signal_connect (error_dialog, "response", G_CALLBACK(gtk_widget_destroy), NULL);
-	gtk_widget_show (error_dialog);
-	g_free (error_string);
-}
-
-static void photo_booth_print_done (GtkPrintOperation *operation, GtkPrintOperationResult result, gpointer user_data)
+/* called by the print queue, usually long after the guest who printed has gone. so a failed job
+ * isn't put in front of whoever is at the booth by then, it shows in the printer status until the
+ * next one comes out */
+static void photo_booth_print_job_done (G_GNUC_UNUSED PhotoBoothPrintQueue *queue, PhotoBoothPrintJob *job, PhotoBooth *pb)
 {
-	PhotoBooth *pb;
-	PhotoBoothPrivate *priv;
-
-	pb = PHOTO_BOOTH (user_data);
-	priv = photo_booth_get_instance_private (pb);
+	PhotoBoothPrivate *priv = photo_booth_get_instance_private (pb);
 
-	GError *print_error;
-	if (result == GTK_PRINT_OPERATION_RESULT_ERROR)
+	if (job->printed)
 	{
-		gtk_print_operation_get_error (operation, &print_error);
-		photo_booth_printing_error_dialog (priv->win, print_error);
-		g_error_free (print_error);
+		priv->photos_printed += job->copies;
+		GST_INFO_OBJECT (pb, "print job %u done on %s photos_printed copies=%i total=%i", job->id, job->printer->name, job->copies, priv->photos_printed);
+		photo_booth_metrics_counter_add (photo_booth_metrics_get_default (), "photobooth_photos_printed_total", NULL, job->copies);
+		photo_booth_metrics_histogram_observe (photo_booth_metrics_get_default (), "photobooth_print_seconds", NULL, (gdouble) (g_get_monotonic_time () - job->started) / G_USEC_PER_SEC);
+		photo_booth_led_printer (priv->led, job->copies);
+		g_clear_pointer (&priv->print_failure, g_free);
 	}
-	else if (result == GTK_PRINT_OPERATION_RESULT_APPLY)
+	else if (job->error)
 	{
-		gint copies = gtk_print_operation_get_n_pages_to_print (operation);
-		priv->photos_printed += copies;
-		GST_INFO_OBJECT (user_data, "print_done photos_printed copies=%i total=%i", copies, priv->photos_printed);
-		photo_booth_led_printer (priv->led, copies);
+		GST_ERROR_OBJECT (pb, "print job %u failed on %s: %s", job->id, job->printer->name, job->error->message);
+		photo_booth_metrics_counter_add (photo_booth_metrics_get_default (), "photobooth_print_jobs_failed_total", NULL, 1);
+		g_free (priv->print_failure);
+		priv->print_failure = g_strdup_printf (_("Last print job failed: %s"), job->error->message);
 	}
 	else
-		GST_INFO_OBJECT (user_data, "print_done photos_printed unhandled result %i", result);
+		GST_INFO_OBJECT (pb, "print job %u not printed, result %i", job->id, job->result);
 
+	photo_booth_show_printer_status (pb);
 	g_timeout_add_seconds (15, (GSourceFunc) photo_booth_get_printer_status, pb);
-	photo_booth_ask_for_publishing (pb);
-	return;
 }
 
 size_t _curl_write_func (void *ptr, size_t size, size_t nmemb, void *buf)
@@ -2672,53 +3470,161 @@ size_t _curl_write_func (void *ptr, size_t size, size_t nmemb, void *buf)
 	return i;
 }
 
-int _curl_progress (void *user_data, G_GNUC_UNUSED curl_off_t dltotal, G_GNUC_UNUSED curl_off_t dlnow, curl_off_t ultotal, curl_off_t ulnow)
+typedef struct
 {
-	PhotoBooth *pb = PHOTO_BOOTH (user_data);
-	PhotoBoothPrivate *priv;
-	priv = photo_booth_get_instance_private (pb);
-	if (!priv->curl_cancelled)
-	{
-		photo_booth_window_upload_progress_show (priv->win, ultotal, ulnow);
-		GST_LOG ("ultotal=%ld ulnow=%ld", ultotal, ulnow);
-		return CURLE_OK;
+	PhotoBooth *pb;
+	curl_off_t offset;
+	curl_off_t total;
+	gint64 start_time, last_sample;
+	curl_off_t last_bytes;
+	gdouble rate;
+	PhotoBoothUploadThrottle throttle;
+} UploadProgress;
+
+/* background uploads yield to the guest in front of the camera, limits are in KiB/s and 0 means unlimited.
+ * called from the upload threads */
+static curl_off_t photo_booth_upload_speed_limit (PhotoBooth *pb)
+{
+	PhotoBoothPrivate *priv = photo_booth_get_instance_private (pb);
+	switch ((PhotoboothState) g_atomic_int_get ((gint *) &priv->state)) {
+		case PB_STATE_COUNTDOWN:
+		case PB_STATE_TAKING_PHOTO:
+			return (curl_off_t) priv->upload_speed_busy * 1024;
+		case PB_STATE_PREVIEW:
+		case PB_STATE_PREVIEW_COOLDOWN:
+		case PB_STATE_MASQUERADE_PHOTO:
+		case PB_STATE_PROCESS_PHOTO:
+			return (curl_off_t) priv->upload_speed_preview * 1024;
+		case PB_STATE_NONE:
+		case PB_STATE_SCREENSAVER:
+			return (curl_off_t) priv->upload_speed_idle * 1024;
+		default:
+			// the guest is waiting for this upload to print or publish their photo
+			return 0;
 	}
-	photo_booth_window_upload_progress_show (priv->win, -1, 0);
-	return -1;
 }
 
-static gpointer photo_booth_linx_post_thread_func (gpointer user_data)
+typedef struct
 {
-	PhotoBooth *pb = PHOTO_BOOTH (user_data);
-	PhotoBoothPrivate *priv;
-	gchar *header;
-	const gchar *filename, *put_uri;
-	CURLcode res;
-	CURL *curl;
-	struct curl_httppost* post = NULL;
-	struct curl_httppost* last = NULL;
-	struct curl_slist *headerlist = NULL;
-	struct stat file_info;
-	FILE *src_file;
-	GString *buf = g_string_new("");
+	const gchar *data;
+	gsize size;
+	gsize pos;
+} LinxChunk;
 
-	curl = curl_easy_init();
-	g_assert (curl);
+static void photo_booth_upload_progress_post (PhotoBooth *pb, gint64 total, gint64 current, gdouble rate, gint eta)
+{
+	PhotoBoothPrivate *priv = photo_booth_get_instance_private (pb);
+	UploadProgressChannel *channel = &priv->upload_progress;
+
+	g_mutex_lock (&channel->lock);
+	channel->total = total;
+	channel->current = current;
+	channel->rate = rate;
+	channel->eta = eta;
+	if (!channel->idle_id)
+		channel->idle_id = g_idle_add ((GSourceFunc) photo_booth_upload_progress_dispatch, pb);
+	g_mutex_unlock (&channel->lock);
+}
 
-	priv = photo_booth_get_instance_private (pb);
-	priv->curl_cancelled = FALSE;
+static gboolean photo_booth_upload_progress_dispatch (PhotoBooth *pb)
+{
+	PhotoBoothPrivate *priv = photo_booth_get_instance_private (pb);
+	UploadProgressChannel *channel = &priv->upload_progress;
+	gint64 total, current;
+	gdouble rate;
+	gint eta;
+
+	g_mutex_lock (&channel->lock);
+	total = channel->total;
+	current = channel->current;
+	rate = channel->rate;
+	eta = channel->eta;
+	channel->idle_id = 0;
+	g_mutex_unlock (&channel->lock);
+
+	photo_booth_window_upload_progress_show (priv->win, total, current, rate, eta);
+	return G_SOURCE_REMOVE;
+}
 
-	g_mutex_lock (&priv->upload_mutex);
-	filename = g_strdup_printf (priv->save_path_template, priv->save_filename_count);
-	put_uri = g_strconcat (priv->linx_put_uri, priv->uuid, NULL);
+static void photo_booth_upload_progress_finish (UploadProgress *progress, curl_off_t bytes)
+{
+	PhotoBoothPrivate *priv = photo_booth_get_instance_private (progress->pb);
+	gint64 elapsed = g_get_monotonic_time () - progress->start_time;
+	if (!progress->start_time || elapsed <= 0 || bytes <= 0)
+		return;
+	g_mutex_lock (&priv->upload_progress.lock);
+	priv->upload_progress.last_rate = (gdouble) bytes * G_USEC_PER_SEC / elapsed;
+	g_mutex_unlock (&priv->upload_progress.lock);
+	photo_booth_metrics_gauge_set (photo_booth_metrics_get_default (), "photobooth_upload_rate_bytes_per_second", NULL, priv->upload_progress.last_rate);
+	photo_booth_metrics_observe (photo_booth_metrics_get_default (), "photobooth_upload_duration_seconds", NULL, (gdouble) elapsed / G_USEC_PER_SEC);
+	GST_INFO ("uploaded %" G_GINT64_FORMAT " bytes in %.2f s (%.1f kB/s)", (gint64) bytes, (gdouble) elapsed / G_USEC_PER_SEC, priv->upload_progress.last_rate / 1024);
+}
 
-	stat (filename, &file_info);
-	src_file = fopen (filename, "rb");
+int _curl_progress (void *user_data, G_GNUC_UNUSED curl_off_t dltotal, G_GNUC_UNUSED curl_off_t dlnow, curl_off_t ultotal, curl_off_t ulnow)
+{
+	UploadProgress *progress = (UploadProgress *) user_data;
+	PhotoBooth *pb = progress->pb;
+	PhotoBoothPrivate *priv;
+	gint64 now = g_get_monotonic_time ();
+	gint eta = -1;
+	priv = photo_booth_get_instance_private (pb);
+	if (priv->curl_cancelled)
+	{
+		photo_booth_upload_progress_post (pb, -1, 0, 0.0, -1);
+		return -1;
+	}
+	photo_booth_upload_throttle_update (&progress->throttle, ulnow);
+	if (progress->total > 0)
+	{
+		ultotal = progress->total;
+		ulnow += progress->offset;
+	}
+	if (!progress->start_time)
+		progress->start_time = now;
+	// libcurl calls back far more often than the screen can show, only sample every UPLOAD_PROGRESS_INTERVAL
+	if (ultotal <= 0 || (now - progress->last_sample < UPLOAD_PROGRESS_INTERVAL && ulnow < ultotal))
+		return CURLE_OK;
+	if (progress->last_sample && now > progress->last_sample && ulnow >= progress->last_bytes)
+	{
+		gdouble rate = (gdouble) (ulnow - progress->last_bytes) * G_USEC_PER_SEC / (now - progress->last_sample);
+		progress->rate = progress->rate > 0 ? 0.7 * progress->rate + 0.3 * rate : rate;
+	}
+	progress->last_sample = now;
+	progress->last_bytes = ulnow;
+	if (progress->rate > 0)
+		eta = (ultotal - ulnow) / progress->rate;
+	photo_booth_upload_progress_post (pb, ultotal, ulnow, progress->rate, eta);
+	GST_LOG ("ultotal=%ld ulnow=%ld rate=%.0f B/s eta=%i s", ultotal, ulnow, progress->rate, eta);
+	return CURLE_OK;
+}
 
-	GST_INFO ("linx PUT %s to %s, size: %ld, expiry: %d", filename, priv->linx_put_uri, file_info.st_size, priv->linx_expiry);
+size_t _curl_read_chunk (char *ptr, size_t size, size_t nmemb, void *user_data)
+{
+	LinxChunk *chunk = (LinxChunk *) user_data;
+	size_t len = MIN (size * nmemb, chunk->size - chunk->pos);
+	memcpy (ptr, chunk->data + chunk->pos, len);
+	chunk->pos += len;
+	return len;
+}
 
-	curl_formadd (&post, &last, CURLFORM_COPYNAME, "image", CURLFORM_FILE, filename, CURLFORM_CONTENTTYPE, "image/jpeg", CURLFORM_END);
-	curl_easy_setopt (curl, CURLOPT_USERAGENT, "Schaffenburg Photobooth");
+size_t _curl_header_upload_offset (char *ptr, size_t size, size_t nitems, void *user_data)
+{
+	curl_off_t *server_offset = (curl_off_t *) user_data;
+	size_t len = size * nitems;
+	if (len > 14 && g_ascii_strncasecmp (ptr, "Upload-Offset:", 14) == 0)
+	{
+		gchar *value = g_strndup (ptr + 14, len - 14);
+		*server_offset = g_ascii_strtoll (g_strstrip (value), NULL, 10);
+		g_free (value);
+	}
+	return len;
+}
+
+static struct curl_slist *photo_booth_linx_headers (PhotoBooth *pb)
+{
+	PhotoBoothPrivate *priv = photo_booth_get_instance_private (pb);
+	struct curl_slist *headerlist = NULL;
+	gchar *header;
 
 	header = g_strdup_printf ("Linx-Expiry: %d", priv->linx_expiry);
 	headerlist = curl_slist_append (headerlist, header);
@@ -2729,9 +3635,37 @@ static gpointer photo_booth_linx_post_thread_func (gpointer user_data)
 		headerlist = curl_slist_append (headerlist, header);
 		g_free (header);
 	}
+	return headerlist;
+}
+
+static gboolean photo_booth_linx_upload_single (PhotoBooth *pb, const gchar *filename, const gchar *put_uri)
+{
+	PhotoBoothPrivate *priv = photo_booth_get_instance_private (pb);
+	CURLcode res;
+	CURL *curl;
+	struct curl_slist *headerlist;
+	struct stat file_info;
+	FILE *src_file;
+	UploadProgress progress = { pb, 0, 0, 0, 0, 0, 0.0, { (PhotoBoothUploadLimitFunc) photo_booth_upload_speed_limit, pb, 0, 0, 0, 0 } };
+	GString *buf = g_string_new ("");
+
+	if (stat (filename, &file_info) || !(src_file = fopen (filename, "rb")))
+	{
+		GST_ERROR ("can't open '%s' for upload: %s (%i)", filename, strerror(errno), errno);
+		g_string_free (buf, TRUE);
+		return FALSE;
+	}
+
+	GST_INFO ("linx PUT %s to %s, size: %ld, expiry: %d", filename, put_uri, file_info.st_size, priv->linx_expiry);
+
+	curl = curl_easy_init();
+	g_assert (curl);
+
+	curl_easy_setopt (curl, CURLOPT_USERAGENT, "Schaffenburg Photobooth");
+	headerlist = photo_booth_linx_headers (pb);
 	curl_easy_setopt (curl, CURLOPT_HTTPHEADER, headerlist);
 	curl_easy_setopt (curl, CURLOPT_URL, put_uri);
-	
+
 	// curl_easy_setopt (curl, CURLOPT_VERBOSE, 1L);
 	curl_easy_setopt (curl, CURLOPT_PUT, 1L);
 	curl_easy_setopt (curl, CURLOPT_UPLOAD, 1L);
@@ -2744,155 +3678,476 @@ static gpointer photo_booth_linx_post_thread_func (gpointer user_data)
 	curl_easy_setopt (curl, CURLOPT_READDATA, src_file);
 
 	curl_easy_setopt (curl, CURLOPT_XFERINFOFUNCTION, _curl_progress);
-	curl_easy_setopt (curl, CURLOPT_XFERINFODATA, pb);
+	curl_easy_setopt (curl, CURLOPT_XFERINFODATA, &progress);
 	curl_easy_setopt (curl, CURLOPT_NOPROGRESS, 0L);
+	photo_booth_upload_throttle_start (&progress.throttle, curl);
 
 	res = curl_easy_perform (curl);
 	if (res != CURLE_OK)
 	{
 		GST_WARNING ("curl_easy_perform() failed %s", curl_easy_strerror(res));
 	}
+	else
+		photo_booth_upload_progress_finish (&progress, progress.last_bytes);
 	curl_easy_cleanup (curl);
-	curl_formfree (post);
+	curl_slist_free_all (headerlist);
 	fclose (src_file);
 
-	if (buf->str[buf->len-1] == '\n') buf->str[buf->len-1] = '\0';
+	if (buf->len && buf->str[buf->len-1] == '\n') buf->str[buf->len-1] = '\0';
 	GST_DEBUG ("curl_easy_perform() finished. response='%s'", buf->str);
-
 	g_string_free (buf, TRUE);
-	g_mutex_unlock (&priv->upload_mutex);
 
-	photo_booth_window_set_spinner (priv->win, FALSE);
-	if (priv->do_linx_upload == UPLOAD_ASK) {
-		photo_booth_ask_for_publishing (pb);
+	return res == CURLE_OK;
+}
+
+static gchar *photo_booth_linx_chunk_checksum (const gchar *data, gsize size)
+{
+	GChecksum *checksum = g_checksum_new (G_CHECKSUM_SHA1);
+	guint8 digest[20];
+	gsize digest_len = sizeof (digest);
+	g_checksum_update (checksum, (const guchar *) data, size);
+	g_checksum_get_digest (checksum, digest, &digest_len);
+	g_checksum_free (checksum);
+	return g_base64_encode (digest, digest_len);
+}
+
+/* how many of the acknowledged chunks, chunk i starting at i * chunk_size, still match the file */
+static guint photo_booth_linx_verify_chunks (FILE *src_file, gchar *data, curl_off_t chunk_size, curl_off_t size, GPtrArray *checksums)
+{
+	guint i;
+	for (i = 0; i < checksums->len && (curl_off_t) i * chunk_size < size; i++)
+	{
+		gchar *checksum;
+		gboolean match;
+		size_t n;
+		if (fseek (src_file, (curl_off_t) i * chunk_size, SEEK_SET))
+			break;
+		n = fread (data, 1, MIN (chunk_size, size - (curl_off_t) i * chunk_size), src_file);
+		if (n == 0)
+			break;
+		checksum = photo_booth_linx_chunk_checksum (data, n);
+		match = !g_strcmp0 (checksum, g_ptr_array_index (checksums, i));
+		g_free (checksum);
+		if (!match)
+			break;
 	}
-	photo_booth_window_upload_progress_show (priv->win, -1, 0);
-	return NULL;
+	return i;
 }
 
-static gpointer photo_booth_public_post_thread_func (gpointer user_data)
+/* the Upload-Offset the server answers a HEAD with, -1 if it doesn't tell */
+static curl_off_t photo_booth_linx_server_offset (PhotoBooth *pb, const gchar *uri)
 {
-	PhotoBooth *pb = PHOTO_BOOTH (user_data);
-	PhotoBoothPrivate *priv;
+	CURL *curl = curl_easy_init ();
+	struct curl_slist *headerlist = photo_booth_linx_headers (pb);
+	curl_off_t server_offset = -1;
 	CURLcode res;
+
+	g_assert (curl);
+	curl_easy_setopt (curl, CURLOPT_USERAGENT, "Schaffenburg Photobooth");
+	curl_easy_setopt (curl, CURLOPT_URL, uri);
+	curl_easy_setopt (curl, CURLOPT_HTTPHEADER, headerlist);
+	curl_easy_setopt (curl, CURLOPT_NOBODY, 1L);
+	curl_easy_setopt (curl, CURLOPT_CONNECTTIMEOUT, 5);
+	curl_easy_setopt (curl, CURLOPT_TIMEOUT, 15);
+	curl_easy_setopt (curl, CURLOPT_HEADERFUNCTION, _curl_header_upload_offset);
+	curl_easy_setopt (curl, CURLOPT_HEADERDATA, &server_offset);
+	res = curl_easy_perform (curl);
+	if (res != CURLE_OK)
+	{
+		GST_WARNING ("can't ask %s for its upload offset: %s", uri, curl_easy_strerror (res));
+		server_offset = -1;
+	}
+	curl_easy_cleanup (curl);
+	curl_slist_free_all (headerlist);
+	return server_offset;
+}
+
+static void photo_booth_linx_save_resume_state (const gchar *state_filename, const gchar *put_uri, struct stat *file_info, curl_off_t chunk_size, curl_off_t offset, GPtrArray *checksums)
+{
+	GKeyFile *state = g_key_file_new ();
+	GError *error = NULL;
+	g_key_file_set_string (state, "upload", "uri", put_uri);
+	g_key_file_set_int64 (state, "upload", "size", (gint64) file_info->st_size);
+	g_key_file_set_int64 (state, "upload", "mtime", (gint64) file_info->st_mtime);
+	g_key_file_set_int64 (state, "upload", "chunk_size", (gint64) chunk_size);
+	g_key_file_set_int64 (state, "upload", "offset", (gint64) offset);
+	g_key_file_set_string_list (state, "upload", "checksums", (const gchar * const *) checksums->pdata, checksums->len);
+	if (!g_key_file_save_to_file (state, state_filename, &error))
+	{
+		GST_WARNING ("can't persist upload state to '%s': %s", state_filename, error->message);
+		g_error_free (error);
+	}
+	g_key_file_free (state);
+}
+
+static gboolean photo_booth_linx_upload_chunked (PhotoBooth *pb, const gchar *filename, const gchar *put_uri)
+{
+	PhotoBoothPrivate *priv = photo_booth_get_instance_private (pb);
 	CURL *curl;
-	priv = photo_booth_get_instance_private (pb);
+	CURLcode res = CURLE_OK;
+	struct stat file_info;
+	FILE *src_file;
+	GKeyFile *state;
+	GPtrArray *checksums;
+	gchar *state_filename, *uri = NULL, *data;
+	curl_off_t offset = 0, resume_offset, chunk_size = (curl_off_t) priv->linx_chunk_size * 1024;
+	gint resyncs = 0;
+	UploadProgress progress = { pb, 0, 0, 0, 0, 0, 0.0, { (PhotoBoothUploadLimitFunc) photo_booth_upload_speed_limit, pb, 0, 0, 0, 0 } };
+	GString *buf = g_string_new ("");
+	gboolean resuming = FALSE, ret = FALSE;
+
+	state_filename = g_strconcat (filename, LINX_RESUME_SUFFIX, NULL);
+	checksums = g_ptr_array_new_with_free_func (g_free);
+
+	if (stat (filename, &file_info) || !(src_file = fopen (filename, "rb")))
+	{
+		GST_ERROR ("can't open '%s' for upload: %s (%i)", filename, strerror(errno), errno);
+		g_unlink (state_filename);
+		goto out;
+	}
 
-	g_mutex_lock (&priv->upload_mutex);
-	curl = curl_easy_init();
-	if (curl)
-	{
-		photo_booth_change_state (pb, PB_STATE_PUBLISHING);
-		struct curl_httppost* post = NULL;
-		struct curl_httppost* last = NULL;
-		GString *buf = g_string_new("");
-		const gchar *filename = g_strdup_printf (priv->save_path_template, priv->save_filename_count);
-		curl_formadd (&post, &last, CURLFORM_COPYNAME, "image", CURLFORM_FILE, filename, CURLFORM_CONTENTTYPE, "image/jpeg", CURLFORM_END);
-		curl_easy_setopt (curl, CURLOPT_USERAGENT, "Schaffenburg Photobooth");
-		if (priv->imgur_access_token && priv->imgur_album_id)
-		{
-			gchar *auth_header;
-			struct curl_slist *headerlist = NULL;
-			auth_header = g_strdup_printf ("Authorization: Bearer %s", priv->imgur_access_token);
-			headerlist = curl_slist_append (headerlist, auth_header);
-			curl_formadd (&post, &last, CURLFORM_COPYNAME, "album", CURLFORM_COPYCONTENTS, priv->imgur_album_id, CURLFORM_END);
-			if (priv->imgur_description)
-				curl_formadd (&post, &last, CURLFORM_COPYNAME, "description", CURLFORM_COPYCONTENTS, priv->imgur_description, CURLFORM_END);
-			curl_easy_setopt (curl, CURLOPT_HTTPHEADER, headerlist);
-			curl_easy_setopt (curl, CURLOPT_URL, IMGUR_UPLOAD_URI);
-			GST_INFO ("imgur posting '%s' to album http://imgur.com/a/%s'...", filename, priv->imgur_album_id);
-			g_free (auth_header);
-		}
-		else if (priv->facebook_put_uri)
+	state = g_key_file_new ();
+	if (g_key_file_load_from_file (state, state_filename, G_KEY_FILE_NONE, NULL))
+	{
+		uri = g_key_file_get_string (state, "upload", "uri", NULL);
+		if (uri && (!put_uri || !g_strcmp0 (uri, put_uri))
+		    && g_key_file_get_int64 (state, "upload", "size", NULL) == (gint64) file_info.st_size
+		    && g_key_file_get_int64 (state, "upload", "mtime", NULL) == (gint64) file_info.st_mtime
+		    && g_key_file_get_int64 (state, "upload", "chunk_size", NULL) == (gint64) chunk_size)
 		{
-			curl_easy_setopt (curl, CURLOPT_URL, priv->facebook_put_uri);
-			GST_INFO ("facebook posting '%s' to '%s'...", filename, priv->facebook_put_uri);
+			gchar **list = g_key_file_get_string_list (state, "upload", "checksums", NULL, NULL);
+			gchar **c;
+			offset = g_key_file_get_int64 (state, "upload", "offset", NULL);
+			for (c = list; c && *c; c++)
+				g_ptr_array_add (checksums, g_strdup (*c));
+			g_strfreev (list);
+			resuming = TRUE;
 		}
 		else
 		{
-			curl_formfree (post);
-			goto out;
+			GST_INFO ("stale upload state '%s' doesn't match %s, restart from zero", state_filename, filename);
+			g_free (uri);
+			uri = NULL;
 		}
-		curl_easy_setopt (curl, CURLOPT_POST, 1L);
-		curl_easy_setopt (curl, CURLOPT_HTTPPOST, post);
-		curl_easy_setopt (curl, CURLOPT_WRITEFUNCTION, _curl_write_func);
-		curl_easy_setopt (curl, CURLOPT_WRITEDATA, buf);
-		curl_easy_setopt (curl, CURLOPT_CONNECTTIMEOUT, 5);
-		curl_easy_setopt (curl, CURLOPT_XFERINFOFUNCTION, _curl_progress);
-		curl_easy_setopt (curl, CURLOPT_NOPROGRESS, 0L);
-		curl_easy_setopt (curl, CURLOPT_XFERINFODATA, pb);
-		res = curl_easy_perform (curl);
-		if (res != CURLE_OK)
+	}
+	g_key_file_free (state);
+
+	if (!uri)
+		uri = g_strdup (put_uri);
+	if (!uri)
+	{
+		GST_WARNING ("no upload uri known for '%s', drop it", filename);
+		g_unlink (state_filename);
+		fclose (src_file);
+		goto out;
+	}
+
+	GST_INFO ("linx chunked PUT %s to %s, size: %ld, chunk size: %" G_GINT64_FORMAT ", expiry: %d", filename, uri, file_info.st_size, (gint64) chunk_size, priv->linx_expiry);
+
+	curl = curl_easy_init();
+	g_assert (curl);
+
+	// the same handle is reused for every chunk so that the connection is kept alive
+	curl_easy_setopt (curl, CURLOPT_USERAGENT, "Schaffenburg Photobooth");
+	curl_easy_setopt (curl, CURLOPT_URL, uri);
+	curl_easy_setopt (curl, CURLOPT_UPLOAD, 1L);
+	curl_easy_setopt (curl, CURLOPT_CONNECTTIMEOUT, 5);
+	curl_easy_setopt (curl, CURLOPT_LOW_SPEED_LIMIT, 1L);
+	curl_easy_setopt (curl, CURLOPT_LOW_SPEED_TIME, 15L);
+	curl_easy_setopt (curl, CURLOPT_READFUNCTION, _curl_read_chunk);
+	curl_easy_setopt (curl, CURLOPT_WRITEFUNCTION, _curl_write_func);
+	curl_easy_setopt (curl, CURLOPT_WRITEDATA, buf);
+	curl_easy_setopt (curl, CURLOPT_XFERINFOFUNCTION, _curl_progress);
+	curl_easy_setopt (curl, CURLOPT_XFERINFODATA, &progress);
+	curl_easy_setopt (curl, CURLOPT_NOPROGRESS, 0L);
+
+	data = g_malloc (chunk_size);
+	photo_booth_memory_track (photo_booth_memory_get_default (), MEMORY_UPLOAD, data, chunk_size);
+
+	// only what the stored checksums still vouch for is skipped, from wherever the server really is
+	if (resuming)
+	{
+		guint verified = photo_booth_linx_verify_chunks (src_file, data, chunk_size, file_info.st_size, checksums);
+		curl_off_t verified_offset = MIN (offset, MIN ((curl_off_t) verified * chunk_size, file_info.st_size));
+		curl_off_t server_offset = photo_booth_linx_server_offset (pb, uri);
+		if (verified < checksums->len)
+			GST_WARNING ("chunk %u of %s doesn't match what was uploaded any more, sending it again", verified, filename);
+		if (server_offset > file_info.st_size)
+			server_offset = -1;
+		// the server holding more than was acknowledged is fine as long as nothing before it changed
+		if (server_offset >= 0 && (server_offset <= verified_offset || verified_offset == offset))
+			offset = server_offset;
+		else
+			offset = verified_offset;
+		g_ptr_array_set_size (checksums, MIN (verified, (guint) (offset / chunk_size)));
+		GST_INFO ("resuming linx upload of %s to %s at offset %" G_GINT64_FORMAT " (%u chunks verified, server at %" G_GINT64_FORMAT ")",
+			filename, uri, (gint64) offset, checksums->len, (gint64) server_offset);
+	}
+	progress.total = file_info.st_size;
+	resume_offset = offset;
+
+	while (offset < file_info.st_size && !priv->curl_cancelled)
+	{
+		LinxChunk chunk;
+		gchar *checksum, *header;
+		gint attempt;
+		long response_code = 0;
+		curl_off_t server_offset = -1;
+
+		if (fseek (src_file, offset, SEEK_SET))
+			break;
+		chunk.data = data;
+		chunk.size = fread (data, 1, MIN (chunk_size, file_info.st_size - offset), src_file);
+		if (chunk.size == 0)
+			break;
+		checksum = photo_booth_linx_chunk_checksum (data, chunk.size);
+
+		for (attempt = 0; attempt <= priv->linx_chunk_retries && !priv->curl_cancelled; attempt++)
 		{
-			GST_WARNING ("curl_easy_perform() failed %s", curl_easy_strerror(res));
+			struct curl_slist *headerlist = photo_booth_linx_headers (pb);
+			if (attempt)
+			{
+				GST_INFO ("retry chunk @%" G_GINT64_FORMAT " (attempt %i/%i)", (gint64) offset, attempt, priv->linx_chunk_retries);
+				g_usleep (attempt * G_USEC_PER_SEC);
+			}
+			header = g_strdup_printf ("Content-Range: bytes %" G_GINT64_FORMAT "-%" G_GINT64_FORMAT "/%" G_GINT64_FORMAT, (gint64) offset, (gint64) (offset + chunk.size - 1), (gint64) file_info.st_size);
+			headerlist = curl_slist_append (headerlist, header);
+			g_free (header);
+			header = g_strdup_printf ("Upload-Offset: %" G_GINT64_FORMAT, (gint64) offset);
+			headerlist = curl_slist_append (headerlist, header);
+			g_free (header);
+			header = g_strdup_printf ("Upload-Checksum: sha1 %s", checksum);
+			headerlist = curl_slist_append (headerlist, header);
+			g_free (header);
+
+			chunk.pos = 0;
+			server_offset = -1;
+			progress.offset = offset;
+			g_string_truncate (buf, 0);
+			curl_easy_setopt (curl, CURLOPT_HTTPHEADER, headerlist);
+			curl_easy_setopt (curl, CURLOPT_READDATA, &chunk);
+			curl_easy_setopt (curl, CURLOPT_INFILESIZE_LARGE, (curl_off_t) chunk.size);
+			curl_easy_setopt (curl, CURLOPT_HEADERFUNCTION, _curl_header_upload_offset);
+			curl_easy_setopt (curl, CURLOPT_HEADERDATA, &server_offset);
+			photo_booth_upload_throttle_start (&progress.throttle, curl);
+
+			res = curl_easy_perform (curl);
+			curl_slist_free_all (headerlist);
+			if (res == CURLE_OK)
+			{
+				curl_easy_getinfo (curl, CURLINFO_RESPONSE_CODE, &response_code);
+				if (response_code == 200 || response_code == 201 || response_code == 204 || response_code == 308)
+					break;
+				GST_WARNING ("chunk @%" G_GINT64_FORMAT " rejected with HTTP %ld: '%s'", (gint64) offset, response_code, buf->str);
+				if (server_offset >= 0 && server_offset != offset && server_offset <= file_info.st_size)
+					break;
+			}
+			else
+				GST_WARNING ("chunk @%" G_GINT64_FORMAT " failed: %s", (gint64) offset, curl_easy_strerror(res));
 		}
-		curl_formfree (post);
-		GST_DEBUG ("curl_easy_perform() finished. response='%s'", buf->str);
 
-		if (priv->twitter_bridge_host && priv->twitter_bridge_port)
+		if (response_code >= 400 && server_offset >= 0 && server_offset != offset && server_offset <= file_info.st_size)
 		{
-			JsonParser *parser;
-			JsonNode *root;
-			JsonReader *reader;
-			GError *error;
-			const char *link_url;
-			GSocketConnection *connection = NULL;
-			GSocketClient *client;
-
-			parser = json_parser_new ();
-
-			error = NULL;
-			json_parser_load_from_data (parser, buf->str, buf->len, &error);
-			if (error)
+			// a server that keeps moving the offset around would have us going forever
+			if (++resyncs > priv->linx_chunk_retries)
 			{
-				GST_WARNING ("Unable to parse '%s': %s", buf->str, error->message);
-				g_error_free (error);
-				g_object_unref (parser);
-				goto out;
+				GST_WARNING ("giving up on %s after %i resyncs, keeping resume state '%s'", filename, resyncs - 1, state_filename);
+				g_free (checksum);
+				break;
 			}
+			GST_INFO ("server has %" G_GINT64_FORMAT " bytes, resync from there", (gint64) server_offset);
+			offset = server_offset;
+			g_ptr_array_set_size (checksums, MIN (checksums->len, (guint) (offset / chunk_size)));
+			g_free (checksum);
+			continue;
+		}
 
-			root = json_parser_get_root (parser);
-			reader = json_reader_new (root);
-			gboolean ret = json_reader_read_member (reader, "data");
-			GST_INFO ("imgur read data member ret=%i", ret);
+		if (attempt > priv->linx_chunk_retries || priv->curl_cancelled)
+		{
+			GST_WARNING ("giving up on %s at offset %" G_GINT64_FORMAT ", keeping resume state '%s'", filename, (gint64) offset, state_filename);
+			g_free (checksum);
+			break;
+		}
 
-			json_reader_read_member (reader, "link");
-			link_url = json_reader_get_string_value (reader);
-			GST_INFO ("imgur published photo url: %s", link_url);
+		// checksums[i] is the chunk at i * chunk_size, one that started off after a resync isn't kept
+		if (offset == (curl_off_t) checksums->len * chunk_size)
+			g_ptr_array_add (checksums, checksum);
+		else
+			g_free (checksum);
+		if (server_offset >= 0 && server_offset <= file_info.st_size)
+			offset = server_offset;
+		else
+			offset += chunk.size;
+		photo_booth_linx_save_resume_state (state_filename, uri, &file_info, chunk_size, offset, checksums);
+		GST_LOG ("chunk acknowledged, offset now %" G_GINT64_FORMAT "/%ld", (gint64) offset, file_info.st_size);
+	}
 
-			client = g_socket_client_new();
+	if (offset >= file_info.st_size)
+	{
+		if (buf->len && buf->str[buf->len-1] == '\n') buf->str[buf->len-1] = '\0';
+		GST_INFO ("linx chunked upload of %s finished in %u chunks. response='%s'", filename, checksums->len, buf->str);
+		photo_booth_upload_progress_finish (&progress, offset - resume_offset);
+		g_unlink (state_filename);
+		ret = TRUE;
+	}
 
-			connection = g_socket_client_connect_to_host (client,
-				priv->twitter_bridge_host, priv->twitter_bridge_port, NULL, &error);
+	photo_booth_memory_untrack (photo_booth_memory_get_default (), data);
+	g_free (data);
+	curl_easy_cleanup (curl);
+	fclose (src_file);
+	g_free (uri);
 
-			if (error != NULL) {
-						GST_WARNING ("Unable to connect to twitter bridge: %s", error->message);
-						g_error_free (error);
-			}
+out:
+	g_ptr_array_free (checksums, TRUE);
+	g_string_free (buf, TRUE);
+	g_free (state_filename);
+	return ret;
+}
 
-			GOutputStream *ostream = g_io_stream_get_output_stream (G_IO_STREAM (connection));
+typedef struct {
+	gint failures;
+	gint64 retry_at;
+} LinxFailure;
 
-			g_output_stream_write  (ostream, link_url, strlen(link_url), NULL, NULL);
-			g_output_stream_write  (ostream, "\n", 1, NULL, &error);
-			if (error != NULL) {
-					GST_WARNING ("Unable to connect to send to twitter bridge: %s", error->message);
-					g_error_free (error);
-			}
+/* a file whose upload failed isn't tried again before its backoff has passed, which doubles with every
+ * failure. called with linx_mutex held */
+static void photo_booth_linx_note_result (PhotoBooth *pb, const gchar *filename, gboolean ok)
+{
+	PhotoBoothPrivate *priv = photo_booth_get_instance_private (pb);
+	LinxFailure *failure;
+	gint backoff;
+
+	if (ok)
+	{
+		g_hash_table_remove (priv->linx_failed, filename);
+		return;
+	}
+	failure = g_hash_table_lookup (priv->linx_failed, filename);
+	if (!failure)
+	{
+		failure = g_new0 (LinxFailure, 1);
+		g_hash_table_insert (priv->linx_failed, g_strdup (filename), failure);
+	}
+	backoff = MIN (LINX_RESUME_BACKOFF << MIN (failure->failures, 5), LINX_RESUME_BACKOFF_MAX);
+	failure->failures++;
+	failure->retry_at = g_get_monotonic_time () + (gint64) backoff * G_USEC_PER_SEC;
+	GST_INFO ("upload of '%s' failed %i times, next attempt in %i s at the earliest", filename, failure->failures, backoff);
+}
 
-			g_object_unref (reader);
-			g_object_unref (parser);
-			GST_INFO ("Successfully twittered");
+static gboolean photo_booth_linx_backing_off (PhotoBooth *pb, const gchar *filename)
+{
+	PhotoBoothPrivate *priv = photo_booth_get_instance_private (pb);
+	LinxFailure *failure = g_hash_table_lookup (priv->linx_failed, filename);
+	return failure && g_get_monotonic_time () < failure->retry_at;
+}
+
+static void photo_booth_linx_resume_pending (PhotoBooth *pb)
+{
+	PhotoBoothPrivate *priv = photo_booth_get_instance_private (pb);
+	gchar *save_dirname = g_path_get_dirname (priv->save_path_template);
+	const gchar *name;
+	GDir *save_dir;
+
+	save_dir = g_dir_open (save_dirname, 0, NULL);
+	if (!save_dir)
+	{
+		g_free (save_dirname);
+		return;
+	}
+	while ((name = g_dir_read_name (save_dir)) && !priv->curl_cancelled)
+	{
+		if (g_str_has_suffix (name, LINX_RESUME_SUFFIX))
+		{
+			gchar *photo_name = g_strndup (name, strlen (name) - strlen (LINX_RESUME_SUFFIX));
+			gchar *filename = g_build_filename (save_dirname, photo_name, NULL);
+			if (photo_booth_linx_backing_off (pb, filename))
+				GST_DEBUG ("interrupted upload of '%s' failed recently, leave it for later", filename);
+			else
+			{
+				GST_INFO ("found interrupted upload of '%s'", filename);
+				photo_booth_linx_note_result (pb, filename, photo_booth_linx_upload_chunked (pb, filename, NULL));
+			}
+			g_free (filename);
+			g_free (photo_name);
 		}
-		g_string_free (buf, TRUE);
 	}
-	goto out;
+	g_dir_close (save_dir);
+	g_free (save_dirname);
+}
+
+/* only the latest upload or publish thread is joined on exit, the one it replaces is let go and cleans up
+ * after itself when it is done instead of keeping its stack around for the rest of the event */
+static void photo_booth_spawn_worker (PhotoBooth *pb, GThread **thread, const gchar *name, GThreadFunc func)
+{
+	GThread *previous = *thread;
+	*thread = g_thread_try_new (name, func, pb, NULL);
+	if (previous)
+		g_thread_unref (previous);
+}
+
+static gpointer photo_booth_linx_post_thread_func (gpointer user_data)
+{
+	PhotoBooth *pb = PHOTO_BOOTH (user_data);
+	PhotoBoothPrivate *priv;
+	gchar *filename, *put_uri;
+	PhotoBoothTraceSession *session = photo_booth_trace_hold (photo_booth_trace_get_default ());
+
+	priv = photo_booth_get_instance_private (pb);
+	priv->curl_cancelled = FALSE;
+
+	filename = photo_booth_file_acquire (pb);
+	put_uri = g_strconcat (priv->linx_put_uri, priv->uuid, NULL);
+
+	// uploads queue up on the mutex while an earlier one is still running
+	photo_booth_metrics_gauge_set (photo_booth_metrics_get_default (), "photobooth_upload_queue_depth", NULL, g_atomic_int_add (&priv->linx_queue_depth, 1) + 1);
+	g_mutex_lock (&priv->linx_mutex);
+	if (priv->linx_chunk_size > 0)
+	{
+		// the file is skipped by the resume pass if it has just failed
+		photo_booth_linx_note_result (pb, filename, photo_booth_linx_upload_chunked (pb, filename, put_uri));
+		photo_booth_linx_resume_pending (pb);
+	}
+	else
+		photo_booth_linx_upload_single (pb, filename, put_uri);
+	g_mutex_unlock (&priv->linx_mutex);
+	photo_booth_metrics_gauge_set (photo_booth_metrics_get_default (), "photobooth_upload_queue_depth", NULL, g_atomic_int_add (&priv->linx_queue_depth, -1) - 1);
+	photo_booth_trace_session_mark (photo_booth_trace_get_default (), session, "upload_done");
+	photo_booth_trace_release (photo_booth_trace_get_default (), session);
+
+	photo_booth_file_release (pb, filename);
+	g_free (put_uri);
+
+	photo_booth_window_set_spinner (priv->win, FALSE);
+	if (priv->do_linx_upload == UPLOAD_ASK) {
+		photo_booth_ask_for_publishing (pb);
+	}
+	photo_booth_upload_progress_post (pb, -1, 0, 0.0, -1);
+	return NULL;
+}
+
+static void photo_booth_publish_progress (gint64 total, gint64 current, PhotoBooth *pb)
+{
+	photo_booth_upload_progress_post (pb, total, current, 0.0, -1);
+}
+
+static gpointer photo_booth_public_post_thread_func (gpointer user_data)
+{
+	PhotoBooth *pb = PHOTO_BOOTH (user_data);
+	PhotoBoothPrivate *priv;
+	gchar *filename;
+	PhotoBoothTraceSession *session = photo_booth_trace_hold (photo_booth_trace_get_default ());
+	priv = photo_booth_get_instance_private (pb);
+
+	photo_booth_change_state (pb, PB_STATE_PUBLISHING);
+	filename = photo_booth_file_acquire (pb);
+	photo_booth_publisher_publish (priv->publisher, filename);
+	photo_booth_file_release (pb, filename);
+	photo_booth_trace_session_mark (photo_booth_trace_get_default (), session, "publish_done");
+	photo_booth_trace_release (photo_booth_trace_get_default (), session);
 
-out:
-	g_mutex_unlock (&priv->upload_mutex);
-	curl_easy_cleanup (curl);
 	photo_booth_change_state (pb, PB_STATE_PREVIEW_COOLDOWN);
 	photo_booth_window_set_spinner (priv->win, FALSE);
-	photo_booth_window_upload_progress_show (priv->win, -1, 0);
+	photo_booth_upload_progress_post (pb, -1, 0, 0.0, -1);
 	return NULL;
 }
 
@@ -2921,12 +4176,88 @@ static gboolean photo_booth_publish_timedout (PhotoBooth *pb)
 	return FALSE;
 }
 
-static gboolean photo_booth_watchdog_timedout (PhotoBooth *pb)
+/* a call into the camera hangs. libgphoto2 can't be interrupted from the outside, but most drivers poll the
+ * context's cancel function. the capture thread reinitializes the camera once the call has returned */
+static void photo_booth_camera_stalled (G_GNUC_UNUSED PhotoBoothWatchdog *watchdog, G_GNUC_UNUSED guint stage, guint attempt, const gchar *where, gpointer user_data)
 {
+	PhotoBooth *pb = PHOTO_BOOTH (user_data);
 	PhotoBoothPrivate *priv = photo_booth_get_instance_private (pb);
-	GST_ERROR ("watchdog timed out in state %s", photo_booth_state_get_name(priv->state));
-	photo_booth_cancel (pb);
-	return FALSE;
+	GST_ERROR ("camera hangs in %s (state %s), cancelling it", where, photo_booth_state_get_name (priv->state));
+	photo_booth_trace_mark (photo_booth_trace_get_default (), "camera_stalled");
+	g_atomic_int_set (&priv->camera_reinit, TRUE);
+	photo_booth_camera_cancel (priv->camera);
+	if (attempt > 1)
+		gtk_label_set_text (priv->win->status, _("Camera not responding!"));
+}
+
+/* no frames out of the video-bin although the live view is on screen */
+static void photo_booth_video_stalled (PhotoBoothWatchdog *watchdog, G_GNUC_UNUSED guint stage, guint attempt, G_GNUC_UNUSED const gchar *where, gpointer user_data)
+{
+	PhotoBooth *pb = PHOTO_BOOTH (user_data);
+	PhotoBoothPrivate *priv = photo_booth_get_instance_private (pb);
+	if (photo_booth_watchdog_is_stalled (watchdog, WATCHDOG_CAMERA))
+	{
+		GST_INFO ("no live view because the camera hangs, leave it to the camera's recovery");
+		return;
+	}
+	GST_ERROR ("live view frozen in state %s, restarting the video-bin", photo_booth_state_get_name (priv->state));
+	photo_booth_trace_mark (photo_booth_trace_get_default (), "video_stalled");
+	if (priv->frame_timing)
+		photo_booth_frame_timing_reset (priv->frame_timing);
+	gst_element_set_state (pb->video_bin, GST_STATE_READY);
+	gst_element_set_state (pb->video_bin, GST_STATE_PLAYING);
+	// frames keep coming from the camera but don't make it through, it may be sending garbage
+	if (attempt > 1)
+		SEND_COMMAND (pb, CONTROL_REINIT);
+}
+
+/* the photo got stuck in the photo-bin, where names the element it was seen leaving last. it is flushed out and
+ * pushed again, then the whole bin is reset, and only after that the guest's photo is given up */
+static void photo_booth_photo_stalled (PhotoBoothWatchdog *watchdog, G_GNUC_UNUSED guint stage, guint attempt, const gchar *where, gpointer user_data)
+{
+	PhotoBooth *pb = PHOTO_BOOTH (user_data);
+	PhotoBoothPrivate *priv = photo_booth_get_instance_private (pb);
+	GstElement *appsrc;
+
+	GST_ERROR ("photo processing stuck behind %s in state %s, attempt %u", where, photo_booth_state_get_name (priv->state), attempt);
+	photo_booth_trace_mark (photo_booth_trace_get_default (), "processing_stalled");
+	if (attempt > 2)
+	{
+		photo_booth_watchdog_disarm (watchdog, WATCHDOG_PHOTO);
+		gtk_label_set_text (priv->win->status, _("Processing photo failed!"));
+		_play_event_sound (priv, ERROR_SOUND);
+		photo_booth_cancel (pb);
+		return;
+	}
+	if (attempt == 1)
+	{
+		appsrc = gst_bin_get_by_name (GST_BIN (pb->photo_bin), "photo-appsrc");
+		gst_element_send_event (appsrc, gst_event_new_flush_start ());
+		gst_element_send_event (appsrc, gst_event_new_flush_stop (TRUE));
+		gst_object_unref (appsrc);
+	}
+	else
+	{
+		gst_element_set_state (pb->photo_bin, GST_STATE_READY);
+		gst_element_set_state (pb->photo_bin, GST_STATE_PLAYING);
+	}
+	photo_booth_push_photo_buffer (pb);
+}
+
+static void photo_booth_setup_watchdog (PhotoBooth *pb)
+{
+	PhotoBoothPrivate *priv = photo_booth_get_instance_private (pb);
+	priv->watchdog = photo_booth_watchdog_new ();
+	photo_booth_watchdog_add_stage (priv->watchdog, "camera", priv->camera_timeout * 1000, photo_booth_camera_stalled, pb);
+	photo_booth_watchdog_add_stage (priv->watchdog, "video", priv->video_timeout * 1000, photo_booth_video_stalled, pb);
+	photo_booth_watchdog_add_stage (priv->watchdog, "photo", priv->processing_timeout * 1000, photo_booth_photo_stalled, pb);
+	photo_booth_watchdog_start (priv->watchdog, WATCHDOG_INTERVAL);
+}
+
+PhotoboothState photo_booth_get_state (PhotoBooth *pb)
+{
+	PhotoBoothPrivate *priv = photo_booth_get_instance_private (pb);
+	return priv->state;
 }
 
 const gchar* photo_booth_state_get_name (PhotoboothState state)
@@ -2956,25 +4287,3 @@ PhotoBooth *photo_booth_new (void)
 			"flags", G_APPLICATION_HANDLES_OPEN,
 			NULL);
 }
-
-int main (int argc, char *argv[])
-{
-	PhotoBooth *pb;
-	int ret;
-
-	XInitThreads();
-	gst_init (0, NULL);
-
-	pb = photo_booth_new ();
-
-	if (argc == 2)
-		photo_booth_load_settings (pb, argv[1]);
-	else
-		photo_booth_load_settings (pb, DEFAULT_CONFIG);
-
-	g_unix_signal_add (SIGINT, (GSourceFunc) photo_booth_quit_signal, pb);
-	ret = g_application_run (G_APPLICATION (pb), argc, argv);
-
-	g_object_unref (pb);
-	return ret;
-}
@@ -24,6 +24,7 @@
 #include <gphoto2/gphoto2.h>
 #include <gphoto2/gphoto2-camera.h>
 #include <json-glib/json-glib.h>
+#include "photoboothcamera.h"
 
 #define CONTROL_VIDEO          '1'     /* start movie capture */
 #define CONTROL_PRETRIGGER     '2'     /* pretrigger */
@@ -56,8 +57,7 @@ G_STMT_START {                                 \
 G_BEGIN_DECLS
 
 struct _CameraInfo {
-	Camera *camera;
-	GPContext *context;
+	PhotoBoothCamera *camera;
 	GMutex mutex;
 	int preview_capture_count;
 	char *data;
@@ -96,7 +96,6 @@ extern gchar *G_stylesheet_filename;
 extern GHashTable *G_strings_table;
 
 #undef _
-#define PHOTO_MASKOVERLAY_NAME_TEMPLATE "photo-maskoverlay-%02d"
 
 #define PHOTO_BOOTH_TYPE                (photo_booth_get_type ())
 #define PHOTO_BOOTH(obj)                (G_TYPE_CHECK_INSTANCE_CAST ((obj),PHOTO_BOOTH_TYPE,PhotoBooth))
@@ -134,7 +133,16 @@ struct _PhotoBoothClass
 GType        photo_booth_get_type (void);
 PhotoBooth  *photo_booth_new (void);
 void         photo_booth_load_settings (PhotoBooth *pb, const gchar *filename);
+PhotoboothState photo_booth_get_state (PhotoBooth *pb);
 const gchar* photo_booth_state_get_name (PhotoboothState state);
+gboolean     photo_booth_quit_signal (gpointer user_data);
+
+/* the photo processing chain on its own, used by photobooth-photobench.
+ * photo_booth_push_photo_buffer feeds it cam_info's data, which stays owned by cam_info */
+GstElement  *photo_booth_build_photo_bin (PhotoBooth *pb);
+void         photo_booth_photo_bin_plug_outputs (PhotoBooth *pb);
+void         photo_booth_photo_bin_unplug_outputs (PhotoBooth *pb);
+gboolean     photo_booth_push_photo_buffer (gpointer user_data);
 
 G_END_DECLS
 
@@ -0,0 +1,486 @@
+/*
+ * GStreamer photoboothbench.c
+ * Copyright 2019 Andreas Frisch <fraxinas@schaffenburg.org>
+ *
+ * This program is licensed under the Creative Commons
+ * Attribution-NonCommercial-ShareAlike 3.0 Unported
+ * License. To view a copy of this license, visit
+ * http://creativecommons.org/licenses/by-nc-sa/3.0/ or send a letter to
+ * Creative Commons,559 Nathan Abbott Way,Stanford,California 94305,USA.
+ *
+ * This program is NOT free software. It is open source, you are allowed
+ * to modify it (if you keep the license), but it may not be commercially
+ * distributed other than under the conditions noted above.
+ */
+
+/* runs guests through the complete booth without anybody touching the screen:
+ * taps the background in preview, presses print and publish when asked and
+ * reads the session trace back afterwards to report throughput, the time and
+ * cpu every state takes, the resident set size and the touch to milestone
+ * latencies. meant to be run with bench.ini, i.e. the simulated camera, the
+ * fake printer backend and resources/upload_standin_server.py.
+ * as a soak test (ninja soak) it also fits a line through the resident size
+ * after every session past the warmup and fails when the booth keeps growing */
+
+#include <signal.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/resource.h>
+#include <glib/gstdio.h>
+#include <json-glib/json-glib.h>
+#include <X11/Xlib.h>
+#include "photobooth.h"
+#include "photoboothwin.h"
+#include "photoboothtrace.h"
+#include "photoboothmemory.h"
+
+#define DEFAULT_BENCH_CONFIG "bench.ini"
+#define BENCH_TICK_MS 20
+#define BENCH_RETAP_TIMEOUT 3
+/* objects a subsystem may hold on to beyond the warmup baseline, e.g. a print still in the queue */
+#define BENCH_OBJECT_SLACK 4
+
+/* the ui's signal handlers from photobooth.c, the bench presses the buttons by calling them */
+void photo_booth_background_clicked (GtkWidget *widget, GdkEventButton *event, PhotoBoothWindow *win);
+void photo_booth_button_print_clicked (GtkButton *button, PhotoBoothWindow *win);
+void photo_booth_button_publish_clicked (GtkButton *button, PhotoBoothWindow *win);
+
+typedef struct
+{
+	PhotoBooth *pb;
+	guint n_sessions;
+	guint sessions_done;
+	guint sessions_failed;
+	gint session_timeout;
+	gboolean in_session;
+	gboolean left_preview;
+	PhotoboothState last_state;
+	gboolean acted;
+	gint64 session_start;
+	gint64 run_start;
+	gint64 run_end;
+	guint warmup;
+	GArray *rss;                             // kB after every session past the warmup
+	guint baseline_objects[MEMORY_SUBSYSTEMS], final_objects[MEMORY_SUBSYSTEMS];
+	gint64 baseline_bytes[MEMORY_SUBSYSTEMS], final_bytes[MEMORY_SUBSYSTEMS];
+} PhotoBoothBench;
+
+typedef struct
+{
+	GArray *wall;
+	gdouble cpu_sum;
+	gint64 rss_max;
+} PhotoBoothBenchStat;
+
+static gint n_sessions = 10;
+static gint session_timeout = 120;
+static gchar *trace_filename = NULL;
+static gint warmup_sessions = -1;
+static gint max_rss_growth = 0;
+
+static GOptionEntry bench_entries[] =
+{
+	{ "sessions", 'n', 0, G_OPTION_ARG_INT, &n_sessions, "Number of guests to run through the booth (default 10)", "N" },
+	{ "timeout", 't', 0, G_OPTION_ARG_INT, &session_timeout, "Give up when a session takes longer than this (default 120)", "SECONDS" },
+	{ "trace", 0, 0, G_OPTION_ARG_FILENAME, &trace_filename, "Keep the session trace in this file (overwritten)", "FILE" },
+	{ "warmup", 'w', 0, G_OPTION_ARG_INT, &warmup_sessions, "Sessions before memory growth is measured (default a tenth)", "N" },
+	{ "max-rss-growth", 0, 0, G_OPTION_ARG_INT, &max_rss_growth, "Fail when the resident size grows more than this over the measured sessions", "KB" },
+	{ NULL, 0, 0, G_OPTION_ARG_NONE, NULL, NULL, NULL }
+};
+
+static void photo_booth_bench_sample_memory (PhotoBoothBench *bench)
+{
+	PhotoBoothMemory *memory = photo_booth_memory_get_default ();
+	PhotoBoothMemorySubsystem i;
+
+	if (bench->sessions_done < bench->warmup)
+		return;
+	for (i = 0; i < MEMORY_SUBSYSTEMS; i++)
+	{
+		bench->final_objects[i] = photo_booth_memory_get_objects (memory, i);
+		bench->final_bytes[i] = photo_booth_memory_get_bytes (memory, i);
+		if (bench->sessions_done == bench->warmup)
+		{
+			bench->baseline_objects[i] = bench->final_objects[i];
+			bench->baseline_bytes[i] = bench->final_bytes[i];
+		}
+	}
+	if (bench->sessions_done > bench->warmup)
+	{
+		gdouble rss = photo_booth_memory_rss ();
+		g_array_append_val (bench->rss, rss);
+	}
+}
+
+static gboolean photo_booth_bench_tick (PhotoBoothBench *bench)
+{
+	GtkWindow *win = gtk_application_get_active_window (GTK_APPLICATION (bench->pb));
+	PhotoboothState state = photo_booth_get_state (bench->pb);
+	gint64 now = g_get_monotonic_time ();
+
+	if (!win)
+		return G_SOURCE_CONTINUE;
+
+	if (state != bench->last_state)
+	{
+		bench->last_state = state;
+		bench->acted = FALSE;
+	}
+
+	if (bench->in_session && now - bench->session_start > bench->session_timeout * G_USEC_PER_SEC)
+	{
+		g_printerr ("session %u stuck in %s for %i s, giving up\n", bench->sessions_done + 1, photo_booth_state_get_name (state), bench->session_timeout);
+		bench->sessions_failed++;
+		bench->run_end = now;
+		g_application_quit (G_APPLICATION (bench->pb));
+		return G_SOURCE_REMOVE;
+	}
+
+	switch (state) {
+		case PB_STATE_PREVIEW:
+		{
+			if (bench->in_session && bench->left_preview)
+			{
+				bench->in_session = FALSE;
+				bench->sessions_done++;
+				g_print ("session %u/%u done in %.2f s\n", bench->sessions_done, bench->n_sessions, (now - bench->session_start) / (gdouble) G_USEC_PER_SEC);
+				photo_booth_bench_sample_memory (bench);
+				if (bench->sessions_done == bench->n_sessions)
+				{
+					bench->run_end = now;
+					g_application_quit (G_APPLICATION (bench->pb));
+					return G_SOURCE_REMOVE;
+				}
+			}
+			// a tap that arrives before the preview is really running is dropped, so tap again
+			if (!bench->in_session || (!bench->left_preview && now - bench->session_start > BENCH_RETAP_TIMEOUT * G_USEC_PER_SEC))
+			{
+				if (!bench->run_start)
+					bench->run_start = now;
+				if (!bench->in_session)
+					bench->session_start = now;
+				bench->in_session = TRUE;
+				bench->left_preview = FALSE;
+				photo_booth_background_clicked (NULL, NULL, PHOTO_BOOTH_WINDOW (win));
+			}
+			return G_SOURCE_CONTINUE;
+		}
+		case PB_STATE_NONE:
+			return G_SOURCE_CONTINUE;
+		default:
+			break;
+	}
+
+	if (bench->in_session)
+		bench->left_preview = TRUE;
+	if (bench->acted)
+		return G_SOURCE_CONTINUE;
+
+	switch (state) {
+		case PB_STATE_MASQUERADE_PHOTO:
+		case PB_STATE_ASK_PRINT:
+			bench->acted = TRUE;
+			photo_booth_button_print_clicked (NULL, PHOTO_BOOTH_WINDOW (win));
+			break;
+		case PB_STATE_ASK_PUBLISH:
+			bench->acted = TRUE;
+			photo_booth_button_publish_clicked (NULL, PHOTO_BOOTH_WINDOW (win));
+			break;
+		case PB_STATE_SCREENSAVER:
+			bench->acted = TRUE;
+			photo_booth_background_clicked (NULL, NULL, PHOTO_BOOTH_WINDOW (win));
+			break;
+		default:
+			break;
+	}
+	return G_SOURCE_CONTINUE;
+}
+
+static void photo_booth_bench_stat_free (PhotoBoothBenchStat *stat)
+{
+	g_array_free (stat->wall, TRUE);
+	g_free (stat);
+}
+
+static PhotoBoothBenchStat *photo_booth_bench_stat_lookup (GHashTable *stats, GPtrArray *order, const gchar *name)
+{
+	PhotoBoothBenchStat *stat = g_hash_table_lookup (stats, name);
+	if (!stat)
+	{
+		stat = g_new0 (PhotoBoothBenchStat, 1);
+		stat->wall = g_array_new (FALSE, FALSE, sizeof (gdouble));
+		g_hash_table_insert (stats, g_strdup (name), stat);
+		g_ptr_array_add (order, g_strdup (name));
+	}
+	return stat;
+}
+
+static gint photo_booth_bench_compare (gconstpointer a, gconstpointer b)
+{
+	gdouble x = *(const gdouble *) a, y = *(const gdouble *) b;
+	return (x > y) - (x < y);
+}
+
+/* nearest rank, same as photo_booth_metrics_quantile and trace_report.py */
+static gdouble photo_booth_bench_quantile (GArray *sorted, gdouble q)
+{
+	guint rank = (guint) (q * sorted->len + 0.999999);
+	rank = CLAMP (rank, 1, sorted->len);
+	return g_array_index (sorted, gdouble, rank - 1);
+}
+
+static guint photo_booth_bench_read_trace (const gchar *filename, GHashTable *stages, GPtrArray *stage_order, GHashTable *milestones, GPtrArray *milestone_order)
+{
+	gchar *contents = NULL, **lines;
+	GError *error = NULL;
+	guint i, n_sessions = 0;
+
+	if (!g_file_get_contents (filename, &contents, NULL, &error))
+	{
+		g_printerr ("can't read trace %s: %s\n", filename, error->message);
+		g_error_free (error);
+		return 0;
+	}
+
+	lines = g_strsplit (contents, "\n", -1);
+	for (i = 0; lines[i]; i++)
+	{
+		JsonParser *parser;
+		JsonArray *events;
+		GHashTable *seen;
+		const gchar *stage = NULL;
+		gdouble stage_t = 0, stage_cpu = 0;
+		gint64 stage_rss = 0;
+		guint j;
+
+		if (!*g_strstrip (lines[i]))
+			continue;
+		parser = json_parser_new ();
+		if (!json_parser_load_from_data (parser, lines[i], -1, &error))
+		{
+			g_printerr ("skipping broken trace line %u: %s\n", i + 1, error->message);
+			g_clear_error (&error);
+			g_object_unref (parser);
+			continue;
+		}
+		n_sessions++;
+		events = json_object_get_array_member (json_node_get_object (json_parser_get_root (parser)), "events");
+		seen = g_hash_table_new (g_str_hash, g_str_equal);
+		for (j = 0; j < json_array_get_length (events); j++)
+		{
+			JsonObject *event = json_array_get_object_element (events, j);
+			gdouble t = json_object_get_double_member (event, "t_ms");
+			gdouble cpu = json_object_get_double_member (event, "cpu_ms");
+			gint64 rss = json_object_get_int_member (event, "rss_kb");
+
+			stage_rss = MAX (stage_rss, rss);
+			if (json_object_has_member (event, "state"))
+			{
+				// a state lasts until the next one, the final preview closes the session
+				if (stage)
+				{
+					PhotoBoothBenchStat *stat = photo_booth_bench_stat_lookup (stages, stage_order, stage);
+					gdouble wall = t - stage_t;
+					g_array_append_val (stat->wall, wall);
+					stat->cpu_sum += cpu - stage_cpu;
+					stat->rss_max = MAX (stat->rss_max, stage_rss);
+				}
+				stage = json_object_get_string_member (event, "state");
+				stage_t = t;
+				stage_cpu = cpu;
+				stage_rss = rss;
+			}
+			else
+			{
+				const gchar *name = json_object_get_string_member (event, "event");
+				if (!g_hash_table_contains (seen, name))
+				{
+					PhotoBoothBenchStat *stat = photo_booth_bench_stat_lookup (milestones, milestone_order, name);
+					g_array_append_val (stat->wall, t);
+					stat->cpu_sum += cpu;
+					stat->rss_max = MAX (stat->rss_max, rss);
+					g_hash_table_add (seen, (gpointer) name);
+				}
+			}
+		}
+		g_hash_table_destroy (seen);
+		g_object_unref (parser);
+	}
+	g_strfreev (lines);
+	g_free (contents);
+	return n_sessions;
+}
+
+static void photo_booth_bench_print_stats (const gchar *title, GHashTable *stats, GPtrArray *order)
+{
+	guint i;
+	g_print ("\n%-28s %6s %9s %9s %9s %10s\n", title, "count", "p50", "p95", "cpu/avg", "rss/max");
+	for (i = 0; i < order->len; i++)
+	{
+		const gchar *name = g_ptr_array_index (order, i);
+		PhotoBoothBenchStat *stat = g_hash_table_lookup (stats, name);
+		g_array_sort (stat->wall, photo_booth_bench_compare);
+		g_print ("%-28s %6u %8.3fs %8.3fs %7.0fms %8"G_GINT64_FORMAT"kB\n", name, stat->wall->len,
+			photo_booth_bench_quantile (stat->wall, 0.5) / 1000.0,
+			photo_booth_bench_quantile (stat->wall, 0.95) / 1000.0,
+			stat->cpu_sum / stat->wall->len, stat->rss_max);
+	}
+}
+
+/* least squares slope of the resident size over the measured sessions times their number, so a single
+ * late spike of the allocator doesn't fail the run but a steady leak of a few kB per guest does */
+static gdouble photo_booth_bench_rss_growth (GArray *rss)
+{
+	gdouble n = rss->len, sx = 0, sy = 0, sxx = 0, sxy = 0;
+	guint i;
+	if (rss->len < 2)
+		return 0;
+	for (i = 0; i < rss->len; i++)
+	{
+		gdouble y = g_array_index (rss, gdouble, i);
+		sx += i;
+		sy += y;
+		sxx += (gdouble) i * i;
+		sxy += i * y;
+	}
+	return (n * sxy - sx * sy) / (n * sxx - sx * sx) * n;
+}
+
+static gboolean photo_booth_bench_check_memory (PhotoBoothBench *bench)
+{
+	gboolean ok = TRUE;
+	gdouble growth = photo_booth_bench_rss_growth (bench->rss);
+	PhotoBoothMemorySubsystem i;
+
+	if (!bench->rss->len)
+		return TRUE;
+	g_print ("\nrss after warmup: %.0f kB -> %.0f kB, trend %+.0f kB over %u sessions (%+.2f kB/guest)\n",
+		g_array_index (bench->rss, gdouble, 0), g_array_index (bench->rss, gdouble, bench->rss->len - 1),
+		growth, bench->rss->len, growth / bench->rss->len);
+	g_print ("%-28s %9s %9s %12s %12s\n", "tracked", "objects", "baseline", "bytes", "baseline");
+	for (i = 0; i < MEMORY_SUBSYSTEMS; i++)
+	{
+		gboolean leaking = bench->final_objects[i] > bench->baseline_objects[i] + BENCH_OBJECT_SLACK;
+		g_print ("%-28s %9u %9u %12" G_GINT64_FORMAT " %12" G_GINT64_FORMAT "%s\n", photo_booth_memory_subsystem_name (i),
+			bench->final_objects[i], bench->baseline_objects[i], bench->final_bytes[i], bench->baseline_bytes[i], leaking ? "  LEAK" : "");
+		if (max_rss_growth > 0 && leaking)
+			ok = FALSE;
+	}
+	if (max_rss_growth > 0 && growth > max_rss_growth)
+	{
+		g_printerr ("resident size grew by %.0f kB, more than the allowed %i kB\n", growth, max_rss_growth);
+		ok = FALSE;
+	}
+	return ok;
+}
+
+static void photo_booth_bench_report (PhotoBoothBench *bench, const gchar *trace)
+{
+	GHashTable *stages, *milestones;
+	GPtrArray *stage_order, *milestone_order;
+	struct rusage usage;
+	gdouble elapsed = (bench->run_end - bench->run_start) / (gdouble) G_USEC_PER_SEC;
+	guint traced;
+
+	stages = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, (GDestroyNotify) photo_booth_bench_stat_free);
+	milestones = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, (GDestroyNotify) photo_booth_bench_stat_free);
+	stage_order = g_ptr_array_new_with_free_func (g_free);
+	milestone_order = g_ptr_array_new_with_free_func (g_free);
+	traced = photo_booth_bench_read_trace (trace, stages, stage_order, milestones, milestone_order);
+
+	getrusage (RUSAGE_SELF, &usage);
+	g_print ("\n%u of %u sessions done, %u failed, %u traced in %.1f s\n", bench->sessions_done, bench->n_sessions, bench->sessions_failed, traced, elapsed);
+	if (elapsed > 0)
+		g_print ("throughput: %.1f guests/hour\n", bench->sessions_done * 3600.0 / elapsed);
+	g_print ("peak rss: %ld kB, cpu: %.1f s user %.1f s system\n", usage.ru_maxrss,
+		usage.ru_utime.tv_sec + usage.ru_utime.tv_usec / 1e6, usage.ru_stime.tv_sec + usage.ru_stime.tv_usec / 1e6);
+
+	photo_booth_bench_print_stats ("state", stages, stage_order);
+	photo_booth_bench_print_stats ("since touch", milestones, milestone_order);
+
+	g_ptr_array_free (milestone_order, TRUE);
+	g_ptr_array_free (stage_order, TRUE);
+	g_hash_table_destroy (milestones);
+	g_hash_table_destroy (stages);
+}
+
+int main (int argc, char *argv[])
+{
+	PhotoBoothBench bench;
+	GOptionContext *context;
+	GError *error = NULL;
+	gchar *app_argv[] = { argv[0], NULL };
+	gboolean temp_trace = FALSE;
+	int ret;
+
+	context = g_option_context_new ("[CONFIG] - run guests through the photobooth without hardware");
+	g_option_context_add_main_entries (context, bench_entries, NULL);
+	if (!g_option_context_parse (context, &argc, &argv, &error))
+	{
+		g_printerr ("%s\n", error->message);
+		g_error_free (error);
+		return EXIT_FAILURE;
+	}
+	g_option_context_free (context);
+	if (n_sessions < 1 || session_timeout < 1)
+	{
+		g_printerr ("sessions and timeout must be positive\n");
+		return EXIT_FAILURE;
+	}
+	if (warmup_sessions < 0)
+		warmup_sessions = n_sessions / 10;
+
+	if (trace_filename)
+		g_file_set_contents (trace_filename, "", 0, NULL);
+	else
+	{
+		gint fd = g_file_open_tmp ("photobooth-bench-XXXXXX.jsonl", &trace_filename, &error);
+		if (fd == -1)
+		{
+			g_printerr ("can't create trace file: %s\n", error->message);
+			g_error_free (error);
+			return EXIT_FAILURE;
+		}
+		close (fd);
+		temp_trace = TRUE;
+	}
+
+	XInitThreads();
+	gst_init (0, NULL);
+
+	memset (&bench, 0, sizeof (bench));
+	bench.pb = photo_booth_new ();
+	bench.n_sessions = n_sessions;
+	bench.session_timeout = session_timeout;
+	bench.last_state = PB_STATE_NONE;
+	bench.warmup = MIN (warmup_sessions, n_sessions);
+	bench.rss = g_array_new (FALSE, FALSE, sizeof (gdouble));
+
+	// don't hand over to a booth that is already running
+	g_application_set_flags (G_APPLICATION (bench.pb), G_APPLICATION_HANDLES_OPEN | G_APPLICATION_NON_UNIQUE);
+	photo_booth_load_settings (bench.pb, argc > 1 ? argv[1] : DEFAULT_BENCH_CONFIG);
+	photo_booth_trace_set_location (photo_booth_trace_get_default (), trace_filename);
+
+	g_unix_signal_add (SIGINT, (GSourceFunc) photo_booth_quit_signal, bench.pb);
+	g_timeout_add (BENCH_TICK_MS, (GSourceFunc) photo_booth_bench_tick, &bench);
+	g_application_run (G_APPLICATION (bench.pb), 1, app_argv);
+
+	// finalizing the booth joins the upload threads and flushes the last session to the trace
+	g_object_unref (bench.pb);
+	if (!bench.run_end)
+		bench.run_end = g_get_monotonic_time ();
+
+	photo_booth_bench_report (&bench, trace_filename);
+	ret = (bench.sessions_done == bench.n_sessions && !bench.sessions_failed) ? EXIT_SUCCESS : EXIT_FAILURE;
+	if (!photo_booth_bench_check_memory (&bench))
+		ret = EXIT_FAILURE;
+	g_array_free (bench.rss, TRUE);
+
+	if (temp_trace)
+		g_unlink (trace_filename);
+	else
+		g_print ("\nsession trace kept in %s\n", trace_filename);
+	g_free (trace_filename);
+	return ret;
+}
@@ -0,0 +1,725 @@
+/*
+ * GStreamer photoboothcamera.c
+ * Copyright 2019 Andreas Frisch <fraxinas@schaffenburg.org>
+ *
+ * This program is licensed under the Creative Commons
+ * Attribution-NonCommercial-ShareAlike 3.0 Unported
+ * License. To view a copy of this license, visit
+ * http://creativecommons.org/licenses/by-nc-sa/3.0/ or send a letter to
+ * Creative Commons,559 Nathan Abbott Way,Stanford,California 94305,USA.
+ *
+ * This program is NOT free software. It is open source, you are allowed
+ * to modify it (if you keep the license), but it may not be commercially
+ * distributed other than under the conditions noted above.
+ */
+
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "photobooth.h"
+#include "photoboothcamera.h"
+
+#define SIMULATED_DEFAULT_PREVIEW_FPS 25
+
+GST_DEBUG_CATEGORY_STATIC (photo_booth_camera_debug);
+#define GST_CAT_DEFAULT photo_booth_camera_debug
+
+G_DEFINE_ABSTRACT_TYPE (PhotoBoothCamera, photo_booth_camera, G_TYPE_OBJECT);
+
+/* PhotoBoothCamera base class */
+
+static void
+photo_booth_camera_finalize (GObject *object)
+{
+	PhotoBoothCamera *camera = PHOTO_BOOTH_CAMERA (object);
+	GST_DEBUG_OBJECT (camera, "finalize %s", camera->name);
+	g_free (camera->name);
+	g_mutex_clear (&camera->cancel_lock);
+	g_cond_clear (&camera->cancel_cond);
+	G_OBJECT_CLASS (photo_booth_camera_parent_class)->finalize (object);
+}
+
+static void
+photo_booth_camera_class_init (PhotoBoothCameraClass *klass)
+{
+	GST_DEBUG_CATEGORY_INIT (photo_booth_camera_debug, "photoboothcamera", GST_DEBUG_BOLD | GST_DEBUG_FG_WHITE | GST_DEBUG_BG_GREEN, "PhotoBoothCamera");
+	G_OBJECT_CLASS (klass)->finalize = photo_booth_camera_finalize;
+	klass->open = NULL;
+	klass->close = NULL;
+	klass->capture_preview = NULL;
+	klass->capture = NULL;
+	klass->download = NULL;
+	klass->focus = NULL;
+}
+
+static void
+photo_booth_camera_init (PhotoBoothCamera *camera)
+{
+	camera->name = NULL;
+	g_mutex_init (&camera->cancel_lock);
+	g_cond_init (&camera->cancel_cond);
+	camera->cancelled = FALSE;
+}
+
+/* every call starts out uncancelled, a cancel only ever aborts the call that is running */
+static void
+photo_booth_camera_begin_call (PhotoBoothCamera *camera)
+{
+	g_mutex_lock (&camera->cancel_lock);
+	camera->cancelled = FALSE;
+	g_mutex_unlock (&camera->cancel_lock);
+}
+
+gint
+photo_booth_camera_open (PhotoBoothCamera *camera)
+{
+	photo_booth_camera_begin_call (camera);
+	return PHOTO_BOOTH_CAMERA_GET_CLASS (camera)->open (camera);
+}
+
+void
+photo_booth_camera_close (PhotoBoothCamera *camera)
+{
+	PHOTO_BOOTH_CAMERA_GET_CLASS (camera)->close (camera);
+}
+
+gint
+photo_booth_camera_capture_preview (PhotoBoothCamera *camera, gint fd)
+{
+	photo_booth_camera_begin_call (camera);
+	return PHOTO_BOOTH_CAMERA_GET_CLASS (camera)->capture_preview (camera, fd);
+}
+
+gint
+photo_booth_camera_capture (PhotoBoothCamera *camera)
+{
+	photo_booth_camera_begin_call (camera);
+	return PHOTO_BOOTH_CAMERA_GET_CLASS (camera)->capture (camera);
+}
+
+gint
+photo_booth_camera_download (PhotoBoothCamera *camera, gchar **data, unsigned long *size)
+{
+	*data = NULL;
+	*size = 0;
+	photo_booth_camera_begin_call (camera);
+	return PHOTO_BOOTH_CAMERA_GET_CLASS (camera)->download (camera, data, size);
+}
+
+gboolean
+photo_booth_camera_focus (PhotoBoothCamera *camera)
+{
+	PhotoBoothCameraClass *klass = PHOTO_BOOTH_CAMERA_GET_CLASS (camera);
+	photo_booth_camera_begin_call (camera);
+	return klass->focus ? klass->focus (camera) : TRUE;
+}
+
+/* may be called from any thread, e.g. by the watchdog when a call hangs */
+void
+photo_booth_camera_cancel (PhotoBoothCamera *camera)
+{
+	g_mutex_lock (&camera->cancel_lock);
+	camera->cancelled = TRUE;
+	g_cond_broadcast (&camera->cancel_cond);
+	g_mutex_unlock (&camera->cancel_lock);
+	GST_INFO_OBJECT (camera, "cancelling running %s camera call", camera->name);
+}
+
+gboolean
+photo_booth_camera_is_cancelled (PhotoBoothCamera *camera)
+{
+	gboolean cancelled;
+	g_mutex_lock (&camera->cancel_lock);
+	cancelled = camera->cancelled;
+	g_mutex_unlock (&camera->cancel_lock);
+	return cancelled;
+}
+
+gboolean
+photo_booth_camera_wait (PhotoBoothCamera *camera, gint64 usec)
+{
+	gint64 end_time = g_get_monotonic_time () + usec;
+	gboolean cancelled;
+
+	g_mutex_lock (&camera->cancel_lock);
+	while (!camera->cancelled)
+	{
+		if (usec < 0)
+			g_cond_wait (&camera->cancel_cond, &camera->cancel_lock);
+		else if (!g_cond_wait_until (&camera->cancel_cond, &camera->cancel_lock, end_time))
+			break;
+	}
+	cancelled = camera->cancelled;
+	g_mutex_unlock (&camera->cancel_lock);
+	return !cancelled;
+}
+
+/* gphoto2 camera on USB */
+
+typedef struct
+{
+	PhotoBoothCamera parent;
+	Camera *camera;
+	GPContext *context;
+	CameraFile *preview_file;
+	gint preview_fd;
+	CameraFilePath path;
+	gboolean keep_files, configured;
+} PhotoBoothCameraGPhoto;
+
+typedef struct
+{
+	PhotoBoothCameraClass parent_class;
+} PhotoBoothCameraGPhotoClass;
+
+static GType photo_booth_camera_gphoto_get_type (void);
+G_DEFINE_TYPE (PhotoBoothCameraGPhoto, photo_booth_camera_gphoto, TYPE_PHOTO_BOOTH_CAMERA);
+
+extern int camera_auto_focus (Camera *list, GPContext *context, int onoff);
+
+/* polled by libgphoto2 during lengthy operations, not every camera driver honours it */
+static GPContextFeedback
+photo_booth_camera_gphoto_cancel_func (G_GNUC_UNUSED GPContext *context, void *data)
+{
+	return photo_booth_camera_is_cancelled (PHOTO_BOOTH_CAMERA (data)) ? GP_CONTEXT_FEEDBACK_CANCEL : GP_CONTEXT_FEEDBACK_OK;
+}
+
+static void
+photo_booth_camera_gphoto_config (PhotoBoothCameraGPhoto *gphoto)
+{
+	int ret;
+	CameraWidgetType	type;
+	CameraWidget *rootconfig = NULL, *child;
+	const char *name = "capturetarget";
+	const char *value = gphoto->keep_files ? "1" : "0";
+	ret = gp_camera_get_single_config (gphoto->camera, name, &child, gphoto->context);
+	rootconfig = child;
+	if (ret != GP_OK)
+		goto fail;
+	ret = gp_widget_get_child_by_name (rootconfig, name, &child);
+	if (ret != GP_OK)
+		goto fail;
+	ret = gp_widget_get_type (child, &type);
+	if (ret != GP_OK)
+		goto fail;
+	if (type == GP_WIDGET_RADIO)
+	{
+		int cnt, i;
+		char *endptr;
+		cnt = gp_widget_count_choices (child);
+		if (cnt < GP_OK) {
+			ret = cnt;
+			goto fail;
+		}
+		ret = GP_ERROR_BAD_PARAMETERS;
+		for ( i=0; i<cnt; i++) {
+			const char *choice;
+
+			ret = gp_widget_get_choice (child, i, &choice);
+			if (ret != GP_OK)
+				continue;
+			if (!strcmp (choice, value)) {
+				ret = gp_widget_set_value (child, value);
+				break;
+			}
+		}
+		if (i != cnt)
+			goto fail;
+		i = strtol (value, &endptr, 10);
+		if ((value != endptr) && (*endptr == '\0')) {
+			if ((i>= 0) && (i < cnt)) {
+				const char *choice;
+				ret = gp_widget_get_choice (child, i, &choice);
+				if (ret == GP_OK)
+					ret = gp_widget_set_value (child, choice);
+			}
+		}
+		ret = gp_widget_set_value (child, value);
+		if (ret != GP_OK)
+			goto fail;
+		ret = gp_camera_set_single_config (gphoto->camera, name, child, gphoto->context);
+		if (ret != GP_OK)
+			goto fail;
+		GST_INFO ("capturetarget configured to %s in camera", value);
+		gp_widget_free (rootconfig);
+		return;
+	}
+
+fail:
+	GST_WARNING ("couldn't set %s config!", name);
+	if (rootconfig)
+		gp_widget_free (rootconfig);
+}
+
+static void
+photo_booth_camera_gphoto_close (PhotoBoothCamera *camera)
+{
+	PhotoBoothCameraGPhoto *gphoto = (PhotoBoothCameraGPhoto *) camera;
+	int retval;
+	if (!gphoto->camera)
+		return;
+	retval = gp_camera_exit (gphoto->camera, gphoto->context);
+	GST_DEBUG ("gp_camera_exit returned %i", retval);
+	gp_camera_free (gphoto->camera);
+	gp_context_unref (gphoto->context);
+	gphoto->camera = NULL;
+	gphoto->context = NULL;
+}
+
+static gint
+photo_booth_camera_gphoto_open (PhotoBoothCamera *camera)
+{
+	PhotoBoothCameraGPhoto *gphoto = (PhotoBoothCameraGPhoto *) camera;
+	int retval;
+	gphoto->context = gp_context_new ();
+	gp_context_set_cancel_func (gphoto->context, photo_booth_camera_gphoto_cancel_func, camera);
+	gp_camera_new (&gphoto->camera);
+	retval = gp_camera_init (gphoto->camera, gphoto->context);
+	GST_DEBUG ("gp_camera_init returned %d camera@%p", retval, (void*) gphoto->camera);
+	if (retval != GP_OK)
+		photo_booth_camera_gphoto_close (camera);
+	else if (!gphoto->configured)
+	{
+		photo_booth_camera_gphoto_config (gphoto);
+		gphoto->configured = TRUE;
+	}
+	return retval;
+}
+
+static gint
+photo_booth_camera_gphoto_capture_preview (PhotoBoothCamera *camera, gint fd)
+{
+	PhotoBoothCameraGPhoto *gphoto = (PhotoBoothCameraGPhoto *) camera;
+	const char *mime;
+	int gpret;
+
+	if (!gphoto->preview_file || gphoto->preview_fd != fd)
+	{
+		if (gphoto->preview_file)
+			gp_file_unref (gphoto->preview_file);
+		gphoto->preview_file = NULL;
+		gpret = gp_file_new_from_fd (&gphoto->preview_file, fd);
+		if (gpret != GP_OK)
+		{
+			GST_ERROR ("gp_file_new_from_fd (%d) failed!", fd);
+			return gpret;
+		}
+		gphoto->preview_fd = fd;
+	}
+	gpret = gp_camera_capture_preview (gphoto->camera, gphoto->preview_file, gphoto->context);
+	if (gpret < 0)
+		return gpret;
+	gp_file_get_mime_type (gphoto->preview_file, &mime);
+	if (strcmp (mime, GP_MIME_JPEG)) {
+		GST_ERROR ("Movie capture error... Unhandled MIME type '%s'.", mime);
+		return GP_ERROR_NOT_SUPPORTED;
+	}
+	return GP_OK;
+}
+
+static gint
+photo_booth_camera_gphoto_capture (PhotoBoothCamera *camera)
+{
+	PhotoBoothCameraGPhoto *gphoto = (PhotoBoothCameraGPhoto *) camera;
+	int gpret;
+	gpret = gp_camera_capture (gphoto->camera, GP_CAPTURE_IMAGE, &gphoto->path, gphoto->context);
+	GST_DEBUG ("gp_camera_capture gpret=%i Pathname on the camera: %s/%s", gpret, gphoto->path.folder, gphoto->path.name);
+	return gpret;
+}
+
+static gint
+photo_booth_camera_gphoto_download (PhotoBoothCamera *camera, gchar **data, unsigned long *size)
+{
+	PhotoBoothCameraGPhoto *gphoto = (PhotoBoothCameraGPhoto *) camera;
+	CameraFile *file;
+	const char *file_data;
+	int gpret;
+
+	gpret = gp_file_new (&file);
+	GST_DEBUG ("gp_file_new gpret=%i", gpret);
+
+	gpret = gp_camera_file_get (gphoto->camera, gphoto->path.folder, gphoto->path.name, GP_FILE_TYPE_NORMAL, file, gphoto->context);
+	GST_DEBUG ("gp_camera_file_get gpret=%i", gpret);
+	if (gpret < 0)
+	{
+		gp_file_unref (file);
+		return gpret;
+	}
+	// the caller g_free()s the data, so it gets its own copy and the file goes with the rest of libgphoto's buffers
+	gpret = gp_file_get_data_and_size (file, &file_data, size);
+	if (gpret < 0)
+	{
+		gp_file_unref (file);
+		return gpret;
+	}
+	*data = g_malloc (*size);
+	memcpy (*data, file_data, *size);
+	gp_file_unref (file);
+
+	if (!gphoto->keep_files)
+	{
+		gpret = gp_camera_file_delete (gphoto->camera, gphoto->path.folder, gphoto->path.name, gphoto->context);
+		GST_DEBUG ("gp_camera_file_delete gpret=%i", gpret);
+	}
+	return GP_OK;
+}
+
+static gboolean
+photo_booth_camera_gphoto_focus (PhotoBoothCamera *camera)
+{
+	PhotoBoothCameraGPhoto *gphoto = (PhotoBoothCameraGPhoto *) camera;
+	int gpret;
+	CameraEventType evttype;
+	void *evtdata;
+
+	do {
+		gpret = gp_camera_wait_for_event (gphoto->camera, 10, &evttype, &evtdata, gphoto->context);
+		GST_DEBUG ("gp_camera_wait_for_event gpret=%i", gpret);
+	} while ((gpret == GP_OK) && (evttype != GP_EVENT_TIMEOUT));
+
+	gpret = camera_auto_focus (gphoto->camera, gphoto->context, 1);
+	if (gpret != GP_OK) {
+		GST_WARNING ("gphoto error: %s\n", gp_result_as_string(gpret));
+		return FALSE;
+	}
+
+	do {
+		GST_DEBUG ("gp_camera_wait_for_event gpret=%i", gpret);
+		gpret = gp_camera_wait_for_event (gphoto->camera, 10, &evttype, &evtdata, gphoto->context);
+	} while ((gpret == GP_OK) && (evttype != GP_EVENT_TIMEOUT));
+
+	gpret = camera_auto_focus (gphoto->camera, gphoto->context, 0);
+	if (gpret != GP_OK) {
+		GST_WARNING ("gphoto error: %s\n", gp_result_as_string(gpret));
+	}
+	return TRUE;
+}
+
+static void
+photo_booth_camera_gphoto_finalize (GObject *object)
+{
+	PhotoBoothCameraGPhoto *gphoto = (PhotoBoothCameraGPhoto *) object;
+	photo_booth_camera_gphoto_close (PHOTO_BOOTH_CAMERA (object));
+	if (gphoto->preview_file)
+		gp_file_unref (gphoto->preview_file);
+	G_OBJECT_CLASS (photo_booth_camera_gphoto_parent_class)->finalize (object);
+}
+
+static void
+photo_booth_camera_gphoto_class_init (PhotoBoothCameraGPhotoClass *klass)
+{
+	G_OBJECT_CLASS (klass)->finalize = photo_booth_camera_gphoto_finalize;
+	PHOTO_BOOTH_CAMERA_CLASS (klass)->open = photo_booth_camera_gphoto_open;
+	PHOTO_BOOTH_CAMERA_CLASS (klass)->close = photo_booth_camera_gphoto_close;
+	PHOTO_BOOTH_CAMERA_CLASS (klass)->capture_preview = photo_booth_camera_gphoto_capture_preview;
+	PHOTO_BOOTH_CAMERA_CLASS (klass)->capture = photo_booth_camera_gphoto_capture;
+	PHOTO_BOOTH_CAMERA_CLASS (klass)->download = photo_booth_camera_gphoto_download;
+	PHOTO_BOOTH_CAMERA_CLASS (klass)->focus = photo_booth_camera_gphoto_focus;
+}
+
+static void
+photo_booth_camera_gphoto_init (PhotoBoothCameraGPhoto *gphoto)
+{
+	gphoto->camera = NULL;
+	gphoto->context = NULL;
+	gphoto->preview_file = NULL;
+	gphoto->preview_fd = -1;
+	gphoto->keep_files = FALSE;
+	gphoto->configured = FALSE;
+}
+
+PhotoBoothCamera *
+photo_booth_camera_gphoto_new (gboolean keep_files)
+{
+	PhotoBoothCameraGPhoto *gphoto = g_object_new (photo_booth_camera_gphoto_get_type (), NULL);
+	PHOTO_BOOTH_CAMERA (gphoto)->name = g_strdup ("gphoto");
+	gphoto->keep_files = keep_files;
+	return PHOTO_BOOTH_CAMERA (gphoto);
+}
+
+/* simulated camera which replays a directory of live view jpegs and hands out stored photos,
+ * for running the booth without hardware. failures are drawn from a seeded generator so a
+ * benchmark run injects them at the same shots every time */
+
+typedef struct
+{
+	PhotoBoothCamera parent;
+	gchar *preview_dir, *photo_dir;
+	GPtrArray *frames;        // GBytes of every live view frame, loaded on first open
+	GPtrArray *photos;        // filenames of the full resolution photos
+	guint next_frame, next_photo, captured;
+	gint64 last_frame_time;
+	gint preview_fps, capture_delay, download_delay;
+	gint preview_error_rate, capture_error_rate, error_code;
+	gint preview_hang_rate, capture_hang_rate;
+	GRand *rand;
+	gboolean opened;
+} PhotoBoothCameraSimulated;
+
+typedef struct
+{
+	PhotoBoothCameraClass parent_class;
+} PhotoBoothCameraSimulatedClass;
+
+static GType photo_booth_camera_simulated_get_type (void);
+G_DEFINE_TYPE (PhotoBoothCameraSimulated, photo_booth_camera_simulated, TYPE_PHOTO_BOOTH_CAMERA);
+
+static gint _compare_filenames (gconstpointer a, gconstpointer b)
+{
+	return g_strcmp0 (*(const gchar * const *) a, *(const gchar * const *) b);
+}
+
+/* sorted paths of the jpegs in dir */
+static GPtrArray *photo_booth_camera_simulated_list (const gchar *dir)
+{
+	GPtrArray *files = g_ptr_array_new_with_free_func (g_free);
+	GError *error = NULL;
+	const gchar *name;
+	GDir *gdir = g_dir_open (dir, 0, &error);
+
+	if (!gdir)
+	{
+		GST_WARNING ("can't open simulated camera directory: %s", error->message);
+		g_error_free (error);
+		return files;
+	}
+	while ((name = g_dir_read_name (gdir)))
+	{
+		gchar *lower = g_ascii_strdown (name, -1);
+		if (g_str_has_suffix (lower, ".jpg") || g_str_has_suffix (lower, ".jpeg"))
+			g_ptr_array_add (files, g_build_filename (dir, name, NULL));
+		g_free (lower);
+	}
+	g_dir_close (gdir);
+	g_ptr_array_sort (files, _compare_filenames);
+	return files;
+}
+
+static gboolean photo_booth_camera_simulated_fails (PhotoBoothCameraSimulated *sim, gint rate)
+{
+	return rate > 0 && g_rand_int_range (sim->rand, 0, 100) < rate;
+}
+
+static gint
+photo_booth_camera_simulated_open (PhotoBoothCamera *camera)
+{
+	PhotoBoothCameraSimulated *sim = (PhotoBoothCameraSimulated *) camera;
+	guint i;
+
+	if (!sim->frames)
+	{
+		GPtrArray *files = photo_booth_camera_simulated_list (sim->preview_dir);
+		sim->frames = g_ptr_array_new_with_free_func ((GDestroyNotify) g_bytes_unref);
+		for (i = 0; i < files->len; i++)
+		{
+			gchar *contents;
+			gsize length;
+			if (g_file_get_contents (g_ptr_array_index (files, i), &contents, &length, NULL))
+				g_ptr_array_add (sim->frames, g_bytes_new_take (contents, length));
+		}
+		// without a photo directory the live view frames stand in for the photos
+		sim->photos = sim->photo_dir ? photo_booth_camera_simulated_list (sim->photo_dir) : g_ptr_array_ref (files);
+		g_ptr_array_unref (files);
+		GST_INFO_OBJECT (sim, "loaded %u live view frames from '%s', %u photos", sim->frames->len, sim->preview_dir, sim->photos->len);
+	}
+	if (!sim->frames->len || !sim->photos->len)
+	{
+		GST_WARNING_OBJECT (sim, "no jpegs found to simulate a camera with");
+		return GP_ERROR_MODEL_NOT_FOUND;
+	}
+	sim->opened = TRUE;
+	sim->last_frame_time = 0;
+	return GP_OK;
+}
+
+static void
+photo_booth_camera_simulated_close (PhotoBoothCamera *camera)
+{
+	PhotoBoothCameraSimulated *sim = (PhotoBoothCameraSimulated *) camera;
+	sim->opened = FALSE;
+}
+
+static gint
+photo_booth_camera_simulated_capture_preview (PhotoBoothCamera *camera, gint fd)
+{
+	PhotoBoothCameraSimulated *sim = (PhotoBoothCameraSimulated *) camera;
+	gint64 interval = G_USEC_PER_SEC / MAX (sim->preview_fps, 1);
+	gint64 now = g_get_monotonic_time ();
+	const guint8 *data;
+	gsize size, written = 0;
+	GBytes *frame;
+
+	if (!sim->opened)
+		return GP_ERROR_CAMERA_ERROR;
+	// the camera can't deliver faster than its own frame rate, no matter how often it is polled
+	if (sim->last_frame_time && now < sim->last_frame_time + interval
+		&& !photo_booth_camera_wait (camera, sim->last_frame_time + interval - now))
+		return GP_ERROR_CANCEL;
+	sim->last_frame_time = g_get_monotonic_time ();
+
+	if (photo_booth_camera_simulated_fails (sim, sim->preview_hang_rate))
+	{
+		GST_INFO_OBJECT (sim, "injecting live view hang");
+		photo_booth_camera_wait (camera, -1);
+		return GP_ERROR_CANCEL;
+	}
+
+	if (photo_booth_camera_simulated_fails (sim, sim->preview_error_rate))
+	{
+		GST_INFO_OBJECT (sim, "injecting live view error %i", sim->error_code);
+		return sim->error_code;
+	}
+
+	frame = g_ptr_array_index (sim->frames, sim->next_frame);
+	sim->next_frame = (sim->next_frame + 1) % sim->frames->len;
+	data = g_bytes_get_data (frame, &size);
+	while (written < size)
+	{
+		ssize_t ret = write (fd, data + written, size - written);
+		if (ret < 0 && errno == EINTR)
+			continue;
+		if (ret < 0)
+		{
+			GST_ERROR_OBJECT (sim, "writing live view frame failed: %s", g_strerror (errno));
+			return GP_ERROR_IO_WRITE;
+		}
+		written += ret;
+	}
+	return GP_OK;
+}
+
+static gint
+photo_booth_camera_simulated_capture (PhotoBoothCamera *camera)
+{
+	PhotoBoothCameraSimulated *sim = (PhotoBoothCameraSimulated *) camera;
+	if (!sim->opened)
+		return GP_ERROR_CAMERA_ERROR;
+	if (!photo_booth_camera_wait (camera, sim->capture_delay * G_TIME_SPAN_MILLISECOND))
+		return GP_ERROR_CANCEL;
+	if (photo_booth_camera_simulated_fails (sim, sim->capture_hang_rate))
+	{
+		GST_INFO_OBJECT (sim, "injecting capture hang");
+		photo_booth_camera_wait (camera, -1);
+		return GP_ERROR_CANCEL;
+	}
+	if (photo_booth_camera_simulated_fails (sim, sim->capture_error_rate))
+	{
+		GST_INFO_OBJECT (sim, "injecting capture error %i", sim->error_code);
+		return sim->error_code;
+	}
+	sim->captured++;
+	GST_DEBUG_OBJECT (sim, "captured photo #%u", sim->captured);
+	return GP_OK;
+}
+
+static gint
+photo_booth_camera_simulated_download (PhotoBoothCamera *camera, gchar **data, unsigned long *size)
+{
+	PhotoBoothCameraSimulated *sim = (PhotoBoothCameraSimulated *) camera;
+	const gchar *filename;
+	GError *error = NULL;
+	gsize length;
+
+	if (!sim->opened || !sim->captured)
+		return GP_ERROR_FILE_NOT_FOUND;
+	if (!photo_booth_camera_wait (camera, sim->download_delay * G_TIME_SPAN_MILLISECOND))
+		return GP_ERROR_CANCEL;
+	filename = g_ptr_array_index (sim->photos, sim->next_photo);
+	sim->next_photo = (sim->next_photo + 1) % sim->photos->len;
+	if (!g_file_get_contents (filename, data, &length, &error))
+	{
+		GST_ERROR_OBJECT (sim, "can't read simulated photo: %s", error->message);
+		g_error_free (error);
+		return GP_ERROR_IO_READ;
+	}
+	*size = length;
+	GST_DEBUG_OBJECT (sim, "downloaded '%s' (%lu bytes)", filename, *size);
+	return GP_OK;
+}
+
+static void
+photo_booth_camera_simulated_finalize (GObject *object)
+{
+	PhotoBoothCameraSimulated *sim = (PhotoBoothCameraSimulated *) object;
+	g_free (sim->preview_dir);
+	g_free (sim->photo_dir);
+	if (sim->frames)
+		g_ptr_array_unref (sim->frames);
+	if (sim->photos)
+		g_ptr_array_unref (sim->photos);
+	g_rand_free (sim->rand);
+	G_OBJECT_CLASS (photo_booth_camera_simulated_parent_class)->finalize (object);
+}
+
+static void
+photo_booth_camera_simulated_class_init (PhotoBoothCameraSimulatedClass *klass)
+{
+	G_OBJECT_CLASS (klass)->finalize = photo_booth_camera_simulated_finalize;
+	PHOTO_BOOTH_CAMERA_CLASS (klass)->open = photo_booth_camera_simulated_open;
+	PHOTO_BOOTH_CAMERA_CLASS (klass)->close = photo_booth_camera_simulated_close;
+	PHOTO_BOOTH_CAMERA_CLASS (klass)->capture_preview = photo_booth_camera_simulated_capture_preview;
+	PHOTO_BOOTH_CAMERA_CLASS (klass)->capture = photo_booth_camera_simulated_capture;
+	PHOTO_BOOTH_CAMERA_CLASS (klass)->download = photo_booth_camera_simulated_download;
+}
+
+static void
+photo_booth_camera_simulated_init (PhotoBoothCameraSimulated *sim)
+{
+	sim->preview_dir = NULL;
+	sim->photo_dir = NULL;
+	sim->frames = NULL;
+	sim->photos = NULL;
+	sim->next_frame = sim->next_photo = sim->captured = 0;
+	sim->last_frame_time = 0;
+	sim->preview_fps = SIMULATED_DEFAULT_PREVIEW_FPS;
+	sim->capture_delay = sim->download_delay = 0;
+	sim->preview_error_rate = sim->capture_error_rate = 0;
+	sim->preview_hang_rate = sim->capture_hang_rate = 0;
+	sim->error_code = GP_ERROR_IO;
+	sim->rand = g_rand_new_with_seed (0);
+	sim->opened = FALSE;
+}
+
+PhotoBoothCamera *
+photo_booth_camera_simulated_new (const gchar *preview_dir, const gchar *photo_dir)
+{
+	PhotoBoothCameraSimulated *sim = g_object_new (photo_booth_camera_simulated_get_type (), NULL);
+	PHOTO_BOOTH_CAMERA (sim)->name = g_strdup ("simulated");
+	sim->preview_dir = g_strdup (preview_dir);
+	sim->photo_dir = g_strdup (photo_dir);
+	return PHOTO_BOOTH_CAMERA (sim);
+}
+
+/* preview_fps is the rate the live view frames are replayed at, the delays are in ms */
+void
+photo_booth_camera_simulated_set_timing (PhotoBoothCamera *camera, gint preview_fps, gint capture_delay, gint download_delay)
+{
+	PhotoBoothCameraSimulated *sim = (PhotoBoothCameraSimulated *) camera;
+	g_return_if_fail (G_TYPE_CHECK_INSTANCE_TYPE (camera, photo_booth_camera_simulated_get_type ()));
+	sim->preview_fps = preview_fps > 0 ? preview_fps : SIMULATED_DEFAULT_PREVIEW_FPS;
+	sim->capture_delay = MAX (capture_delay, 0);
+	sim->download_delay = MAX (download_delay, 0);
+}
+
+/* rates are in percent of the calls, error_code is the gphoto2 result returned instead */
+void
+photo_booth_camera_simulated_set_failures (PhotoBoothCamera *camera, gint preview_error_rate, gint capture_error_rate, gint error_code, guint32 seed)
+{
+	PhotoBoothCameraSimulated *sim = (PhotoBoothCameraSimulated *) camera;
+	g_return_if_fail (G_TYPE_CHECK_INSTANCE_TYPE (camera, photo_booth_camera_simulated_get_type ()));
+	sim->preview_error_rate = CLAMP (preview_error_rate, 0, 100);
+	sim->capture_error_rate = CLAMP (capture_error_rate, 0, 100);
+	sim->error_code = error_code < 0 ? error_code : GP_ERROR_IO;
+	g_rand_set_seed (sim->rand, seed);
+}
+
+/* rates are in percent of the calls, a hanging call only returns once it is cancelled */
+void
+photo_booth_camera_simulated_set_hangs (PhotoBoothCamera *camera, gint preview_hang_rate, gint capture_hang_rate)
+{
+	PhotoBoothCameraSimulated *sim = (PhotoBoothCameraSimulated *) camera;
+	g_return_if_fail (G_TYPE_CHECK_INSTANCE_TYPE (camera, photo_booth_camera_simulated_get_type ()));
+	sim->preview_hang_rate = CLAMP (preview_hang_rate, 0, 100);
+	sim->capture_hang_rate = CLAMP (capture_hang_rate, 0, 100);
+}
@@ -0,0 +1,83 @@
+/*
+ * GStreamer photoboothcamera.h
+ * Copyright 2019 Andreas Frisch <fraxinas@schaffenburg.org>
+ *
+ * This program is licensed under the Creative Commons
+ * Attribution-NonCommercial-ShareAlike 3.0 Unported
+ * License. To view a copy of this license, visit
+ * http://creativecommons.org/licenses/by-nc-sa/3.0/ or send a letter to
+ * Creative Commons,559 Nathan Abbott Way,Stanford,California 94305,USA.
+ *
+ * This program is NOT free software. It is open source, you are allowed
+ * to modify it (if you keep the license), but it may not be commercially
+ * distributed other than under the conditions noted above.
+ */
+
+#ifndef __PHOTO_BOOTH_CAMERA_H__
+#define __PHOTO_BOOTH_CAMERA_H__
+
+#include <glib-object.h>
+#include <glib.h>
+#include <gphoto2/gphoto2-result.h>
+
+G_BEGIN_DECLS
+
+#define TYPE_PHOTO_BOOTH_CAMERA                (photo_booth_camera_get_type ())
+#define PHOTO_BOOTH_CAMERA(obj)                (G_TYPE_CHECK_INSTANCE_CAST ((obj),TYPE_PHOTO_BOOTH_CAMERA,PhotoBoothCamera))
+#define PHOTO_BOOTH_CAMERA_CLASS(klass)        (G_TYPE_CHECK_CLASS_CAST ((klass), TYPE_PHOTO_BOOTH_CAMERA,PhotoBoothCameraClass))
+#define PHOTO_BOOTH_CAMERA_GET_CLASS(obj)      (G_TYPE_INSTANCE_GET_CLASS ((obj),TYPE_PHOTO_BOOTH_CAMERA,PhotoBoothCameraClass))
+#define IS_PHOTO_BOOTH_CAMERA(obj)             (G_TYPE_CHECK_INSTANCE_TYPE ((obj),TYPE_PHOTO_BOOTH_CAMERA))
+
+typedef struct _PhotoBoothCamera              PhotoBoothCamera;
+typedef struct _PhotoBoothCameraClass         PhotoBoothCameraClass;
+
+struct _PhotoBoothCamera
+{
+	GObject parent;
+	gchar *name;
+	GMutex cancel_lock;
+	GCond cancel_cond;
+	gboolean cancelled;
+};
+
+/* all calls return gphoto2 result codes (GP_OK or a negative GP_ERROR_*) and are
+ * serialized by the caller, they block for as long as the camera takes unless
+ * photo_booth_camera_cancel is called from another thread, then they return GP_ERROR_CANCEL */
+struct _PhotoBoothCameraClass
+{
+	GObjectClass parent_class;
+
+	gint     (*open)            (PhotoBoothCamera *camera);
+	void     (*close)           (PhotoBoothCamera *camera);
+	/* writes one jpeg live view frame to fd */
+	gint     (*capture_preview) (PhotoBoothCamera *camera, gint fd);
+	/* releases the shutter, the photo stays on the camera until it is downloaded */
+	gint     (*capture)         (PhotoBoothCamera *camera);
+	/* fetches the last captured photo, data is to be freed with g_free */
+	gint     (*download)        (PhotoBoothCamera *camera, gchar **data, unsigned long *size);
+	gboolean (*focus)           (PhotoBoothCamera *camera);
+};
+
+GType             photo_booth_camera_get_type                (void);
+PhotoBoothCamera *photo_booth_camera_gphoto_new              (gboolean keep_files);
+PhotoBoothCamera *photo_booth_camera_simulated_new           (const gchar *preview_dir, const gchar *photo_dir);
+void              photo_booth_camera_simulated_set_timing    (PhotoBoothCamera *camera, gint preview_fps, gint capture_delay, gint download_delay);
+void              photo_booth_camera_simulated_set_failures  (PhotoBoothCamera *camera, gint preview_error_rate, gint capture_error_rate, gint error_code, guint32 seed);
+void              photo_booth_camera_simulated_set_hangs     (PhotoBoothCamera *camera, gint preview_hang_rate, gint capture_hang_rate);
+
+gint              photo_booth_camera_open                    (PhotoBoothCamera *camera);
+void              photo_booth_camera_close                   (PhotoBoothCamera *camera);
+gint              photo_booth_camera_capture_preview         (PhotoBoothCamera *camera, gint fd);
+gint              photo_booth_camera_capture                 (PhotoBoothCamera *camera);
+gint              photo_booth_camera_download                (PhotoBoothCamera *camera, gchar **data, unsigned long *size);
+gboolean          photo_booth_camera_focus                   (PhotoBoothCamera *camera);
+void              photo_booth_camera_cancel                  (PhotoBoothCamera *camera);
+
+/* for the implementations: sleeps for usec or until the running call is cancelled (usec < 0 waits for
+ * the cancel only), returns FALSE if it was */
+gboolean          photo_booth_camera_wait                    (PhotoBoothCamera *camera, gint64 usec);
+gboolean          photo_booth_camera_is_cancelled            (PhotoBoothCamera *camera);
+
+G_END_DECLS
+
+#endif /* __PHOTO_BOOTH_CAMERA_H__ */
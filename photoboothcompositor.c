@@ -0,0 +1,209 @@
+/*
+ * GStreamer photoboothcompositor.c
+ * Copyright 2019 Andreas Frisch <fraxinas@schaffenburg.org>
+ *
+ * This program is licensed under the Creative Commons
+ * Attribution-NonCommercial-ShareAlike 3.0 Unported
+ * License. To view a copy of this license, visit
+ * http://creativecommons.org/licenses/by-nc-sa/3.0/ or send a letter to
+ * Creative Commons,559 Nathan Abbott Way,Stanford,California 94305,USA.
+ *
+ * This program is NOT free software. It is open source, you are allowed
+ * to modify it (if you keep the license), but it may not be commercially
+ * distributed other than under the conditions noted above.
+ */
+
+#include "photobooth.h"
+#include "photoboothcompositor.h"
+
+static GstStaticPadTemplate sink_template = GST_STATIC_PAD_TEMPLATE ("sink", GST_PAD_SINK, GST_PAD_ALWAYS,
+	GST_STATIC_CAPS (GST_VIDEO_CAPS_MAKE (GST_VIDEO_OVERLAY_COMPOSITION_BLEND_FORMATS)));
+static GstStaticPadTemplate src_template = GST_STATIC_PAD_TEMPLATE ("src", GST_PAD_SRC, GST_PAD_ALWAYS,
+	GST_STATIC_CAPS (GST_VIDEO_CAPS_MAKE (GST_VIDEO_OVERLAY_COMPOSITION_BLEND_FORMATS)));
+
+G_DEFINE_TYPE (PhotoBoothCompositor, photo_booth_compositor, GST_TYPE_VIDEO_FILTER);
+
+GST_DEBUG_CATEGORY_STATIC (photo_booth_compositor_debug);
+#define GST_CAT_DEFAULT photo_booth_compositor_debug
+
+static void photo_booth_compositor_finalize (GObject *object);
+static gboolean photo_booth_compositor_set_info (GstVideoFilter *filter, GstCaps *incaps, GstVideoInfo *in_info, GstCaps *outcaps, GstVideoInfo *out_info);
+static GstFlowReturn photo_booth_compositor_transform_frame_ip (GstVideoFilter *filter, GstVideoFrame *frame);
+
+static void photo_booth_compositor_class_init (PhotoBoothCompositorClass *klass)
+{
+	GObjectClass *gobject_class = G_OBJECT_CLASS (klass);
+	GstElementClass *element_class = GST_ELEMENT_CLASS (klass);
+	GstVideoFilterClass *filter_class = GST_VIDEO_FILTER_CLASS (klass);
+
+	GST_DEBUG_CATEGORY_INIT (photo_booth_compositor_debug, "photoboothcompositor", GST_DEBUG_BOLD | GST_DEBUG_FG_WHITE | GST_DEBUG_BG_MAGENTA, "PhotoBoothCompositor");
+
+	gobject_class->finalize = photo_booth_compositor_finalize;
+	gst_element_class_add_static_pad_template (element_class, &sink_template);
+	gst_element_class_add_static_pad_template (element_class, &src_template);
+	gst_element_class_set_static_metadata (element_class, "Photobooth mask compositor", "Filter/Effect/Video", "Blends the frame overlay and the masks onto the photo", "Andreas Frisch <fraxinas@schaffenburg.org>");
+	filter_class->set_info = photo_booth_compositor_set_info;
+	filter_class->transform_frame_ip = photo_booth_compositor_transform_frame_ip;
+}
+
+static void photo_booth_compositor_init (PhotoBoothCompositor *comp)
+{
+	comp->frame = NULL;
+	comp->masks = g_ptr_array_new_with_free_func ((GDestroyNotify) gst_video_overlay_rectangle_unref);
+	comp->composition = NULL;
+	comp->dirty = TRUE;
+	gst_base_transform_set_in_place (GST_BASE_TRANSFORM (comp), TRUE);
+	gst_base_transform_set_passthrough (GST_BASE_TRANSFORM (comp), TRUE);
+}
+
+static void photo_booth_compositor_finalize (GObject *object)
+{
+	PhotoBoothCompositor *comp = PHOTO_BOOTH_COMPOSITOR (object);
+	if (comp->frame)
+		gst_buffer_unref (comp->frame);
+	if (comp->composition)
+		gst_video_overlay_composition_unref (comp->composition);
+	g_ptr_array_free (comp->masks, TRUE);
+	G_OBJECT_CLASS (photo_booth_compositor_parent_class)->finalize (object);
+}
+
+GstElement *photo_booth_compositor_new (const gchar *name)
+{
+	return g_object_new (PHOTO_BOOTH_COMPOSITOR_TYPE, "name", name, NULL);
+}
+
+/* overlay rectangles want unpremultiplied ARGB in native byte order, gdk-pixbuf has RGB(A) bytes */
+static GstBuffer *photo_booth_compositor_pixbuf_to_buffer (GdkPixbuf *pixbuf)
+{
+	gint width = gdk_pixbuf_get_width (pixbuf);
+	gint height = gdk_pixbuf_get_height (pixbuf);
+	gint n_channels = gdk_pixbuf_get_n_channels (pixbuf);
+	gint rowstride = gdk_pixbuf_get_rowstride (pixbuf);
+	const guint8 *pixels = gdk_pixbuf_read_pixels (pixbuf);
+	GstBuffer *buffer = gst_buffer_new_allocate (NULL, width * height * 4, NULL);
+	GstMapInfo map;
+	gint x, y;
+
+	gst_buffer_map (buffer, &map, GST_MAP_WRITE);
+	for (y = 0; y < height; y++)
+	{
+		const guint8 *src = pixels + y * rowstride;
+		guint32 *dst = (guint32 *) (map.data + y * width * 4);
+		for (x = 0; x < width; x++, src += n_channels)
+		{
+			guint32 alpha = n_channels == 4 ? src[3] : 0xff;
+			dst[x] = alpha << 24 | (guint32) src[0] << 16 | (guint32) src[1] << 8 | src[2];
+		}
+	}
+	gst_buffer_unmap (buffer, &map);
+	gst_buffer_add_video_meta (buffer, GST_VIDEO_FRAME_FLAG_NONE, GST_VIDEO_OVERLAY_COMPOSITION_FORMAT_RGB, width, height);
+	return buffer;
+}
+
+/* call with object lock held */
+static void photo_booth_compositor_rebuild (PhotoBoothCompositor *comp)
+{
+	GstVideoInfo *info = &GST_VIDEO_FILTER (comp)->in_info;
+	guint i;
+
+	if (comp->composition)
+		gst_video_overlay_composition_unref (comp->composition);
+	comp->composition = NULL;
+
+	if (comp->frame)
+	{
+		GstVideoMeta *meta = gst_buffer_get_video_meta (comp->frame);
+		GstVideoOverlayRectangle *rect = gst_video_overlay_rectangle_new_raw (comp->frame, 0, 0, GST_VIDEO_INFO_WIDTH (info), GST_VIDEO_INFO_HEIGHT (info), GST_VIDEO_OVERLAY_FORMAT_FLAG_NONE);
+		if (meta->width != (guint) GST_VIDEO_INFO_WIDTH (info) || meta->height != (guint) GST_VIDEO_INFO_HEIGHT (info))
+			GST_WARNING_OBJECT (comp, "frame overlay is %ux%u but the photo is %dx%d, it will be scaled on every capture", meta->width, meta->height, GST_VIDEO_INFO_WIDTH (info), GST_VIDEO_INFO_HEIGHT (info));
+		comp->composition = gst_video_overlay_composition_new (rect);
+		gst_video_overlay_rectangle_unref (rect);
+	}
+	// masks go on top of the frame, in the order they were placed
+	for (i = 0; i < comp->masks->len; i++)
+	{
+		GstVideoOverlayRectangle *rect = g_ptr_array_index (comp->masks, i);
+		if (!comp->composition)
+			comp->composition = gst_video_overlay_composition_new (rect);
+		else
+			gst_video_overlay_composition_add_rectangle (comp->composition, rect);
+	}
+	comp->dirty = FALSE;
+	GST_DEBUG_OBJECT (comp, "composition with%s frame and %u masks", comp->frame ? "" : "out", comp->masks->len);
+}
+
+static void photo_booth_compositor_changed (PhotoBoothCompositor *comp)
+{
+	gboolean empty;
+	GST_OBJECT_LOCK (comp);
+	comp->dirty = TRUE;
+	empty = !comp->frame && comp->masks->len == 0;
+	GST_OBJECT_UNLOCK (comp);
+	// nothing to draw means the buffers don't even have to be made writable
+	gst_base_transform_set_passthrough (GST_BASE_TRANSFORM (comp), empty);
+}
+
+void photo_booth_compositor_set_frame (PhotoBoothCompositor *comp, GdkPixbuf *pixbuf)
+{
+	GstBuffer *frame = pixbuf ? photo_booth_compositor_pixbuf_to_buffer (pixbuf) : NULL;
+	GST_OBJECT_LOCK (comp);
+	if (comp->frame)
+		gst_buffer_unref (comp->frame);
+	comp->frame = frame;
+	GST_OBJECT_UNLOCK (comp);
+	photo_booth_compositor_changed (comp);
+}
+
+void photo_booth_compositor_add_mask (PhotoBoothCompositor *comp, GdkPixbuf *pixbuf, gint x, gint y, gint width, gint height)
+{
+	GstBuffer *buffer;
+	GstVideoOverlayRectangle *rect;
+
+	g_return_if_fail (pixbuf != NULL && width > 0 && height > 0);
+	buffer = photo_booth_compositor_pixbuf_to_buffer (pixbuf);
+	rect = gst_video_overlay_rectangle_new_raw (buffer, x, y, width, height, GST_VIDEO_OVERLAY_FORMAT_FLAG_NONE);
+	gst_buffer_unref (buffer);
+	GST_DEBUG_OBJECT (comp, "add mask %dx%d @ (%d,%d)", width, height, x, y);
+	GST_OBJECT_LOCK (comp);
+	g_ptr_array_add (comp->masks, rect);
+	GST_OBJECT_UNLOCK (comp);
+	photo_booth_compositor_changed (comp);
+}
+
+void photo_booth_compositor_clear_masks (PhotoBoothCompositor *comp)
+{
+	GST_OBJECT_LOCK (comp);
+	g_ptr_array_set_size (comp->masks, 0);
+	GST_OBJECT_UNLOCK (comp);
+	photo_booth_compositor_changed (comp);
+}
+
+static gboolean photo_booth_compositor_set_info (GstVideoFilter *filter, G_GNUC_UNUSED GstCaps *incaps, G_GNUC_UNUSED GstVideoInfo *in_info, G_GNUC_UNUSED GstCaps *outcaps, G_GNUC_UNUSED GstVideoInfo *out_info)
+{
+	PhotoBoothCompositor *comp = PHOTO_BOOTH_COMPOSITOR (filter);
+	GST_OBJECT_LOCK (comp);
+	comp->dirty = TRUE;
+	GST_OBJECT_UNLOCK (comp);
+	return TRUE;
+}
+
+static GstFlowReturn photo_booth_compositor_transform_frame_ip (GstVideoFilter *filter, GstVideoFrame *frame)
+{
+	PhotoBoothCompositor *comp = PHOTO_BOOTH_COMPOSITOR (filter);
+	GstVideoOverlayComposition *composition = NULL;
+
+	GST_OBJECT_LOCK (comp);
+	if (comp->dirty)
+		photo_booth_compositor_rebuild (comp);
+	if (comp->composition)
+		composition = gst_video_overlay_composition_ref (comp->composition);
+	GST_OBJECT_UNLOCK (comp);
+
+	if (composition)
+	{
+		// the rectangles keep their scaled pixels cached, so only a changed mask ever gets rescaled
+		gst_video_overlay_composition_blend (composition, frame);
+		gst_video_overlay_composition_unref (composition);
+	}
+	return GST_FLOW_OK;
+}
@@ -0,0 +1,58 @@
+/*
+ * GStreamer photoboothcompositor.h
+ * Copyright 2019 Andreas Frisch <fraxinas@schaffenburg.org>
+ *
+ * This program is licensed under the Creative Commons
+ * Attribution-NonCommercial-ShareAlike 3.0 Unported
+ * License. To view a copy of this license, visit
+ * http://creativecommons.org/licenses/by-nc-sa/3.0/ or send a letter to
+ * Creative Commons,559 Nathan Abbott Way,Stanford,California 94305,USA.
+ *
+ * This program is NOT free software. It is open source, you are allowed
+ * to modify it (if you keep the license), but it may not be commercially
+ * distributed other than under the conditions noted above.
+ */
+
+#ifndef __PHOTO_BOOTH_COMPOSITOR_H__
+#define __PHOTO_BOOTH_COMPOSITOR_H__
+
+#include <gdk-pixbuf/gdk-pixbuf.h>
+#include <gst/video/gstvideofilter.h>
+#include <gst/video/video-overlay-composition.h>
+
+G_BEGIN_DECLS
+
+#define PHOTO_BOOTH_COMPOSITOR_TYPE                (photo_booth_compositor_get_type ())
+#define PHOTO_BOOTH_COMPOSITOR(obj)                (G_TYPE_CHECK_INSTANCE_CAST ((obj),PHOTO_BOOTH_COMPOSITOR_TYPE,PhotoBoothCompositor))
+#define PHOTO_BOOTH_COMPOSITOR_CLASS(klass)        (G_TYPE_CHECK_CLASS_CAST ((klass), PHOTO_BOOTH_COMPOSITOR_TYPE,PhotoBoothCompositorClass))
+#define IS_PHOTO_BOOTH_COMPOSITOR(obj)             (G_TYPE_CHECK_INSTANCE_TYPE ((obj),PHOTO_BOOTH_COMPOSITOR_TYPE))
+#define IS_PHOTO_BOOTH_COMPOSITOR_CLASS(klass)     (G_TYPE_CHECK_CLASS_TYPE ((klass), PHOTO_BOOTH_COMPOSITOR_TYPE))
+
+typedef struct _PhotoBoothCompositor              PhotoBoothCompositor;
+typedef struct _PhotoBoothCompositorClass         PhotoBoothCompositorClass;
+
+/* blends the frame overlay and all placed masks onto the photo in one in-place pass.
+ * only the pixels under the rectangles are touched, the rest of the frame is left alone */
+struct _PhotoBoothCompositor
+{
+	GstVideoFilter parent;
+	GstBuffer *frame;
+	GPtrArray *masks;
+	GstVideoOverlayComposition *composition;
+	gboolean dirty;
+};
+
+struct _PhotoBoothCompositorClass
+{
+	GstVideoFilterClass parent_class;
+};
+
+GType       photo_booth_compositor_get_type    (void);
+GstElement *photo_booth_compositor_new         (const gchar *name);
+void        photo_booth_compositor_set_frame   (PhotoBoothCompositor *comp, GdkPixbuf *pixbuf);
+void        photo_booth_compositor_add_mask    (PhotoBoothCompositor *comp, GdkPixbuf *pixbuf, gint x, gint y, gint width, gint height);
+void        photo_booth_compositor_clear_masks (PhotoBoothCompositor *comp);
+
+G_END_DECLS
+
+#endif /* __PHOTO_BOOTH_COMPOSITOR_H__ */
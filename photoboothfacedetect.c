@@ -0,0 +1,371 @@
+/*
+ * GStreamer photoboothfacedetect.c
+ * Copyright 2019 Andreas Frisch <fraxinas@schaffenburg.org>
+ *
+ * This program is licensed under the Creative Commons
+ * Attribution-NonCommercial-ShareAlike 3.0 Unported
+ * License. To view a copy of this license, visit
+ * http://creativecommons.org/licenses/by-nc-sa/3.0/ or send a letter to
+ * Creative Commons,559 Nathan Abbott Way,Stanford,California 94305,USA.
+ *
+ * This program is NOT free software. It is open source, you are allowed
+ * to modify it (if you keep the license), but it may not be commercially
+ * distributed other than under the conditions noted above.
+ */
+
+#include <math.h>
+#include <string.h>
+#include "photobooth.h"
+#include "photoboothfacedetect.h"
+#include "photoboothmetrics.h"
+
+/* scan parameters as recommended for the pico face cascade */
+#define FACE_DETECT_SCALE_FACTOR   1.1
+#define FACE_DETECT_SHIFT_FACTOR   0.1
+#define FACE_DETECT_MIN_OVERLAP    0.3
+#define FACE_DETECT_THRESHOLD      5.0
+#define FACE_DETECT_MAX_DETECTIONS 2048
+#define DEFAULT_FACE_DETECT_MIN_SIZE 24
+
+typedef struct
+{
+	gfloat r, c, s, q;
+} PhotoBoothDetection;
+
+static GstStaticPadTemplate sink_template = GST_STATIC_PAD_TEMPLATE ("sink", GST_PAD_SINK, GST_PAD_ALWAYS,
+	GST_STATIC_CAPS (GST_VIDEO_CAPS_MAKE ("{ I420, YV12, NV12, NV21, GRAY8 }")));
+static GstStaticPadTemplate src_template = GST_STATIC_PAD_TEMPLATE ("src", GST_PAD_SRC, GST_PAD_ALWAYS,
+	GST_STATIC_CAPS (GST_VIDEO_CAPS_MAKE ("{ I420, YV12, NV12, NV21, GRAY8 }")));
+
+G_DEFINE_TYPE (PhotoBoothFaceDetect, photo_booth_face_detect, GST_TYPE_VIDEO_FILTER);
+
+GST_DEBUG_CATEGORY_STATIC (photo_booth_face_detect_debug);
+#define GST_CAT_DEFAULT photo_booth_face_detect_debug
+
+static void photo_booth_face_detect_finalize (GObject *object);
+static GstFlowReturn photo_booth_face_detect_transform_frame_ip (GstVideoFilter *filter, GstVideoFrame *frame);
+
+static void photo_booth_cascade_free (PhotoBoothCascade *cascade)
+{
+	if (!cascade)
+		return;
+	g_free (cascade->codes);
+	g_free (cascade->luts);
+	g_free (cascade->thresholds);
+	g_free (cascade);
+}
+
+static void photo_booth_face_detect_class_init (PhotoBoothFaceDetectClass *klass)
+{
+	GObjectClass *gobject_class = G_OBJECT_CLASS (klass);
+	GstElementClass *element_class = GST_ELEMENT_CLASS (klass);
+	GstVideoFilterClass *filter_class = GST_VIDEO_FILTER_CLASS (klass);
+
+	GST_DEBUG_CATEGORY_INIT (photo_booth_face_detect_debug, "photoboothfacedetect", GST_DEBUG_BOLD | GST_DEBUG_FG_WHITE | GST_DEBUG_BG_GREEN, "PhotoBoothFaceDetect");
+
+	gobject_class->finalize = photo_booth_face_detect_finalize;
+	gst_element_class_add_static_pad_template (element_class, &sink_template);
+	gst_element_class_add_static_pad_template (element_class, &src_template);
+	gst_element_class_set_static_metadata (element_class, "Photobooth face detector", "Filter/Analyzer/Video", "Detects faces with a pixel comparison cascade and posts facedetect messages", "Andreas Frisch <fraxinas@schaffenburg.org>");
+	filter_class->transform_frame_ip = photo_booth_face_detect_transform_frame_ip;
+}
+
+static void photo_booth_face_detect_init (PhotoBoothFaceDetect *detect)
+{
+	detect->cascade = NULL;
+	detect->min_size = DEFAULT_FACE_DETECT_MIN_SIZE;
+	detect->detections = g_array_sized_new (FALSE, FALSE, sizeof (PhotoBoothDetection), FACE_DETECT_MAX_DETECTIONS);
+	// the frames are only looked at
+	gst_base_transform_set_passthrough (GST_BASE_TRANSFORM (detect), TRUE);
+}
+
+static void photo_booth_face_detect_finalize (GObject *object)
+{
+	PhotoBoothFaceDetect *detect = PHOTO_BOOTH_FACE_DETECT (object);
+	photo_booth_cascade_free (detect->cascade);
+	g_array_free (detect->detections, TRUE);
+	G_OBJECT_CLASS (photo_booth_face_detect_parent_class)->finalize (object);
+}
+
+static gint32 _read_int32 (const guint8 *data)
+{
+	guint32 value;
+	memcpy (&value, data, sizeof (value));
+	return (gint32) GUINT32_FROM_LE (value);
+}
+
+static gfloat _read_float (const guint8 *data)
+{
+	union { guint32 i; gfloat f; } value;
+	memcpy (&value.i, data, sizeof (value.i));
+	value.i = GUINT32_FROM_LE (value.i);
+	return value.f;
+}
+
+/* header: float tsr, float tsc, int32 tdepth, int32 ntrees, then per tree:
+ * 4 byte pixel offset pairs for every inner node, the leaf values and the rejection threshold */
+static PhotoBoothCascade *photo_booth_cascade_parse (const guint8 *data, gsize size, GError **error)
+{
+	PhotoBoothCascade *cascade;
+	gint32 tdepth, ntrees;
+	gsize nodes, leaves, tree_size, i, j;
+
+	if (size < 16)
+		goto invalid;
+	tdepth = _read_int32 (data + 8);
+	ntrees = _read_int32 (data + 12);
+	if (tdepth < 1 || tdepth > 12 || ntrees < 1)
+		goto invalid;
+	nodes = (1 << tdepth) - 1;
+	leaves = 1 << tdepth;
+	tree_size = nodes * 4 + leaves * sizeof (gfloat) + sizeof (gfloat);
+	if (size < 16 + ntrees * tree_size)
+		goto invalid;
+
+	cascade = g_new0 (PhotoBoothCascade, 1);
+	cascade->tdepth = tdepth;
+	cascade->ntrees = ntrees;
+	cascade->codes = g_new (gint8, ntrees * nodes * 4);
+	cascade->luts = g_new (gfloat, ntrees * leaves);
+	cascade->thresholds = g_new (gfloat, ntrees);
+	for (i = 0; i < (gsize) ntrees; i++)
+	{
+		const guint8 *tree = data + 16 + i * tree_size;
+		memcpy (cascade->codes + i * nodes * 4, tree, nodes * 4);
+		for (j = 0; j < leaves; j++)
+			cascade->luts[i * leaves + j] = _read_float (tree + nodes * 4 + j * sizeof (gfloat));
+		cascade->thresholds[i] = _read_float (tree + nodes * 4 + leaves * sizeof (gfloat));
+	}
+	return cascade;
+
+invalid:
+	g_set_error (error, G_IO_ERROR, G_IO_ERROR_INVALID_DATA, "not a pico cascade (%" G_GSIZE_FORMAT " bytes)", size);
+	return NULL;
+}
+
+GstElement *photo_booth_face_detect_new (const gchar *name, const gchar *model_location, GError **error)
+{
+	PhotoBoothFaceDetect *detect;
+	PhotoBoothCascade *cascade;
+	GFile *file;
+	gchar *contents = NULL;
+	gsize size = 0;
+
+	// plain paths as well as resource:// uris, so a model can be compiled into the binary
+	file = g_file_new_for_commandline_arg (model_location);
+	if (!g_file_load_contents (file, NULL, &contents, &size, NULL, error))
+	{
+		g_object_unref (file);
+		return NULL;
+	}
+	g_object_unref (file);
+	cascade = photo_booth_cascade_parse ((const guint8 *) contents, size, error);
+	g_free (contents);
+	if (!cascade)
+		return NULL;
+
+	detect = g_object_new (PHOTO_BOOTH_FACE_DETECT_TYPE, "name", name, NULL);
+	detect->cascade = cascade;
+	GST_INFO_OBJECT (detect, "loaded cascade '%s' with %d trees of depth %d", model_location, cascade->ntrees, cascade->tdepth);
+	return GST_ELEMENT (detect);
+}
+
+void photo_booth_face_detect_set_min_size (PhotoBoothFaceDetect *detect, gint min_size)
+{
+	detect->min_size = MAX (min_size, 8);
+}
+
+/* pixel coordinates are in 1/256 fixed point, the codes scale with the window size s */
+static inline gboolean photo_booth_cascade_classify (const PhotoBoothCascade *cascade, gint r, gint c, gint s, const guint8 *pixels, gint nrows, gint ncols, gint stride, gfloat *q)
+{
+	const gint8 *codes = cascade->codes;
+	gint nodes = (1 << cascade->tdepth) - 1, leaves = 1 << cascade->tdepth;
+	gfloat score = 0.0f;
+	gint i, j;
+
+	r *= 256;
+	c *= 256;
+	if ((r + 128 * s) / 256 >= nrows || (r - 128 * s) / 256 < 0 || (c + 128 * s) / 256 >= ncols || (c - 128 * s) / 256 < 0)
+		return FALSE;
+
+	for (i = 0; i < cascade->ntrees; i++, codes += nodes * 4)
+	{
+		gint idx = 1;
+		for (j = 0; j < cascade->tdepth; j++)
+		{
+			const gint8 *n = codes + 4 * (idx - 1);
+			idx = 2 * idx + (pixels[(r + n[0] * s) / 256 * stride + (c + n[1] * s) / 256] <= pixels[(r + n[2] * s) / 256 * stride + (c + n[3] * s) / 256]);
+		}
+		score += cascade->luts[i * leaves + idx - leaves];
+		// nearly all windows are rejected by the first few trees
+		if (score <= cascade->thresholds[i])
+			return FALSE;
+	}
+	*q = score - cascade->thresholds[cascade->ntrees - 1];
+	return TRUE;
+}
+
+static gfloat _overlap (const PhotoBoothDetection *a, const PhotoBoothDetection *b)
+{
+	gfloat overr = MAX (0, MIN (a->r + a->s / 2, b->r + b->s / 2) - MAX (a->r - a->s / 2, b->r - b->s / 2));
+	gfloat overc = MAX (0, MIN (a->c + a->s / 2, b->c + b->s / 2) - MAX (a->c - a->s / 2, b->c - b->s / 2));
+	return overr * overc / (a->s * a->s + b->s * b->s - overr * overc);
+}
+
+/* darkest 3x3 neighbourhood inside a region of the luma plane */
+static gboolean _darkest_spot (const guint8 *pixels, gint stride, gint nrows, gint ncols, gint x0, gint y0, gint x1, gint y1, gint *px, gint *py)
+{
+	guint best = G_MAXUINT;
+	gint x, y;
+
+	x0 = MAX (x0, 1);
+	y0 = MAX (y0, 1);
+	x1 = MIN (x1, ncols - 1);
+	y1 = MIN (y1, nrows - 1);
+	for (y = y0; y < y1; y++)
+		for (x = x0; x < x1; x++)
+		{
+			const guint8 *p = pixels + (y - 1) * stride + x - 1;
+			guint sum = p[0] + p[1] + p[2] + p[stride] + p[stride + 1] + p[stride + 2] + p[2 * stride] + p[2 * stride + 1] + p[2 * stride + 2];
+			if (sum < best)
+			{
+				best = sum;
+				*px = x;
+				*py = y;
+			}
+		}
+	return best != G_MAXUINT;
+}
+
+/* coarse landmarks for the mask transform. pupils and the mouth gap are the darkest spots in the
+ * regions where they sit in an upright cascade window, the eyes are dropped unless they look like a pair.
+ * the nose is never dark enough to be found like that, it goes between the eyes and the mouth. a mouth
+ * that isn't found is put below the eyes, tilted along with them */
+static void photo_booth_face_detect_landmarks (const guint8 *pixels, gint stride, gint nrows, gint ncols, gfloat x, gfloat y, gfloat s, GstStructure *face)
+{
+	gint lx, ly, rx, ry, mx, my;
+	gfloat ex, ey, roll, nx, ny;
+
+	if (!_darkest_spot (pixels, stride, nrows, ncols, x + 0.15 * s, y + 0.25 * s, x + 0.48 * s, y + 0.5 * s, &lx, &ly)
+		|| !_darkest_spot (pixels, stride, nrows, ncols, x + 0.52 * s, y + 0.25 * s, x + 0.85 * s, y + 0.5 * s, &rx, &ry))
+		return;
+	if (ABS (ry - ly) > 0.2 * s || rx - lx < 0.2 * s || rx - lx > 0.6 * s)
+		return;
+	ex = (lx + rx) / 2.0;
+	ey = (ly + ry) / 2.0;
+	roll = atan2f (ry - ly, rx - lx);
+	if (!_darkest_spot (pixels, stride, nrows, ncols, x + 0.3 * s, y + 0.65 * s, x + 0.7 * s, y + 0.92 * s, &mx, &my) || my <= MAX (ly, ry))
+	{
+		mx = CLAMP (ex - sinf (roll) * (PHOTO_BOOTH_FACE_MOUTH_Y - PHOTO_BOOTH_FACE_EYES_Y) * s, 0, ncols - 1);
+		my = CLAMP (ey + cosf (roll) * (PHOTO_BOOTH_FACE_MOUTH_Y - PHOTO_BOOTH_FACE_EYES_Y) * s, 0, nrows - 1);
+	}
+	nx = ex + (mx - ex) * (PHOTO_BOOTH_FACE_NOSE_Y - PHOTO_BOOTH_FACE_EYES_Y) / (PHOTO_BOOTH_FACE_MOUTH_Y - PHOTO_BOOTH_FACE_EYES_Y);
+	ny = ey + (my - ey) * (PHOTO_BOOTH_FACE_NOSE_Y - PHOTO_BOOTH_FACE_EYES_Y) / (PHOTO_BOOTH_FACE_MOUTH_Y - PHOTO_BOOTH_FACE_EYES_Y);
+	gst_structure_set (face, "left-eye->x", G_TYPE_UINT, (guint) lx, "left-eye->y", G_TYPE_UINT, (guint) ly,
+		"right-eye->x", G_TYPE_UINT, (guint) rx, "right-eye->y", G_TYPE_UINT, (guint) ry,
+		"nose->x", G_TYPE_UINT, (guint) nx, "nose->y", G_TYPE_UINT, (guint) ny,
+		"mouth->x", G_TYPE_UINT, (guint) mx, "mouth->y", G_TYPE_UINT, (guint) my, NULL);
+}
+
+/* merges overlapping windows into one face each: positions are averaged, scores summed */
+static void photo_booth_face_detect_cluster (GArray *detections, const guint8 *pixels, gint stride, gint nrows, gint ncols, GValue *faces)
+{
+	guint n = detections->len, i, j, k;
+	guint *labels = g_new0 (guint, n + 1), *stack = g_new (guint, n + 1);
+	guint n_labels = 0;
+
+	for (i = 0; i < n; i++)
+	{
+		guint top = 0;
+		if (labels[i])
+			continue;
+		labels[i] = ++n_labels;
+		stack[top++] = i;
+		while (top)
+		{
+			k = stack[--top];
+			for (j = 0; j < n; j++)
+				if (!labels[j] && _overlap (&g_array_index (detections, PhotoBoothDetection, k), &g_array_index (detections, PhotoBoothDetection, j)) > FACE_DETECT_MIN_OVERLAP)
+				{
+					labels[j] = n_labels;
+					stack[top++] = j;
+				}
+		}
+	}
+
+	for (k = 1; k <= n_labels; k++)
+	{
+		gfloat r = 0, c = 0, s = 0, q = 0;
+		guint count = 0;
+		for (i = 0; i < n; i++)
+		{
+			const PhotoBoothDetection *d = &g_array_index (detections, PhotoBoothDetection, i);
+			if (labels[i] != k)
+				continue;
+			r += d->r;
+			c += d->c;
+			s += d->s;
+			q += d->q;
+			count++;
+		}
+		if (q >= FACE_DETECT_THRESHOLD)
+		{
+			GValue value = G_VALUE_INIT;
+			GstStructure *face;
+			r /= count;
+			c /= count;
+			s /= count;
+			face = gst_structure_new ("face",
+				"x", G_TYPE_UINT, (guint) MAX (c - s / 2, 0),
+				"y", G_TYPE_UINT, (guint) MAX (r - s / 2, 0),
+				"width", G_TYPE_UINT, (guint) s,
+				"height", G_TYPE_UINT, (guint) s, NULL);
+			photo_booth_face_detect_landmarks (pixels, stride, nrows, ncols, c - s / 2, r - s / 2, s, face);
+			g_value_init (&value, GST_TYPE_STRUCTURE);
+			g_value_take_boxed (&value, face);
+			gst_value_list_append_and_take_value (faces, &value);
+		}
+	}
+	g_free (labels);
+	g_free (stack);
+}
+
+static GstFlowReturn photo_booth_face_detect_transform_frame_ip (GstVideoFilter *filter, GstVideoFrame *frame)
+{
+	PhotoBoothFaceDetect *detect = PHOTO_BOOTH_FACE_DETECT (filter);
+	const guint8 *pixels = GST_VIDEO_FRAME_PLANE_DATA (frame, 0);
+	gint stride = GST_VIDEO_FRAME_PLANE_STRIDE (frame, 0);
+	gint nrows = GST_VIDEO_FRAME_HEIGHT (frame), ncols = GST_VIDEO_FRAME_WIDTH (frame);
+	gint64 start = g_get_monotonic_time ();
+	GValue faces = G_VALUE_INIT;
+	GstStructure *structure;
+	gfloat s;
+
+	if (!detect->cascade)
+		return GST_FLOW_OK;
+
+	g_array_set_size (detect->detections, 0);
+	for (s = detect->min_size; s <= MIN (nrows, ncols); s *= FACE_DETECT_SCALE_FACTOR)
+	{
+		gint size = s, step = MAX ((gint) (FACE_DETECT_SHIFT_FACTOR * s), 1);
+		gint r, c;
+		for (r = size / 2 + 1; r <= nrows - size / 2 - 1; r += step)
+			for (c = size / 2 + 1; c <= ncols - size / 2 - 1; c += step)
+			{
+				PhotoBoothDetection d = { r, c, size, 0 };
+				if (detect->detections->len < FACE_DETECT_MAX_DETECTIONS && photo_booth_cascade_classify (detect->cascade, r, c, size, pixels, nrows, ncols, stride, &d.q))
+					g_array_append_val (detect->detections, d);
+			}
+	}
+
+	g_value_init (&faces, GST_TYPE_LIST);
+	photo_booth_face_detect_cluster (detect->detections, pixels, stride, nrows, ncols, &faces);
+	GST_LOG_OBJECT (detect, "%u windows -> %u faces in %" G_GINT64_FORMAT " us", detect->detections->len, gst_value_list_get_size (&faces), g_get_monotonic_time () - start);
+	photo_booth_metrics_observe (photo_booth_metrics_get_default (), "photobooth_facedetect_seconds", NULL, (gdouble) (g_get_monotonic_time () - start) / G_USEC_PER_SEC);
+
+	// same message layout as the opencv facedetect element, so the bus handling doesn't care which one runs
+	structure = gst_structure_new ("facedetect", "timestamp", G_TYPE_UINT64, GST_BUFFER_PTS (frame->buffer), NULL);
+	gst_structure_take_value (structure, "faces", &faces);
+	gst_element_post_message (GST_ELEMENT (detect), gst_message_new_element (GST_OBJECT (detect), structure));
+	return GST_FLOW_OK;
+}
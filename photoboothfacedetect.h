@@ -0,0 +1,72 @@
+/*
+ * GStreamer photoboothfacedetect.h
+ * Copyright 2019 Andreas Frisch <fraxinas@schaffenburg.org>
+ *
+ * This program is licensed under the Creative Commons
+ * Attribution-NonCommercial-ShareAlike 3.0 Unported
+ * License. To view a copy of this license, visit
+ * http://creativecommons.org/licenses/by-nc-sa/3.0/ or send a letter to
+ * Creative Commons,559 Nathan Abbott Way,Stanford,California 94305,USA.
+ *
+ * This program is NOT free software. It is open source, you are allowed
+ * to modify it (if you keep the license), but it may not be commercially
+ * distributed other than under the conditions noted above.
+ */
+
+#ifndef __PHOTO_BOOTH_FACE_DETECT_H__
+#define __PHOTO_BOOTH_FACE_DETECT_H__
+
+#include <gst/video/gstvideofilter.h>
+
+G_BEGIN_DECLS
+
+#define PHOTO_BOOTH_FACE_DETECT_TYPE                (photo_booth_face_detect_get_type ())
+#define PHOTO_BOOTH_FACE_DETECT(obj)                (G_TYPE_CHECK_INSTANCE_CAST ((obj),PHOTO_BOOTH_FACE_DETECT_TYPE,PhotoBoothFaceDetect))
+#define PHOTO_BOOTH_FACE_DETECT_CLASS(klass)        (G_TYPE_CHECK_CLASS_CAST ((klass), PHOTO_BOOTH_FACE_DETECT_TYPE,PhotoBoothFaceDetectClass))
+#define IS_PHOTO_BOOTH_FACE_DETECT(obj)             (G_TYPE_CHECK_INSTANCE_TYPE ((obj),PHOTO_BOOTH_FACE_DETECT_TYPE))
+#define IS_PHOTO_BOOTH_FACE_DETECT_CLASS(klass)     (G_TYPE_CHECK_CLASS_TYPE ((klass), PHOTO_BOOTH_FACE_DETECT_TYPE))
+
+/* the frames only need a luma plane, so the detection branch can skip colour conversion */
+#define PHOTO_BOOTH_FACE_DETECT_FORMAT "I420"
+
+/* where the features of an upright face sit in the face box, as fractions of its height.
+ * landmarks that can't be found are placed by these, relative to the ones that can */
+#define PHOTO_BOOTH_FACE_EYES_Y  0.4
+#define PHOTO_BOOTH_FACE_NOSE_Y  0.6
+#define PHOTO_BOOTH_FACE_MOUTH_Y 0.8
+
+typedef struct _PhotoBoothFaceDetect              PhotoBoothFaceDetect;
+typedef struct _PhotoBoothFaceDetectClass         PhotoBoothFaceDetectClass;
+
+/* pixel intensity comparison cascade in the format of the pico object detector:
+ * every tree compares pairs of pixels at window-relative offsets down to a leaf
+ * whose value is added to the score, a window is rejected as soon as the running
+ * score drops below the tree's threshold */
+typedef struct
+{
+	gint tdepth, ntrees;
+	gint8 *codes;
+	gfloat *luts;
+	gfloat *thresholds;
+} PhotoBoothCascade;
+
+struct _PhotoBoothFaceDetect
+{
+	GstVideoFilter parent;
+	PhotoBoothCascade *cascade;
+	gint min_size;
+	GArray *detections;
+};
+
+struct _PhotoBoothFaceDetectClass
+{
+	GstVideoFilterClass parent_class;
+};
+
+GType       photo_booth_face_detect_get_type     (void);
+GstElement *photo_booth_face_detect_new          (const gchar *name, const gchar *model_location, GError **error);
+void        photo_booth_face_detect_set_min_size (PhotoBoothFaceDetect *detect, gint min_size);
+
+G_END_DECLS
+
+#endif /* __PHOTO_BOOTH_FACE_DETECT_H__ */
@@ -0,0 +1,254 @@
+/*
+ * GStreamer photoboothframetiming.c
+ * Copyright 2019 Andreas Frisch <fraxinas@schaffenburg.org>
+ *
+ * This program is licensed under the Creative Commons
+ * Attribution-NonCommercial-ShareAlike 3.0 Unported
+ * License. To view a copy of this license, visit
+ * http://creativecommons.org/licenses/by-nc-sa/3.0/ or send a letter to
+ * Creative Commons,559 Nathan Abbott Way,Stanford,California 94305,USA.
+ *
+ * This program is NOT free software. It is open source, you are allowed
+ * to modify it (if you keep the license), but it may not be commercially
+ * distributed other than under the conditions noted above.
+ */
+
+#include <string.h>
+#include "photobooth.h"
+#include "photoboothmetrics.h"
+#include "photoboothframetiming.h"
+
+#define FRAME_METRIC "photobooth_preview_frame_seconds"
+/* frames the capture thread may be ahead of the parser before the oldest are forgotten */
+#define MAX_PENDING_CAPTURES 16
+
+static const gchar *stage_names[FRAME_STAGE_COUNT] = {
+	"capture", "fifo", "decode", "scale", "convert", "flip", "facedetect", "sink", "render", "total"
+};
+
+typedef struct
+{
+	gint64 start, end;
+} PhotoBoothFrameCapture;
+
+typedef struct
+{
+	PhotoBoothFrameTiming *timing;
+	PhotoBoothFrameStage stage, after;
+} PhotoBoothFrameProbe;
+
+G_DEFINE_TYPE (PhotoBoothFrameTiming, photo_booth_frame_timing, G_TYPE_OBJECT);
+
+GST_DEBUG_CATEGORY_STATIC (photo_booth_frame_timing_debug);
+#define GST_CAT_DEFAULT photo_booth_frame_timing_debug
+
+/* PhotoBoothFrameMeta */
+
+static gboolean photo_booth_frame_meta_init (GstMeta *meta, G_GNUC_UNUSED gpointer params, G_GNUC_UNUSED GstBuffer *buffer)
+{
+	PhotoBoothFrameMeta *fmeta = (PhotoBoothFrameMeta *) meta;
+	fmeta->captured = 0;
+	memset (fmeta->stamps, 0, sizeof (fmeta->stamps));
+	return TRUE;
+}
+
+/* the timestamps stay valid whatever is done to the frame, so the meta survives decoding, scaling and converting */
+static gboolean photo_booth_frame_meta_transform (GstBuffer *dest, GstMeta *meta, G_GNUC_UNUSED GstBuffer *buffer, G_GNUC_UNUSED GQuark type, G_GNUC_UNUSED gpointer data)
+{
+	PhotoBoothFrameMeta *src = (PhotoBoothFrameMeta *) meta, *dst;
+	dst = (PhotoBoothFrameMeta *) gst_buffer_add_meta (dest, photo_booth_frame_meta_get_info (), NULL);
+	if (!dst)
+		return FALSE;
+	dst->captured = src->captured;
+	memcpy (dst->stamps, src->stamps, sizeof (src->stamps));
+	return TRUE;
+}
+
+GType photo_booth_frame_meta_api_get_type (void)
+{
+	static gsize type = 0;
+	static const gchar *tags[] = { NULL };
+	if (g_once_init_enter (&type))
+	{
+		GType _type = gst_meta_api_type_register ("PhotoBoothFrameMetaAPI", tags);
+		g_once_init_leave (&type, _type);
+	}
+	return type;
+}
+
+const GstMetaInfo *photo_booth_frame_meta_get_info (void)
+{
+	static const GstMetaInfo *info = NULL;
+	if (g_once_init_enter ((GstMetaInfo **) &info))
+	{
+		const GstMetaInfo *mi = gst_meta_register (PHOTO_BOOTH_FRAME_META_API_TYPE, "PhotoBoothFrameMeta", sizeof (PhotoBoothFrameMeta),
+			photo_booth_frame_meta_init, NULL, photo_booth_frame_meta_transform);
+		g_once_init_leave ((GstMetaInfo **) &info, (GstMetaInfo *) mi);
+	}
+	return info;
+}
+
+/* PhotoBoothFrameTiming */
+
+static void photo_booth_frame_timing_finalize (GObject *object);
+
+static void photo_booth_frame_timing_class_init (PhotoBoothFrameTimingClass *klass)
+{
+	GObjectClass *gobject_class = G_OBJECT_CLASS (klass);
+
+	GST_DEBUG_CATEGORY_INIT (photo_booth_frame_timing_debug, "photoboothframetiming", GST_DEBUG_BOLD | GST_DEBUG_FG_BLACK | GST_DEBUG_BG_YELLOW, "PhotoBoothFrameTiming");
+
+	gobject_class->finalize = photo_booth_frame_timing_finalize;
+}
+
+static void photo_booth_frame_timing_init (PhotoBoothFrameTiming *timing)
+{
+	guint i;
+	g_mutex_init (&timing->lock);
+	timing->captures = g_queue_new ();
+	memset (timing->shown, 0, sizeof (timing->shown));
+	timing->shown_captured = 0;
+	timing->shown_pending = FALSE;
+	for (i = 0; i < FRAME_STAGE_COUNT; i++)
+		timing->labels[i] = g_strdup_printf ("stage=\"%s\"", stage_names[i]);
+}
+
+static void photo_booth_frame_timing_finalize (GObject *object)
+{
+	PhotoBoothFrameTiming *timing = PHOTO_BOOTH_FRAME_TIMING (object);
+	guint i;
+	g_queue_free_full (timing->captures, g_free);
+	for (i = 0; i < FRAME_STAGE_COUNT; i++)
+		g_free (timing->labels[i]);
+	g_mutex_clear (&timing->lock);
+	G_OBJECT_CLASS (photo_booth_frame_timing_parent_class)->finalize (object);
+}
+
+PhotoBoothFrameTiming *photo_booth_frame_timing_new (void)
+{
+	return g_object_new (PHOTO_BOOTH_FRAME_TIMING_TYPE, NULL);
+}
+
+static void photo_booth_frame_timing_observe (PhotoBoothFrameTiming *timing, PhotoBoothFrameStage stage, gint64 duration)
+{
+	photo_booth_metrics_observe (photo_booth_metrics_get_default (), FRAME_METRIC, timing->labels[stage], (gdouble) duration / G_USEC_PER_SEC);
+}
+
+/* called by the capture thread for every live view frame it has written to the fifo */
+void photo_booth_frame_timing_captured (PhotoBoothFrameTiming *timing, gint64 start, gint64 end)
+{
+	PhotoBoothFrameCapture *capture = g_new (PhotoBoothFrameCapture, 1);
+	capture->start = start;
+	capture->end = end;
+	photo_booth_frame_timing_observe (timing, FRAME_STAGE_CAPTURE, end - start);
+	g_mutex_lock (&timing->lock);
+	g_queue_push_tail (timing->captures, capture);
+	while (g_queue_get_length (timing->captures) > MAX_PENDING_CAPTURES)
+		g_free (g_queue_pop_head (timing->captures));
+	g_mutex_unlock (&timing->lock);
+}
+
+/* the fifo is matched to the parsed frames by order only, whenever frames may have been
+ * lost in between (the video-bin was stopped) the pending captures have to be forgotten */
+void photo_booth_frame_timing_reset (PhotoBoothFrameTiming *timing)
+{
+	g_mutex_lock (&timing->lock);
+	g_queue_free_full (timing->captures, g_free);
+	timing->captures = g_queue_new ();
+	timing->shown_pending = FALSE;
+	g_mutex_unlock (&timing->lock);
+}
+
+static GstPadProbeReturn photo_booth_frame_timing_probe (G_GNUC_UNUSED GstPad *pad, GstPadProbeInfo *info, gpointer user_data)
+{
+	PhotoBoothFrameProbe *probe = user_data;
+	PhotoBoothFrameTiming *timing = probe->timing;
+	GstBuffer *buffer = gst_pad_probe_info_get_buffer (info);
+	PhotoBoothFrameMeta *meta;
+	gint64 now = g_get_monotonic_time ();
+
+	if (probe->stage == FRAME_STAGE_FIFO)
+	{
+		// a freshly parsed jpeg, it gets the times of the oldest capture still in the fifo
+		PhotoBoothFrameCapture *capture;
+		g_mutex_lock (&timing->lock);
+		capture = g_queue_pop_head (timing->captures);
+		g_mutex_unlock (&timing->lock);
+		if (!capture)
+			return GST_PAD_PROBE_OK;
+		buffer = gst_buffer_make_writable (buffer);
+		GST_PAD_PROBE_INFO_DATA (info) = buffer;
+		meta = (PhotoBoothFrameMeta *) gst_buffer_add_meta (buffer, photo_booth_frame_meta_get_info (), NULL);
+		meta->captured = capture->start;
+		meta->stamps[FRAME_STAGE_CAPTURE] = capture->end;
+		g_free (capture);
+	}
+	else if (!(meta = gst_buffer_get_photo_booth_frame_meta (buffer)))
+		return GST_PAD_PROBE_OK;
+
+	// every stage only ever writes its own stamp, so the branches after a tee don't get in each other's way
+	meta->stamps[probe->stage] = now;
+	if (meta->stamps[probe->after])
+		photo_booth_frame_timing_observe (timing, probe->stage, now - meta->stamps[probe->after]);
+
+	if (probe->stage == FRAME_STAGE_SINK)
+	{
+		g_mutex_lock (&timing->lock);
+		memcpy (timing->shown, meta->stamps, sizeof (timing->shown));
+		timing->shown_captured = meta->captured;
+		timing->shown_pending = TRUE;
+		g_mutex_unlock (&timing->lock);
+	}
+	return GST_PAD_PROBE_OK;
+}
+
+/* times the buffers leaving pad as stage, measured from when they left stage after.
+ * FRAME_STAGE_FIFO is where the jpegs are parsed and tagged with their capture times */
+void photo_booth_frame_timing_watch (PhotoBoothFrameTiming *timing, GstPad *pad, PhotoBoothFrameStage stage, PhotoBoothFrameStage after)
+{
+	PhotoBoothFrameProbe *probe = g_new (PhotoBoothFrameProbe, 1);
+	probe->timing = timing;
+	probe->stage = stage;
+	probe->after = after;
+	gst_pad_add_probe (pad, GST_PAD_PROBE_TYPE_BUFFER, photo_booth_frame_timing_probe, probe, g_free);
+	GST_DEBUG_OBJECT (timing, "timing %s after %s at %" GST_PTR_FORMAT, stage_names[stage], stage_names[after], pad);
+}
+
+/* called from the video widget's draw handler, the frame gtksink got last is on screen now */
+void photo_booth_frame_timing_rendered (PhotoBoothFrameTiming *timing)
+{
+	gint64 now = g_get_monotonic_time (), sink = 0, captured = 0;
+	g_mutex_lock (&timing->lock);
+	if (timing->shown_pending)
+	{
+		sink = timing->shown[FRAME_STAGE_SINK];
+		captured = timing->shown_captured;
+		timing->shown_pending = FALSE;
+	}
+	g_mutex_unlock (&timing->lock);
+	if (sink)
+		photo_booth_frame_timing_observe (timing, FRAME_STAGE_RENDER, now - sink);
+	if (captured)
+		photo_booth_frame_timing_observe (timing, FRAME_STAGE_TOTAL, now - captured);
+}
+
+/* a few lines for the on-screen hud with the recent percentiles of every stage in ms */
+gchar *photo_booth_frame_timing_describe (PhotoBoothFrameTiming *timing)
+{
+	PhotoBoothMetrics *metrics = photo_booth_metrics_get_default ();
+	GString *out = g_string_new (NULL);
+	guint i;
+
+	g_string_append_printf (out, "live view %.1f fps\n%-10s %6s %6s %6s", photo_booth_metrics_get_value (metrics, "photobooth_preview_fps", NULL), "ms", "p50", "p95", "max");
+	for (i = 0; i < FRAME_STAGE_COUNT; i++)
+	{
+		gdouble max = photo_booth_metrics_quantile (metrics, FRAME_METRIC, timing->labels[i], 1.0);
+		if (max <= 0.0)
+			continue;
+		g_string_append_printf (out, "\n%-10s %6.1f %6.1f %6.1f", stage_names[i],
+			photo_booth_metrics_quantile (metrics, FRAME_METRIC, timing->labels[i], 0.5) * 1000.0,
+			photo_booth_metrics_quantile (metrics, FRAME_METRIC, timing->labels[i], 0.95) * 1000.0,
+			max * 1000.0);
+	}
+	return g_string_free (out, FALSE);
+}
@@ -0,0 +1,91 @@
+/*
+ * GStreamer photoboothframetiming.h
+ * Copyright 2019 Andreas Frisch <fraxinas@schaffenburg.org>
+ *
+ * This program is licensed under the Creative Commons
+ * Attribution-NonCommercial-ShareAlike 3.0 Unported
+ * License. To view a copy of this license, visit
+ * http://creativecommons.org/licenses/by-nc-sa/3.0/ or send a letter to
+ * Creative Commons,559 Nathan Abbott Way,Stanford,California 94305,USA.
+ *
+ * This program is NOT free software. It is open source, you are allowed
+ * to modify it (if you keep the license), but it may not be commercially
+ * distributed other than under the conditions noted above.
+ */
+
+#ifndef __PHOTO_BOOTH_FRAME_TIMING_H__
+#define __PHOTO_BOOTH_FRAME_TIMING_H__
+
+#include <glib-object.h>
+#include <glib.h>
+#include <gst/gst.h>
+
+G_BEGIN_DECLS
+
+#define PHOTO_BOOTH_FRAME_TIMING_TYPE                (photo_booth_frame_timing_get_type ())
+#define PHOTO_BOOTH_FRAME_TIMING(obj)                (G_TYPE_CHECK_INSTANCE_CAST ((obj),PHOTO_BOOTH_FRAME_TIMING_TYPE,PhotoBoothFrameTiming))
+#define PHOTO_BOOTH_FRAME_TIMING_CLASS(klass)        (G_TYPE_CHECK_CLASS_CAST ((klass), PHOTO_BOOTH_FRAME_TIMING_TYPE,PhotoBoothFrameTimingClass))
+#define IS_PHOTO_BOOTH_FRAME_TIMING(obj)             (G_TYPE_CHECK_INSTANCE_TYPE ((obj),PHOTO_BOOTH_FRAME_TIMING_TYPE))
+#define IS_PHOTO_BOOTH_FRAME_TIMING_CLASS(klass)     (G_TYPE_CHECK_CLASS_TYPE ((klass), PHOTO_BOOTH_FRAME_TIMING_TYPE))
+
+/* the live view path from the camera to the screen, every stage is timed from the end of the one it follows */
+typedef enum
+{
+	FRAME_STAGE_CAPTURE = 0,   // gp_camera_capture_preview until the jpeg is in the fifo
+	FRAME_STAGE_FIFO,          // fifo, fdsrc and jpegparse
+	FRAME_STAGE_DECODE,        // jpegdec
+	FRAME_STAGE_SCALE,         // videoscale
+	FRAME_STAGE_CONVERT,       // videoconvert
+	FRAME_STAGE_FLIP,          // videoflip and the output capsfilter
+	FRAME_STAGE_FACEDETECT,    // face detection side branch, after flip
+	FRAME_STAGE_SINK,          // display queue and mask overlay until gtksink has the frame, after flip
+	FRAME_STAGE_RENDER,        // gtksink until the widget has drawn it
+	FRAME_STAGE_TOTAL,         // capture call to drawn widget
+	FRAME_STAGE_COUNT
+} PhotoBoothFrameStage;
+
+typedef struct _PhotoBoothFrameTiming          PhotoBoothFrameTiming;
+typedef struct _PhotoBoothFrameTimingClass     PhotoBoothFrameTimingClass;
+typedef struct _PhotoBoothFrameMeta            PhotoBoothFrameMeta;
+
+/* monotonic times in us at which the frame left each stage, 0 if it hasn't (yet) */
+struct _PhotoBoothFrameMeta
+{
+	GstMeta meta;
+	gint64 captured;
+	gint64 stamps[FRAME_STAGE_COUNT];
+};
+
+struct _PhotoBoothFrameTiming
+{
+	GObject parent;
+	GMutex lock;
+	GQueue *captures;          // capture start and end of the frames in the fifo, oldest first
+	gint64 shown[FRAME_STAGE_COUNT], shown_captured;
+	gboolean shown_pending;
+	gchar *labels[FRAME_STAGE_COUNT];
+};
+
+struct _PhotoBoothFrameTimingClass
+{
+	GObjectClass parent_class;
+};
+
+GType                  photo_booth_frame_meta_api_get_type   (void);
+const GstMetaInfo     *photo_booth_frame_meta_get_info       (void);
+#define PHOTO_BOOTH_FRAME_META_API_TYPE (photo_booth_frame_meta_api_get_type ())
+#define gst_buffer_get_photo_booth_frame_meta(b) ((PhotoBoothFrameMeta *) gst_buffer_get_meta ((b), PHOTO_BOOTH_FRAME_META_API_TYPE))
+
+/* stage durations go into the photobooth_preview_frame_seconds{stage=...} summaries of the default metrics,
+ * which keep the most recent frames only */
+GType                  photo_booth_frame_timing_get_type     (void);
+PhotoBoothFrameTiming *photo_booth_frame_timing_new          (void);
+void                   photo_booth_frame_timing_captured     (PhotoBoothFrameTiming *timing, gint64 start, gint64 end);
+void                   photo_booth_frame_timing_reset        (PhotoBoothFrameTiming *timing);
+void                   photo_booth_frame_timing_watch        (PhotoBoothFrameTiming *timing, GstPad *pad, PhotoBoothFrameStage stage, PhotoBoothFrameStage after);
+void                   photo_booth_frame_timing_rendered     (PhotoBoothFrameTiming *timing);
+gchar                 *photo_booth_frame_timing_describe     (PhotoBoothFrameTiming *timing);
+
+G_END_DECLS
+
+#endif /* __PHOTO_BOOTH_FRAME_TIMING_H__ */
@@ -13,9 +13,16 @@
  * distributed other than under the conditions noted above.
  */
 
+#include <math.h>
+#include <string.h>
 #include <gst/video/gstvideosink.h>
 #include "photobooth.h"
 #include "photoboothmasquerade.h"
+#include "photoboothtracker.h"
+#include "photoboothcompositor.h"
+#include "photoboothfacedetect.h"
+#include "photoboothmemory.h"
+#include "photoboothstartup.h"
 
 #define _(key) (G_strings_table && g_hash_table_contains (G_strings_table, key) ? g_hash_table_lookup (G_strings_table, key) : key)
 
@@ -25,6 +32,45 @@
 PhotoBoothMask))
 #define IS_PHOTO_BOOTH_MASK(obj) (G_TYPE_CHECK_INSTANCE_TYPE((obj),TYPE_PHOTO_BOOTH_MASK))
 
+/* live masks are drawn from prescaled copies, each level 1/sqrt(2) the size of the previous one */
+#define MASK_MIP_LEVELS    16
+#define MASK_MIP_MIN_WIDTH 16
+
+/* a mask pack directory may carry a manifest made by resources/compile_mask_pack.py */
+#define MASK_PACK_MANIFEST "manifest.json"
+#define MASK_PACK_VERSION  1
+#define DEFAULT_MASK_CACHE_SIZE 8
+
+/* heads tilted further than this are more likely a misdetected landmark than a pose */
+#define MASK_MAX_ROLL             (G_PI / 5)
+/* share of a new detection's landmarks that goes into a tracked mask's pose */
+#define MASK_LANDMARK_SMOOTHING   0.5
+
+typedef enum
+{
+	MASK_ANCHOR_FACE,
+	MASK_ANCHOR_EYES,
+	MASK_ANCHOR_NOSE,
+	MASK_ANCHOR_MOUTH
+} PhotoBoothMaskAnchor;
+
+/* landmark positions as fractions of the face box and the head's roll in radians, clockwise */
+typedef struct
+{
+	gdouble roll;
+	gdouble eyes_x, eyes_y;
+	gdouble nose_x, nose_y;
+	gdouble mouth_x, mouth_y;
+} PhotoBoothFaceLandmarks;
+
+/* where a mask goes: its centre, its unrotated size and the rotation around the centre */
+typedef struct
+{
+	gdouble cx, cy;
+	gdouble width, height;
+	gdouble angle;
+} PhotoBoothMaskPose;
+
 typedef struct _PhotoBoothMask PhotoBoothMask;
 typedef struct _PhotoBoothMaskClass PhotoBoothMaskClass;
 
@@ -35,16 +81,24 @@ struct _PhotoBoothMask
 	GstObject parent;
 	guint index;
 	gboolean active;
-	const gchar *filename;
+	gchar *filename;
+	gint width, height;
 	GtkFixed *fixed;
-	GdkPixbuf *pixbuf, *pixbuf_icon, *pixbuf_copy;
+	/* the full size pixbuf and its mip levels are only decoded on demand, see photo_booth_masquerade_use_mask */
+	GdkPixbuf *pixbuf, *pixbuf_icon;
+	gboolean loading, failed;
 	GtkWidget *imagew, *eventw;
 	gint screen_offset_x, screen_offset_y;
 	gint offset_x, offset_y;
+	PhotoBoothMaskAnchor anchor;
 	gdouble print_scaling_factor;
 	gboolean dragging;
 	gint dragstartoffsetx, dragstartoffsety;
-	GstVideoRectangle print_rectangle;
+	PhotoBoothFaceLandmarks landmarks;
+	PhotoBoothMaskPose print_pose;
+	gint placed_x, placed_y;
+	cairo_surface_t *mip[MASK_MIP_LEVELS];
+	guint n_mip;
 };
 
 struct _PhotoBoothMaskClass
@@ -58,9 +112,12 @@ GST_DEBUG_CATEGORY_STATIC (photo_booth_masquerade_debug);
 #define GST_CAT_DEFAULT photo_booth_masquerade_debug
 
 static void photo_booth_mask_connect_events (PhotoBoothMask *mask, gpointer press, gpointer release, gpointer motion);
-static void photo_booth_mask_create_overlay (PhotoBoothMask *mask, GstElement *mask_bin);
+static void photo_booth_mask_create_overlay (PhotoBoothMask *mask, PhotoBoothCompositor *compositor);
 static void photo_booth_mask_show (PhotoBoothMask *mask, const GValue *face, GstStructure *structure);
+static void photo_booth_mask_place (PhotoBoothMask *mask, const PhotoBoothBox *face, const PhotoBoothFaceLandmarks *landmarks, PhotoboothState state);
 static void photo_booth_mask_hide (PhotoBoothMask *mask);
+static void photo_booth_mask_draw (PhotoBoothMask *mask, cairo_t *cr, const PhotoBoothMaskPose *pose);
+static GdkPixbuf *photo_booth_mask_render (PhotoBoothMask *mask, const PhotoBoothMaskPose *pose, GdkRectangle *rect);
 
 gboolean photo_booth_masquerade_press   (GtkWidget *widget, GdkEventButton *event, gpointer user_data);
 gboolean photo_booth_masquerade_release (GtkWidget *widget, GdkEventButton *event, gpointer user_data);
@@ -70,12 +127,16 @@ static void
 photo_booth_mask_finalize (GObject *object)
 {
 	PhotoBoothMask *mask;
+	guint i;
 	mask = PHOTO_BOOTH_MASK (object);
 	GST_DEBUG_OBJECT (mask, "finalize");
-	g_object_unref (mask->pixbuf);
-	g_object_unref (mask->pixbuf_icon);
-	if (mask->pixbuf_copy)
-		g_object_unref (mask->pixbuf_copy);
+	photo_booth_memory_untrack (photo_booth_memory_get_default (), mask);
+	for (i = 0; i < mask->n_mip; i++)
+		cairo_surface_destroy (mask->mip[i]);
+	g_clear_object (&mask->pixbuf);
+	g_clear_object (&mask->pixbuf_icon);
+	g_clear_object (&mask->fixed);
+	g_free (mask->filename);
 	mask->imagew = mask->eventw = NULL;
 	G_OBJECT_CLASS (photo_booth_mask_parent_class)->finalize (object);
 }
@@ -87,11 +148,28 @@ photo_booth_mask_class_init (PhotoBoothMaskClass *klass)
 	G_OBJECT_CLASS (klass)->finalize = photo_booth_mask_finalize;
 }
 
+static void
+photo_booth_face_landmarks_init (PhotoBoothFaceLandmarks *landmarks)
+{
+	// where the features of an upright face sit in the detector's box
+	landmarks->roll = 0.0;
+	landmarks->eyes_x = landmarks->nose_x = landmarks->mouth_x = 0.5;
+	landmarks->eyes_y = PHOTO_BOOTH_FACE_EYES_Y;
+	landmarks->nose_y = PHOTO_BOOTH_FACE_NOSE_Y;
+	landmarks->mouth_y = PHOTO_BOOTH_FACE_MOUTH_Y;
+}
+
 static void
 photo_booth_mask_init (PhotoBoothMask *mask)
 {
 	GST_LOG_OBJECT (mask, "mask init");
-	mask->pixbuf = mask->pixbuf_icon = mask->pixbuf_copy = NULL;
+	mask->pixbuf = mask->pixbuf_icon = NULL;
+	mask->fixed = NULL;
+	mask->filename = NULL;
+	mask->loading = mask->failed = FALSE;
+	mask->n_mip = 0;
+	mask->anchor = MASK_ANCHOR_FACE;
+	photo_booth_face_landmarks_init (&mask->landmarks);
 	mask->eventw = gtk_event_box_new ();
 	mask->imagew = gtk_image_new ();
 	gtk_widget_set_can_focus (mask->eventw, FALSE);
@@ -108,16 +186,12 @@ photo_booth_mask_connect_events (PhotoBoothMask *mask, gpointer press, gpointer
 }
 
 static void
-photo_booth_mask_create_overlay (PhotoBoothMask *mask, GstElement *mask_bin)
+photo_booth_mask_create_overlay (PhotoBoothMask *mask, PhotoBoothCompositor *compositor)
 {
-	GstPad *ghost_srcpad;
-	GstPad *prev_srcpad, *new_sinkpad, *new_srcpad;
-	const gchar *element_name;
-	GstElement *photo_overlay = NULL;
-	guint width, height, x, y;
-
-	width = mask->print_rectangle.w;
-	height = mask->print_rectangle.h;
+	PhotoBoothMaskPose pose = mask->print_pose;
+	GdkRectangle rect;
+	GdkPixbuf *rendered;
+	gint x, y;
 
 	GValue pos = G_VALUE_INIT;
 	g_value_init (&pos, G_TYPE_INT);
@@ -128,95 +202,257 @@ photo_booth_mask_create_overlay (PhotoBoothMask *mask, GstElement *mask_bin)
 	gtk_container_child_get_property (GTK_CONTAINER (mask->fixed), GTK_WIDGET (mask->eventw), "y", &pos);
 	y = g_value_get_int (&pos);
 
-	GST_DEBUG_OBJECT (mask, "mask [%d] original widget size (%dx%d) @ (%d, %d)", mask->index, width, height, x, y);
+	// the print keeps the detected pose, only moved by however far the mask was dragged on screen
+	pose.cx += (gdouble) (x - mask->placed_x) / mask->print_scaling_factor;
+	pose.cy += (gdouble) (y - mask->placed_y) / mask->print_scaling_factor;
 
-	// convert screen widget's coordinates, size and offset to print values
-	width = (gdouble) width / mask->print_scaling_factor;
-	height = (gdouble) height / mask->print_scaling_factor;
-	gdouble video_scaling_factor = (gdouble) width / (gdouble) gdk_pixbuf_get_width (mask->pixbuf);
-	x = (gdouble) ((x - mask->screen_offset_x) - (gdouble) mask->offset_x * video_scaling_factor * mask->print_scaling_factor) / mask->print_scaling_factor;
-	y = (gdouble) ((y - mask->screen_offset_y) - (gdouble) mask->offset_y * video_scaling_factor * mask->print_scaling_factor) / mask->print_scaling_factor;
+	GST_DEBUG_OBJECT (mask, "mask [%d] widget @ (%d, %d) placed @ (%d, %d)", mask->index, x, y, mask->placed_x, mask->placed_y);
 
-	GST_DEBUG_OBJECT (mask, "mask->screen_offset_y=%d, mask->offset_y=%d", mask->screen_offset_y, mask->offset_y);
-	GST_DEBUG_OBJECT (mask, "mask [%d] scaled   widget size (%dx%d) @ (%d, %d)", mask->index, width, height, x, y);
-
-	element_name = g_strdup_printf (PHOTO_MASKOVERLAY_NAME_TEMPLATE, mask->index);
-	photo_overlay = gst_bin_get_by_name (GST_BIN (mask_bin), element_name);
-	if (photo_overlay) {
-		GST_DEBUG_OBJECT (mask, "using existing photo_overlay element %" GST_PTR_FORMAT, photo_overlay);
-	} else {
-		photo_overlay = gst_element_factory_make ("gdkpixbufoverlay", element_name);
-		GST_DEBUG_OBJECT (mask, "created new photo_overlay element %" GST_PTR_FORMAT, photo_overlay);
-		int ret = gst_bin_add (GST_BIN (mask_bin), photo_overlay);
-		g_assert (ret);
-		ghost_srcpad = gst_element_get_static_pad (mask_bin, "src");
-		prev_srcpad = gst_ghost_pad_get_target (GST_GHOST_PAD (ghost_srcpad));
-		new_sinkpad = gst_element_get_static_pad (photo_overlay, "sink");
-		new_srcpad = gst_element_get_static_pad (photo_overlay, "src");
-		ret = gst_ghost_pad_set_target (GST_GHOST_PAD (ghost_srcpad), new_srcpad);
-		g_assert (ret);
-		GstPadLinkReturn lret = gst_pad_link (prev_srcpad, new_sinkpad);
-		g_assert (lret == GST_PAD_LINK_OK);
-	}
-
-	mask->pixbuf_copy = gdk_pixbuf_copy (mask->pixbuf); // because GStreamer's gdkpixbufoverlay modifies the channel layout in-place
-	g_object_set (photo_overlay, "pixbuf", mask->pixbuf_copy,
-	                             "overlay-width", width,
-	                             "overlay-height", height,
-	                             "offset-x", x,
-	                             "offset-y", y,
-	                             NULL);
+	// rendered straight from the full size mask, not from the screen copy
+	rendered = photo_booth_mask_render (mask, &pose, &rect);
+	GST_DEBUG_OBJECT (mask, "mask [%d] print size (%.0fx%.0f) rotated by %.2f rad -> (%dx%d) @ (%d, %d)", mask->index, pose.width, pose.height, pose.angle, rect.width, rect.height, rect.x, rect.y);
+	photo_booth_compositor_add_mask (compositor, rendered, rect.x, rect.y, rect.width, rect.height);
+	g_object_unref (rendered);
 
 	photo_booth_mask_hide (mask);
 }
 
+/* a landmark as reported by the face detector, OpenCV gives rectangles and the built-in detector points */
+static gboolean
+_face_point (const GstStructure *face, const gchar *name, gdouble *px, gdouble *py)
+{
+	guint x = 0, y = 0, width = 0, height = 0;
+	gboolean found;
+	gchar *key;
+
+	key = g_strdup_printf ("%s->x", name);
+	found = gst_structure_get_uint (face, key, &x);
+	g_free (key);
+	key = g_strdup_printf ("%s->y", name);
+	found = gst_structure_get_uint (face, key, &y) && found;
+	g_free (key);
+	key = g_strdup_printf ("%s->width", name);
+	gst_structure_get_uint (face, key, &width);
+	g_free (key);
+	key = g_strdup_printf ("%s->height", name);
+	gst_structure_get_uint (face, key, &height);
+	g_free (key);
+
+	*px = x + width / 2.0;
+	*py = y + height / 2.0;
+	return found;
+}
+
+/* the point distance face heights further down the tilted face from x, y, all as fractions of the face box */
+static void
+photo_booth_face_landmarks_below (const PhotoBoothFaceLandmarks *landmarks, gdouble x, gdouble y, gdouble distance, guint fw, guint fh, gdouble *px, gdouble *py)
+{
+	*px = x - sin (landmarks->roll) * distance * fh / fw;
+	*py = y + cos (landmarks->roll) * distance;
+}
+
+static void
+photo_booth_face_landmarks_parse (const GstStructure *face_struct, PhotoBoothFaceLandmarks *landmarks)
+{
+	guint fx = 0, fy = 0, fw = 0, fh = 0;
+	gdouble lx, ly, rx, ry, x, y;
+	gboolean has_pupils = FALSE, has_eyes = FALSE, has_nose = FALSE, has_mouth = FALSE;
+
+	photo_booth_face_landmarks_init (landmarks);
+	gst_structure_get_uint (face_struct, "x", &fx);
+	gst_structure_get_uint (face_struct, "y", &fy);
+	gst_structure_get_uint (face_struct, "width", &fw);
+	gst_structure_get_uint (face_struct, "height", &fh);
+	if (!fw || !fh)
+		return;
+
+	if (_face_point (face_struct, "left-eye", &lx, &ly) && _face_point (face_struct, "right-eye", &rx, &ry))
+	{
+		landmarks->roll = atan2 (ry - ly, rx - lx);
+		landmarks->eyes_x = ((lx + rx) / 2 - fx) / fw;
+		landmarks->eyes_y = ((ly + ry) / 2 - fy) / fh;
+		has_pupils = has_eyes = TRUE;
+	}
+	else if (_face_point (face_struct, "eyes", &x, &y))
+	{
+		landmarks->eyes_x = (x - fx) / fw;
+		landmarks->eyes_y = (y - fy) / fh;
+		has_eyes = TRUE;
+	}
+	if (_face_point (face_struct, "nose", &x, &y))
+	{
+		landmarks->nose_x = (x - fx) / fw;
+		landmarks->nose_y = (y - fy) / fh;
+		has_nose = TRUE;
+	}
+	if (_face_point (face_struct, "mouth", &x, &y))
+	{
+		landmarks->mouth_x = (x - fx) / fw;
+		landmarks->mouth_y = (y - fy) / fh;
+		has_mouth = TRUE;
+	}
+
+	// without pupils the tilt is still told by the line from between the eyes down to the mouth
+	if (!has_pupils && has_eyes && has_mouth && landmarks->mouth_y > landmarks->eyes_y)
+		landmarks->roll = atan2 ((landmarks->eyes_x - landmarks->mouth_x) * fw, (landmarks->mouth_y - landmarks->eyes_y) * fh);
+	landmarks->roll = CLAMP (landmarks->roll, -MASK_MAX_ROLL, MASK_MAX_ROLL);
+
+	// the ones that weren't found go where they'd be relative to the ones that were, instead of where
+	// they'd be in an upright face box, so a nose anchored mask doesn't drift off a tilted face
+	if (has_eyes)
+	{
+		if (!has_nose)
+			photo_booth_face_landmarks_below (landmarks, landmarks->eyes_x, landmarks->eyes_y, PHOTO_BOOTH_FACE_NOSE_Y - PHOTO_BOOTH_FACE_EYES_Y, fw, fh, &landmarks->nose_x, &landmarks->nose_y);
+		if (!has_mouth)
+			photo_booth_face_landmarks_below (landmarks, landmarks->eyes_x, landmarks->eyes_y, PHOTO_BOOTH_FACE_MOUTH_Y - PHOTO_BOOTH_FACE_EYES_Y, fw, fh, &landmarks->mouth_x, &landmarks->mouth_y);
+	}
+	else if (has_mouth)
+	{
+		photo_booth_face_landmarks_below (landmarks, landmarks->mouth_x, landmarks->mouth_y, PHOTO_BOOTH_FACE_EYES_Y - PHOTO_BOOTH_FACE_MOUTH_Y, fw, fh, &landmarks->eyes_x, &landmarks->eyes_y);
+		if (!has_nose)
+			photo_booth_face_landmarks_below (landmarks, landmarks->mouth_x, landmarks->mouth_y, PHOTO_BOOTH_FACE_NOSE_Y - PHOTO_BOOTH_FACE_MOUTH_Y, fw, fh, &landmarks->nose_x, &landmarks->nose_y);
+	}
+}
+
+static void
+photo_booth_face_landmarks_smooth (PhotoBoothFaceLandmarks *landmarks, const PhotoBoothFaceLandmarks *measured)
+{
+	landmarks->roll += MASK_LANDMARK_SMOOTHING * (measured->roll - landmarks->roll);
+	landmarks->eyes_x += MASK_LANDMARK_SMOOTHING * (measured->eyes_x - landmarks->eyes_x);
+	landmarks->eyes_y += MASK_LANDMARK_SMOOTHING * (measured->eyes_y - landmarks->eyes_y);
+	landmarks->nose_x += MASK_LANDMARK_SMOOTHING * (measured->nose_x - landmarks->nose_x);
+	landmarks->nose_y += MASK_LANDMARK_SMOOTHING * (measured->nose_y - landmarks->nose_y);
+	landmarks->mouth_x += MASK_LANDMARK_SMOOTHING * (measured->mouth_x - landmarks->mouth_x);
+	landmarks->mouth_y += MASK_LANDMARK_SMOOTHING * (measured->mouth_y - landmarks->mouth_y);
+}
+
+static PhotoBoothMaskAnchor
+photo_booth_mask_anchor_from_string (const gchar *anchor)
+{
+	if (g_strcmp0 (anchor, "eyes") == 0)
+		return MASK_ANCHOR_EYES;
+	if (g_strcmp0 (anchor, "nose") == 0)
+		return MASK_ANCHOR_NOSE;
+	if (g_strcmp0 (anchor, "mouth") == 0)
+		return MASK_ANCHOR_MOUTH;
+	return MASK_ANCHOR_FACE;
+}
+
+/* the mask is scaled to the face width and turned with the head. the offsets are in mask pixels and
+ * rotate along: for a face anchored mask they move the top left corner from the face box's,
+ * for a landmark anchored one they move the mask's centre from the landmark */
+static void
+photo_booth_mask_pose (PhotoBoothMask *mask, const PhotoBoothBox *face, const PhotoBoothFaceLandmarks *landmarks, PhotoBoothMaskPose *pose)
+{
+	gdouble scale = face->width / mask->width;
+	gdouble c = cos (landmarks->roll), s = sin (landmarks->roll);
+	gdouble ax, ay, dx, dy;
+
+	pose->width = face->width;
+	pose->height = mask->height * scale;
+	pose->angle = landmarks->roll;
+	dx = mask->offset_x * scale;
+	dy = mask->offset_y * scale;
+
+	switch (mask->anchor)
+	{
+		case MASK_ANCHOR_EYES:
+			ax = face->x + landmarks->eyes_x * face->width;
+			ay = face->y + landmarks->eyes_y * face->height;
+			break;
+		case MASK_ANCHOR_NOSE:
+			ax = face->x + landmarks->nose_x * face->width;
+			ay = face->y + landmarks->nose_y * face->height;
+			break;
+		case MASK_ANCHOR_MOUTH:
+			ax = face->x + landmarks->mouth_x * face->width;
+			ay = face->y + landmarks->mouth_y * face->height;
+			break;
+		case MASK_ANCHOR_FACE:
+		default:
+			ax = face->x + face->width / 2;
+			ay = face->y + face->height / 2;
+			dx += (pose->width - face->width) / 2;
+			dy += (pose->height - face->height) / 2;
+			break;
+	}
+	pose->cx = ax + dx * c - dy * s;
+	pose->cy = ay + dx * s + dy * c;
+}
+
+/* pixel bounds of the rotated mask, with a pixel to spare for the antialiased edges */
+static void
+photo_booth_mask_pose_bounds (const PhotoBoothMaskPose *pose, GdkRectangle *rect)
+{
+	gdouble c = fabs (cos (pose->angle)), s = fabs (sin (pose->angle));
+	gdouble width = pose->width * c + pose->height * s;
+	gdouble height = pose->width * s + pose->height * c;
+
+	rect->x = floor (pose->cx - width / 2) - 1;
+	rect->y = floor (pose->cy - height / 2) - 1;
+	rect->width = ceil (width) + 2;
+	rect->height = ceil (height) + 2;
+}
+
+/* captured photo only, the live masks are drawn into the preview frames and never become widgets.
+ * on the photo they do so they can be dragged into place before printing */
+static void
+photo_booth_mask_place (PhotoBoothMask *mask, const PhotoBoothBox *face, const PhotoBoothFaceLandmarks *landmarks, PhotoboothState state)
+{
+	PhotoBoothMaskPose pose;
+	GdkRectangle rect;
+	GdkPixbuf *rendered;
+
+	photo_booth_mask_pose (mask, face, landmarks, &pose);
+	mask->print_pose = pose;
+	pose.cx = pose.cx * mask->print_scaling_factor + mask->screen_offset_x;
+	pose.cy = pose.cy * mask->print_scaling_factor + mask->screen_offset_y;
+	pose.width *= mask->print_scaling_factor;
+	pose.height *= mask->print_scaling_factor;
+	GST_DEBUG_OBJECT (mask, "PHOTO mask size: (%.0fx%.0f) (print scaling factor=%.2f) centre: (%.0f,%.0f) roll: %.2f state: (%s)", pose.width, pose.height, mask->print_scaling_factor, pose.cx, pose.cy, pose.angle, photo_booth_state_get_name (state));
+	photo_booth_mask_connect_events (mask, photo_booth_masquerade_press, photo_booth_masquerade_release, photo_booth_masquerade_motion);
+
+	rendered = photo_booth_mask_render (mask, &pose, &rect);
+	mask->placed_x = rect.x;
+	mask->placed_y = rect.y;
+	gtk_fixed_move (mask->fixed, mask->eventw, rect.x, rect.y);
+	gtk_image_set_from_pixbuf (GTK_IMAGE (mask->imagew), rendered);
+	g_object_unref (rendered);
+	gtk_widget_show (mask->eventw);
+	gtk_widget_show (mask->imagew);
+	mask->active = TRUE;
+}
+
 static void
 photo_booth_mask_show (PhotoBoothMask *mask, const GValue *face, GstStructure *structure)
 {
 	int state;
-	gboolean is_video;
 
 	if (!mask->imagew || !structure || !face)
 		return;
 
 	gst_structure_get_int (structure, "state", &state);
-	gst_structure_get_boolean (structure, "is-video", &is_video);
 
 	const GstStructure *face_struct = gst_value_get_structure (face);
-	GdkPixbuf *scaled_mask_pixbuf;
-	guint x, y, width, height;
-	gdouble video_scaling_factor;
+	guint x = 0, y = 0, width = 0, height = 0;
+	gdouble detect_scale = 1.0;
+	PhotoBoothFaceLandmarks landmarks;
+	PhotoBoothBox box;
 
 	gst_structure_get_uint (face_struct, "x", &x);
 	gst_structure_get_uint (face_struct, "y", &y);
 	gst_structure_get_uint (face_struct, "width", &width);
 	gst_structure_get_uint (face_struct, "height", &height);
+	photo_booth_face_landmarks_parse (face_struct, &landmarks);
 
-	video_scaling_factor = (gdouble) width / (gdouble) gdk_pixbuf_get_width (mask->pixbuf);
-
-	if (is_video) {
-		height = (gdouble) gdk_pixbuf_get_height (mask->pixbuf) * video_scaling_factor;
-		x += mask->screen_offset_x + (gdouble) mask->offset_x * video_scaling_factor;
-		y += mask->screen_offset_y + (gdouble) mask->offset_y * video_scaling_factor;
-		GST_LOG_OBJECT (mask, "VIDEO mask size: (%dx%d) (video scaling factor=%.2f) position: (%d,%d) state: (%s)", width, height, video_scaling_factor, x, y, photo_booth_state_get_name (state));
-	}
-	else { // Captured Photo
-		width = (gdouble) width * mask->print_scaling_factor;
-		height = (gdouble) gdk_pixbuf_get_height (mask->pixbuf) * video_scaling_factor * mask->print_scaling_factor;
-		x = (gdouble) x * mask->print_scaling_factor + mask->screen_offset_x + (gdouble) mask->offset_x * video_scaling_factor * mask->print_scaling_factor;
-		y = (gdouble) y * mask->print_scaling_factor + mask->screen_offset_y + (gdouble) mask->offset_y * video_scaling_factor * mask->print_scaling_factor;
-		GST_DEBUG_OBJECT (mask, "PHOTO mask size: (%dx%d) (print scaling factor=%.2f) position: (%d,%d) state: (%s)", width, height, mask->print_scaling_factor, x, y, photo_booth_state_get_name (state));
-		mask->print_rectangle.w = width;
-		mask->print_rectangle.h = height;
-		photo_booth_mask_connect_events (mask, photo_booth_masquerade_press, photo_booth_masquerade_release, photo_booth_masquerade_motion);
-	}
-	gtk_fixed_move (mask->fixed, mask->eventw, x, y);
-	scaled_mask_pixbuf = gdk_pixbuf_scale_simple (mask->pixbuf, width, height, GDK_INTERP_BILINEAR);
-	gtk_image_set_from_pixbuf (GTK_IMAGE (mask->imagew), scaled_mask_pixbuf);
-	gtk_widget_show (mask->eventw);
-	gtk_widget_show (mask->imagew);
-	g_object_unref (scaled_mask_pixbuf);
-	mask->active = TRUE;
+	// detection runs on a downscaled copy of the frame, the landmarks are relative to the face and don't care
+	gst_structure_get_double (structure, "detect-scale", &detect_scale);
+	box.x = x * detect_scale;
+	box.y = y * detect_scale;
+	box.width = width * detect_scale;
+	box.height = height * detect_scale;
+
+	photo_booth_mask_place (mask, &box, &landmarks, state);
 }
 
 static void
@@ -230,24 +466,114 @@ photo_booth_mask_hide (PhotoBoothMask *mask)
 	mask->active = FALSE;
 }
 
+static guint
+photo_booth_mask_build_mip (GdkPixbuf *pixbuf, cairo_surface_t **mip)
+{
+	GdkPixbuf *level = g_object_ref (pixbuf);
+	gint width = gdk_pixbuf_get_width (level);
+	gint height = gdk_pixbuf_get_height (level);
+	guint n_mip = 0;
+
+	// every level is filtered from the previous one so the small ones don't alias
+	while (n_mip < MASK_MIP_LEVELS)
+	{
+		GdkPixbuf *next;
+		mip[n_mip++] = gdk_cairo_surface_create_from_pixbuf (level, 1, NULL);
+		width = width * G_SQRT2 / 2;
+		height = height * G_SQRT2 / 2;
+		if (width < MASK_MIP_MIN_WIDTH || height < 1)
+			break;
+		next = gdk_pixbuf_scale_simple (level, width, height, GDK_INTERP_BILINEAR);
+		g_object_unref (level);
+		level = next;
+	}
+	g_object_unref (level);
+	return n_mip;
+}
+
+static void
+photo_booth_mask_unload (PhotoBoothMask *mask)
+{
+	guint i;
+	photo_booth_memory_untrack (photo_booth_memory_get_default (), mask);
+	for (i = 0; i < mask->n_mip; i++)
+		cairo_surface_destroy (mask->mip[i]);
+	mask->n_mip = 0;
+	g_clear_object (&mask->pixbuf);
+}
+
+/* smallest prescaled level that is still at least as wide as the target, so cairo only ever shrinks by < sqrt(2) */
+static cairo_surface_t *
+photo_booth_mask_mip_level (PhotoBoothMask *mask, gint width)
+{
+	guint level = 0;
+	while (level + 1 < mask->n_mip && cairo_image_surface_get_width (mask->mip[level + 1]) >= width)
+		level++;
+	return mask->mip[level];
+}
+
+/* paints the mask in its pose, centred on the origin of cr */
+static void
+photo_booth_mask_paint (PhotoBoothMask *mask, cairo_t *cr, const PhotoBoothMaskPose *pose)
+{
+	cairo_surface_t *level = photo_booth_mask_mip_level (mask, pose->width);
+	gint width = cairo_image_surface_get_width (level);
+	gint height = cairo_image_surface_get_height (level);
+
+	cairo_save (cr);
+	cairo_rotate (cr, pose->angle);
+	cairo_scale (cr, pose->width / width, pose->height / height);
+	cairo_set_source_surface (cr, level, -width / 2.0, -height / 2.0);
+	cairo_pattern_set_filter (cairo_get_source (cr), CAIRO_FILTER_BILINEAR);
+	cairo_paint (cr);
+	cairo_restore (cr);
+}
+
+static void
+photo_booth_mask_draw (PhotoBoothMask *mask, cairo_t *cr, const PhotoBoothMaskPose *pose)
+{
+	if (!mask->n_mip || pose->width < 1 || pose->height < 1)
+		return;
+	cairo_save (cr);
+	cairo_translate (cr, pose->cx, pose->cy);
+	photo_booth_mask_paint (mask, cr, pose);
+	cairo_restore (cr);
+}
+
+/* the mask in its pose on a transparent pixbuf the size of its bounds, for the photo widget and the print */
+static GdkPixbuf *
+photo_booth_mask_render (PhotoBoothMask *mask, const PhotoBoothMaskPose *pose, GdkRectangle *rect)
+{
+	cairo_surface_t *surface;
+	GdkPixbuf *rendered;
+	cairo_t *cr;
+
+	photo_booth_mask_pose_bounds (pose, rect);
+	surface = cairo_image_surface_create (CAIRO_FORMAT_ARGB32, rect->width, rect->height);
+	cr = cairo_create (surface);
+	cairo_translate (cr, pose->cx - rect->x, pose->cy - rect->y);
+	photo_booth_mask_paint (mask, cr, pose);
+	cairo_destroy (cr);
+	rendered = gdk_pixbuf_get_from_surface (surface, 0, 0, rect->width, rect->height);
+	cairo_surface_destroy (surface);
+	return rendered;
+}
+
+/* the icon and the size have been read by photo_booth_mask_spec_load already */
 static PhotoBoothMask *
-photo_booth_mask_new (guint index, GtkFixed *fixed, const gchar *filename, gint offset_x, gint offset_y, gdouble print_scaling_factor)
+photo_booth_mask_new (guint index, GtkFixed *fixed, const gchar *filename, GdkPixbuf *icon, gint width, gint height, gint offset_x, gint offset_y, PhotoBoothMaskAnchor anchor, gdouble print_scaling_factor)
 {
 	PhotoBoothMask *mask = g_object_new (TYPE_PHOTO_BOOTH_MASK, NULL);
-	GError *error = NULL;
 	mask->index = index;
-	mask->filename = filename;
+	mask->filename = g_strdup (filename);
 	mask->active = FALSE;
-	mask->pixbuf = gdk_pixbuf_new_from_file_at_scale (filename, -1, -1, FALSE, &error);
-	if (error) {
-		GST_WARNING_OBJECT (mask, "couldn't load mask file '%s': %s", filename, error->message);
-		g_error_free (error);
-		return NULL;
-	}
-	mask->pixbuf_icon = gdk_pixbuf_new_from_file_at_size (filename, MASK_ICON_SIZE, MASK_ICON_SIZE, &error);
+	mask->pixbuf_icon = g_object_ref (icon);
+	mask->width = width;
+	mask->height = height;
 	mask->fixed = g_object_ref (fixed);
 	mask->offset_x = offset_x;
 	mask->offset_y = offset_y;
+	mask->anchor = anchor;
 	mask->print_scaling_factor = print_scaling_factor;
 	mask->dragstartoffsetx = mask->dragstartoffsety = 0;
 	mask->dragging = FALSE;
@@ -256,8 +582,8 @@ photo_booth_mask_new (guint index, GtkFixed *fixed, const gchar *filename, gint
 	mask->screen_offset_x = GPOINTER_TO_INT (g_object_get_data (G_OBJECT (fixed), "screen-offset-x"));
 	mask->screen_offset_y = GPOINTER_TO_INT (g_object_get_data (G_OBJECT (fixed), "screen-offset-y"));
 
-	GST_DEBUG_OBJECT (mask, "new mask [%i] from filename %s with offsets (%d,%d) and fixed widget %" GST_PTR_FORMAT "@%p", 
-		index, filename, offset_x, offset_y, fixed, mask->pixbuf);
+	GST_DEBUG_OBJECT (mask, "new mask [%i] from filename %s (%dx%d) with offsets (%d,%d) anchor %d and fixed widget %" GST_PTR_FORMAT,
+		index, filename, width, height, offset_x, offset_y, anchor, fixed);
 
 	return mask;
 }
@@ -268,17 +594,43 @@ struct _PhotoBoothMasqueradePrivate
 {
 	guint primary_mask_index;
 	GList *masks;
+	PhotoBoothTracker *tracker;
+	GHashTable *track_masks;
+	GtkWidget *fixed;
+	PhotoboothState state;
+	/* the tracker, the masks' live landmarks and the primary mask are shared between the
+	 * detector's streaming thread, the preview's streaming thread and the main loop */
+	GMutex lock;
+	guint64 live_timestamp;
+	/* decoded masks, most recently used first, and the worker that decodes them */
+	GQueue loaded;
+	guint cache_size;
+	GThreadPool *loader;
+	GCond loaded_cond;
+	gboolean closing;
 };
 
 G_DEFINE_TYPE_WITH_PRIVATE (PhotoBoothMasquerade, photo_booth_masquerade, G_TYPE_OBJECT);
 
+static void photo_booth_masquerade_load_func (gpointer data, gpointer user_data);
+
 static void photo_booth_masquerade_finalize (GObject *object)
 {
 	PhotoBoothMasquerade *masq = PHOTO_BOOTH_MASQUERADE (object);
 	PhotoBoothMasqueradePrivate *priv = photo_booth_masquerade_get_instance_private (masq);
 
+	// the decodes still queued only drop their mask's reference instead of being thrown away with it
+	g_mutex_lock (&priv->lock);
+	priv->closing = TRUE;
+	g_mutex_unlock (&priv->lock);
+	g_thread_pool_free (priv->loader, FALSE, TRUE);
+	g_queue_clear (&priv->loaded);
 	g_list_free_full (priv->masks, g_object_unref);
 	priv->masks = NULL;
+	g_object_unref (priv->tracker);
+	g_hash_table_destroy (priv->track_masks);
+	g_mutex_clear (&priv->lock);
+	g_cond_clear (&priv->loaded_cond);
 	G_OBJECT_CLASS (photo_booth_masquerade_parent_class)->finalize (object);
 }
 
@@ -297,19 +649,306 @@ static void photo_booth_masquerade_init (PhotoBoothMasquerade *masq)
 	PhotoBoothMasqueradePrivate *priv = photo_booth_masquerade_get_instance_private (masq);
 	priv->masks = NULL;
 	priv->primary_mask_index = 0;
+	priv->tracker = photo_booth_tracker_new ();
+	priv->track_masks = g_hash_table_new (g_direct_hash, g_direct_equal);
+	priv->fixed = NULL;
+	priv->state = PB_STATE_NONE;
+	priv->live_timestamp = 0;
+	g_mutex_init (&priv->lock);
+	g_queue_init (&priv->loaded);
+	priv->cache_size = DEFAULT_MASK_CACHE_SIZE;
+	priv->loader = g_thread_pool_new (photo_booth_masquerade_load_func, masq, 1, FALSE, NULL);
+	g_cond_init (&priv->loaded_cond);
+	priv->closing = FALSE;
 }
 
-void photo_booth_masquerade_init_masks (PhotoBoothMasquerade *masq, GtkFixed *fixed, const gchar *dir, gchar *list_json, gdouble print_scaling_factor)
+static gboolean _pbm_is_mask (G_GNUC_UNUSED gpointer key, gpointer value, gpointer mask)
 {
-	JsonParser *parser;
-	JsonNode *root;
-	JsonReader *reader;
+	return value == mask;
+}
+
+/* call with the lock held */
+static gboolean photo_booth_masquerade_mask_in_use (PhotoBoothMasquerade *masq, PhotoBoothMask *mask)
+{
+	PhotoBoothMasqueradePrivate *priv = photo_booth_masquerade_get_instance_private (masq);
+	return mask->active || g_hash_table_find (priv->track_masks, _pbm_is_mask, mask) != NULL;
+}
+
+/* call with the lock held. drops the least recently used decoded masks beyond the cache size,
+ * as long as they aren't on a face or on the photo right now */
+static void photo_booth_masquerade_evict (PhotoBoothMasquerade *masq)
+{
+	PhotoBoothMasqueradePrivate *priv = photo_booth_masquerade_get_instance_private (masq);
+	GList *link = priv->loaded.tail;
+
+	while (link && g_queue_get_length (&priv->loaded) > priv->cache_size)
+	{
+		GList *prev = link->prev;
+		PhotoBoothMask *mask = link->data;
+		if (!photo_booth_masquerade_mask_in_use (masq, mask))
+		{
+			GST_DEBUG_OBJECT (masq, "evicting mask [%d] from the cache", mask->index);
+			photo_booth_mask_unload (mask);
+			g_queue_delete_link (&priv->loaded, link);
+		}
+		link = prev;
+	}
+}
+
+static void photo_booth_masquerade_load_func (gpointer data, gpointer user_data)
+{
+	PhotoBoothMask *mask = PHOTO_BOOTH_MASK (data);
+	PhotoBoothMasquerade *masq = PHOTO_BOOTH_MASQUERADE (user_data);
+	PhotoBoothMasqueradePrivate *priv = photo_booth_masquerade_get_instance_private (masq);
+	cairo_surface_t *mip[MASK_MIP_LEVELS];
+	gint64 start = g_get_monotonic_time ();
 	GError *error = NULL;
-	gint i, n_masks, index = 0;
+	GdkPixbuf *pixbuf;
+	guint i, n_mip = 0;
+	gsize bytes = 0;
+	gboolean closing;
+
+	g_mutex_lock (&priv->lock);
+	closing = priv->closing;
+	g_mutex_unlock (&priv->lock);
+	if (closing)
+	{
+		g_object_unref (mask);
+		return;
+	}
+
+	pixbuf = gdk_pixbuf_new_from_file (mask->filename, &error);
+	if (pixbuf)
+	{
+		n_mip = photo_booth_mask_build_mip (pixbuf, mip);
+		bytes = gdk_pixbuf_get_byte_length (pixbuf);
+		for (i = 0; i < n_mip; i++)
+			bytes += (gsize) cairo_image_surface_get_stride (mip[i]) * cairo_image_surface_get_height (mip[i]);
+	}
+
+	g_mutex_lock (&priv->lock);
+	mask->loading = FALSE;
+	if (pixbuf)
+	{
+		GST_DEBUG_OBJECT (masq, "decoded mask [%d] '%s' with %u mip levels in %" G_GINT64_FORMAT " us", mask->index, mask->filename, n_mip, g_get_monotonic_time () - start);
+		mask->pixbuf = pixbuf;
+		memcpy (mask->mip, mip, n_mip * sizeof (cairo_surface_t *));
+		mask->n_mip = n_mip;
+		photo_booth_memory_track (photo_booth_memory_get_default (), MEMORY_MASQUERADE, mask, bytes);
+		mask->width = gdk_pixbuf_get_width (pixbuf);
+		mask->height = gdk_pixbuf_get_height (pixbuf);
+		g_queue_push_head (&priv->loaded, mask);
+		photo_booth_masquerade_evict (masq);
+	}
+	else
+	{
+		GST_WARNING_OBJECT (masq, "couldn't load mask file '%s': %s", mask->filename, error->message);
+		g_error_free (error);
+		mask->failed = TRUE;
+	}
+	g_cond_broadcast (&priv->loaded_cond);
+	g_mutex_unlock (&priv->lock);
+	g_object_unref (mask);
+}
+
+/* call with the lock held. marks the mask as the most recently used one and has it decoded in the
+ * background if it isn't yet, until then it is simply not drawn */
+static void photo_booth_masquerade_use_mask (PhotoBoothMasquerade *masq, PhotoBoothMask *mask)
+{
+	PhotoBoothMasqueradePrivate *priv = photo_booth_masquerade_get_instance_private (masq);
+	GList *link;
+
+	if (mask->pixbuf)
+	{
+		link = g_queue_find (&priv->loaded, mask);
+		if (link && link != priv->loaded.head)
+		{
+			g_queue_unlink (&priv->loaded, link);
+			g_queue_push_head_link (&priv->loaded, link);
+		}
+		return;
+	}
+	if (mask->loading || mask->failed)
+		return;
+	mask->loading = TRUE;
+	g_thread_pool_push (priv->loader, g_object_ref (mask), NULL);
+}
+
+/* call with the lock held. the captured photo can't do without its masks, so this waits for them */
+static gboolean photo_booth_masquerade_load_mask (PhotoBoothMasquerade *masq, PhotoBoothMask *mask)
+{
 	PhotoBoothMasqueradePrivate *priv = photo_booth_masquerade_get_instance_private (masq);
+	photo_booth_masquerade_use_mask (masq, mask);
+	while (mask->loading)
+		g_cond_wait (&priv->loaded_cond, &priv->lock);
+	return mask->pixbuf != NULL;
+}
+
+void photo_booth_masquerade_set_cache_size (PhotoBoothMasquerade *masq, guint cache_size)
+{
+	PhotoBoothMasqueradePrivate *priv = photo_booth_masquerade_get_instance_private (masq);
+	g_mutex_lock (&priv->lock);
+	priv->cache_size = MAX (cache_size, 1);
+	photo_booth_masquerade_evict (masq);
+	g_mutex_unlock (&priv->lock);
+}
+
+/* a mask as listed in the manifest or the [masks] list, until its icon is decoded and it can be added */
+typedef struct
+{
+	gchar *path, *icon_path, *title;
+	gint width, height, offset_x, offset_y;
+	PhotoBoothMaskAnchor anchor;
+	GdkPixbuf *icon;
+} PhotoBoothMaskSpec;
+
+typedef struct
+{
+	PhotoBoothMasquerade *masq;
+	GtkFixed *fixed;
+	gchar *dir, *list_json;
+	gdouble print_scaling_factor;
+	GPtrArray *specs;
+} PhotoBoothMaskLoad;
+
+static void photo_booth_mask_spec_free (PhotoBoothMaskSpec *spec)
+{
+	g_free (spec->path);
+	g_free (spec->icon_path);
+	g_free (spec->title);
+	g_clear_object (&spec->icon);
+	g_free (spec);
+}
 
-	if (!list_json)
+static void photo_booth_mask_spec_add (GPtrArray *specs, const gchar *path, const gchar *icon_path, gint width, gint height, gint offset_x, gint offset_y, PhotoBoothMaskAnchor anchor, const gchar *title)
+{
+	PhotoBoothMaskSpec *spec = g_new0 (PhotoBoothMaskSpec, 1);
+	spec->path = g_strdup (path);
+	spec->icon_path = g_strdup (icon_path);
+	spec->title = g_strdup (title);
+	spec->width = width;
+	spec->height = height;
+	spec->offset_x = offset_x;
+	spec->offset_y = offset_y;
+	spec->anchor = anchor;
+	g_ptr_array_add (specs, spec);
+}
+
+/* in one of the loader threads. the size comes from the pack's manifest or else from the file's header */
+static void photo_booth_mask_spec_load (PhotoBoothMaskSpec *spec, G_GNUC_UNUSED gpointer user_data)
+{
+	GError *error = NULL;
+	if (spec->icon_path)
+		spec->icon = gdk_pixbuf_new_from_file (spec->icon_path, &error);
+	else
+		spec->icon = gdk_pixbuf_new_from_file_at_size (spec->path, MASK_ICON_SIZE, MASK_ICON_SIZE, &error);
+	if (error) {
+		GST_WARNING ("couldn't load icon for mask file '%s': %s", spec->path, error->message);
+		g_error_free (error);
 		return;
+	}
+	if ((spec->width <= 0 || spec->height <= 0) && !gdk_pixbuf_get_file_info (spec->path, &spec->width, &spec->height)) {
+		GST_WARNING ("couldn't read size of mask file '%s'", spec->path);
+		g_clear_object (&spec->icon);
+	}
+}
+
+static void photo_booth_masquerade_add_mask (PhotoBoothMasquerade *masq, GtkFixed *fixed, PhotoBoothMaskSpec *spec, gdouble print_scaling_factor)
+{
+	PhotoBoothMasqueradePrivate *priv = photo_booth_masquerade_get_instance_private (masq);
+	PhotoBoothMask *mask;
+	GtkTreeIter iter;
+	guint index;
+
+	// the live view and the face detection are running already
+	g_mutex_lock (&priv->lock);
+	index = g_list_length (priv->masks);
+	mask = photo_booth_mask_new (index, fixed, spec->path, spec->icon, spec->width, spec->height, spec->offset_x, spec->offset_y, spec->anchor, print_scaling_factor);
+	priv->masks = g_list_append (priv->masks, mask);
+	g_mutex_unlock (&priv->lock);
+	gtk_list_store_append (masq->store, &iter);
+	gtk_list_store_set (masq->store, &iter, COL_INDEX, index, COL_TEXT, spec->title, COL_ICON, mask->pixbuf_icon, -1);
+}
+
+static const gchar *_pbm_manifest_string (JsonReader *reader, const gchar *member)
+{
+	const gchar *value = NULL;
+	if (json_reader_read_member (reader, member))
+		value = json_reader_get_string_value (reader);
+	json_reader_end_member (reader);
+	return value;
+}
+
+static gint _pbm_manifest_int (JsonReader *reader, const gchar *member)
+{
+	gint value = 0;
+	if (json_reader_read_member (reader, member))
+		value = json_reader_get_int_value (reader);
+	json_reader_end_member (reader);
+	return value;
+}
+
+/* a compiled mask pack: pre-made icons and the mask sizes, nothing has to be decoded at startup */
+static gboolean photo_booth_masquerade_read_manifest (PhotoBoothMasquerade *masq, const gchar *dir, const gchar *manifest, GPtrArray *specs)
+{
+	JsonParser *parser = json_parser_new ();
+	JsonReader *reader = NULL;
+	GError *error = NULL;
+	gint i, n_masks, version;
+
+	if (!json_parser_load_from_file (parser, manifest, &error))
+	{
+		GST_WARNING_OBJECT (masq, "couldn't parse mask pack manifest '%s': %s", manifest, error->message);
+		g_error_free (error);
+		g_object_unref (parser);
+		return FALSE;
+	}
+	reader = json_reader_new (json_parser_get_root (parser));
+	version = _pbm_manifest_int (reader, "version");
+	if (version != MASK_PACK_VERSION)
+		GST_WARNING_OBJECT (masq, "mask pack manifest '%s' has version %d, expected %d", manifest, version, MASK_PACK_VERSION);
+
+	json_reader_read_member (reader, "masks");
+	n_masks = json_reader_is_array (reader) ? json_reader_count_elements (reader) : 0;
+	GST_DEBUG ("found %i masks in pack manifest %s", n_masks, manifest);
+
+	for (i = 0; i < n_masks; i++)
+	{
+		const gchar *file, *icon;
+		gchar *path, *icon_path = NULL;
+
+		json_reader_read_element (reader, i);
+		file = _pbm_manifest_string (reader, "file");
+		icon = _pbm_manifest_string (reader, "icon");
+		if (file)
+		{
+			path = g_build_filename (dir, file, NULL);
+			if (icon)
+				icon_path = g_build_filename (dir, icon, NULL);
+			photo_booth_mask_spec_add (specs, path, icon_path,
+				_pbm_manifest_int (reader, "width"), _pbm_manifest_int (reader, "height"),
+				_pbm_manifest_int (reader, "offset_x"), _pbm_manifest_int (reader, "offset_y"),
+				photo_booth_mask_anchor_from_string (_pbm_manifest_string (reader, "anchor")),
+				_pbm_manifest_string (reader, "title"));
+			g_free (path);
+			g_free (icon_path);
+		}
+		json_reader_end_element (reader);
+	}
+	json_reader_end_member (reader);
+
+	g_object_unref (reader);
+	g_object_unref (parser);
+	return TRUE;
+}
+
+/* the [masks] list: [["filename", x-offset, y-offset, "title", "anchor"]...] */
+static void photo_booth_masquerade_read_list (PhotoBoothMasquerade *masq, const gchar *dir, const gchar *list_json, GPtrArray *specs)
+{
+	JsonParser *parser;
+	JsonReader *reader = NULL;
+	GError *error = NULL;
+	gint i, n_masks;
 
 	parser = json_parser_new ();
 
@@ -317,8 +956,7 @@ void photo_booth_masquerade_init_masks (PhotoBoothMasquerade *masq, GtkFixed *fi
 	if (error)
 		goto fail;
 
-	root = json_parser_get_root (parser);
-	reader = json_reader_new (root);
+	reader = json_reader_new (json_parser_get_root (parser));
 
 	if (!json_reader_is_array(reader))
 		goto fail;
@@ -327,17 +965,12 @@ void photo_booth_masquerade_init_masks (PhotoBoothMasquerade *masq, GtkFixed *fi
 
 	GST_DEBUG ("found %i masks in list", n_masks);
 
-	masq->store = gtk_list_store_new (NUM_COLS, G_TYPE_INT, G_TYPE_STRING, GDK_TYPE_PIXBUF);
-	GtkTreeIter iter;
-	gtk_list_store_append (masq->store, &iter);
-	gtk_list_store_set (masq->store, &iter, COL_INDEX, -1, COL_TEXT, _("No mask"), COL_ICON, NULL, -1);
-
 	for (i = 0; i < n_masks; i++)
 	{
 		const gchar *filename, *title;
 		gchar *maskpath;
 		gint offset_x, offset_y;
-		PhotoBoothMask *mask;
+		PhotoBoothMaskAnchor anchor = MASK_ANCHOR_FACE;
 
 		if (!json_reader_read_element (reader, i))
 			goto fail;
@@ -357,14 +990,14 @@ void photo_booth_masquerade_init_masks (PhotoBoothMasquerade *masq, GtkFixed *fi
 			goto fail;
 		title = json_reader_get_string_value (reader);
 		json_reader_end_element (reader);
-		maskpath = g_strconcat (dir, filename, NULL);
-		mask = photo_booth_mask_new (index, fixed, maskpath, offset_x, offset_y, print_scaling_factor);
-		if (mask) {
-			priv->masks = g_list_append (priv->masks, mask);
-			gtk_list_store_append (masq->store, &iter);
-			gtk_list_store_set (masq->store, &iter, COL_INDEX, index, COL_TEXT, title, COL_ICON, mask->pixbuf_icon, -1);
-			index++;
+		if (json_reader_count_elements (reader) > 4)
+		{
+			json_reader_read_element (reader, 4);
+			anchor = photo_booth_mask_anchor_from_string (json_reader_get_string_value (reader));
+			json_reader_end_element (reader);
 		}
+		maskpath = g_strconcat (dir ? dir : "", filename, NULL);
+		photo_booth_mask_spec_add (specs, maskpath, NULL, 0, 0, offset_x, offset_y, anchor, title);
 		json_reader_end_element (reader);
 		g_free (maskpath);
 	}
@@ -373,16 +1006,90 @@ void photo_booth_masquerade_init_masks (PhotoBoothMasquerade *masq, GtkFixed *fi
 	return;
 
 fail:
-	GST_WARNING_OBJECT (masq, "couldn't parse masks list JSON '%s': %s", list_json, error->message);
-	g_error_free (error);
-	g_object_unref (reader);
+	if (!error && reader && json_reader_get_error (reader))
+		error = g_error_copy (json_reader_get_error (reader));
+	GST_WARNING_OBJECT (masq, "couldn't parse masks list JSON '%s': %s", list_json, error ? error->message : "not a list");
+	g_clear_error (&error);
+	g_clear_object (&reader);
 	g_object_unref (parser);
 }
 
+static void photo_booth_mask_load_free (PhotoBoothMaskLoad *load)
+{
+	g_ptr_array_free (load->specs, TRUE);
+	g_free (load->dir);
+	g_free (load->list_json);
+	g_object_unref (load->fixed);
+	g_object_unref (load->masq);
+	g_free (load);
+}
+
+/* in a startup thread: reads the pack or the list and decodes the icons, on all cores */
+static gpointer photo_booth_masquerade_prepare_masks (PhotoBoothMaskLoad *load)
+{
+	gchar *manifest = load->dir ? g_build_filename (load->dir, MASK_PACK_MANIFEST, NULL) : NULL;
+	GThreadPool *pool;
+	guint i;
+
+	// a compiled pack takes precedence over the list
+	if (!(manifest && g_file_test (manifest, G_FILE_TEST_IS_REGULAR) && photo_booth_masquerade_read_manifest (load->masq, load->dir, manifest, load->specs)) && load->list_json)
+		photo_booth_masquerade_read_list (load->masq, load->dir, load->list_json, load->specs);
+	g_free (manifest);
+
+	pool = g_thread_pool_new ((GFunc) photo_booth_mask_spec_load, NULL, MAX (g_get_num_processors (), 1), FALSE, NULL);
+	for (i = 0; i < load->specs->len; i++)
+		g_thread_pool_push (pool, g_ptr_array_index (load->specs, i), NULL);
+	g_thread_pool_free (pool, FALSE, TRUE);
+	return load;
+}
+
+/* back in the main loop, the masks are put into the combo box in their listed order */
+static void photo_booth_masquerade_masks_prepared (PhotoBoothMaskLoad *load, G_GNUC_UNUSED gpointer user_data)
+{
+	guint i;
+	for (i = 0; i < load->specs->len; i++)
+	{
+		PhotoBoothMaskSpec *spec = g_ptr_array_index (load->specs, i);
+		if (spec->icon)
+			photo_booth_masquerade_add_mask (load->masq, load->fixed, spec, load->print_scaling_factor);
+	}
+	GST_DEBUG_OBJECT (load->masq, "added %u masks", load->specs->len);
+	photo_booth_mask_load_free (load);
+}
+
+/* the store is there right away with just "No mask", the masks are added as soon as their icons are decoded */
+void photo_booth_masquerade_init_masks (PhotoBoothMasquerade *masq, GtkFixed *fixed, const gchar *dir, gchar *list_json, gdouble print_scaling_factor)
+{
+	PhotoBoothMasqueradePrivate *priv = photo_booth_masquerade_get_instance_private (masq);
+	PhotoBoothMaskLoad *load;
+	GtkTreeIter iter;
+
+	priv->fixed = GTK_WIDGET (fixed);
+
+	masq->store = gtk_list_store_new (NUM_COLS, G_TYPE_INT, G_TYPE_STRING, GDK_TYPE_PIXBUF);
+	gtk_list_store_append (masq->store, &iter);
+	gtk_list_store_set (masq->store, &iter, COL_INDEX, -1, COL_TEXT, _("No mask"), COL_ICON, NULL, -1);
+
+	load = g_new0 (PhotoBoothMaskLoad, 1);
+	load->masq = g_object_ref (masq);
+	load->fixed = g_object_ref (fixed);
+	load->dir = g_strdup (dir);
+	load->list_json = g_strdup (list_json);
+	load->print_scaling_factor = print_scaling_factor;
+	load->specs = g_ptr_array_new_with_free_func ((GDestroyNotify) photo_booth_mask_spec_free);
+	photo_booth_startup_run (photo_booth_startup_get_default (), "masks", (GThreadFunc) photo_booth_masquerade_prepare_masks,
+		(PhotoBoothStartupDoneFunc) photo_booth_masquerade_masks_prepared, (GDestroyNotify) photo_booth_mask_load_free, load);
+}
+
 void photo_booth_masquerade_set_primary_mask (PhotoBoothMasquerade *masq, guint index)
 {
 	PhotoBoothMasqueradePrivate *priv = photo_booth_masquerade_get_instance_private (masq);
+	g_mutex_lock (&priv->lock);
 	priv->primary_mask_index = index;
+	// chances are the next face gets this one, have it ready by then
+	if (index < g_list_length (priv->masks))
+		photo_booth_masquerade_use_mask (masq, g_list_nth_data (priv->masks, index));
+	g_mutex_unlock (&priv->lock);
 	GST_DEBUG ("setting primary mask index %i", priv->primary_mask_index);
 	photo_booth_masquerade_facedetect_update (masq, NULL);
 }
@@ -398,6 +1105,147 @@ static gint _pbm_sort_faces_by_xpos (gconstpointer f1, gconstpointer f2, G_GNUC_
 	return ( x1>x2 ? +1 : -1);
 }
 
+static gboolean photo_booth_masquerade_track_alive (PhotoBoothTracker *tracker, guint id)
+{
+	guint i;
+	for (i = 0; i < tracker->tracks->len; i++)
+		if (g_array_index (tracker->tracks, PhotoBoothTrack, i).id == id)
+			return TRUE;
+	return FALSE;
+}
+
+/* every face track keeps the mask it got first, until the track is lost. the mask's landmarks
+ * follow the detections that corrected its track, smoothed. call with the lock held */
+static void photo_booth_masquerade_assign_tracks (PhotoBoothMasquerade *masq, gint64 timestamp, const PhotoBoothFaceLandmarks *landmarks, guint n_landmarks)
+{
+	PhotoBoothMasqueradePrivate *priv = photo_booth_masquerade_get_instance_private (masq);
+	GHashTable *used = g_hash_table_new (g_direct_hash, g_direct_equal);
+	GHashTableIter iter;
+	gpointer key, value;
+	guint i, n_masks = g_list_length (priv->masks);
+
+	photo_booth_tracker_expire (priv->tracker, timestamp);
+	g_hash_table_iter_init (&iter, priv->track_masks);
+	while (g_hash_table_iter_next (&iter, &key, &value))
+	{
+		if (photo_booth_masquerade_track_alive (priv->tracker, GPOINTER_TO_UINT (key)))
+			g_hash_table_add (used, value);
+		else
+			g_hash_table_iter_remove (&iter);
+	}
+
+	for (i = 0; i < priv->tracker->tracks->len; i++)
+	{
+		PhotoBoothTrack *track = &g_array_index (priv->tracker->tracks, PhotoBoothTrack, i);
+		PhotoBoothMask *mask = g_hash_table_lookup (priv->track_masks, GUINT_TO_POINTER (track->id));
+		gboolean measured = track->matched >= 0 && (guint) track->matched < n_landmarks;
+		if (!mask)
+		{
+			guint k, mask_index = priv->primary_mask_index;
+			for (k = 0; k < n_masks && !mask; k++, mask_index++)
+			{
+				PhotoBoothMask *candidate = g_list_nth_data (priv->masks, mask_index % n_masks);
+				if (!g_hash_table_contains (used, candidate))
+					mask = candidate;
+			}
+			if (!mask)
+				continue;
+			GST_DEBUG_OBJECT (masq, "face track %u gets mask [%d]", track->id, mask->index);
+			g_hash_table_insert (priv->track_masks, GUINT_TO_POINTER (track->id), mask);
+			g_hash_table_add (used, mask);
+			if (measured)
+				mask->landmarks = landmarks[track->matched];
+			else
+				photo_booth_face_landmarks_init (&mask->landmarks);
+		}
+		else if (measured)
+			photo_booth_face_landmarks_smooth (&mask->landmarks, &landmarks[track->matched]);
+		photo_booth_masquerade_use_mask (masq, mask);
+	}
+	g_hash_table_destroy (used);
+}
+
+static void photo_booth_masquerade_stop_tracking (PhotoBoothMasquerade *masq)
+{
+	PhotoBoothMasqueradePrivate *priv = photo_booth_masquerade_get_instance_private (masq);
+	g_mutex_lock (&priv->lock);
+	photo_booth_tracker_reset (priv->tracker);
+	g_hash_table_remove_all (priv->track_masks);
+	g_mutex_unlock (&priv->lock);
+}
+
+/* live view, in the detector's streaming thread: detections only correct the tracks. the tracks are
+ * timed by the detected frame's timestamp so that the preview can predict them for any later frame */
+static void photo_booth_masquerade_track_faces (PhotoBoothMasquerade *masq, const GValue *faces, guint n_faces, GstStructure *structure, PhotoboothState state)
+{
+	PhotoBoothMasqueradePrivate *priv = photo_booth_masquerade_get_instance_private (masq);
+	PhotoBoothBox *boxes = g_new0 (PhotoBoothBox, n_faces + 1);
+	PhotoBoothFaceLandmarks *landmarks = g_new0 (PhotoBoothFaceLandmarks, n_faces + 1);
+	gdouble detect_scale = 1.0;
+	guint64 timestamp = GST_CLOCK_TIME_NONE;
+	gint64 frame_time;
+	guint i;
+
+	gst_structure_get_double (structure, "detect-scale", &detect_scale);
+	gst_structure_get_uint64 (structure, "timestamp", &timestamp);
+	for (i = 0; i < n_faces; i++)
+	{
+		const GstStructure *face_struct = gst_value_get_structure (gst_value_list_get_value (faces, i));
+		guint x = 0, y = 0, width = 0, height = 0;
+		gst_structure_get_uint (face_struct, "x", &x);
+		gst_structure_get_uint (face_struct, "y", &y);
+		gst_structure_get_uint (face_struct, "width", &width);
+		gst_structure_get_uint (face_struct, "height", &height);
+		boxes[i].x = x * detect_scale;
+		boxes[i].y = y * detect_scale;
+		boxes[i].width = width * detect_scale;
+		boxes[i].height = height * detect_scale;
+		photo_booth_face_landmarks_parse (face_struct, &landmarks[i]);
+	}
+
+	g_mutex_lock (&priv->lock);
+	// without a timestamp the detection is taken to belong to the last frame that was drawn
+	frame_time = GST_TIME_AS_USECONDS (GST_CLOCK_TIME_IS_VALID (timestamp) ? timestamp : priv->live_timestamp);
+	photo_booth_tracker_update (priv->tracker, boxes, n_faces, frame_time);
+	priv->state = state;
+	photo_booth_masquerade_assign_tracks (masq, frame_time, landmarks, n_faces);
+	g_mutex_unlock (&priv->lock);
+
+	g_free (boxes);
+	g_free (landmarks);
+}
+
+/* called from the preview's streaming thread for every frame, draws each tracked face's mask
+ * where the tracker expects the face in this very frame */
+void photo_booth_masquerade_draw_live (PhotoBoothMasquerade *masq, cairo_t *cr, guint64 timestamp)
+{
+	PhotoBoothMasqueradePrivate *priv;
+	gint64 frame_time;
+	guint i;
+
+	if (!IS_PHOTO_BOOTH_MASQUERADE (masq) || !GST_CLOCK_TIME_IS_VALID (timestamp))
+		return;
+	priv = photo_booth_masquerade_get_instance_private (masq);
+	frame_time = GST_TIME_AS_USECONDS (timestamp);
+
+	g_mutex_lock (&priv->lock);
+	priv->live_timestamp = timestamp;
+	photo_booth_tracker_expire (priv->tracker, frame_time);
+	for (i = 0; i < priv->tracker->tracks->len; i++)
+	{
+		PhotoBoothTrack *track = &g_array_index (priv->tracker->tracks, PhotoBoothTrack, i);
+		PhotoBoothMask *mask = g_hash_table_lookup (priv->track_masks, GUINT_TO_POINTER (track->id));
+		PhotoBoothMaskPose pose;
+		PhotoBoothBox box;
+		if (!mask || !mask->pixbuf)
+			continue;
+		photo_booth_tracker_predict (track, frame_time, &box);
+		photo_booth_mask_pose (mask, &box, &mask->landmarks, &pose);
+		photo_booth_mask_draw (mask, cr, &pose);
+	}
+	g_mutex_unlock (&priv->lock);
+}
+
 void photo_booth_masquerade_facedetect_update (PhotoBoothMasquerade *masq, GstStructure *structure)
 {
 	if (!IS_PHOTO_BOOTH_MASQUERADE (masq))
@@ -407,15 +1255,16 @@ void photo_booth_masquerade_facedetect_update (PhotoBoothMasquerade *masq, GstSt
 	GList *sorted_faces = NULL;
 	const GValue *faces = NULL;
 	int state = 0;
+	gboolean is_video = FALSE;
 	PhotoBoothMasqueradePrivate *priv = photo_booth_masquerade_get_instance_private (masq);
 
 	if (structure) {
 		faces = gst_structure_get_value (structure, "faces");
 		gst_structure_get_int (structure, "state", &state);
+		gst_structure_get_boolean (structure, "is-video", &is_video);
 	} else {
 		GST_LOG ("GstStructure missing for face detection, hide all");
 	}
-	n_masks = g_list_length (priv->masks);
 
 	if ((PhotoboothState) state > PB_STATE_TAKING_PHOTO)
 	{
@@ -427,10 +1276,17 @@ void photo_booth_masquerade_facedetect_update (PhotoBoothMasquerade *masq, GstSt
 	{
 		gchar *contents = g_strdup_value_contents (faces);
 		n_faces = gst_value_list_get_size (faces);
-		GST_LOG ("Detected objects: %s faces=%i masks=%i", *(&contents), n_faces, n_masks);
+		GST_LOG ("Detected objects: %s faces=%i", *(&contents), n_faces);
 		g_free (contents);
 	}
 
+	if (is_video)
+	{
+		photo_booth_masquerade_track_faces (masq, faces, n_faces, structure, (PhotoboothState) state);
+		return;
+	}
+	photo_booth_masquerade_stop_tracking (masq);
+
 	for (guint i = 0; i < n_faces; i++)
 	{
 		const GValue *face = gst_value_list_get_value (faces, i);
@@ -442,6 +1298,9 @@ void photo_booth_masquerade_facedetect_update (PhotoBoothMasquerade *masq, GstSt
 		sorted_faces = g_list_reverse (sorted_faces);
 	}
 
+	// masks are added from the main loop while this runs on the streaming thread
+	g_mutex_lock (&priv->lock);
+	n_masks = g_list_length (priv->masks);
 	mask_index = priv->primary_mask_index;
 	for (i = 0; i < n_masks; i++)
 	{
@@ -449,7 +1308,7 @@ void photo_booth_masquerade_facedetect_update (PhotoBoothMasquerade *masq, GstSt
 		if (mask_index >= n_masks)
 			mask_index = 0;
 		mask = (g_list_nth (priv->masks, mask_index))->data;
-		if (mask && i < n_faces)
+		if (mask && i < n_faces && photo_booth_masquerade_load_mask (masq, mask))
 		{
 			const GValue *face = g_list_nth_data (sorted_faces, i);
 			photo_booth_mask_show (mask, face, structure);
@@ -458,53 +1317,31 @@ void photo_booth_masquerade_facedetect_update (PhotoBoothMasquerade *masq, GstSt
 		}
 		mask_index++;
 	}
+	g_mutex_unlock (&priv->lock);
+	g_list_free (sorted_faces);
 }
 
 void
-photo_booth_masquerade_create_overlays (PhotoBoothMasquerade *masq, GstElement *mask_bin)
+photo_booth_masquerade_create_overlays (PhotoBoothMasquerade *masq, GstElement *compositor)
 {
 	GList *m;
 	PhotoBoothMasqueradePrivate *priv = photo_booth_masquerade_get_instance_private (masq);
-	GST_DEBUG_OBJECT (mask_bin, "photo_booth_masquerade_create_overlays");
+	GST_DEBUG_OBJECT (compositor, "photo_booth_masquerade_create_overlays");
+	photo_booth_compositor_clear_masks (PHOTO_BOOTH_COMPOSITOR (compositor));
+	g_mutex_lock (&priv->lock);
 	for (m = priv->masks; m != NULL; m = m->next) {
 		if (PHOTO_BOOTH_MASK (m->data)->active) {
-			photo_booth_mask_create_overlay (m->data, mask_bin);
+			photo_booth_mask_create_overlay (m->data, PHOTO_BOOTH_COMPOSITOR (compositor));
 		}
 	}
+	g_mutex_unlock (&priv->lock);
 }
 
 void
-photo_booth_masquerade_clear_mask_bin (G_GNUC_UNUSED PhotoBoothMasquerade *masq, GstElement *mask_bin)
-{
-	GstIterator *iter = NULL;
-	GValue value = { 0 };
-	GstElement *elem = NULL;
-	gboolean done = FALSE;
-	GST_DEBUG_OBJECT (mask_bin, "clearing mask bin!");
-
-	iter = gst_bin_iterate_elements (GST_BIN (mask_bin));
-	while (!done) {
-		switch (gst_iterator_next (iter, &value)) {
-			case GST_ITERATOR_OK:
-				elem = (GstElement *) g_value_get_object (&value);
-				g_object_set (elem, "pixbuf", NULL, NULL);
-				GST_LOG_OBJECT (elem, "unsetting pixbuf property");
-				/* Iterator increased the element refcount, so unref */
-				g_value_unset (&value);
-				break;
-			case GST_ITERATOR_RESYNC:
-				gst_iterator_resync (iter);
-				break;
-			case GST_ITERATOR_ERROR:
-				GST_WARNING_OBJECT (mask_bin, "error in iterating elements");
-				done = TRUE;
-				break;
-			case GST_ITERATOR_DONE:
-				done = TRUE;
-				break;
-		}
-	}
-	gst_iterator_free (iter);
+photo_booth_masquerade_clear_overlays (G_GNUC_UNUSED PhotoBoothMasquerade *masq, GstElement *compositor)
+{
+	GST_DEBUG_OBJECT (compositor, "clearing mask overlays!");
+	photo_booth_compositor_clear_masks (PHOTO_BOOTH_COMPOSITOR (compositor));
 }
 
 gboolean photo_booth_masquerade_press (GtkWidget *widget, GdkEventButton *event, gpointer user_data)
@@ -45,9 +45,11 @@ GType                 photo_booth_masquerade_get_type          (void);
 PhotoBoothMasquerade *photo_booth_masquerade_new               (void);
 void                  photo_booth_masquerade_init_masks        (PhotoBoothMasquerade *masq, GtkFixed *fixed, const gchar *dir, gchar *list_json, gdouble print_scaling_factor);
 void                  photo_booth_masquerade_facedetect_update (PhotoBoothMasquerade *masq, GstStructure *structure);
-void                  photo_booth_masquerade_create_overlays   (PhotoBoothMasquerade *masq, GstElement *mask_bin);
-void                  photo_booth_masquerade_clear_mask_bin    (PhotoBoothMasquerade *masq, GstElement *mask_bin);
+void                  photo_booth_masquerade_draw_live         (PhotoBoothMasquerade *masq, cairo_t *cr, guint64 timestamp);
+void                  photo_booth_masquerade_create_overlays   (PhotoBoothMasquerade *masq, GstElement *compositor);
+void                  photo_booth_masquerade_clear_overlays    (PhotoBoothMasquerade *masq, GstElement *compositor);
 void                  photo_booth_masquerade_set_primary_mask  (PhotoBoothMasquerade *masq, guint index);
+void                  photo_booth_masquerade_set_cache_size    (PhotoBoothMasquerade *masq, guint cache_size);
 
 enum {COL_INDEX, COL_TEXT, COL_ICON, NUM_COLS};
 #define MASK_ICON_SIZE 64
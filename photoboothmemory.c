@@ -0,0 +1,324 @@
+/*
+ * GStreamer photoboothmemory.c
+ * Copyright 2019 Andreas Frisch <fraxinas@schaffenburg.org>
+ *
+ * This program is licensed under the Creative Commons
+ * Attribution-NonCommercial-ShareAlike 3.0 Unported
+ * License. To view a copy of this license, visit
+ * http://creativecommons.org/licenses/by-nc-sa/3.0/ or send a letter to
+ * Creative Commons,559 Nathan Abbott Way,Stanford,California 94305,USA.
+ *
+ * This program is NOT free software. It is open source, you are allowed
+ * to modify it (if you keep the license), but it may not be commercially
+ * distributed other than under the conditions noted above.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#ifdef HAVE_MALLINFO2
+#include <malloc.h>
+#endif
+#include <json-glib/json-glib.h>
+#include "photobooth.h"
+#include "photoboothmetrics.h"
+#include "photoboothtrace.h"
+#include "photoboothmemory.h"
+
+static const gchar *subsystem_names[MEMORY_SUBSYSTEMS] = {
+	"capture", "photo_bin", "print", "upload", "masquerade"
+};
+
+typedef struct
+{
+	PhotoBoothMemorySubsystem subsystem;
+	gsize bytes;
+	gboolean weak;
+} PhotoBoothMemoryEntry;
+
+G_DEFINE_TYPE (PhotoBoothMemory, photo_booth_memory, G_TYPE_OBJECT);
+
+GST_DEBUG_CATEGORY_STATIC (photo_booth_memory_debug);
+#define GST_CAT_DEFAULT photo_booth_memory_debug
+
+static void photo_booth_memory_finalize (GObject *object);
+
+static void photo_booth_memory_class_init (PhotoBoothMemoryClass *klass)
+{
+	GObjectClass *gobject_class = G_OBJECT_CLASS (klass);
+
+	GST_DEBUG_CATEGORY_INIT (photo_booth_memory_debug, "photoboothmemory", GST_DEBUG_BOLD | GST_DEBUG_FG_BLACK | GST_DEBUG_BG_GREEN, "PhotoBoothMemory");
+
+	gobject_class->finalize = photo_booth_memory_finalize;
+}
+
+static void photo_booth_memory_init (PhotoBoothMemory *memory)
+{
+	guint i;
+	g_mutex_init (&memory->lock);
+	memory->tracked = g_hash_table_new_full (g_direct_hash, g_direct_equal, NULL, g_free);
+	for (i = 0; i < MEMORY_SUBSYSTEMS; i++)
+	{
+		memory->bytes[i] = memory->peak_bytes[i] = 0;
+		memory->objects[i] = 0;
+		memory->allocations[i] = 0;
+	}
+	memory->location = NULL;
+	memory->snapshot_id = 0;
+	memory->start_time = g_get_monotonic_time ();
+}
+
+static void photo_booth_memory_finalize (GObject *object)
+{
+	PhotoBoothMemory *memory = PHOTO_BOOTH_MEMORY (object);
+	photo_booth_memory_stop (memory);
+	g_hash_table_destroy (memory->tracked);
+	g_free (memory->location);
+	g_mutex_clear (&memory->lock);
+	G_OBJECT_CLASS (photo_booth_memory_parent_class)->finalize (object);
+}
+
+PhotoBoothMemory *photo_booth_memory_get_default (void)
+{
+	static gsize initialized = 0;
+	static PhotoBoothMemory *memory = NULL;
+	if (g_once_init_enter (&initialized))
+	{
+		memory = g_object_new (PHOTO_BOOTH_MEMORY_TYPE, NULL);
+		g_once_init_leave (&initialized, 1);
+	}
+	return memory;
+}
+
+const gchar *photo_booth_memory_subsystem_name (PhotoBoothMemorySubsystem subsystem)
+{
+	g_return_val_if_fail (subsystem < MEMORY_SUBSYSTEMS, NULL);
+	return subsystem_names[subsystem];
+}
+
+/* call with lock held, returns the entry that was removed or NULL */
+static PhotoBoothMemoryEntry *photo_booth_memory_remove (PhotoBoothMemory *memory, gconstpointer ptr)
+{
+	PhotoBoothMemoryEntry *entry = g_hash_table_lookup (memory->tracked, ptr);
+	if (!entry)
+		return NULL;
+	g_hash_table_steal (memory->tracked, ptr);
+	memory->bytes[entry->subsystem] -= entry->bytes;
+	memory->objects[entry->subsystem]--;
+	return entry;
+}
+
+/* call with lock held */
+static void photo_booth_memory_add (PhotoBoothMemory *memory, PhotoBoothMemorySubsystem subsystem, gconstpointer ptr, gsize bytes, gboolean weak)
+{
+	PhotoBoothMemoryEntry *entry = g_new (PhotoBoothMemoryEntry, 1);
+	entry->subsystem = subsystem;
+	entry->bytes = bytes;
+	entry->weak = weak;
+	g_hash_table_insert (memory->tracked, (gpointer) ptr, entry);
+	memory->bytes[subsystem] += bytes;
+	memory->peak_bytes[subsystem] = MAX (memory->peak_bytes[subsystem], memory->bytes[subsystem]);
+	memory->objects[subsystem]++;
+	memory->allocations[subsystem]++;
+}
+
+/* ptr is accounted to subsystem with bytes until it is untracked, tracking it again updates its size */
+void photo_booth_memory_track (PhotoBoothMemory *memory, PhotoBoothMemorySubsystem subsystem, gconstpointer ptr, gsize bytes)
+{
+	PhotoBoothMemoryEntry *old;
+	gboolean weak = FALSE;
+	g_return_if_fail (subsystem < MEMORY_SUBSYSTEMS);
+	if (!ptr)
+		return;
+	g_mutex_lock (&memory->lock);
+	if ((old = photo_booth_memory_remove (memory, ptr)))
+	{
+		weak = old->weak;
+		g_free (old);
+	}
+	photo_booth_memory_add (memory, subsystem, ptr, bytes, weak);
+	g_mutex_unlock (&memory->lock);
+}
+
+static void photo_booth_memory_object_finalized (gpointer data, GObject *where_the_object_was)
+{
+	PhotoBoothMemory *memory = PHOTO_BOOTH_MEMORY (data);
+	g_mutex_lock (&memory->lock);
+	g_free (photo_booth_memory_remove (memory, where_the_object_was));
+	g_mutex_unlock (&memory->lock);
+}
+
+/* like track, but the object untracks itself when it is finalized */
+void photo_booth_memory_track_object (PhotoBoothMemory *memory, PhotoBoothMemorySubsystem subsystem, gpointer object, gsize bytes)
+{
+	PhotoBoothMemoryEntry *old;
+	g_return_if_fail (subsystem < MEMORY_SUBSYSTEMS);
+	g_return_if_fail (G_IS_OBJECT (object));
+	g_mutex_lock (&memory->lock);
+	old = photo_booth_memory_remove (memory, object);
+	if (!old || !old->weak)
+		g_object_weak_ref (G_OBJECT (object), photo_booth_memory_object_finalized, memory);
+	g_free (old);
+	photo_booth_memory_add (memory, subsystem, object, bytes, TRUE);
+	g_mutex_unlock (&memory->lock);
+}
+
+void photo_booth_memory_untrack (PhotoBoothMemory *memory, gconstpointer ptr)
+{
+	PhotoBoothMemoryEntry *entry;
+	if (!ptr)
+		return;
+	g_mutex_lock (&memory->lock);
+	entry = photo_booth_memory_remove (memory, ptr);
+	g_mutex_unlock (&memory->lock);
+	if (entry && entry->weak)
+		g_object_weak_unref (G_OBJECT (ptr), photo_booth_memory_object_finalized, memory);
+	g_free (entry);
+}
+
+gint64 photo_booth_memory_get_bytes (PhotoBoothMemory *memory, PhotoBoothMemorySubsystem subsystem)
+{
+	gint64 bytes;
+	g_return_val_if_fail (subsystem < MEMORY_SUBSYSTEMS, 0);
+	g_mutex_lock (&memory->lock);
+	bytes = memory->bytes[subsystem];
+	g_mutex_unlock (&memory->lock);
+	return bytes;
+}
+
+guint photo_booth_memory_get_objects (PhotoBoothMemory *memory, PhotoBoothMemorySubsystem subsystem)
+{
+	guint objects;
+	g_return_val_if_fail (subsystem < MEMORY_SUBSYSTEMS, 0);
+	g_mutex_lock (&memory->lock);
+	objects = memory->objects[subsystem];
+	g_mutex_unlock (&memory->lock);
+	return objects;
+}
+
+/* resident set size in kB */
+glong photo_booth_memory_rss (void)
+{
+	glong size = 0, resident = 0;
+	FILE *statm = fopen ("/proc/self/statm", "r");
+	if (statm)
+	{
+		if (fscanf (statm, "%ld %ld", &size, &resident) != 2)
+			resident = 0;
+		fclose (statm);
+	}
+	return resident * (sysconf (_SC_PAGESIZE) / 1024);
+}
+
+/* kB handed out by malloc and not yet freed, unlike the rss this doesn't include freed memory
+ * malloc keeps around. -1 if the libc can't tell */
+glong photo_booth_memory_heap (void)
+{
+#ifdef HAVE_MALLINFO2
+	struct mallinfo2 info = mallinfo2 ();
+	return (info.uordblks + info.hblkhd) / 1024;
+#else
+	return -1;
+#endif
+}
+
+/* appends one json line with the process' and every subsystem's footprint and updates the metrics */
+void photo_booth_memory_snapshot (PhotoBoothMemory *memory)
+{
+	PhotoBoothMetrics *metrics = photo_booth_metrics_get_default ();
+	gint64 bytes[MEMORY_SUBSYSTEMS], peak_bytes[MEMORY_SUBSYSTEMS];
+	guint objects[MEMORY_SUBSYSTEMS];
+	guint64 allocations[MEMORY_SUBSYSTEMS];
+	glong rss = photo_booth_memory_rss (), heap = photo_booth_memory_heap ();
+	gchar *location, *now;
+	JsonBuilder *builder;
+	GDateTime *date;
+	guint i;
+
+	g_mutex_lock (&memory->lock);
+	memcpy (bytes, memory->bytes, sizeof (bytes));
+	memcpy (peak_bytes, memory->peak_bytes, sizeof (peak_bytes));
+	memcpy (objects, memory->objects, sizeof (objects));
+	memcpy (allocations, memory->allocations, sizeof (allocations));
+	location = g_strdup (memory->location);
+	g_mutex_unlock (&memory->lock);
+
+	photo_booth_metrics_gauge_set (metrics, "photobooth_resident_bytes", NULL, rss * 1024.0);
+	if (heap >= 0)
+		photo_booth_metrics_gauge_set (metrics, "photobooth_heap_bytes", NULL, heap * 1024.0);
+	for (i = 0; i < MEMORY_SUBSYSTEMS; i++)
+	{
+		gchar *labels = g_strdup_printf ("subsystem=\"%s\"", subsystem_names[i]);
+		photo_booth_metrics_gauge_set (metrics, "photobooth_memory_bytes", labels, bytes[i]);
+		photo_booth_metrics_gauge_set (metrics, "photobooth_memory_objects", labels, objects[i]);
+		g_free (labels);
+	}
+	GST_DEBUG_OBJECT (memory, "rss %ld kB, heap %ld kB, capture %" G_GINT64_FORMAT " photo-bin %" G_GINT64_FORMAT " print %" G_GINT64_FORMAT " upload %" G_GINT64_FORMAT " masquerade %" G_GINT64_FORMAT " bytes",
+		rss, heap, bytes[MEMORY_CAPTURE], bytes[MEMORY_PHOTO_BIN], bytes[MEMORY_PRINT], bytes[MEMORY_UPLOAD], bytes[MEMORY_MASQUERADE]);
+
+	if (!location)
+		return;
+
+	date = g_date_time_new_now_local ();
+	now = g_date_time_format (date, "%FT%T%z");
+	builder = json_builder_new ();
+	json_builder_begin_object (builder);
+	json_builder_set_member_name (builder, "time");
+	json_builder_add_string_value (builder, now);
+	json_builder_set_member_name (builder, "uptime_s");
+	json_builder_add_int_value (builder, (g_get_monotonic_time () - memory->start_time) / G_USEC_PER_SEC);
+	json_builder_set_member_name (builder, "rss_kb");
+	json_builder_add_int_value (builder, rss);
+	json_builder_set_member_name (builder, "heap_kb");
+	json_builder_add_int_value (builder, heap);
+	json_builder_set_member_name (builder, "subsystems");
+	json_builder_begin_object (builder);
+	for (i = 0; i < MEMORY_SUBSYSTEMS; i++)
+	{
+		json_builder_set_member_name (builder, subsystem_names[i]);
+		json_builder_begin_object (builder);
+		json_builder_set_member_name (builder, "bytes");
+		json_builder_add_int_value (builder, bytes[i]);
+		json_builder_set_member_name (builder, "peak_bytes");
+		json_builder_add_int_value (builder, peak_bytes[i]);
+		json_builder_set_member_name (builder, "objects");
+		json_builder_add_int_value (builder, objects[i]);
+		json_builder_set_member_name (builder, "allocations");
+		json_builder_add_int_value (builder, allocations[i]);
+		json_builder_end_object (builder);
+	}
+	json_builder_end_object (builder);
+	json_builder_end_object (builder);
+
+	photo_booth_trace_append_json (memory, location, builder, "a memory snapshot");
+	g_object_unref (builder);
+	g_free (now);
+	g_date_time_unref (date);
+	g_free (location);
+}
+
+static gboolean photo_booth_memory_snapshot_cb (PhotoBoothMemory *memory)
+{
+	photo_booth_memory_snapshot (memory);
+	return G_SOURCE_CONTINUE;
+}
+
+/* snapshots every interval_s from the default main context, to location if it isn't NULL */
+void photo_booth_memory_start (PhotoBoothMemory *memory, const gchar *location, guint interval_s)
+{
+	photo_booth_memory_stop (memory);
+	g_mutex_lock (&memory->lock);
+	g_free (memory->location);
+	memory->location = g_strdup (location);
+	g_mutex_unlock (&memory->lock);
+	memory->snapshot_id = g_timeout_add_seconds (MAX (interval_s, 1), (GSourceFunc) photo_booth_memory_snapshot_cb, memory);
+	GST_INFO_OBJECT (memory, "memory snapshots every %u s to '%s'", MAX (interval_s, 1), location ? location : "(metrics only)");
+	photo_booth_memory_snapshot (memory);
+}
+
+void photo_booth_memory_stop (PhotoBoothMemory *memory)
+{
+	if (memory->snapshot_id)
+		g_source_remove (memory->snapshot_id);
+	memory->snapshot_id = 0;
+}
@@ -0,0 +1,79 @@
+/*
+ * GStreamer photoboothmemory.h
+ * Copyright 2019 Andreas Frisch <fraxinas@schaffenburg.org>
+ *
+ * This program is licensed under the Creative Commons
+ * Attribution-NonCommercial-ShareAlike 3.0 Unported
+ * License. To view a copy of this license, visit
+ * http://creativecommons.org/licenses/by-nc-sa/3.0/ or send a letter to
+ * Creative Commons,559 Nathan Abbott Way,Stanford,California 94305,USA.
+ *
+ * This program is NOT free software. It is open source, you are allowed
+ * to modify it (if you keep the license), but it may not be commercially
+ * distributed other than under the conditions noted above.
+ */
+
+#ifndef __PHOTO_BOOTH_MEMORY_H__
+#define __PHOTO_BOOTH_MEMORY_H__
+
+#include <glib-object.h>
+#include <glib.h>
+
+G_BEGIN_DECLS
+
+#define PHOTO_BOOTH_MEMORY_TYPE                (photo_booth_memory_get_type ())
+#define PHOTO_BOOTH_MEMORY(obj)                (G_TYPE_CHECK_INSTANCE_CAST ((obj),PHOTO_BOOTH_MEMORY_TYPE,PhotoBoothMemory))
+#define PHOTO_BOOTH_MEMORY_CLASS(klass)        (G_TYPE_CHECK_CLASS_CAST ((klass), PHOTO_BOOTH_MEMORY_TYPE,PhotoBoothMemoryClass))
+#define IS_PHOTO_BOOTH_MEMORY(obj)             (G_TYPE_CHECK_INSTANCE_TYPE ((obj),PHOTO_BOOTH_MEMORY_TYPE))
+#define IS_PHOTO_BOOTH_MEMORY_CLASS(klass)     (G_TYPE_CHECK_CLASS_TYPE ((klass), PHOTO_BOOTH_MEMORY_TYPE))
+
+typedef enum
+{
+	MEMORY_CAPTURE = 0,        // the downloaded photo
+	MEMORY_PHOTO_BIN,          // the per-photo encoder, filesink and print branch elements
+	MEMORY_PRINT,              // the processed print buffer and print operations
+	MEMORY_UPLOAD,             // upload chunk and response buffers
+	MEMORY_MASQUERADE,         // decoded masks and their mip levels
+	MEMORY_SUBSYSTEMS
+} PhotoBoothMemorySubsystem;
+
+typedef struct _PhotoBoothMemory              PhotoBoothMemory;
+typedef struct _PhotoBoothMemoryClass         PhotoBoothMemoryClass;
+
+struct _PhotoBoothMemory
+{
+	GObject parent;
+	GMutex lock;
+	GHashTable *tracked;                        // pointer -> subsystem and size
+	gint64 bytes[MEMORY_SUBSYSTEMS], peak_bytes[MEMORY_SUBSYSTEMS];
+	guint objects[MEMORY_SUBSYSTEMS];
+	guint64 allocations[MEMORY_SUBSYSTEMS];
+	gchar *location;
+	guint snapshot_id;
+	gint64 start_time;
+};
+
+struct _PhotoBoothMemoryClass
+{
+	GObjectClass parent_class;
+};
+
+/* the booth's big per-guest allocations are tracked by pointer, so whatever is still tracked long after
+ * the guest is gone has leaked. tracking is cheap and always on, snapshots are only written when started */
+GType               photo_booth_memory_get_type        (void);
+PhotoBoothMemory   *photo_booth_memory_get_default     (void);
+void                photo_booth_memory_track           (PhotoBoothMemory *memory, PhotoBoothMemorySubsystem subsystem, gconstpointer ptr, gsize bytes);
+void                photo_booth_memory_track_object    (PhotoBoothMemory *memory, PhotoBoothMemorySubsystem subsystem, gpointer object, gsize bytes);
+void                photo_booth_memory_untrack         (PhotoBoothMemory *memory, gconstpointer ptr);
+gint64              photo_booth_memory_get_bytes       (PhotoBoothMemory *memory, PhotoBoothMemorySubsystem subsystem);
+guint               photo_booth_memory_get_objects     (PhotoBoothMemory *memory, PhotoBoothMemorySubsystem subsystem);
+const gchar        *photo_booth_memory_subsystem_name  (PhotoBoothMemorySubsystem subsystem);
+glong               photo_booth_memory_rss             (void);
+glong               photo_booth_memory_heap            (void);
+void                photo_booth_memory_snapshot        (PhotoBoothMemory *memory);
+void                photo_booth_memory_start           (PhotoBoothMemory *memory, const gchar *location, guint interval_s);
+void                photo_booth_memory_stop            (PhotoBoothMemory *memory);
+
+G_END_DECLS
+
+#endif /* __PHOTO_BOOTH_MEMORY_H__ */
@@ -0,0 +1,400 @@
+/*
+ * GStreamer photoboothmetrics.c
+ * Copyright 2019 Andreas Frisch <fraxinas@schaffenburg.org>
+ *
+ * This program is licensed under the Creative Commons
+ * Attribution-NonCommercial-ShareAlike 3.0 Unported
+ * License. To view a copy of this license, visit
+ * http://creativecommons.org/licenses/by-nc-sa/3.0/ or send a letter to
+ * Creative Commons,559 Nathan Abbott Way,Stanford,California 94305,USA.
+ *
+ * This program is NOT free software. It is open source, you are allowed
+ * to modify it (if you keep the license), but it may not be commercially
+ * distributed other than under the conditions noted above.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <glib/gstdio.h>
+#include <gio/gunixsocketaddress.h>
+#include "photobooth.h"
+#include "photoboothmetrics.h"
+
+typedef enum { METRIC_COUNTER, METRIC_GAUGE, METRIC_SUMMARY, METRIC_HISTOGRAM } metric_t;
+
+static const gdouble histogram_bounds[] = { METRICS_HISTOGRAM_BUCKETS };
+#define N_HISTOGRAM_BUCKETS G_N_ELEMENTS (histogram_bounds)
+
+typedef struct
+{
+	metric_t type;
+	gchar *name;
+	gchar *labels;
+	gdouble value;  // counter / gauge value, sum of all observations for summaries and histograms
+	guint64 count;
+	gdouble samples[METRICS_SUMMARY_WINDOW];
+	guint n_samples, next_sample;
+	guint64 buckets[N_HISTOGRAM_BUCKETS];  // not cumulative, the exposition adds them up
+} PhotoBoothMetric;
+
+G_DEFINE_TYPE (PhotoBoothMetrics, photo_booth_metrics, G_TYPE_OBJECT);
+
+GST_DEBUG_CATEGORY_STATIC (photo_booth_metrics_debug);
+#define GST_CAT_DEFAULT photo_booth_metrics_debug
+
+static void photo_booth_metrics_finalize (GObject *object);
+
+static void photo_booth_metric_free (PhotoBoothMetric *metric)
+{
+	g_free (metric->name);
+	g_free (metric->labels);
+	g_free (metric);
+}
+
+static void photo_booth_metrics_class_init (PhotoBoothMetricsClass *klass)
+{
+	GObjectClass *gobject_class = G_OBJECT_CLASS (klass);
+
+	GST_DEBUG_CATEGORY_INIT (photo_booth_metrics_debug, "photoboothmetrics", GST_DEBUG_BOLD | GST_DEBUG_FG_WHITE | GST_DEBUG_BG_CYAN, "PhotoBoothMetrics");
+
+	gobject_class->finalize = photo_booth_metrics_finalize;
+}
+
+static void photo_booth_metrics_init (PhotoBoothMetrics *metrics)
+{
+	g_mutex_init (&metrics->lock);
+	metrics->metrics = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, (GDestroyNotify) photo_booth_metric_free);
+	metrics->service = NULL;
+	metrics->socket_path = NULL;
+}
+
+static void photo_booth_metrics_finalize (GObject *object)
+{
+	PhotoBoothMetrics *metrics = PHOTO_BOOTH_METRICS (object);
+	photo_booth_metrics_stop (metrics);
+	g_hash_table_destroy (metrics->metrics);
+	g_mutex_clear (&metrics->lock);
+	G_OBJECT_CLASS (photo_booth_metrics_parent_class)->finalize (object);
+}
+
+PhotoBoothMetrics *photo_booth_metrics_get_default (void)
+{
+	static gsize initialized = 0;
+	static PhotoBoothMetrics *metrics = NULL;
+	if (g_once_init_enter (&initialized))
+	{
+		metrics = g_object_new (PHOTO_BOOTH_METRICS_TYPE, NULL);
+		g_once_init_leave (&initialized, 1);
+	}
+	return metrics;
+}
+
+/* call with lock held */
+static PhotoBoothMetric *photo_booth_metrics_lookup (PhotoBoothMetrics *metrics, metric_t type, const gchar *name, const gchar *labels, gboolean create)
+{
+	PhotoBoothMetric *metric;
+	gchar *key = g_strdup_printf ("%s{%s}", name, labels ? labels : "");
+	metric = g_hash_table_lookup (metrics->metrics, key);
+	if (!metric && create)
+	{
+		metric = g_new0 (PhotoBoothMetric, 1);
+		metric->type = type;
+		metric->name = g_strdup (name);
+		metric->labels = g_strdup (labels);
+		g_hash_table_insert (metrics->metrics, key, metric);
+		GST_DEBUG_OBJECT (metrics, "new metric %s{%s}", name, labels ? labels : "");
+		return metric;
+	}
+	g_free (key);
+	if (metric && metric->type != type && create)
+	{
+		GST_WARNING_OBJECT (metrics, "metric %s{%s} used with different types", name, labels ? labels : "");
+		return NULL;
+	}
+	return metric;
+}
+
+void photo_booth_metrics_counter_add (PhotoBoothMetrics *metrics, const gchar *name, const gchar *labels, gdouble value)
+{
+	PhotoBoothMetric *metric;
+	g_mutex_lock (&metrics->lock);
+	metric = photo_booth_metrics_lookup (metrics, METRIC_COUNTER, name, labels, TRUE);
+	if (metric)
+	{
+		metric->value += value;
+		metric->count++;
+	}
+	g_mutex_unlock (&metrics->lock);
+}
+
+void photo_booth_metrics_gauge_set (PhotoBoothMetrics *metrics, const gchar *name, const gchar *labels, gdouble value)
+{
+	PhotoBoothMetric *metric;
+	g_mutex_lock (&metrics->lock);
+	metric = photo_booth_metrics_lookup (metrics, METRIC_GAUGE, name, labels, TRUE);
+	if (metric)
+	{
+		metric->value = value;
+		metric->count++;
+	}
+	g_mutex_unlock (&metrics->lock);
+}
+
+void photo_booth_metrics_observe (PhotoBoothMetrics *metrics, const gchar *name, const gchar *labels, gdouble value)
+{
+	PhotoBoothMetric *metric;
+	g_mutex_lock (&metrics->lock);
+	metric = photo_booth_metrics_lookup (metrics, METRIC_SUMMARY, name, labels, TRUE);
+	if (metric)
+	{
+		metric->value += value;
+		metric->count++;
+		metric->samples[metric->next_sample] = value;
+		metric->next_sample = (metric->next_sample + 1) % METRICS_SUMMARY_WINDOW;
+		if (metric->n_samples < METRICS_SUMMARY_WINDOW)
+			metric->n_samples++;
+	}
+	g_mutex_unlock (&metrics->lock);
+}
+
+void photo_booth_metrics_histogram_observe (PhotoBoothMetrics *metrics, const gchar *name, const gchar *labels, gdouble value)
+{
+	PhotoBoothMetric *metric;
+	guint i;
+	g_mutex_lock (&metrics->lock);
+	metric = photo_booth_metrics_lookup (metrics, METRIC_HISTOGRAM, name, labels, TRUE);
+	if (metric)
+	{
+		metric->value += value;
+		metric->count++;
+		for (i = 0; i < N_HISTOGRAM_BUCKETS && value > histogram_bounds[i]; i++);
+		if (i < N_HISTOGRAM_BUCKETS)
+			metric->buckets[i]++;
+	}
+	g_mutex_unlock (&metrics->lock);
+}
+
+gdouble photo_booth_metrics_get_value (PhotoBoothMetrics *metrics, const gchar *name, const gchar *labels)
+{
+	PhotoBoothMetric *metric;
+	gdouble value = 0.0;
+	g_mutex_lock (&metrics->lock);
+	metric = photo_booth_metrics_lookup (metrics, METRIC_COUNTER, name, labels, FALSE);
+	if (metric)
+		value = metric->value;
+	g_mutex_unlock (&metrics->lock);
+	return value;
+}
+
+static gint _compare_double (gconstpointer a, gconstpointer b)
+{
+	gdouble da = *(const gdouble *) a, db = *(const gdouble *) b;
+	return da < db ? -1 : da > db;
+}
+
+/* nearest-rank quantile over the window, call with lock held */
+static gdouble photo_booth_metric_quantile (PhotoBoothMetric *metric, gdouble q)
+{
+	gdouble sorted[METRICS_SUMMARY_WINDOW];
+	guint rank;
+	if (!metric->n_samples)
+		return 0.0;
+	memcpy (sorted, metric->samples, metric->n_samples * sizeof (gdouble));
+	qsort (sorted, metric->n_samples, sizeof (gdouble), _compare_double);
+	rank = (guint) (q * metric->n_samples + 0.999999);
+	rank = CLAMP (rank, 1, metric->n_samples);
+	return sorted[rank - 1];
+}
+
+gdouble photo_booth_metrics_quantile (PhotoBoothMetrics *metrics, const gchar *name, const gchar *labels, gdouble q)
+{
+	PhotoBoothMetric *metric;
+	gdouble value = 0.0;
+	g_mutex_lock (&metrics->lock);
+	metric = photo_booth_metrics_lookup (metrics, METRIC_SUMMARY, name, labels, FALSE);
+	if (metric && metric->type == METRIC_SUMMARY)
+		value = photo_booth_metric_quantile (metric, q);
+	g_mutex_unlock (&metrics->lock);
+	return value;
+}
+
+static gint _compare_metric (gconstpointer a, gconstpointer b)
+{
+	const PhotoBoothMetric *ma = *(PhotoBoothMetric * const *) a, *mb = *(PhotoBoothMetric * const *) b;
+	gint ret = strcmp (ma->name, mb->name);
+	return ret ? ret : g_strcmp0 (ma->labels, mb->labels);
+}
+
+static void _append_sample (GString *out, const gchar *name, const gchar *suffix, const gchar *labels, const gchar *extra_label, gdouble value)
+{
+	gboolean has_labels = labels && *labels;
+	gchar number[G_ASCII_DTOSTR_BUF_SIZE];
+	g_string_append_printf (out, "%s%s", name, suffix);
+	if (has_labels || extra_label)
+		g_string_append_printf (out, "{%s%s%s}", has_labels ? labels : "", has_labels && extra_label ? "," : "", extra_label ? extra_label : "");
+	// not printf, whose decimal separator follows the locale gtk_init set, and without losing digits of the byte gauges
+	g_string_append_printf (out, " %s\n", g_ascii_dtostr (number, sizeof (number), value));
+}
+
+/* text exposition format, one block per metric name sorted alphabetically */
+gchar *photo_booth_metrics_to_string (PhotoBoothMetrics *metrics)
+{
+	static const gchar *type_names[] = { "counter", "gauge", "summary", "histogram" };
+	GString *out = g_string_new ("");
+	GPtrArray *sorted = g_ptr_array_new ();
+	GHashTableIter iter;
+	gpointer value;
+	const gchar *last_name = NULL;
+	guint i;
+
+	g_mutex_lock (&metrics->lock);
+	g_hash_table_iter_init (&iter, metrics->metrics);
+	while (g_hash_table_iter_next (&iter, NULL, &value))
+		g_ptr_array_add (sorted, value);
+	g_ptr_array_sort (sorted, _compare_metric);
+
+	for (i = 0; i < sorted->len; i++)
+	{
+		PhotoBoothMetric *metric = g_ptr_array_index (sorted, i);
+		if (g_strcmp0 (last_name, metric->name))
+			g_string_append_printf (out, "# TYPE %s %s\n", metric->name, type_names[metric->type]);
+		last_name = metric->name;
+		if (metric->type == METRIC_SUMMARY)
+		{
+			_append_sample (out, metric->name, "", metric->labels, "quantile=\"0.5\"", photo_booth_metric_quantile (metric, 0.5));
+			_append_sample (out, metric->name, "", metric->labels, "quantile=\"0.95\"", photo_booth_metric_quantile (metric, 0.95));
+			_append_sample (out, metric->name, "_sum", metric->labels, NULL, metric->value);
+			_append_sample (out, metric->name, "_count", metric->labels, NULL, metric->count);
+		}
+		else if (metric->type == METRIC_HISTOGRAM)
+		{
+			guint64 cumulative = 0;
+			guint b;
+			for (b = 0; b < N_HISTOGRAM_BUCKETS; b++)
+			{
+				gchar number[G_ASCII_DTOSTR_BUF_SIZE];
+				gchar *le = g_strdup_printf ("le=\"%s\"", g_ascii_dtostr (number, sizeof (number), histogram_bounds[b]));
+				cumulative += metric->buckets[b];
+				_append_sample (out, metric->name, "_bucket", metric->labels, le, cumulative);
+				g_free (le);
+			}
+			_append_sample (out, metric->name, "_bucket", metric->labels, "le=\"+Inf\"", metric->count);
+			_append_sample (out, metric->name, "_sum", metric->labels, NULL, metric->value);
+			_append_sample (out, metric->name, "_count", metric->labels, NULL, metric->count);
+		}
+		else
+			_append_sample (out, metric->name, "", metric->labels, NULL, metric->value);
+	}
+	g_mutex_unlock (&metrics->lock);
+
+	g_ptr_array_free (sorted, TRUE);
+	return g_string_free (out, FALSE);
+}
+
+/* one request per connection, runs in the service's worker thread */
+static gboolean photo_booth_metrics_handle (G_GNUC_UNUSED GThreadedSocketService *service, GSocketConnection *connection, G_GNUC_UNUSED GObject *source, PhotoBoothMetrics *metrics)
+{
+	GDataInputStream *in = g_data_input_stream_new (g_io_stream_get_input_stream (G_IO_STREAM (connection)));
+	GOutputStream *out = g_io_stream_get_output_stream (G_IO_STREAM (connection));
+	gchar *line, *request = NULL, *body = NULL, *response;
+
+	g_socket_set_timeout (g_socket_connection_get_socket (connection), 5);
+	g_data_input_stream_set_newline_type (in, G_DATA_STREAM_NEWLINE_TYPE_ANY);
+	// the request line, then skip the headers up to the blank line
+	while ((line = g_data_input_stream_read_line (in, NULL, NULL, NULL)))
+	{
+		gboolean blank = (*g_strchomp (line) == '\0');
+		if (!request)
+			request = line;
+		else
+			g_free (line);
+		if (blank)
+			break;
+	}
+
+	if (request && (g_str_has_prefix (request, "GET /metrics") || g_str_has_prefix (request, "GET / ")))
+	{
+		body = photo_booth_metrics_to_string (metrics);
+		response = g_strdup_printf ("HTTP/1.0 200 OK\r\nContent-Type: text/plain; version=0.0.4\r\nContent-Length: %"G_GSIZE_FORMAT"\r\nConnection: close\r\n\r\n%s", strlen (body), body);
+	}
+	else
+		response = g_strdup ("HTTP/1.0 404 Not Found\r\nContent-Length: 0\r\nConnection: close\r\n\r\n");
+	GST_LOG_OBJECT (metrics, "'%s' answered with %"G_GSIZE_FORMAT" bytes", request ? request : "(nothing)", strlen (response));
+	g_output_stream_write_all (out, response, strlen (response), NULL, NULL, NULL);
+	g_io_stream_close (G_IO_STREAM (connection), NULL, NULL);
+
+	g_free (response);
+	g_free (body);
+	g_free (request);
+	g_object_unref (in);
+	return TRUE;
+}
+
+gboolean photo_booth_metrics_serve (PhotoBoothMetrics *metrics, guint16 port, const gchar *socket_path, GError **error)
+{
+	GSocketService *service;
+	GSocketAddress *address;
+	gboolean ret = TRUE;
+
+	photo_booth_metrics_stop (metrics);
+	if (!port && !socket_path)
+		return TRUE;
+
+	service = g_threaded_socket_service_new (2);
+	if (port)
+	{
+		// only ever on the loopback, the metrics are not for the venue's wifi
+		GInetAddress *loopback = g_inet_address_new_loopback (G_SOCKET_FAMILY_IPV4);
+		address = g_inet_socket_address_new (loopback, port);
+		ret = g_socket_listener_add_address (G_SOCKET_LISTENER (service), address, G_SOCKET_TYPE_STREAM, G_SOCKET_PROTOCOL_TCP, NULL, NULL, error);
+		g_object_unref (address);
+		g_object_unref (loopback);
+	}
+	if (ret && socket_path)
+	{
+		g_unlink (socket_path);
+		address = g_unix_socket_address_new (socket_path);
+		ret = g_socket_listener_add_address (G_SOCKET_LISTENER (service), address, G_SOCKET_TYPE_STREAM, G_SOCKET_PROTOCOL_DEFAULT, NULL, NULL, error);
+		g_object_unref (address);
+	}
+	if (!ret)
+	{
+		g_object_unref (service);
+		return FALSE;
+	}
+
+	g_signal_connect (service, "run", G_CALLBACK (photo_booth_metrics_handle), metrics);
+	g_socket_service_start (service);
+	GST_INFO_OBJECT (metrics, "serving metrics on 127.0.0.1:%u %s", port, socket_path ? socket_path : "");
+
+	g_mutex_lock (&metrics->lock);
+	metrics->service = service;
+	metrics->socket_path = g_strdup (socket_path);
+	g_mutex_unlock (&metrics->lock);
+	return TRUE;
+}
+
+void photo_booth_metrics_stop (PhotoBoothMetrics *metrics)
+{
+	GSocketService *service;
+	gchar *socket_path;
+
+	g_mutex_lock (&metrics->lock);
+	service = metrics->service;
+	socket_path = metrics->socket_path;
+	metrics->service = NULL;
+	metrics->socket_path = NULL;
+	g_mutex_unlock (&metrics->lock);
+
+	if (service)
+	{
+		g_socket_service_stop (service);
+		g_socket_listener_close (G_SOCKET_LISTENER (service));
+		g_object_unref (service);
+	}
+	if (socket_path)
+	{
+		g_unlink (socket_path);
+		g_free (socket_path);
+	}
+}
@@ -0,0 +1,70 @@
+/*
+ * GStreamer photoboothmetrics.h
+ * Copyright 2019 Andreas Frisch <fraxinas@schaffenburg.org>
+ *
+ * This program is licensed under the Creative Commons
+ * Attribution-NonCommercial-ShareAlike 3.0 Unported
+ * License. To view a copy of this license, visit
+ * http://creativecommons.org/licenses/by-nc-sa/3.0/ or send a letter to
+ * Creative Commons,559 Nathan Abbott Way,Stanford,California 94305,USA.
+ *
+ * This program is NOT free software. It is open source, you are allowed
+ * to modify it (if you keep the license), but it may not be commercially
+ * distributed other than under the conditions noted above.
+ */
+
+#ifndef __PHOTO_BOOTH_METRICS_H__
+#define __PHOTO_BOOTH_METRICS_H__
+
+#include <glib-object.h>
+#include <glib.h>
+#include <gio/gio.h>
+
+G_BEGIN_DECLS
+
+#define PHOTO_BOOTH_METRICS_TYPE                (photo_booth_metrics_get_type ())
+#define PHOTO_BOOTH_METRICS(obj)                (G_TYPE_CHECK_INSTANCE_CAST ((obj),PHOTO_BOOTH_METRICS_TYPE,PhotoBoothMetrics))
+#define PHOTO_BOOTH_METRICS_CLASS(klass)        (G_TYPE_CHECK_CLASS_CAST ((klass), PHOTO_BOOTH_METRICS_TYPE,PhotoBoothMetricsClass))
+#define IS_PHOTO_BOOTH_METRICS(obj)             (G_TYPE_CHECK_INSTANCE_TYPE ((obj),PHOTO_BOOTH_METRICS_TYPE))
+#define IS_PHOTO_BOOTH_METRICS_CLASS(klass)     (G_TYPE_CHECK_CLASS_TYPE ((klass), PHOTO_BOOTH_METRICS_TYPE))
+
+/* number of most recent observations a summary keeps for its quantiles */
+#define METRICS_SUMMARY_WINDOW 256
+/* upper bounds of the histogram buckets in seconds, +Inf is implied */
+#define METRICS_HISTOGRAM_BUCKETS 0.01, 0.025, 0.05, 0.1, 0.25, 0.5, 1.0, 2.5, 5.0, 10.0, 30.0, 60.0
+
+typedef struct _PhotoBoothMetrics              PhotoBoothMetrics;
+typedef struct _PhotoBoothMetricsClass         PhotoBoothMetricsClass;
+
+struct _PhotoBoothMetrics
+{
+	GObject parent;
+	GMutex lock;
+	GHashTable *metrics;
+	GSocketService *service;
+	gchar *socket_path;
+};
+
+struct _PhotoBoothMetricsClass
+{
+	GObjectClass parent_class;
+};
+
+/* labels are given preformatted without braces, e.g. "target=\"imgur\"", or NULL */
+GType              photo_booth_metrics_get_type        (void);
+PhotoBoothMetrics *photo_booth_metrics_get_default     (void);
+void               photo_booth_metrics_counter_add     (PhotoBoothMetrics *metrics, const gchar *name, const gchar *labels, gdouble value);
+void               photo_booth_metrics_gauge_set       (PhotoBoothMetrics *metrics, const gchar *name, const gchar *labels, gdouble value);
+void               photo_booth_metrics_observe         (PhotoBoothMetrics *metrics, const gchar *name, const gchar *labels, gdouble value);
+void               photo_booth_metrics_histogram_observe (PhotoBoothMetrics *metrics, const gchar *name, const gchar *labels, gdouble value);
+gdouble            photo_booth_metrics_get_value       (PhotoBoothMetrics *metrics, const gchar *name, const gchar *labels);
+gdouble            photo_booth_metrics_quantile        (PhotoBoothMetrics *metrics, const gchar *name, const gchar *labels, gdouble q);
+gchar             *photo_booth_metrics_to_string       (PhotoBoothMetrics *metrics);
+
+/* serves the text format over HTTP on 127.0.0.1:port and/or a unix socket (e.g. curl --unix-socket) */
+gboolean           photo_booth_metrics_serve           (PhotoBoothMetrics *metrics, guint16 port, const gchar *socket_path, GError **error);
+void               photo_booth_metrics_stop            (PhotoBoothMetrics *metrics);
+
+G_END_DECLS
+
+#endif /* __PHOTO_BOOTH_METRICS_H__ */
@@ -0,0 +1,553 @@
+/*
+ * GStreamer photoboothphotobench.c
+ * Copyright 2019 Andreas Frisch <fraxinas@schaffenburg.org>
+ *
+ * This program is licensed under the Creative Commons
+ * Attribution-NonCommercial-ShareAlike 3.0 Unported
+ * License. To view a copy of this license, visit
+ * http://creativecommons.org/licenses/by-nc-sa/3.0/ or send a letter to
+ * Creative Commons,559 Nathan Abbott Way,Stanford,California 94305,USA.
+ *
+ * This program is NOT free software. It is open source, you are allowed
+ * to modify it (if you keep the license), but it may not be commercially
+ * distributed other than under the conditions noted above.
+ */
+
+/* pushes full size jpegs through the booth's photo-bin, built by the very same
+ * photo_booth_build_photo_bin and photo_booth_photo_bin_plug_outputs, and times
+ * every element with pad probes: from the buffer arriving on its sink pad until
+ * it pushes the result out of its first src pad. a pass runs like the
+ * processing pass of a guest: the outputs are plugged, one photo is pushed and
+ * the outputs are unplugged again once the print buffer has been caught.
+ * every photo runs with the ICC profile, a few placed masks and the QR code
+ * each switched on and off */
+
+#include <stdlib.h>
+#include <string.h>
+#include <glib/gstdio.h>
+#include <gst/app/app.h>
+#include "photobooth.h"
+#include "photoboothcompositor.h"
+
+#define DEFAULT_BENCH_CONFIG "bench.ini"
+#define DEFAULT_ICC_PROFILE "CP955_F.icc"
+#define DEFAULT_QRCODE_URI "https://schaffenburg.org/"
+#define PASS_TIMEOUT 120
+#define THUMBNAIL_SIZE (3*1024*1024) // smaller jpegs are dropped by photo_booth_drop_thumbnails
+
+typedef struct
+{
+	gchar *name;
+	gint64 in;
+	GArray *times;
+} PhotoBenchElement;
+
+typedef struct
+{
+	GMutex lock;
+	GCond cond;
+	gboolean done;
+	gint64 pass_start;
+	gint64 pass_end;
+	GHashTable *elements;
+	GPtrArray *order;
+	GArray *pass_times;
+} PhotoBench;
+
+typedef struct
+{
+	gchar *title;
+	GBytes *jpeg;
+} PhotoBenchImage;
+
+static gint n_passes = 5;
+static gint n_masks = 3;
+static gchar *mask_filename = NULL;
+static gchar *config_filename = NULL;
+
+static GOptionEntry photobench_entries[] =
+{
+	{ "passes", 'n', 0, G_OPTION_ARG_INT, &n_passes, "Timed passes per photo and configuration, after one warm-up pass (default 5)", "N" },
+	{ "masks", 'm', 0, G_OPTION_ARG_INT, &n_masks, "Number of masks placed when masks are on (default 3)", "N" },
+	{ "mask", 0, 0, G_OPTION_ARG_FILENAME, &mask_filename, "PNG to use as mask, a plain translucent square otherwise", "FILE" },
+	{ "config", 'c', 0, G_OPTION_ARG_FILENAME, &config_filename, "Config the variants are derived from (default "DEFAULT_BENCH_CONFIG")", "FILE" },
+	{ NULL, 0, 0, G_OPTION_ARG_NONE, NULL, NULL, NULL }
+};
+
+static void photobench_element_free (PhotoBenchElement *element)
+{
+	g_free (element->name);
+	g_array_free (element->times, TRUE);
+	g_free (element);
+}
+
+static void photobench_reset (PhotoBench *bench)
+{
+	g_mutex_lock (&bench->lock);
+	g_hash_table_remove_all (bench->elements);
+	g_ptr_array_set_size (bench->order, 0);
+	g_array_set_size (bench->pass_times, 0);
+	g_mutex_unlock (&bench->lock);
+}
+
+static GstPadProbeReturn photobench_probe (GstPad *pad, G_GNUC_UNUSED GstPadProbeInfo *info, PhotoBench *bench)
+{
+	GstElement *element = gst_pad_get_parent_element (pad);
+	gint64 now = g_get_monotonic_time ();
+	PhotoBenchElement *stat;
+
+	if (!element)
+		return GST_PAD_PROBE_OK;
+
+	g_mutex_lock (&bench->lock);
+	stat = g_hash_table_lookup (bench->elements, GST_ELEMENT_NAME (element));
+	if (!stat)
+	{
+		stat = g_new0 (PhotoBenchElement, 1);
+		stat->name = g_strdup (GST_ELEMENT_NAME (element));
+		stat->times = g_array_new (FALSE, FALSE, sizeof (gdouble));
+		g_hash_table_insert (bench->elements, stat->name, stat);
+	}
+	if (GST_PAD_IS_SINK (pad))
+	{
+		stat->in = now;
+		if (GST_IS_APP_SINK (element))
+		{
+			// the print buffer is the last one out of the tee, the pass is done
+			bench->pass_end = now;
+			bench->done = TRUE;
+			g_cond_signal (&bench->cond);
+		}
+	}
+	else if (element->numsinkpads == 0)
+		bench->pass_start = now;
+	else if (stat->in)
+	{
+		gdouble ms = (now - stat->in) / 1000.0;
+		// elements show up in the order the buffer passes them
+		if (stat->times->len == 0)
+			g_ptr_array_add (bench->order, stat);
+		g_array_append_val (stat->times, ms);
+		stat->in = 0;
+	}
+	g_mutex_unlock (&bench->lock);
+	gst_object_unref (element);
+	return GST_PAD_PROBE_OK;
+}
+
+/* the outputs are new elements with new tee pads on every pass, so probe whatever isn't yet */
+static void photobench_instrument (PhotoBench *bench, GstBin *bin)
+{
+	GstIterator *elements = gst_bin_iterate_recurse (bin);
+	GValue item = G_VALUE_INIT;
+
+	while (gst_iterator_next (elements, &item) == GST_ITERATOR_OK)
+	{
+		GstElement *element = g_value_get_object (&item);
+		GstIterator *pads = gst_element_iterate_pads (element);
+		GValue pad_item = G_VALUE_INIT;
+		while (gst_iterator_next (pads, &pad_item) == GST_ITERATOR_OK)
+		{
+			GstPad *pad = g_value_get_object (&pad_item);
+			if (!g_object_get_data (G_OBJECT (pad), "photobench-probe"))
+			{
+				gst_pad_add_probe (pad, GST_PAD_PROBE_TYPE_BUFFER, (GstPadProbeCallback) photobench_probe, bench, NULL);
+				g_object_set_data (G_OBJECT (pad), "photobench-probe", GINT_TO_POINTER (TRUE));
+			}
+			g_value_reset (&pad_item);
+		}
+		g_value_unset (&pad_item);
+		gst_iterator_free (pads);
+		g_value_reset (&item);
+	}
+	g_value_unset (&item);
+	gst_iterator_free (elements);
+}
+
+static GdkPixbuf *photobench_make_mask (gint size)
+{
+	GdkPixbuf *mask;
+	GError *error = NULL;
+
+	if (mask_filename)
+	{
+		mask = gdk_pixbuf_new_from_file_at_scale (mask_filename, size, size, TRUE, &error);
+		if (mask)
+			return mask;
+		g_printerr ("can't load mask %s: %s, using a plain one\n", mask_filename, error->message);
+		g_error_free (error);
+	}
+	mask = gdk_pixbuf_new (GDK_COLORSPACE_RGB, TRUE, 8, size, size);
+	gdk_pixbuf_fill (mask, 0xff80c0a0);
+	return mask;
+}
+
+static void photobench_place_masks (GstElement *photo_bin, gint print_width, gint print_height)
+{
+	GstElement *compositor = gst_bin_get_by_name (GST_BIN (photo_bin), "photo-compositor");
+	gint size = print_height / 3;
+	GdkPixbuf *mask;
+	gint i;
+
+	if (!compositor)
+		return;
+	mask = photobench_make_mask (size);
+	for (i = 0; i < n_masks; i++)
+	{
+		gint x = (i + 1) * print_width / (n_masks + 1) - gdk_pixbuf_get_width (mask) / 2;
+		photo_booth_compositor_add_mask (PHOTO_BOOTH_COMPOSITOR (compositor), mask, x, print_height / 4, gdk_pixbuf_get_width (mask), gdk_pixbuf_get_height (mask));
+	}
+	g_object_unref (mask);
+	gst_object_unref (compositor);
+}
+
+static gboolean photobench_run_pass (PhotoBench *bench, PhotoBooth *pb, GBytes *jpeg)
+{
+	gboolean done;
+	gint64 end_time;
+
+	photo_booth_photo_bin_plug_outputs (pb);
+	photobench_instrument (bench, GST_BIN (pb->photo_bin));
+	gst_element_set_state (pb->photo_bin, GST_STATE_PLAYING);
+
+	g_mutex_lock (&bench->lock);
+	bench->done = FALSE;
+	g_mutex_unlock (&bench->lock);
+
+	// the photo stays with cam_info, the pushed buffer only wraps it
+	g_free (pb->cam_info->data);
+	pb->cam_info->size = g_bytes_get_size (jpeg);
+	pb->cam_info->data = g_memdup (g_bytes_get_data (jpeg, NULL), pb->cam_info->size);
+	photo_booth_push_photo_buffer (pb);
+
+	end_time = g_get_monotonic_time () + PASS_TIMEOUT * G_TIME_SPAN_SECOND;
+	g_mutex_lock (&bench->lock);
+	while (!bench->done)
+		if (!g_cond_wait_until (&bench->cond, &bench->lock, end_time))
+			break;
+	done = bench->done;
+	if (done)
+	{
+		gdouble ms = (bench->pass_end - bench->pass_start) / 1000.0;
+		g_array_append_val (bench->pass_times, ms);
+	}
+	g_mutex_unlock (&bench->lock);
+
+	gst_element_set_state (pb->photo_bin, GST_STATE_READY);
+	photo_booth_photo_bin_unplug_outputs (pb);
+	return done;
+}
+
+static gint photobench_compare (gconstpointer a, gconstpointer b)
+{
+	gdouble x = *(const gdouble *) a, y = *(const gdouble *) b;
+	return (x > y) - (x < y);
+}
+
+static gdouble photobench_median (GArray *times)
+{
+	g_array_sort (times, photobench_compare);
+	return g_array_index (times, gdouble, (times->len - 1) / 2);
+}
+
+static void photobench_print (PhotoBench *bench, const gchar *variant, PhotoBenchImage *image)
+{
+	gdouble total, self = 0;
+	guint i;
+
+	g_print ("\n%s, %s: %u passes\n", variant, image->title, bench->pass_times->len);
+	g_print ("  %-28s %10s %10s\n", "element", "median", "max");
+	for (i = 0; i < bench->order->len; i++)
+	{
+		PhotoBenchElement *stat = g_ptr_array_index (bench->order, i);
+		gdouble median = photobench_median (stat->times);
+		g_print ("  %-28s %8.1fms %8.1fms\n", stat->name, median, g_array_index (stat->times, gdouble, stat->times->len - 1));
+		self += median;
+	}
+	total = photobench_median (bench->pass_times);
+	g_print ("  %-28s %8.1fms\n", "(sinks, queuing, other)", MAX (total - self, 0));
+	g_print ("  %-28s %8.1fms %8.1fms\n", "pass", total, g_array_index (bench->pass_times, gdouble, bench->pass_times->len - 1));
+}
+
+static gboolean photobench_run_variant (PhotoBench *bench, GKeyFile *base, gboolean icc, gboolean masks, gboolean qr, GPtrArray *images, const gchar *save_dir, GString *summary)
+{
+	GKeyFile *gkf = g_key_file_new ();
+	gchar *data, *variant_filename, *save_template, *variant;
+	PhotoBooth *pb;
+	GstElement *pipeline, *display_sink, *qr_overlay;
+	gint print_width, print_height;
+	gboolean ok = TRUE;
+	guint i;
+	gint pass;
+
+	data = g_key_file_to_data (base, NULL, NULL);
+	g_key_file_load_from_data (gkf, data, -1, G_KEY_FILE_KEEP_COMMENTS, NULL);
+	g_free (data);
+
+	// face detection isn't part of the timed chain, the masks are placed right away
+	g_key_file_set_integer (gkf, "general", "facedetection", 0);
+	save_template = g_build_filename (save_dir, "photobench_%04d.jpg", NULL);
+	g_key_file_set_string (gkf, "general", "save_path_template", save_template);
+	g_free (save_template);
+	g_key_file_remove_key (gkf, "general", "trace_file", NULL);
+	// nothing leaves the machine
+	g_key_file_remove_key (gkf, "upload", "linx_put_uri", NULL);
+	g_key_file_remove_key (gkf, "upload", "webhook_uri", NULL);
+	g_key_file_remove_key (gkf, "upload", "facebook_put_uri", NULL);
+	g_key_file_remove_key (gkf, "upload", "imgur_access_token", NULL);
+	if (icc && !g_key_file_has_key (gkf, "printer", "icc_profile", NULL))
+		g_key_file_set_string (gkf, "printer", "icc_profile", DEFAULT_ICC_PROFILE);
+	else if (!icc)
+		g_key_file_remove_key (gkf, "printer", "icc_profile", NULL);
+	if (qr && !g_key_file_has_key (gkf, "upload", "qrcode_base_uri", NULL))
+		g_key_file_set_string (gkf, "upload", "qrcode_base_uri", DEFAULT_QRCODE_URI);
+	else if (!qr)
+		g_key_file_remove_key (gkf, "upload", "qrcode_base_uri", NULL);
+
+	print_width = g_key_file_get_integer (gkf, "printer", "width", NULL);
+	print_height = g_key_file_get_integer (gkf, "printer", "height", NULL);
+	variant_filename = g_build_filename (save_dir, "variant.ini", NULL);
+	g_key_file_save_to_file (gkf, variant_filename, NULL);
+	g_key_file_free (gkf);
+
+	variant = g_strdup_printf ("icc %s, masks %s, qr %s", icc ? "on" : "off", masks ? "on" : "off", qr ? "on" : "off");
+
+	pb = photo_booth_new ();
+	photo_booth_load_settings (pb, variant_filename);
+	pb->cam_info = g_new0 (CameraInfo, 1);
+	pb->photo_bin = photo_booth_build_photo_bin (pb);
+	if (!pb->photo_bin)
+	{
+		g_printerr ("%s: can't build the photo-bin\n", variant);
+		ok = FALSE;
+		goto out;
+	}
+	qr_overlay = gst_bin_get_by_name (GST_BIN (pb->photo_bin), "qr-overlay");
+	if (qr && !qr_overlay)
+		g_printerr ("%s: qroverlay element not installed, the QR code is left out\n", variant);
+	if (qr_overlay)
+		gst_object_unref (qr_overlay);
+	if (masks && print_width > 0 && print_height > 0)
+		photobench_place_masks (pb->photo_bin, print_width, print_height);
+
+	// stands in for the gtksink that shows the photo on the screen
+	pipeline = gst_pipeline_new ("photobench-pipeline");
+	display_sink = gst_element_factory_make ("fakesink", "display-sink");
+	g_object_set (display_sink, "sync", FALSE, "async", FALSE, NULL);
+	gst_bin_add_many (GST_BIN (pipeline), pb->photo_bin, display_sink, NULL);
+	gst_element_link (pb->photo_bin, display_sink);
+	gst_element_set_state (pipeline, GST_STATE_PLAYING);
+
+	for (i = 0; i < images->len && ok; i++)
+	{
+		PhotoBenchImage *image = g_ptr_array_index (images, i);
+		for (pass = 0; pass <= n_passes; pass++)
+		{
+			if (pass == 1) // the first pass warms up lcms' transform and the encoder
+				photobench_reset (bench);
+			if (!photobench_run_pass (bench, pb, image->jpeg))
+			{
+				g_printerr ("%s, %s: pass timed out after %i s\n", variant, image->title, PASS_TIMEOUT);
+				ok = FALSE;
+				break;
+			}
+		}
+		if (ok)
+		{
+			photobench_print (bench, variant, image);
+			g_string_append_printf (summary, "%-32s %-28s %8.1fms\n", variant, image->title, photobench_median (bench->pass_times));
+		}
+		photobench_reset (bench);
+	}
+
+	gst_element_set_state (pipeline, GST_STATE_NULL);
+	gst_object_unref (pipeline);
+out:
+	pb->photo_bin = NULL;
+	g_free (pb->cam_info->data);
+	g_free (pb->cam_info);
+	pb->cam_info = NULL;
+	g_object_unref (pb);
+	g_unlink (variant_filename);
+	g_free (variant_filename);
+	g_free (variant);
+	return ok;
+}
+
+/* noise doesn't compress, so these come out well above the thumbnail size like real photos */
+static GBytes *photobench_make_jpeg (gint width, gint height)
+{
+	gchar *description = g_strdup_printf ("videotestsrc num-buffers=1 pattern=snow ! video/x-raw,width=%i,height=%i ! jpegenc quality=90 ! appsink name=sink", width, height);
+	GstElement *pipeline = gst_parse_launch (description, NULL);
+	GstElement *sink;
+	GstSample *sample;
+	GBytes *jpeg = NULL;
+
+	g_free (description);
+	if (!pipeline)
+		return NULL;
+	sink = gst_bin_get_by_name (GST_BIN (pipeline), "sink");
+	gst_element_set_state (pipeline, GST_STATE_PLAYING);
+	sample = gst_app_sink_pull_sample (GST_APP_SINK (sink));
+	if (sample)
+	{
+		GstMapInfo map;
+		GstBuffer *buffer = gst_sample_get_buffer (sample);
+		gst_buffer_map (buffer, &map, GST_MAP_READ);
+		jpeg = g_bytes_new (map.data, map.size);
+		gst_buffer_unmap (buffer, &map);
+		gst_sample_unref (sample);
+	}
+	gst_element_set_state (pipeline, GST_STATE_NULL);
+	gst_object_unref (sink);
+	gst_object_unref (pipeline);
+	return jpeg;
+}
+
+static void photobench_image_free (PhotoBenchImage *image)
+{
+	g_free (image->title);
+	if (image->jpeg)
+		g_bytes_unref (image->jpeg);
+	g_free (image);
+}
+
+static void photobench_add_image (GPtrArray *images, gchar *title, GBytes *jpeg)
+{
+	PhotoBenchImage *image;
+	if (!jpeg)
+	{
+		g_printerr ("no photo for %s, skipped\n", title);
+		g_free (title);
+		return;
+	}
+	if (g_bytes_get_size (jpeg) < THUMBNAIL_SIZE)
+	{
+		g_printerr ("%s is smaller than %i MB and would be dropped as a thumbnail, skipped\n", title, THUMBNAIL_SIZE >> 20);
+		g_free (title);
+		g_bytes_unref (jpeg);
+		return;
+	}
+	image = g_new0 (PhotoBenchImage, 1);
+	image->title = title;
+	image->jpeg = jpeg;
+	g_ptr_array_add (images, image);
+}
+
+int main (int argc, char *argv[])
+{
+	static const struct { const gchar *title; gint width, height; } sizes[] = {
+		{ "12 MP", 4256, 2832 },
+		{ "24 MP", 6000, 4000 },
+		{ "45 MP", 8256, 5504 },
+	};
+	PhotoBench bench;
+	GOptionContext *context;
+	GKeyFile *base;
+	GPtrArray *images;
+	GString *summary;
+	GError *error = NULL;
+	gchar *save_dir;
+	gint i, variant;
+	gboolean ok = TRUE;
+
+	context = g_option_context_new ("[PHOTO.jpg...] - time the photo processing chain element by element");
+	g_option_context_add_main_entries (context, photobench_entries, NULL);
+	g_option_context_add_group (context, gst_init_get_option_group ());
+	if (!g_option_context_parse (context, &argc, &argv, &error))
+	{
+		g_printerr ("%s\n", error->message);
+		g_error_free (error);
+		return EXIT_FAILURE;
+	}
+	g_option_context_free (context);
+	if (n_passes < 1 || n_masks < 0)
+	{
+		g_printerr ("passes must be positive and masks can't be negative\n");
+		return EXIT_FAILURE;
+	}
+
+	base = g_key_file_new ();
+	if (!g_key_file_load_from_file (base, config_filename ? config_filename : DEFAULT_BENCH_CONFIG, G_KEY_FILE_KEEP_COMMENTS, &error))
+	{
+		g_printerr ("can't load %s: %s\n", config_filename ? config_filename : DEFAULT_BENCH_CONFIG, error->message);
+		g_error_free (error);
+		return EXIT_FAILURE;
+	}
+
+	images = g_ptr_array_new_with_free_func ((GDestroyNotify) photobench_image_free);
+	if (argc > 1)
+	{
+		for (i = 1; i < argc; i++)
+		{
+			gchar *contents;
+			gsize length;
+			if (g_file_get_contents (argv[i], &contents, &length, &error))
+				photobench_add_image (images, g_path_get_basename (argv[i]), g_bytes_new_take (contents, length));
+			else
+			{
+				g_printerr ("%s\n", error->message);
+				g_clear_error (&error);
+			}
+		}
+	}
+	else
+	{
+		g_print ("no photos given, generating noise at camera resolutions...\n");
+		for (i = 0; i < (gint) G_N_ELEMENTS (sizes); i++)
+			photobench_add_image (images, g_strdup_printf ("%s %ix%i", sizes[i].title, sizes[i].width, sizes[i].height), photobench_make_jpeg (sizes[i].width, sizes[i].height));
+	}
+	if (!images->len)
+	{
+		g_printerr ("nothing to push through the photo-bin\n");
+		return EXIT_FAILURE;
+	}
+
+	save_dir = g_dir_make_tmp ("photobench-XXXXXX", &error);
+	if (!save_dir)
+	{
+		g_printerr ("can't create a directory for the saved photos: %s\n", error->message);
+		g_error_free (error);
+		return EXIT_FAILURE;
+	}
+
+	memset (&bench, 0, sizeof (bench));
+	g_mutex_init (&bench.lock);
+	g_cond_init (&bench.cond);
+	bench.elements = g_hash_table_new_full (g_str_hash, g_str_equal, NULL, (GDestroyNotify) photobench_element_free);
+	bench.order = g_ptr_array_new ();
+	bench.pass_times = g_array_new (FALSE, FALSE, sizeof (gdouble));
+	summary = g_string_new (NULL);
+
+	// icc, masks and qr code as bits, all off first
+	for (variant = 0; variant < 8 && ok; variant++)
+		ok = photobench_run_variant (&bench, base, variant & 4, variant & 2, variant & 1, images, save_dir, summary);
+
+	g_print ("\n%-32s %-28s %10s\n%s", "configuration", "photo", "pass", summary->str);
+
+	// remove the saved photos
+	{
+		GDir *dir = g_dir_open (save_dir, 0, NULL);
+		const gchar *name;
+		while (dir && (name = g_dir_read_name (dir)))
+		{
+			gchar *path = g_build_filename (save_dir, name, NULL);
+			g_unlink (path);
+			g_free (path);
+		}
+		if (dir)
+			g_dir_close (dir);
+		g_rmdir (save_dir);
+	}
+
+	g_string_free (summary, TRUE);
+	g_array_free (bench.pass_times, TRUE);
+	g_ptr_array_free (bench.order, TRUE);
+	g_hash_table_destroy (bench.elements);
+	g_cond_clear (&bench.cond);
+	g_mutex_clear (&bench.lock);
+	g_ptr_array_free (images, TRUE);
+	g_key_file_free (base);
+	g_free (save_dir);
+	return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,603 @@
+/*
+ * GStreamer photoboothprintqueue.c
+ * Copyright 2019 Andreas Frisch <fraxinas@schaffenburg.org>
+ *
+ * This program is licensed under the Creative Commons
+ * Attribution-NonCommercial-ShareAlike 3.0 Unported
+ * License. To view a copy of this license, visit
+ * http://creativecommons.org/licenses/by-nc-sa/3.0/ or send a letter to
+ * Creative Commons,559 Nathan Abbott Way,Stanford,California 94305,USA.
+ *
+ * This program is NOT free software. It is open source, you are allowed
+ * to modify it (if you keep the license), but it may not be commercially
+ * distributed other than under the conditions noted above.
+ */
+
+#include "photobooth.h"
+#include "photoboothmemory.h"
+#include "photoboothmetrics.h"
+#include "photoboothprintqueue.h"
+
+#define PT_PER_IN 72
+/* until the first job on a printer has finished */
+#define DEFAULT_SECONDS_PER_COPY 30.0
+/* weight of the latest job in the learnt time per copy */
+#define SECONDS_PER_COPY_ALPHA 0.3
+
+G_DEFINE_TYPE (PhotoBoothPrintQueue, photo_booth_print_queue, G_TYPE_OBJECT);
+
+GST_DEBUG_CATEGORY_STATIC (photo_booth_print_queue_debug);
+#define GST_CAT_DEFAULT photo_booth_print_queue_debug
+
+static void photo_booth_print_queue_dispose (GObject *object);
+static void photo_booth_print_queue_schedule (PhotoBoothPrintQueue *queue);
+static void photo_booth_printer_free (PhotoBoothPrinter *printer);
+
+static void photo_booth_print_queue_class_init (PhotoBoothPrintQueueClass *klass)
+{
+	GObjectClass *gobject_class = G_OBJECT_CLASS (klass);
+
+	GST_DEBUG_CATEGORY_INIT (photo_booth_print_queue_debug, "photoboothprintqueue", GST_DEBUG_BOLD | GST_DEBUG_FG_WHITE | GST_DEBUG_BG_GREEN, "PhotoBoothPrintQueue");
+
+	gobject_class->dispose = photo_booth_print_queue_dispose;
+}
+
+static void photo_booth_print_queue_init (PhotoBoothPrintQueue *queue)
+{
+	queue->pending = g_queue_new ();
+	queue->printers = g_ptr_array_new_with_free_func ((GDestroyNotify) photo_booth_printer_free);
+	queue->settings = NULL;
+	queue->parent_window = NULL;
+	queue->width = queue->height = 0;
+	queue->dpi = PT_PER_IN;
+	queue->x_offset = queue->y_offset = 0;
+	queue->next_id = 1;
+	queue->submit_id = 0;
+	queue->timeout = 0;
+	queue->started_func = queue->done_func = NULL;
+	queue->user_data = NULL;
+}
+
+static void photo_booth_print_job_free (PhotoBoothPrintJob *job)
+{
+	photo_booth_memory_untrack (photo_booth_memory_get_default (), job);
+	gst_buffer_unref (job->buffer);
+	g_clear_error (&job->error);
+	g_hash_table_destroy (job->tried);
+	photo_booth_trace_release (photo_booth_trace_get_default (), job->session);
+	g_free (job);
+}
+
+/* lets go of the printer's operation, whatever has been spooled already is left to cups */
+static void photo_booth_printer_release (PhotoBoothPrinter *printer)
+{
+	if (printer->timeout_id)
+		g_source_remove (printer->timeout_id);
+	printer->timeout_id = 0;
+	if (!printer->operation)
+		return;
+	g_signal_handlers_disconnect_by_data (printer->operation, printer);
+	photo_booth_memory_untrack (photo_booth_memory_get_default (), printer->operation);
+	g_clear_object (&printer->operation);
+}
+
+static void photo_booth_printer_free (PhotoBoothPrinter *printer)
+{
+	photo_booth_printer_release (printer);
+	if (printer->withdraw_id)
+		g_source_remove (printer->withdraw_id);
+	if (printer->active)
+		photo_booth_print_job_free (printer->active);
+	g_clear_object (&printer->settings);
+	g_free (printer->name);
+	g_free (printer->cups_printer);
+	g_free (printer->labels);
+	g_free (printer);
+}
+
+static void photo_booth_print_queue_depth_changed (PhotoBoothPrintQueue *queue)
+{
+	photo_booth_metrics_gauge_set (photo_booth_metrics_get_default (), "photobooth_print_queue_depth", NULL, photo_booth_print_queue_get_depth (queue));
+}
+
+static void photo_booth_print_queue_dispose (GObject *object)
+{
+	PhotoBoothPrintQueue *queue = PHOTO_BOOTH_PRINT_QUEUE (object);
+	if (queue->submit_id)
+		g_source_remove (queue->submit_id);
+	queue->submit_id = 0;
+	g_clear_pointer (&queue->printers, g_ptr_array_unref);
+	if (queue->pending)
+	{
+		if (!g_queue_is_empty (queue->pending))
+			GST_WARNING_OBJECT (queue, "dropping %u unprinted jobs", g_queue_get_length (queue->pending));
+		g_queue_free_full (queue->pending, (GDestroyNotify) photo_booth_print_job_free);
+		queue->pending = NULL;
+	}
+	g_clear_object (&queue->settings);
+	G_OBJECT_CLASS (photo_booth_print_queue_parent_class)->dispose (object);
+}
+
+PhotoBoothPrintQueue *photo_booth_print_queue_new (void)
+{
+	return g_object_new (PHOTO_BOOTH_PRINT_QUEUE_TYPE, NULL);
+}
+
+/* the size of the rendered prints in pixels, their resolution and where they go on the paper */
+void photo_booth_print_queue_set_layout (PhotoBoothPrintQueue *queue, gint width, gint height, gint dpi, gdouble x_offset, gdouble y_offset)
+{
+	queue->width = width;
+	queue->height = height;
+	queue->dpi = dpi;
+	queue->x_offset = x_offset;
+	queue->y_offset = y_offset;
+}
+
+/* the settings every printer starts out with, each with its own cups printer if it has one */
+void photo_booth_print_queue_set_settings (PhotoBoothPrintQueue *queue, GtkPrintSettings *settings)
+{
+	guint i;
+	g_clear_object (&queue->settings);
+	if (settings)
+		queue->settings = g_object_ref (settings);
+	for (i = 0; i < queue->printers->len; i++)
+		g_clear_object (&((PhotoBoothPrinter *) g_ptr_array_index (queue->printers, i))->settings);
+}
+
+/* the window the print dialog is shown over */
+void photo_booth_print_queue_set_parent (PhotoBoothPrintQueue *queue, GtkWindow *parent)
+{
+	queue->parent_window = parent;
+}
+
+void photo_booth_print_queue_set_callbacks (PhotoBoothPrintQueue *queue, PhotoBoothPrintJobFunc started, PhotoBoothPrintJobFunc done, gpointer user_data)
+{
+	queue->started_func = started;
+	queue->done_func = done;
+	queue->user_data = user_data;
+}
+
+/* a job that hasn't finished after seconds_per_copy per copy is tried on another printer, 0 waits forever */
+void photo_booth_print_queue_set_timeout (PhotoBoothPrintQueue *queue, gint seconds_per_copy)
+{
+	queue->timeout = MAX (seconds_per_copy, 0);
+}
+
+PhotoBoothPrinter *photo_booth_print_queue_add_printer (PhotoBoothPrintQueue *queue, const gchar *name, const gchar *cups_printer, gdouble seconds_per_copy)
+{
+	PhotoBoothPrinter *printer = g_new0 (PhotoBoothPrinter, 1);
+	printer->queue = queue;
+	printer->name = g_strdup (name);
+	printer->cups_printer = cups_printer && *cups_printer ? g_strdup (cups_printer) : NULL;
+	printer->online = TRUE;
+	printer->remain = -1;
+	printer->seconds_per_copy = seconds_per_copy > 0 ? seconds_per_copy : DEFAULT_SECONDS_PER_COPY;
+	printer->labels = g_strdup_printf ("printer=\"%s\"", name ? name : "default");
+	g_ptr_array_add (queue->printers, printer);
+	GST_INFO_OBJECT (queue, "added printer %s (cups printer %s), %.0f s per copy", name, printer->cups_printer, printer->seconds_per_copy);
+	return printer;
+}
+
+/* in the order they were added. a queue without printers gets one that prints wherever the settings say */
+GPtrArray *photo_booth_print_queue_get_printers (PhotoBoothPrintQueue *queue)
+{
+	if (!queue->printers->len)
+		photo_booth_print_queue_add_printer (queue, NULL, NULL, 0);
+	return queue->printers;
+}
+
+/* the jobs waiting plus the ones at the printers */
+guint photo_booth_print_queue_get_depth (PhotoBoothPrintQueue *queue)
+{
+	guint i, depth = g_queue_get_length (queue->pending);
+	for (i = 0; i < queue->printers->len; i++)
+		if (((PhotoBoothPrinter *) g_ptr_array_index (queue->printers, i))->active)
+			depth++;
+	return depth;
+}
+
+static void photo_booth_print_queue_begin_print (GtkPrintOperation *operation, G_GNUC_UNUSED GtkPrintContext *context, PhotoBoothPrinter *printer)
+{
+	GST_INFO_OBJECT (printer->queue, "begin print job %u on %s, %i copies", printer->active->id, printer->name, printer->active->copies);
+	// the time a guest spent in the print dialog isn't the printer's
+	printer->active->started = g_get_monotonic_time ();
+	gtk_print_operation_set_n_pages (operation, printer->active->copies);
+}
+
+static void photo_booth_print_queue_draw_page (G_GNUC_UNUSED GtkPrintOperation *operation, GtkPrintContext *context, int page_nr, PhotoBoothPrinter *printer)
+{
+	PhotoBoothPrintQueue *queue = printer->queue;
+	PhotoBoothPrintJob *job = printer->active;
+	GstMapInfo map;
+
+	GST_DEBUG_OBJECT (context, "draw_page no. %i of job %u . %" GST_PTR_FORMAT " size %dx%d, %i dpi, offsets (%.2f, %.2f)", page_nr, job->id, job->buffer, queue->width, queue->height, queue->dpi, queue->x_offset, queue->y_offset);
+
+	if (!gst_buffer_map (job->buffer, &map, GST_MAP_READ))
+	{
+		GST_ERROR_OBJECT (queue, "can't map the buffer of print job %u", job->id);
+		return;
+	}
+
+	int stride = cairo_format_stride_for_width (CAIRO_FORMAT_RGB24, queue->width);
+	cairo_surface_t *cairosurface = cairo_image_surface_create_for_data (map.data, CAIRO_FORMAT_RGB24, queue->width, queue->height, stride);
+	cairo_t *cr = gtk_print_context_get_cairo_context (context);
+	cairo_matrix_t m;
+	cairo_get_matrix(cr, &m);
+
+	float scale = (float) PT_PER_IN / (float) queue->dpi;
+	cairo_scale(cr, scale, scale);
+	cairo_set_source_surface(cr, cairosurface, queue->x_offset, queue->y_offset);
+	cairo_paint(cr);
+	cairo_set_matrix(cr, &m);
+	cairo_surface_destroy (cairosurface);
+
+	gst_buffer_unmap (job->buffer, &map);
+}
+
+static void photo_booth_print_queue_job_done (PhotoBoothPrintQueue *queue, PhotoBoothPrintJob *job)
+{
+	if (queue->done_func)
+		queue->done_func (queue, job, queue->user_data);
+	photo_booth_print_job_free (job);
+}
+
+/* the printer's job is done with, for better or worse. a failed job is put back at the front of the
+ * queue for the printers it hasn't failed on yet, unless the print dialog was cancelled */
+static void photo_booth_printer_finish (PhotoBoothPrinter *printer)
+{
+	PhotoBoothPrintQueue *queue = printer->queue;
+	PhotoBoothPrintJob *job = printer->active;
+	PhotoBoothTrace *trace = photo_booth_trace_get_default ();
+	gint64 elapsed = g_get_monotonic_time () - job->started;
+	guint i;
+
+	photo_booth_printer_release (printer);
+	printer->active = NULL;
+
+	if (job->printed)
+	{
+		GST_INFO_OBJECT (queue, "print job %u done on %s, %i copies in %.1f s after %.1f s in the queue", job->id, printer->name, job->copies,
+			elapsed / (gdouble) G_USEC_PER_SEC, (job->started - job->queued) / (gdouble) G_USEC_PER_SEC);
+		printer->seconds_per_copy += SECONDS_PER_COPY_ALPHA * (elapsed / (gdouble) G_USEC_PER_SEC / MAX (job->copies, 1) - printer->seconds_per_copy);
+		if (printer->remain > 0)
+			printer->remain = MAX (printer->remain - job->copies, 0);
+		photo_booth_metrics_gauge_set (photo_booth_metrics_get_default (), "photobooth_printer_seconds_per_copy", printer->labels, printer->seconds_per_copy);
+		photo_booth_metrics_counter_add (photo_booth_metrics_get_default (), "photobooth_printer_copies_total", printer->labels, job->copies);
+		photo_booth_trace_session_mark (trace, job->session, "print_done");
+		photo_booth_print_queue_job_done (queue, job);
+	}
+	else
+	{
+		gboolean retry = FALSE;
+		GST_WARNING_OBJECT (queue, "print job %u failed on %s with result %i: %s", job->id, printer->name, job->result, job->error ? job->error->message : "no error");
+		photo_booth_metrics_counter_add (photo_booth_metrics_get_default (), "photobooth_printer_failures_total", printer->labels, 1);
+		if (job->spooled)
+			GST_WARNING_OBJECT (queue, "print job %u may still come out of %s, it isn't tried on the others", job->id, printer->name);
+		if (job->result != GTK_PRINT_OPERATION_RESULT_CANCEL)
+		{
+			// the printer is left alone until its status says it's back, one without a backend can't tell
+			if (printer->name)
+				printer->online = FALSE;
+			g_hash_table_add (job->tried, printer);
+			for (i = 0; i < queue->printers->len && !retry && !job->spooled; i++)
+				retry = !g_hash_table_contains (job->tried, g_ptr_array_index (queue->printers, i));
+		}
+		if (retry)
+		{
+			GST_INFO_OBJECT (queue, "print job %u goes to another printer", job->id);
+			photo_booth_trace_session_mark (trace, job->session, "print_retry");
+			job->result = GTK_PRINT_OPERATION_RESULT_IN_PROGRESS;
+			job->started = 0;
+			g_clear_error (&job->error);
+			g_queue_push_head (queue->pending, job);
+		}
+		else
+		{
+			photo_booth_trace_session_mark (trace, job->session, "print_failed");
+			photo_booth_print_queue_job_done (queue, job);
+		}
+	}
+	photo_booth_print_queue_depth_changed (queue);
+	photo_booth_print_queue_schedule (queue);
+}
+
+/* with status tracking the job may still be in the printer's queue after it has been spooled */
+static void photo_booth_print_queue_status_changed (GtkPrintOperation *operation, PhotoBoothPrinter *printer)
+{
+	GtkPrintStatus status = gtk_print_operation_get_status (operation);
+	GST_DEBUG_OBJECT (printer->queue, "print job %u on %s status %i: %s", printer->active->id, printer->name, status, gtk_print_operation_get_status_string (operation));
+	if (printer->active->result != GTK_PRINT_OPERATION_RESULT_APPLY || !gtk_print_operation_is_finished (operation))
+		return;
+	printer->active->printed = status == GTK_PRINT_STATUS_FINISHED;
+	printer->active->spooled = FALSE;
+	photo_booth_printer_finish (printer);
+}
+
+static void photo_booth_print_queue_done (GtkPrintOperation *operation, GtkPrintOperationResult result, PhotoBoothPrinter *printer)
+{
+	PhotoBoothPrintJob *job = printer->active;
+
+	job->result = result;
+	if (result == GTK_PRINT_OPERATION_RESULT_ERROR)
+		gtk_print_operation_get_error (operation, &job->error);
+	else if (result == GTK_PRINT_OPERATION_RESULT_APPLY)
+	{
+		// keeps whatever printer was picked in the dialog for the following jobs
+		g_clear_object (&printer->settings);
+		printer->settings = g_object_ref (gtk_print_operation_get_print_settings (operation));
+	}
+	else if (result == GTK_PRINT_OPERATION_RESULT_CANCEL)
+	{
+		// asks again next time
+		g_clear_object (&printer->settings);
+	}
+	GST_DEBUG_OBJECT (printer->queue, "print job %u spooled to %s with result %i", job->id, printer->name, result);
+
+	if (result == GTK_PRINT_OPERATION_RESULT_APPLY && !gtk_print_operation_is_finished (operation))
+	{
+		job->spooled = TRUE;
+		return;
+	}
+	job->printed = result == GTK_PRINT_OPERATION_RESULT_APPLY && gtk_print_operation_get_status (operation) != GTK_PRINT_STATUS_FINISHED_ABORTED;
+	photo_booth_printer_finish (printer);
+}
+
+static void photo_booth_printer_withdrawn (GPid pid, gint status, PhotoBoothPrinter *printer)
+{
+	PhotoBoothPrintJob *job = printer->active;
+	g_spawn_close_pid (pid);
+	printer->withdraw_id = 0;
+	if (status == 0)
+	{
+		GST_INFO_OBJECT (printer->queue, "withdrew print job %u from %s", job->id, printer->cups_printer);
+		job->spooled = FALSE;
+	}
+	else
+		GST_ERROR_OBJECT (printer->queue, "cancel -a %s failed with status %i, print job %u stays there", printer->cups_printer, status, job->id);
+	photo_booth_printer_finish (printer);
+}
+
+/* gtk can't take back a job it has handed to cups and doesn't tell its id, so everything waiting
+ * for the printer's cups printer is cancelled. the queue has one job on it at a time. the printer
+ * keeps the job until cancel has exited, without blocking the main loop on cups meanwhile */
+static gboolean photo_booth_printer_withdraw (PhotoBoothPrinter *printer)
+{
+	gchar *argv[] = { "cancel", "-a", printer->cups_printer, NULL };
+	GError *error = NULL;
+	GPid pid;
+
+	if (!printer->cups_printer)
+		return FALSE;
+	if (!g_spawn_async (NULL, argv, NULL, G_SPAWN_SEARCH_PATH | G_SPAWN_DO_NOT_REAP_CHILD | G_SPAWN_STDOUT_TO_DEV_NULL, NULL, NULL, &pid, &error))
+	{
+		GST_ERROR_OBJECT (printer->queue, "can't spawn %s to withdraw the jobs on %s (%s)", argv[0], printer->cups_printer, error->message);
+		g_error_free (error);
+		return FALSE;
+	}
+	printer->withdraw_id = g_child_watch_add (pid, (GChildWatchFunc) photo_booth_printer_withdrawn, printer);
+	return TRUE;
+}
+
+/* gives up on the printer's job, it goes to the next printer. a job that has been spooled only
+ * goes once it has been withdrawn from the cups printer, it would come out twice otherwise */
+static void photo_booth_printer_abandon (PhotoBoothPrinter *printer, const gchar *reason)
+{
+	PhotoBoothPrintJob *job = printer->active;
+	GST_WARNING_OBJECT (printer->queue, "abandoning print job %u on %s: %s", job->id, printer->name, reason);
+	g_signal_handlers_disconnect_by_data (printer->operation, printer);
+	gtk_print_operation_cancel (printer->operation);
+	job->printed = FALSE;
+	job->result = GTK_PRINT_OPERATION_RESULT_ERROR;
+	g_clear_error (&job->error);
+	job->error = g_error_new (G_IO_ERROR, G_IO_ERROR_TIMED_OUT, "print job %u on %s: %s", job->id, printer->name, reason);
+	// without its operation and timeout neither can abandon it again while cancel runs
+	photo_booth_printer_release (printer);
+	if (job->spooled && photo_booth_printer_withdraw (printer))
+		return;
+	photo_booth_printer_finish (printer);
+}
+
+static gboolean photo_booth_printer_timedout (PhotoBoothPrinter *printer)
+{
+	printer->timeout_id = 0;
+	photo_booth_printer_abandon (printer, "not done in time");
+	return G_SOURCE_REMOVE;
+}
+
+static void photo_booth_printer_submit (PhotoBoothPrinter *printer, PhotoBoothPrintJob *job)
+{
+	PhotoBoothPrintQueue *queue = printer->queue;
+	GtkPrintOperation *printop;
+	GtkPrintOperationResult res;
+	GtkPrintOperationAction action;
+	GtkPageSetup *page_setup;
+	GtkPaperSize *paper_size;
+	GError *print_error = NULL;
+
+	printer->active = job;
+	job->printer = printer;
+	job->started = g_get_monotonic_time ();
+	photo_booth_metrics_observe (photo_booth_metrics_get_default (), "photobooth_print_queue_wait_seconds", NULL, (gdouble) (job->started - job->queued) / G_USEC_PER_SEC);
+	photo_booth_trace_session_mark (photo_booth_trace_get_default (), job->session, "print_started");
+
+	printop = gtk_print_operation_new ();
+	printer->operation = printop;
+	photo_booth_memory_track_object (photo_booth_memory_get_default (), MEMORY_PRINT, printop, 0);
+
+	// a cups printer is enough to print without the dialog, [print_settings] or not
+	if (!printer->settings && (queue->settings || printer->cups_printer))
+	{
+		printer->settings = queue->settings ? gtk_print_settings_copy (queue->settings) : gtk_print_settings_new ();
+		if (printer->cups_printer)
+			gtk_print_settings_set_printer (printer->settings, printer->cups_printer);
+	}
+	if (printer->settings)
+	{
+		gtk_print_operation_set_print_settings (printop, printer->settings);
+		action = GTK_PRINT_OPERATION_ACTION_PRINT;
+	}
+	else
+		action = GTK_PRINT_OPERATION_ACTION_PRINT_DIALOG;
+
+	gtk_print_operation_set_allow_async (printop, TRUE);
+	gtk_print_operation_set_track_print_status (printop, TRUE);
+	g_signal_connect (printop, "begin_print", G_CALLBACK (photo_booth_print_queue_begin_print), printer);
+	g_signal_connect (printop, "draw_page", G_CALLBACK (photo_booth_print_queue_draw_page), printer);
+	g_signal_connect (printop, "done", G_CALLBACK (photo_booth_print_queue_done), printer);
+	g_signal_connect (printop, "status-changed", G_CALLBACK (photo_booth_print_queue_status_changed), printer);
+
+	page_setup = gtk_page_setup_new();
+	paper_size = gtk_paper_size_new_custom("custom", "custom", PT_PER_IN*4.0, PT_PER_IN*6.0, GTK_UNIT_POINTS);
+	gtk_page_setup_set_orientation (page_setup, GTK_PAGE_ORIENTATION_LANDSCAPE);
+
+	gtk_page_setup_set_paper_size (page_setup, paper_size);
+	gtk_print_operation_set_default_page_setup (printop, page_setup);
+	gtk_paper_size_free (paper_size);
+	g_object_unref (page_setup);
+	gtk_print_operation_set_use_full_page (printop, TRUE);
+	gtk_print_operation_set_unit (printop, GTK_UNIT_POINTS);
+
+	// the dialog may take as long as it takes
+	if (queue->timeout && action == GTK_PRINT_OPERATION_ACTION_PRINT)
+		printer->timeout_id = g_timeout_add_seconds (queue->timeout * MAX (job->copies, 1), (GSourceFunc) photo_booth_printer_timedout, printer);
+
+	GST_INFO_OBJECT (queue, "submitting print job %u to %s, %i copies, %u more waiting", job->id, printer->name, job->copies, g_queue_get_length (queue->pending));
+	if (queue->started_func)
+		queue->started_func (queue, job, queue->user_data);
+
+	// the operation may be finished already (e.g. cancelled in the dialog) when run returns
+	g_object_ref (printop);
+	res = gtk_print_operation_run (printop, action, queue->parent_window, &print_error);
+	if (printer->operation == printop && (res == GTK_PRINT_OPERATION_RESULT_ERROR || res == GTK_PRINT_OPERATION_RESULT_CANCEL))
+	{
+		job->result = res;
+		job->error = print_error;
+		print_error = NULL;
+		if (res == GTK_PRINT_OPERATION_RESULT_CANCEL)
+			g_clear_object (&printer->settings);
+		photo_booth_printer_finish (printer);
+	}
+	g_clear_error (&print_error);
+	g_object_unref (printop);
+}
+
+/* monotonic time the printer is expected to have job done by */
+static gint64 photo_booth_printer_expected_done (PhotoBoothPrinter *printer, PhotoBoothPrintJob *job, gint64 now)
+{
+	gint64 free_at = now;
+	if (printer->active)
+		free_at = MAX (now, printer->active->started + (gint64) (printer->active->copies * printer->seconds_per_copy * G_USEC_PER_SEC));
+	return free_at + (gint64) (job->copies * printer->seconds_per_copy * G_USEC_PER_SEC);
+}
+
+/* without settings or a cups printer of its own the printer's next job brings up the print dialog */
+static gboolean photo_booth_printer_needs_dialog (PhotoBoothPrinter *printer)
+{
+	return !printer->settings && !printer->queue->settings && !printer->cups_printer;
+}
+
+static gboolean photo_booth_print_queue_dialog_open (PhotoBoothPrintQueue *queue)
+{
+	GPtrArray *printers = photo_booth_print_queue_get_printers (queue);
+	guint i;
+	for (i = 0; i < printers->len; i++)
+	{
+		PhotoBoothPrinter *printer = g_ptr_array_index (printers, i);
+		if (printer->active && photo_booth_printer_needs_dialog (printer))
+			return TRUE;
+	}
+	return FALSE;
+}
+
+static gboolean photo_booth_printer_can_take (PhotoBoothPrinter *printer, PhotoBoothPrintJob *job)
+{
+	return printer->online && (printer->remain < 0 || printer->remain >= job->copies) && !g_hash_table_contains (job->tried, printer);
+}
+
+/* the job at the front goes to the printer that will have it done first. if that one is still busy
+ * the job waits for it, if none can take it right now (off-line or out of media) it waits for a status */
+static gboolean photo_booth_print_queue_dispatch (PhotoBoothPrintQueue *queue)
+{
+	GPtrArray *printers = photo_booth_print_queue_get_printers (queue);
+	PhotoBoothPrintJob *job;
+
+	queue->submit_id = 0;
+	while ((job = g_queue_peek_head (queue->pending)))
+	{
+		PhotoBoothPrinter *best = NULL;
+		gint64 now = g_get_monotonic_time (), best_done = G_MAXINT64;
+		gboolean dialog_open = photo_booth_print_queue_dialog_open (queue);
+		guint i;
+
+		for (i = 0; i < printers->len; i++)
+		{
+			PhotoBoothPrinter *printer = g_ptr_array_index (printers, i);
+			gint64 done;
+			if (!photo_booth_printer_can_take (printer, job))
+				continue;
+			// one print dialog at a time, the next one comes up when the guest is done with it
+			if (dialog_open && photo_booth_printer_needs_dialog (printer))
+				continue;
+			done = photo_booth_printer_expected_done (printer, job, now);
+			if (done < best_done)
+			{
+				best = printer;
+				best_done = done;
+			}
+		}
+		if (!best)
+		{
+			GST_DEBUG_OBJECT (queue, "no printer can take print job %u right now", job->id);
+			break;
+		}
+		if (best->active)
+		{
+			GST_DEBUG_OBJECT (queue, "print job %u waits for %s, expected to be done in %.0f s", job->id, best->name, (best_done - now) / (gdouble) G_USEC_PER_SEC);
+			break;
+		}
+		g_queue_pop_head (queue->pending);
+		photo_booth_printer_submit (best, job);
+	}
+	return G_SOURCE_REMOVE;
+}
+
+static void photo_booth_print_queue_schedule (PhotoBoothPrintQueue *queue)
+{
+	if (!queue->submit_id && !g_queue_is_empty (queue->pending))
+		queue->submit_id = g_idle_add ((GSourceFunc) photo_booth_print_queue_dispatch, queue);
+}
+
+/* what the printer's backend reported last. a printer going off-line hands its job to the others */
+void photo_booth_print_queue_set_status (PhotoBoothPrintQueue *queue, PhotoBoothPrinter *printer, gboolean online, gint remain)
+{
+	GST_DEBUG_OBJECT (queue, "printer %s %s, %i prints remaining", printer->name, online ? "online" : "off-line", remain);
+	printer->online = online;
+	printer->remain = remain;
+	photo_booth_metrics_gauge_set (photo_booth_metrics_get_default (), "photobooth_printer_online", printer->labels, online);
+	if (!online && printer->active && printer->operation)
+		photo_booth_printer_abandon (printer, "printer went off-line");
+	photo_booth_print_queue_schedule (queue);
+}
+
+/* takes a reference to buffer and returns right away, the job is held in the guest's trace until it is printed */
+guint photo_booth_print_queue_enqueue (PhotoBoothPrintQueue *queue, GstBuffer *buffer, gint copies)
+{
+	PhotoBoothPrintJob *job = g_new0 (PhotoBoothPrintJob, 1);
+	PhotoBoothTrace *trace = photo_booth_trace_get_default ();
+
+	job->id = queue->next_id++;
+	job->buffer = gst_buffer_ref (buffer);
+	job->copies = copies;
+	job->queued = g_get_monotonic_time ();
+	job->result = GTK_PRINT_OPERATION_RESULT_IN_PROGRESS;
+	job->tried = g_hash_table_new (NULL, NULL);
+	job->session = photo_booth_trace_hold (trace);
+	photo_booth_trace_session_mark (trace, job->session, "print_queued");
+	photo_booth_memory_track (photo_booth_memory_get_default (), MEMORY_PRINT, job, gst_buffer_get_size (buffer));
+
+	g_queue_push_tail (queue->pending, job);
+	GST_INFO_OBJECT (queue, "queued print job %u with %i copies, %u in the queue", job->id, copies, photo_booth_print_queue_get_depth (queue));
+	photo_booth_print_queue_depth_changed (queue);
+	photo_booth_print_queue_schedule (queue);
+	return job->id;
+}
@@ -0,0 +1,117 @@
+/*
+ * GStreamer photoboothprintqueue.h
+ * Copyright 2019 Andreas Frisch <fraxinas@schaffenburg.org>
+ *
+ * This program is licensed under the Creative Commons
+ * Attribution-NonCommercial-ShareAlike 3.0 Unported
+ * License. To view a copy of this license, visit
+ * http://creativecommons.org/licenses/by-nc-sa/3.0/ or send a letter to
+ * Creative Commons,559 Nathan Abbott Way,Stanford,California 94305,USA.
+ *
+ * This program is NOT free software. It is open source, you are allowed
+ * to modify it (if you keep the license), but it may not be commercially
+ * distributed other than under the conditions noted above.
+ */
+
+#ifndef __PHOTO_BOOTH_PRINT_QUEUE_H__
+#define __PHOTO_BOOTH_PRINT_QUEUE_H__
+
+#include <glib-object.h>
+#include <glib.h>
+#include <gtk/gtk.h>
+#include <gst/gst.h>
+#include "photoboothtrace.h"
+
+G_BEGIN_DECLS
+
+#define PHOTO_BOOTH_PRINT_QUEUE_TYPE                (photo_booth_print_queue_get_type ())
+#define PHOTO_BOOTH_PRINT_QUEUE(obj)                (G_TYPE_CHECK_INSTANCE_CAST ((obj),PHOTO_BOOTH_PRINT_QUEUE_TYPE,PhotoBoothPrintQueue))
+#define PHOTO_BOOTH_PRINT_QUEUE_CLASS(klass)        (G_TYPE_CHECK_CLASS_CAST ((klass), PHOTO_BOOTH_PRINT_QUEUE_TYPE,PhotoBoothPrintQueueClass))
+#define IS_PHOTO_BOOTH_PRINT_QUEUE(obj)             (G_TYPE_CHECK_INSTANCE_TYPE ((obj),PHOTO_BOOTH_PRINT_QUEUE_TYPE))
+#define IS_PHOTO_BOOTH_PRINT_QUEUE_CLASS(klass)     (G_TYPE_CHECK_CLASS_TYPE ((klass), PHOTO_BOOTH_PRINT_QUEUE_TYPE))
+
+typedef struct _PhotoBoothPrintQueue              PhotoBoothPrintQueue;
+typedef struct _PhotoBoothPrintQueueClass         PhotoBoothPrintQueueClass;
+
+typedef struct _PhotoBoothPrinter                 PhotoBoothPrinter;
+
+typedef struct
+{
+	guint id;
+	GstBuffer *buffer;                   // the rendered print, owned by the job
+	gint copies;
+	gint64 queued, started;              // monotonic, started is 0 while the job waits and restarts when printing begins after the dialog
+	GtkPrintOperationResult result;
+	gboolean printed;                    // the printer reported the job as finished
+	gboolean spooled;                    // handed to cups and not finished there, it may still be printed
+	GError *error;
+	PhotoBoothPrinter *printer;          // the printer it was (last) sent to
+	GHashTable *tried;                   // printers it has failed on
+	PhotoBoothTraceSession *session;     // the guest's trace, held until the job is done
+} PhotoBoothPrintJob;
+
+struct _PhotoBoothPrinter
+{
+	PhotoBoothPrintQueue *queue;
+	gchar *name;                         // the gutenprint backend, NULL for a printer that is only known to gtk
+	gchar *cups_printer;                 // overrides the printer of the print settings
+	GtkPrintSettings *settings;
+	gboolean online;
+	gint remain;                         // media left, -1 while unknown
+	gdouble seconds_per_copy;            // expected, learnt from the finished jobs
+	PhotoBoothPrintJob *active;
+	GtkPrintOperation *operation;
+	guint timeout_id;
+	guint withdraw_id;                   // child watch of the cancel taking the abandoned job back from cups
+	gchar *labels;                       // printer="name" for the metrics
+};
+
+/* called from the main loop when a job is handed to the printer and when it is done with */
+typedef void (*PhotoBoothPrintJobFunc) (PhotoBoothPrintQueue *queue, PhotoBoothPrintJob *job, gpointer user_data);
+
+struct _PhotoBoothPrintQueue
+{
+	GObject parent;
+	GQueue *pending;
+	GPtrArray *printers;
+	GtkPrintSettings *settings;
+	GtkWindow *parent_window;
+	gint width, height, dpi;
+	gdouble x_offset, y_offset;
+	guint next_id;
+	guint submit_id;
+	gint timeout;                        // seconds per copy until a job is given up on its printer
+	PhotoBoothPrintJobFunc started_func, done_func;
+	gpointer user_data;
+};
+
+struct _PhotoBoothPrintQueueClass
+{
+	GObjectClass parent_class;
+};
+
+/* owns the rendered prints from the moment the guest presses print and hands them to its printers, one
+ * job per printer at a time, so the booth can go on with the next guest while the copies come out.
+ * each job goes to the printer that is expected to have it done first. a job that fails, stalls or whose
+ * printer goes off-line is tried again on the other printers. once spooled that needs its cups printer,
+ * whose waiting jobs are all cancelled, without one the job stays where it is and counts as failed
+ * even if it comes out when the printer is back. without any printers added the queue prints
+ * to whatever the print settings say. main loop only. a printer with a cups printer prints to it with
+ * the print settings or GTK's defaults. without either the first job on every printer brings up the
+ * print dialog, one dialog at a time */
+GType                  photo_booth_print_queue_get_type       (void);
+PhotoBoothPrintQueue  *photo_booth_print_queue_new            (void);
+void                   photo_booth_print_queue_set_layout     (PhotoBoothPrintQueue *queue, gint width, gint height, gint dpi, gdouble x_offset, gdouble y_offset);
+void                   photo_booth_print_queue_set_settings   (PhotoBoothPrintQueue *queue, GtkPrintSettings *settings);
+void                   photo_booth_print_queue_set_parent     (PhotoBoothPrintQueue *queue, GtkWindow *parent);
+void                   photo_booth_print_queue_set_callbacks  (PhotoBoothPrintQueue *queue, PhotoBoothPrintJobFunc started, PhotoBoothPrintJobFunc done, gpointer user_data);
+void                   photo_booth_print_queue_set_timeout    (PhotoBoothPrintQueue *queue, gint seconds_per_copy);
+PhotoBoothPrinter     *photo_booth_print_queue_add_printer    (PhotoBoothPrintQueue *queue, const gchar *name, const gchar *cups_printer, gdouble seconds_per_copy);
+GPtrArray             *photo_booth_print_queue_get_printers   (PhotoBoothPrintQueue *queue);
+void                   photo_booth_print_queue_set_status     (PhotoBoothPrintQueue *queue, PhotoBoothPrinter *printer, gboolean online, gint remain);
+guint                  photo_booth_print_queue_enqueue        (PhotoBoothPrintQueue *queue, GstBuffer *buffer, gint copies);
+guint                  photo_booth_print_queue_get_depth      (PhotoBoothPrintQueue *queue);
+
+G_END_DECLS
+
+#endif /* __PHOTO_BOOTH_PRINT_QUEUE_H__ */
@@ -0,0 +1,587 @@
+/*
+ * GStreamer photoboothpublish.c
+ * Copyright 2019 Andreas Frisch <fraxinas@schaffenburg.org>
+ *
+ * This program is licensed under the Creative Commons
+ * Attribution-NonCommercial-ShareAlike 3.0 Unported
+ * License. To view a copy of this license, visit
+ * http://creativecommons.org/licenses/by-nc-sa/3.0/ or send a letter to
+ * Creative Commons,559 Nathan Abbott Way,Stanford,California 94305,USA.
+ *
+ * This program is NOT free software. It is open source, you are allowed
+ * to modify it (if you keep the license), but it may not be commercially
+ * distributed other than under the conditions noted above.
+ */
+
+#include <string.h>
+#include "photobooth.h"
+#include "photoboothpublish.h"
+#include "photoboothmetrics.h"
+
+#define IMGUR_UPLOAD_URI "https://api.imgur.com/3/upload"
+#define PUBLISH_USER_AGENT "Schaffenburg Photobooth"
+#define PUBLISH_PROGRESS_INTERVAL (50 * G_TIME_SPAN_MILLISECOND)
+#define THROTTLE_MAX_PAUSE (100 * G_TIME_SPAN_MILLISECOND)
+
+GST_DEBUG_CATEGORY_STATIC (photo_booth_publish_debug);
+#define GST_CAT_DEFAULT photo_booth_publish_debug
+
+/* one photo being published to all targets at once */
+typedef struct
+{
+	PhotoBoothPublisher *pub;
+	gchar *filename;
+	GMutex lock;
+	GCond cond;
+	guint pending;
+	guint published;
+	gint64 *totals, *currents;
+	gint64 last_progress;
+} PublishJob;
+
+typedef struct
+{
+	PublishJob *job;
+	guint index;
+	PhotoBoothUploadThrottle throttle;
+} PublishTask;
+
+typedef struct
+{
+	CURL *curl;
+	GThreadPool *pool;
+} PhotoBoothPublishTargetPrivate;
+
+typedef struct
+{
+	GPtrArray *targets;
+	PhotoBoothPublishProgressFunc progress_func;
+	gpointer progress_data;
+	PhotoBoothUploadLimitFunc limit_func;
+	gpointer limit_data;
+	gint cancelled;
+} PhotoBoothPublisherPrivate;
+
+G_DEFINE_ABSTRACT_TYPE_WITH_PRIVATE (PhotoBoothPublishTarget, photo_booth_publish_target, G_TYPE_OBJECT);
+G_DEFINE_TYPE_WITH_PRIVATE (PhotoBoothPublisher, photo_booth_publisher, G_TYPE_OBJECT);
+
+static void photo_booth_publish_target_run (PublishTask *task, PhotoBoothPublishTarget *target);
+static void photo_booth_publish_target_account (PhotoBoothPublishTarget *target, gboolean ok, gdouble seconds);
+
+/* PhotoBoothPublishTarget base class, every target owns one curl handle so the connection is kept alive
+ * between photos and a worker thread that serializes the target's requests */
+
+static void
+photo_booth_publish_target_finalize (GObject *object)
+{
+	PhotoBoothPublishTarget *target = PHOTO_BOOTH_PUBLISH_TARGET (object);
+	PhotoBoothPublishTargetPrivate *priv = photo_booth_publish_target_get_instance_private (target);
+	GST_DEBUG_OBJECT (target, "finalize %s", target->name);
+	g_thread_pool_free (priv->pool, FALSE, TRUE);
+	if (priv->curl)
+		curl_easy_cleanup (priv->curl);
+	g_free (target->name);
+	G_OBJECT_CLASS (photo_booth_publish_target_parent_class)->finalize (object);
+}
+
+static void
+photo_booth_publish_target_class_init (PhotoBoothPublishTargetClass *klass)
+{
+	GST_DEBUG_CATEGORY_INIT (photo_booth_publish_debug, "photoboothpublish", GST_DEBUG_BOLD | GST_DEBUG_FG_WHITE | GST_DEBUG_BG_MAGENTA, "PhotoBoothPublish");
+	G_OBJECT_CLASS (klass)->finalize = photo_booth_publish_target_finalize;
+	klass->prepare = NULL;
+	klass->parse_link = NULL;
+}
+
+static void
+photo_booth_publish_target_init (PhotoBoothPublishTarget *target)
+{
+	PhotoBoothPublishTargetPrivate *priv = photo_booth_publish_target_get_instance_private (target);
+	target->name = NULL;
+	priv->curl = NULL;
+	priv->pool = g_thread_pool_new ((GFunc) photo_booth_publish_target_run, target, 1, FALSE, NULL);
+}
+
+static size_t _publish_write_func (void *ptr, size_t size, size_t nmemb, void *buf)
+{
+	g_string_append_len ((GString *) buf, ptr, size * nmemb);
+	return size * nmemb;
+}
+
+static int _publish_progress (void *user_data, G_GNUC_UNUSED curl_off_t dltotal, G_GNUC_UNUSED curl_off_t dlnow, curl_off_t ultotal, curl_off_t ulnow)
+{
+	PublishTask *task = (PublishTask *) user_data;
+	PublishJob *job = task->job;
+	PhotoBoothPublisherPrivate *ppriv = photo_booth_publisher_get_instance_private (job->pub);
+	gint64 now = g_get_monotonic_time ();
+	gint64 total = 0, current = 0;
+	gboolean notify = FALSE;
+	guint i;
+
+	if (g_atomic_int_get (&ppriv->cancelled))
+		return -1;
+	photo_booth_upload_throttle_update (&task->throttle, ulnow);
+	if (ultotal <= 0)
+		return CURLE_OK;
+
+	g_mutex_lock (&job->lock);
+	job->totals[task->index] = ultotal;
+	job->currents[task->index] = ulnow;
+	if (now - job->last_progress >= PUBLISH_PROGRESS_INTERVAL)
+	{
+		for (i = 0; i < ppriv->targets->len; i++)
+		{
+			total += job->totals[i];
+			current += job->currents[i];
+		}
+		job->last_progress = now;
+		notify = TRUE;
+	}
+	g_mutex_unlock (&job->lock);
+
+	if (notify && ppriv->progress_func)
+		ppriv->progress_func (total, current, ppriv->progress_data);
+	return CURLE_OK;
+}
+
+static void
+photo_booth_publish_target_run (PublishTask *task, PhotoBoothPublishTarget *target)
+{
+	PhotoBoothPublishTargetPrivate *priv = photo_booth_publish_target_get_instance_private (target);
+	PhotoBoothPublishTargetClass *klass = PHOTO_BOOTH_PUBLISH_TARGET_GET_CLASS (target);
+	PublishJob *job = task->job;
+	struct curl_httppost *post = NULL;
+	struct curl_slist *headers = NULL;
+	GString *buf = g_string_new ("");
+	gboolean ok = FALSE;
+	gint64 start = g_get_monotonic_time ();
+	long http_code = 0;
+	CURLcode res;
+
+	if (!priv->curl)
+		priv->curl = curl_easy_init ();
+	else
+		curl_easy_reset (priv->curl); // keeps the connection cache, so the next POST reuses the open connection
+	if (!priv->curl)
+	{
+		GST_WARNING_OBJECT (target, "%s: couldn't initialize curl", target->name);
+		goto out;
+	}
+
+	curl_easy_setopt (priv->curl, CURLOPT_USERAGENT, PUBLISH_USER_AGENT);
+	curl_easy_setopt (priv->curl, CURLOPT_TCP_KEEPALIVE, 1L);
+	if (!klass->prepare (target, priv->curl, job->filename, &post, &headers))
+		goto out;
+	curl_easy_setopt (priv->curl, CURLOPT_HTTPPOST, post);
+	if (headers)
+		curl_easy_setopt (priv->curl, CURLOPT_HTTPHEADER, headers);
+	curl_easy_setopt (priv->curl, CURLOPT_WRITEFUNCTION, _publish_write_func);
+	curl_easy_setopt (priv->curl, CURLOPT_WRITEDATA, buf);
+	curl_easy_setopt (priv->curl, CURLOPT_CONNECTTIMEOUT, 5L);
+	curl_easy_setopt (priv->curl, CURLOPT_XFERINFOFUNCTION, _publish_progress);
+	curl_easy_setopt (priv->curl, CURLOPT_XFERINFODATA, task);
+	curl_easy_setopt (priv->curl, CURLOPT_NOPROGRESS, 0L);
+	photo_booth_upload_throttle_start (&task->throttle, priv->curl);
+
+	res = curl_easy_perform (priv->curl);
+	curl_easy_getinfo (priv->curl, CURLINFO_RESPONSE_CODE, &http_code);
+	if (res != CURLE_OK)
+		GST_WARNING_OBJECT (target, "%s: posting '%s' failed: %s", target->name, job->filename, curl_easy_strerror (res));
+	else if (http_code >= 300)
+		GST_WARNING_OBJECT (target, "%s: posting '%s' failed with HTTP %ld: '%s'", target->name, job->filename, http_code, buf->str);
+	else
+	{
+		gchar *link = klass->parse_link ? klass->parse_link (target, buf->str) : NULL;
+		GST_INFO_OBJECT (target, "%s: published '%s' in %.2f s %s%s", target->name, job->filename,
+			(gdouble) (g_get_monotonic_time () - start) / G_USEC_PER_SEC, link ? "as " : "", link ? link : "");
+		g_free (link);
+		ok = TRUE;
+	}
+
+out:
+	photo_booth_publish_target_account (target, ok, (gdouble) (g_get_monotonic_time () - start) / G_USEC_PER_SEC);
+	curl_formfree (post);
+	curl_slist_free_all (headers);
+	g_string_free (buf, TRUE);
+	g_free (task);
+
+	g_mutex_lock (&job->lock);
+	if (ok)
+		job->published++;
+	job->pending--;
+	g_cond_signal (&job->cond);
+	g_mutex_unlock (&job->lock);
+}
+
+static void
+photo_booth_publish_target_account (PhotoBoothPublishTarget *target, gboolean ok, gdouble seconds)
+{
+	PhotoBoothMetrics *metrics = photo_booth_metrics_get_default ();
+	gchar *labels = g_strdup_printf ("target=\"%s\"", target->name);
+	gdouble attempts, successes;
+
+	photo_booth_metrics_counter_add (metrics, "photobooth_publish_attempts_total", labels, 1);
+	if (ok)
+		photo_booth_metrics_counter_add (metrics, "photobooth_publish_success_total", labels, 1);
+	attempts = photo_booth_metrics_get_value (metrics, "photobooth_publish_attempts_total", labels);
+	successes = photo_booth_metrics_get_value (metrics, "photobooth_publish_success_total", labels);
+	photo_booth_metrics_gauge_set (metrics, "photobooth_publish_success_ratio", labels, successes / attempts);
+	photo_booth_metrics_observe (metrics, "photobooth_publish_latency_seconds", labels, seconds);
+	GST_DEBUG_OBJECT (target, "%s: success rate %.0f/%.0f, latency p50 %.2f s p95 %.2f s", target->name, successes, attempts,
+		photo_booth_metrics_quantile (metrics, "photobooth_publish_latency_seconds", labels, 0.5),
+		photo_booth_metrics_quantile (metrics, "photobooth_publish_latency_seconds", labels, 0.95));
+	g_free (labels);
+}
+
+static struct curl_httppost *
+photo_booth_publish_target_image_form (const gchar *filename, struct curl_httppost **last)
+{
+	struct curl_httppost *post = NULL;
+	curl_formadd (&post, last, CURLFORM_COPYNAME, "image", CURLFORM_FILE, filename, CURLFORM_CONTENTTYPE, "image/jpeg", CURLFORM_END);
+	return post;
+}
+
+/* imgur: POST to the upload API into an album, the response carries the public link */
+
+typedef struct
+{
+	PhotoBoothPublishTarget parent;
+	gchar *upload_uri, *access_token, *album_id, *description;
+} PhotoBoothPublishImgur;
+
+typedef struct
+{
+	PhotoBoothPublishTargetClass parent_class;
+} PhotoBoothPublishImgurClass;
+
+static GType photo_booth_publish_imgur_get_type (void);
+G_DEFINE_TYPE (PhotoBoothPublishImgur, photo_booth_publish_imgur, TYPE_PHOTO_BOOTH_PUBLISH_TARGET);
+
+static gboolean
+photo_booth_publish_imgur_prepare (PhotoBoothPublishTarget *target, CURL *curl, const gchar *filename, struct curl_httppost **post, struct curl_slist **headers)
+{
+	PhotoBoothPublishImgur *imgur = (PhotoBoothPublishImgur *) target;
+	struct curl_httppost *last = NULL;
+	gchar *auth_header;
+
+	*post = photo_booth_publish_target_image_form (filename, &last);
+	curl_formadd (post, &last, CURLFORM_COPYNAME, "album", CURLFORM_COPYCONTENTS, imgur->album_id, CURLFORM_END);
+	if (imgur->description)
+		curl_formadd (post, &last, CURLFORM_COPYNAME, "description", CURLFORM_COPYCONTENTS, imgur->description, CURLFORM_END);
+	auth_header = g_strdup_printf ("Authorization: Bearer %s", imgur->access_token);
+	*headers = curl_slist_append (*headers, auth_header);
+	g_free (auth_header);
+	curl_easy_setopt (curl, CURLOPT_URL, imgur->upload_uri);
+	GST_INFO_OBJECT (target, "imgur posting '%s' to album http://imgur.com/a/%s ...", filename, imgur->album_id);
+	return TRUE;
+}
+
+static gchar *
+photo_booth_publish_imgur_parse_link (PhotoBoothPublishTarget *target, const gchar *response)
+{
+	JsonParser *parser;
+	JsonReader *reader;
+	GError *error = NULL;
+	gchar *link = NULL;
+
+	parser = json_parser_new ();
+	if (!json_parser_load_from_data (parser, response, -1, &error))
+	{
+		GST_WARNING_OBJECT (target, "unable to parse imgur response '%s': %s", response, error->message);
+		g_error_free (error);
+		g_object_unref (parser);
+		return NULL;
+	}
+	reader = json_reader_new (json_parser_get_root (parser));
+	if (json_reader_read_member (reader, "data") && json_reader_read_member (reader, "link"))
+		link = g_strdup (json_reader_get_string_value (reader));
+	else
+		GST_WARNING_OBJECT (target, "imgur response without data.link: '%s'", response);
+	g_object_unref (reader);
+	g_object_unref (parser);
+	return link;
+}
+
+static void
+photo_booth_publish_imgur_finalize (GObject *object)
+{
+	PhotoBoothPublishImgur *imgur = (PhotoBoothPublishImgur *) object;
+	g_free (imgur->upload_uri);
+	g_free (imgur->access_token);
+	g_free (imgur->album_id);
+	g_free (imgur->description);
+	G_OBJECT_CLASS (photo_booth_publish_imgur_parent_class)->finalize (object);
+}
+
+static void
+photo_booth_publish_imgur_class_init (PhotoBoothPublishImgurClass *klass)
+{
+	G_OBJECT_CLASS (klass)->finalize = photo_booth_publish_imgur_finalize;
+	PHOTO_BOOTH_PUBLISH_TARGET_CLASS (klass)->prepare = photo_booth_publish_imgur_prepare;
+	PHOTO_BOOTH_PUBLISH_TARGET_CLASS (klass)->parse_link = photo_booth_publish_imgur_parse_link;
+}
+
+static void
+photo_booth_publish_imgur_init (PhotoBoothPublishImgur *imgur)
+{
+	imgur->upload_uri = imgur->access_token = imgur->album_id = imgur->description = NULL;
+}
+
+PhotoBoothPublishTarget *
+photo_booth_publish_target_imgur_new (const gchar *upload_uri, const gchar *access_token, const gchar *album_id, const gchar *description)
+{
+	PhotoBoothPublishImgur *imgur = g_object_new (photo_booth_publish_imgur_get_type (), NULL);
+	imgur->parent.name = g_strdup ("imgur");
+	imgur->upload_uri = g_strdup (upload_uri ? upload_uri : IMGUR_UPLOAD_URI);
+	imgur->access_token = g_strdup (access_token);
+	imgur->album_id = g_strdup (album_id);
+	imgur->description = g_strdup (description);
+	return PHOTO_BOOTH_PUBLISH_TARGET (imgur);
+}
+
+/* facebook and webhook: plain multipart POST of the image to a configured uri */
+
+typedef struct
+{
+	PhotoBoothPublishTarget parent;
+	gchar *uri;
+} PhotoBoothPublishForm;
+
+typedef struct
+{
+	PhotoBoothPublishTargetClass parent_class;
+} PhotoBoothPublishFormClass;
+
+static GType photo_booth_publish_form_get_type (void);
+G_DEFINE_TYPE (PhotoBoothPublishForm, photo_booth_publish_form, TYPE_PHOTO_BOOTH_PUBLISH_TARGET);
+
+static gboolean
+photo_booth_publish_form_prepare (PhotoBoothPublishTarget *target, CURL *curl, const gchar *filename, struct curl_httppost **post, G_GNUC_UNUSED struct curl_slist **headers)
+{
+	PhotoBoothPublishForm *form = (PhotoBoothPublishForm *) target;
+	struct curl_httppost *last = NULL;
+	gchar *basename;
+
+	*post = photo_booth_publish_target_image_form (filename, &last);
+	basename = g_path_get_basename (filename);
+	curl_formadd (post, &last, CURLFORM_COPYNAME, "filename", CURLFORM_COPYCONTENTS, basename, CURLFORM_END);
+	g_free (basename);
+	curl_easy_setopt (curl, CURLOPT_URL, form->uri);
+	GST_INFO_OBJECT (target, "%s posting '%s' to '%s'...", target->name, filename, form->uri);
+	return TRUE;
+}
+
+static gchar *
+photo_booth_publish_form_parse_link (G_GNUC_UNUSED PhotoBoothPublishTarget *target, const gchar *response)
+{
+	gchar *link = g_strstrip (g_strdup (response));
+	if (!g_str_has_prefix (link, "http"))
+	{
+		g_free (link);
+		return NULL;
+	}
+	return link;
+}
+
+static void
+photo_booth_publish_form_finalize (GObject *object)
+{
+	PhotoBoothPublishForm *form = (PhotoBoothPublishForm *) object;
+	g_free (form->uri);
+	G_OBJECT_CLASS (photo_booth_publish_form_parent_class)->finalize (object);
+}
+
+static void
+photo_booth_publish_form_class_init (PhotoBoothPublishFormClass *klass)
+{
+	G_OBJECT_CLASS (klass)->finalize = photo_booth_publish_form_finalize;
+	PHOTO_BOOTH_PUBLISH_TARGET_CLASS (klass)->prepare = photo_booth_publish_form_prepare;
+	PHOTO_BOOTH_PUBLISH_TARGET_CLASS (klass)->parse_link = photo_booth_publish_form_parse_link;
+}
+
+static void
+photo_booth_publish_form_init (PhotoBoothPublishForm *form)
+{
+	form->uri = NULL;
+}
+
+static PhotoBoothPublishTarget *
+photo_booth_publish_form_new (const gchar *name, const gchar *uri)
+{
+	PhotoBoothPublishForm *form = g_object_new (photo_booth_publish_form_get_type (), NULL);
+	form->parent.name = g_strdup (name);
+	form->uri = g_strdup (uri);
+	return PHOTO_BOOTH_PUBLISH_TARGET (form);
+}
+
+PhotoBoothPublishTarget *
+photo_booth_publish_target_facebook_new (const gchar *put_uri)
+{
+	return photo_booth_publish_form_new ("facebook", put_uri);
+}
+
+PhotoBoothPublishTarget *
+photo_booth_publish_target_webhook_new (const gchar *uri)
+{
+	return photo_booth_publish_form_new ("webhook", uri);
+}
+
+/* PhotoBoothPublisher: fans one photo out to all targets and waits for them */
+
+static void
+photo_booth_publisher_finalize (GObject *object)
+{
+	PhotoBoothPublisher *pub = PHOTO_BOOTH_PUBLISHER (object);
+	PhotoBoothPublisherPrivate *priv = photo_booth_publisher_get_instance_private (pub);
+	GST_DEBUG_OBJECT (pub, "finalize");
+	g_ptr_array_free (priv->targets, TRUE);
+	G_OBJECT_CLASS (photo_booth_publisher_parent_class)->finalize (object);
+}
+
+static void
+photo_booth_publisher_class_init (PhotoBoothPublisherClass *klass)
+{
+	GST_DEBUG_CATEGORY_INIT (photo_booth_publish_debug, "photoboothpublish", GST_DEBUG_BOLD | GST_DEBUG_FG_WHITE | GST_DEBUG_BG_MAGENTA, "PhotoBoothPublish");
+	G_OBJECT_CLASS (klass)->finalize = photo_booth_publisher_finalize;
+}
+
+static void
+photo_booth_publisher_init (PhotoBoothPublisher *pub)
+{
+	PhotoBoothPublisherPrivate *priv = photo_booth_publisher_get_instance_private (pub);
+	priv->targets = g_ptr_array_new_with_free_func (g_object_unref);
+	priv->progress_func = NULL;
+	priv->progress_data = NULL;
+	priv->limit_func = NULL;
+	priv->limit_data = NULL;
+	priv->cancelled = FALSE;
+}
+
+PhotoBoothPublisher *
+photo_booth_publisher_new (void)
+{
+	return g_object_new (TYPE_PHOTO_BOOTH_PUBLISHER, NULL);
+}
+
+void
+photo_booth_publisher_add_target (PhotoBoothPublisher *pub, PhotoBoothPublishTarget *target)
+{
+	PhotoBoothPublisherPrivate *priv = photo_booth_publisher_get_instance_private (pub);
+	GST_INFO_OBJECT (pub, "added publish target %s", target->name);
+	g_ptr_array_add (priv->targets, target);
+}
+
+guint
+photo_booth_publisher_get_n_targets (PhotoBoothPublisher *pub)
+{
+	PhotoBoothPublisherPrivate *priv = photo_booth_publisher_get_instance_private (pub);
+	return priv->targets->len;
+}
+
+void
+photo_booth_publisher_set_progress_func (PhotoBoothPublisher *pub, PhotoBoothPublishProgressFunc func, gpointer user_data)
+{
+	PhotoBoothPublisherPrivate *priv = photo_booth_publisher_get_instance_private (pub);
+	priv->progress_func = func;
+	priv->progress_data = user_data;
+}
+
+void
+photo_booth_publisher_set_limit_func (PhotoBoothPublisher *pub, PhotoBoothUploadLimitFunc func, gpointer user_data)
+{
+	PhotoBoothPublisherPrivate *priv = photo_booth_publisher_get_instance_private (pub);
+	priv->limit_func = func;
+	priv->limit_data = user_data;
+}
+
+guint
+photo_booth_publisher_publish (PhotoBoothPublisher *pub, const gchar *filename)
+{
+	PhotoBoothPublisherPrivate *priv = photo_booth_publisher_get_instance_private (pub);
+	PublishJob job;
+	guint i;
+
+	if (priv->targets->len == 0)
+		return 0;
+
+	g_atomic_int_set (&priv->cancelled, FALSE);
+	job.pub = pub;
+	job.filename = g_strdup (filename);
+	g_mutex_init (&job.lock);
+	g_cond_init (&job.cond);
+	job.pending = priv->targets->len;
+	job.published = 0;
+	job.totals = g_new0 (gint64, priv->targets->len);
+	job.currents = g_new0 (gint64, priv->targets->len);
+	job.last_progress = 0;
+
+	GST_DEBUG_OBJECT (pub, "publishing '%s' to %u targets", filename, priv->targets->len);
+	for (i = 0; i < priv->targets->len; i++)
+	{
+		PhotoBoothPublishTarget *target = g_ptr_array_index (priv->targets, i);
+		PhotoBoothPublishTargetPrivate *tpriv = photo_booth_publish_target_get_instance_private (target);
+		PublishTask *task = g_new0 (PublishTask, 1);
+		task->job = &job;
+		task->index = i;
+		task->throttle.limit_func = priv->limit_func;
+		task->throttle.limit_data = priv->limit_data;
+		g_thread_pool_push (tpriv->pool, task, NULL);
+	}
+
+	g_mutex_lock (&job.lock);
+	while (job.pending)
+		g_cond_wait (&job.cond, &job.lock);
+	g_mutex_unlock (&job.lock);
+
+	GST_INFO_OBJECT (pub, "published '%s' to %u of %u targets", filename, job.published, priv->targets->len);
+	g_mutex_clear (&job.lock);
+	g_cond_clear (&job.cond);
+	g_free (job.totals);
+	g_free (job.currents);
+	g_free (job.filename);
+	return job.published;
+}
+
+void
+photo_booth_publisher_cancel (PhotoBoothPublisher *pub)
+{
+	PhotoBoothPublisherPrivate *priv = photo_booth_publisher_get_instance_private (pub);
+	g_atomic_int_set (&priv->cancelled, TRUE);
+}
+
+void
+photo_booth_upload_throttle_start (PhotoBoothUploadThrottle *throttle, CURL *curl)
+{
+	throttle->applied = throttle->limit_func ? throttle->limit_func (throttle->limit_data) : 0;
+	throttle->limit = throttle->applied;
+	throttle->since = g_get_monotonic_time ();
+	throttle->since_bytes = 0;
+	curl_easy_setopt (curl, CURLOPT_MAX_SEND_SPEED_LARGE, throttle->applied);
+	GST_LOG ("upload starts limited to %" G_GINT64_FORMAT " bytes/s", (gint64) throttle->applied);
+}
+
+void
+photo_booth_upload_throttle_update (PhotoBoothUploadThrottle *throttle, curl_off_t ulnow)
+{
+	curl_off_t limit;
+	gint64 now, due;
+
+	if (!throttle->limit_func)
+		return;
+	limit = throttle->limit_func (throttle->limit_data);
+	now = g_get_monotonic_time ();
+	if (limit != throttle->limit)
+	{
+		GST_DEBUG ("upload limit changed %" G_GINT64_FORMAT " -> %" G_GINT64_FORMAT " bytes/s at %" G_GINT64_FORMAT " bytes",
+			(gint64) throttle->limit, (gint64) limit, (gint64) ulnow);
+		throttle->limit = limit;
+		throttle->since = now;
+		throttle->since_bytes = ulnow;
+	}
+	// curl already keeps the transfer under the limit it was started with, a looser one has to wait for the next transfer
+	if (!limit || (throttle->applied && limit >= throttle->applied))
+		return;
+	due = throttle->since + (ulnow - throttle->since_bytes) * G_USEC_PER_SEC / limit;
+	if (due > now)
+		g_usleep (MIN (due - now, THROTTLE_MAX_PAUSE));
+}
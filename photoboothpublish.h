@@ -0,0 +1,101 @@
+/*
+ * GStreamer photoboothpublish.h
+ * Copyright 2019 Andreas Frisch <fraxinas@schaffenburg.org>
+ *
+ * This program is licensed under the Creative Commons
+ * Attribution-NonCommercial-ShareAlike 3.0 Unported
+ * License. To view a copy of this license, visit
+ * http://creativecommons.org/licenses/by-nc-sa/3.0/ or send a letter to
+ * Creative Commons,559 Nathan Abbott Way,Stanford,California 94305,USA.
+ *
+ * This program is NOT free software. It is open source, you are allowed
+ * to modify it (if you keep the license), but it may not be commercially
+ * distributed other than under the conditions noted above.
+ */
+
+#ifndef __PHOTO_BOOTH_PUBLISH_H__
+#define __PHOTO_BOOTH_PUBLISH_H__
+
+#include <glib-object.h>
+#include <glib.h>
+#include <curl/curl.h>
+
+G_BEGIN_DECLS
+
+#define TYPE_PHOTO_BOOTH_PUBLISH_TARGET                (photo_booth_publish_target_get_type ())
+#define PHOTO_BOOTH_PUBLISH_TARGET(obj)                (G_TYPE_CHECK_INSTANCE_CAST ((obj),TYPE_PHOTO_BOOTH_PUBLISH_TARGET,PhotoBoothPublishTarget))
+#define PHOTO_BOOTH_PUBLISH_TARGET_CLASS(klass)        (G_TYPE_CHECK_CLASS_CAST ((klass), TYPE_PHOTO_BOOTH_PUBLISH_TARGET,PhotoBoothPublishTargetClass))
+#define PHOTO_BOOTH_PUBLISH_TARGET_GET_CLASS(obj)      (G_TYPE_INSTANCE_GET_CLASS ((obj),TYPE_PHOTO_BOOTH_PUBLISH_TARGET,PhotoBoothPublishTargetClass))
+#define IS_PHOTO_BOOTH_PUBLISH_TARGET(obj)             (G_TYPE_CHECK_INSTANCE_TYPE ((obj),TYPE_PHOTO_BOOTH_PUBLISH_TARGET))
+
+#define TYPE_PHOTO_BOOTH_PUBLISHER                     (photo_booth_publisher_get_type ())
+#define PHOTO_BOOTH_PUBLISHER(obj)                     (G_TYPE_CHECK_INSTANCE_CAST ((obj),TYPE_PHOTO_BOOTH_PUBLISHER,PhotoBoothPublisher))
+#define IS_PHOTO_BOOTH_PUBLISHER(obj)                  (G_TYPE_CHECK_INSTANCE_TYPE ((obj),TYPE_PHOTO_BOOTH_PUBLISHER))
+
+typedef struct _PhotoBoothPublishTarget              PhotoBoothPublishTarget;
+typedef struct _PhotoBoothPublishTargetClass         PhotoBoothPublishTargetClass;
+typedef struct _PhotoBoothPublisher                  PhotoBoothPublisher;
+typedef struct _PhotoBoothPublisherClass             PhotoBoothPublisherClass;
+
+typedef void (*PhotoBoothPublishProgressFunc) (gint64 total, gint64 current, gpointer user_data);
+/* returns the upload bandwidth currently allowed in bytes/s, 0 = unlimited */
+typedef curl_off_t (*PhotoBoothUploadLimitFunc) (gpointer user_data);
+
+/* keeps one curl upload within the limit, which may change while the transfer is running.
+ * the limit at transfer start is handed to curl as CURLOPT_MAX_SEND_SPEED_LARGE, a stricter
+ * one coming up mid-transfer is enforced by pausing in the progress callback */
+typedef struct
+{
+	PhotoBoothUploadLimitFunc limit_func;
+	gpointer limit_data;
+	curl_off_t applied, limit;
+	gint64 since;
+	curl_off_t since_bytes;
+} PhotoBoothUploadThrottle;
+
+struct _PhotoBoothPublishTarget
+{
+	GObject parent;
+	gchar *name;
+};
+
+struct _PhotoBoothPublishTargetClass
+{
+	GObjectClass parent_class;
+
+	/* sets up url, headers and form for posting filename on the target's persistent curl handle */
+	gboolean (*prepare)    (PhotoBoothPublishTarget *target, CURL *curl, const gchar *filename, struct curl_httppost **post, struct curl_slist **headers);
+	/* extracts the public link from the response, may return NULL */
+	gchar *  (*parse_link) (PhotoBoothPublishTarget *target, const gchar *response);
+};
+
+struct _PhotoBoothPublisher
+{
+	GObject parent;
+};
+
+struct _PhotoBoothPublisherClass
+{
+	GObjectClass parent_class;
+};
+
+GType                    photo_booth_publish_target_get_type      (void);
+PhotoBoothPublishTarget *photo_booth_publish_target_imgur_new     (const gchar *upload_uri, const gchar *access_token, const gchar *album_id, const gchar *description);
+PhotoBoothPublishTarget *photo_booth_publish_target_facebook_new  (const gchar *put_uri);
+PhotoBoothPublishTarget *photo_booth_publish_target_webhook_new   (const gchar *uri);
+
+GType                    photo_booth_publisher_get_type           (void);
+PhotoBoothPublisher     *photo_booth_publisher_new                (void);
+void                     photo_booth_publisher_add_target         (PhotoBoothPublisher *pub, PhotoBoothPublishTarget *target);
+guint                    photo_booth_publisher_get_n_targets      (PhotoBoothPublisher *pub);
+void                     photo_booth_publisher_set_progress_func  (PhotoBoothPublisher *pub, PhotoBoothPublishProgressFunc func, gpointer user_data);
+void                     photo_booth_publisher_set_limit_func     (PhotoBoothPublisher *pub, PhotoBoothUploadLimitFunc func, gpointer user_data);
+guint                    photo_booth_publisher_publish            (PhotoBoothPublisher *pub, const gchar *filename);
+void                     photo_booth_publisher_cancel             (PhotoBoothPublisher *pub);
+
+void                     photo_booth_upload_throttle_start        (PhotoBoothUploadThrottle *throttle, CURL *curl);
+void                     photo_booth_upload_throttle_update       (PhotoBoothUploadThrottle *throttle, curl_off_t ulnow);
+
+G_END_DECLS
+
+#endif /* __PHOTO_BOOTH_PUBLISH_H__ */
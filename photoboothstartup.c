@@ -0,0 +1,362 @@
+/*
+ * GStreamer photoboothstartup.c
+ * Copyright 2019 Andreas Frisch <fraxinas@schaffenburg.org>
+ *
+ * This program is licensed under the Creative Commons
+ * Attribution-NonCommercial-ShareAlike 3.0 Unported
+ * License. To view a copy of this license, visit
+ * http://creativecommons.org/licenses/by-nc-sa/3.0/ or send a letter to
+ * Creative Commons,559 Nathan Abbott Way,Stanford,California 94305,USA.
+ *
+ * This program is NOT free software. It is open source, you are allowed
+ * to modify it (if you keep the license), but it may not be commercially
+ * distributed other than under the conditions noted above.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <json-glib/json-glib.h>
+#include "photobooth.h"
+#include "photoboothmetrics.h"
+#include "photoboothtrace.h"
+#include "photoboothstartup.h"
+
+/* how long after the live view is up the steps still running alongside are waited for before reporting */
+#define STARTUP_REPORT_TIMEOUT 10
+
+typedef struct
+{
+	const gchar *name;
+	gint64 start, end;           // monotonic, end is 0 while the step is running
+	gboolean main;               // ran in the main thread
+} PhotoBoothStartupStep;
+
+typedef struct
+{
+	PhotoBoothStartup *startup;
+	const gchar *step;
+	GThreadFunc func;
+	PhotoBoothStartupDoneFunc done;
+	GDestroyNotify free_result;
+	gpointer user_data;
+	gpointer result;
+} PhotoBoothStartupJob;
+
+G_DEFINE_TYPE (PhotoBoothStartup, photo_booth_startup, G_TYPE_OBJECT);
+
+GST_DEBUG_CATEGORY_STATIC (photo_booth_startup_debug);
+#define GST_CAT_DEFAULT photo_booth_startup_debug
+
+static void photo_booth_startup_finalize (GObject *object);
+static void photo_booth_startup_check_report (PhotoBoothStartup *startup);
+
+static void photo_booth_startup_class_init (PhotoBoothStartupClass *klass)
+{
+	GObjectClass *gobject_class = G_OBJECT_CLASS (klass);
+
+	GST_DEBUG_CATEGORY_INIT (photo_booth_startup_debug, "photoboothstartup", GST_DEBUG_BOLD | GST_DEBUG_FG_BLACK | GST_DEBUG_BG_MAGENTA, "PhotoBoothStartup");
+
+	gobject_class->finalize = photo_booth_startup_finalize;
+}
+
+/* monotonic time the process was started at, the dynamic linker and gst_init count as startup too */
+static gint64 photo_booth_startup_launch_time (void)
+{
+	gint64 now = g_get_monotonic_time ();
+	gchar *stat = NULL, *fields;
+	unsigned long long starttime = 0;
+	struct timespec boottime;
+	gint64 since_launch = -1;
+
+	if (g_file_get_contents ("/proc/self/stat", &stat, NULL, NULL) && (fields = strrchr (stat, ')'))
+	    && sscanf (fields + 2, "%*c %*d %*d %*d %*d %*d %*u %*u %*u %*u %*u %*u %*u %*d %*d %*d %*d %*d %*d %llu", &starttime) == 1
+	    && !clock_gettime (CLOCK_BOOTTIME, &boottime))
+		since_launch = (gint64) boottime.tv_sec * G_USEC_PER_SEC + boottime.tv_nsec / 1000 - (gint64) starttime * G_USEC_PER_SEC / sysconf (_SC_CLK_TCK);
+	g_free (stat);
+	return since_launch >= 0 ? now - since_launch : now;
+}
+
+static void photo_booth_startup_init (PhotoBoothStartup *startup)
+{
+	g_mutex_init (&startup->lock);
+	startup->launch = photo_booth_startup_launch_time ();
+	startup->ready = 0;
+	startup->main_thread = g_thread_self ();
+	startup->steps = g_array_new (FALSE, FALSE, sizeof (PhotoBoothStartupStep));
+	startup->threads = g_ptr_array_new ();
+	startup->cancelled = FALSE;
+	startup->reported = FALSE;
+	startup->report_id = 0;
+	startup->location = NULL;
+}
+
+static void photo_booth_startup_finalize (GObject *object)
+{
+	PhotoBoothStartup *startup = PHOTO_BOOTH_STARTUP (object);
+	photo_booth_startup_cancel (startup);
+	g_array_free (startup->steps, TRUE);
+	g_ptr_array_free (startup->threads, TRUE);
+	g_free (startup->location);
+	g_mutex_clear (&startup->lock);
+	G_OBJECT_CLASS (photo_booth_startup_parent_class)->finalize (object);
+}
+
+/* the first call should be made from main (), its thread is the main thread */
+PhotoBoothStartup *photo_booth_startup_get_default (void)
+{
+	static gsize initialized = 0;
+	static PhotoBoothStartup *startup = NULL;
+	if (g_once_init_enter (&initialized))
+	{
+		startup = g_object_new (PHOTO_BOOTH_STARTUP_TYPE, NULL);
+		g_once_init_leave (&initialized, 1);
+	}
+	return startup;
+}
+
+void photo_booth_startup_set_location (PhotoBoothStartup *startup, const gchar *filename)
+{
+	g_mutex_lock (&startup->lock);
+	g_free (startup->location);
+	startup->location = g_strdup (filename);
+	g_mutex_unlock (&startup->lock);
+}
+
+void photo_booth_startup_begin (PhotoBoothStartup *startup, const gchar *step)
+{
+	PhotoBoothStartupStep s;
+	s.name = step;
+	s.start = g_get_monotonic_time ();
+	s.end = 0;
+	s.main = g_thread_self () == startup->main_thread;
+	g_mutex_lock (&startup->lock);
+	g_array_append_val (startup->steps, s);
+	g_mutex_unlock (&startup->lock);
+	GST_DEBUG_OBJECT (startup, "%s started after %.1f ms", step, (s.start - startup->launch) / 1000.0);
+}
+
+/* a step that ran from start (monotonic) until now, for what happened before there was a startup */
+void photo_booth_startup_add (PhotoBoothStartup *startup, const gchar *step, gint64 start)
+{
+	PhotoBoothStartupStep s;
+	s.name = step;
+	s.start = start;
+	s.end = g_get_monotonic_time ();
+	s.main = g_thread_self () == startup->main_thread;
+	g_mutex_lock (&startup->lock);
+	g_array_append_val (startup->steps, s);
+	g_mutex_unlock (&startup->lock);
+	GST_DEBUG_OBJECT (startup, "%s took %.1f ms", step, (s.end - s.start) / 1000.0);
+}
+
+void photo_booth_startup_end (PhotoBoothStartup *startup, const gchar *step)
+{
+	gint64 now = g_get_monotonic_time ();
+	gint i;
+	g_mutex_lock (&startup->lock);
+	for (i = startup->steps->len - 1; i >= 0; i--)
+	{
+		PhotoBoothStartupStep *s = &g_array_index (startup->steps, PhotoBoothStartupStep, i);
+		if (s->name == step && !s->end)
+		{
+			s->end = now;
+			GST_DEBUG_OBJECT (startup, "%s done in %.1f ms", step, (now - s->start) / 1000.0);
+			break;
+		}
+	}
+	g_mutex_unlock (&startup->lock);
+	if (g_thread_self () == startup->main_thread)
+		photo_booth_startup_check_report (startup);
+}
+
+static gboolean photo_booth_startup_job_done (PhotoBoothStartupJob *job)
+{
+	PhotoBoothStartup *startup = job->startup;
+	gboolean cancelled;
+	g_mutex_lock (&startup->lock);
+	cancelled = startup->cancelled;
+	g_mutex_unlock (&startup->lock);
+	if (!cancelled && job->done)
+		job->done (job->result, job->user_data);
+	else if (job->free_result && job->result)
+		job->free_result (job->result);
+	if (!cancelled)
+		photo_booth_startup_check_report (startup);
+	g_free (job);
+	return G_SOURCE_REMOVE;
+}
+
+static gpointer photo_booth_startup_job_thread (PhotoBoothStartupJob *job)
+{
+	photo_booth_startup_begin (job->startup, job->step);
+	job->result = job->func (job->user_data);
+	photo_booth_startup_end (job->startup, job->step);
+	g_main_context_invoke (NULL, (GSourceFunc) photo_booth_startup_job_done, job);
+	return NULL;
+}
+
+/* runs func (user_data) in a thread of its own and hands its result to done in the main loop.
+ * when the startup is cancelled before, done isn't called and the result is freed with free_result */
+void photo_booth_startup_run (PhotoBoothStartup *startup, const gchar *step, GThreadFunc func, PhotoBoothStartupDoneFunc done, GDestroyNotify free_result, gpointer user_data)
+{
+	PhotoBoothStartupJob *job = g_new0 (PhotoBoothStartupJob, 1);
+	GThread *thread;
+	job->startup = startup;
+	job->step = step;
+	job->func = func;
+	job->done = done;
+	job->free_result = free_result;
+	job->user_data = user_data;
+	thread = g_thread_try_new (step, (GThreadFunc) photo_booth_startup_job_thread, job, NULL);
+	if (!thread)
+	{
+		// do it the old way
+		GST_WARNING_OBJECT (startup, "can't start a thread for %s, running it in place", step);
+		photo_booth_startup_begin (startup, step);
+		job->result = func (user_data);
+		photo_booth_startup_end (startup, step);
+		photo_booth_startup_job_done (job);
+		return;
+	}
+	g_mutex_lock (&startup->lock);
+	g_ptr_array_add (startup->threads, thread);
+	g_mutex_unlock (&startup->lock);
+}
+
+static void photo_booth_startup_write (PhotoBoothStartup *startup, GArray *steps, const gchar *location)
+{
+	JsonBuilder *builder = json_builder_new ();
+	GDateTime *date = g_date_time_new_now_local ();
+	gchar *now;
+	guint i;
+
+	now = g_date_time_format (date, "%FT%T%z");
+	json_builder_begin_object (builder);
+	json_builder_set_member_name (builder, "start");
+	json_builder_add_string_value (builder, now);
+	json_builder_set_member_name (builder, "ready_ms");
+	json_builder_add_double_value (builder, (startup->ready - startup->launch) / 1000.0);
+	json_builder_set_member_name (builder, "steps");
+	json_builder_begin_array (builder);
+	for (i = 0; i < steps->len; i++)
+	{
+		PhotoBoothStartupStep *s = &g_array_index (steps, PhotoBoothStartupStep, i);
+		json_builder_begin_object (builder);
+		json_builder_set_member_name (builder, "step");
+		json_builder_add_string_value (builder, s->name);
+		json_builder_set_member_name (builder, "main");
+		json_builder_add_boolean_value (builder, s->main);
+		json_builder_set_member_name (builder, "start_ms");
+		json_builder_add_double_value (builder, (s->start - startup->launch) / 1000.0);
+		json_builder_set_member_name (builder, "end_ms");
+		if (s->end)
+			json_builder_add_double_value (builder, (s->end - startup->launch) / 1000.0);
+		else
+			json_builder_add_null_value (builder);
+		json_builder_end_object (builder);
+	}
+	json_builder_end_array (builder);
+	json_builder_end_object (builder);
+
+	photo_booth_trace_append_json (startup, location, builder, "the startup trace");
+	g_object_unref (builder);
+	g_free (now);
+	g_date_time_unref (date);
+}
+
+static void photo_booth_startup_report (PhotoBoothStartup *startup)
+{
+	PhotoBoothMetrics *metrics = photo_booth_metrics_get_default ();
+	GArray *steps;
+	gchar *location;
+	guint i;
+
+	g_mutex_lock (&startup->lock);
+	startup->reported = TRUE;
+	steps = g_array_sized_new (FALSE, FALSE, sizeof (PhotoBoothStartupStep), startup->steps->len);
+	g_array_append_vals (steps, startup->steps->data, startup->steps->len);
+	location = g_strdup (startup->location);
+	g_mutex_unlock (&startup->lock);
+	if (startup->report_id)
+		g_source_remove (startup->report_id);
+	startup->report_id = 0;
+
+	GST_INFO_OBJECT (startup, "live view up %.1f ms after launch", (startup->ready - startup->launch) / 1000.0);
+	photo_booth_metrics_gauge_set (metrics, "photobooth_startup_ready_seconds", NULL, (gdouble) (startup->ready - startup->launch) / G_USEC_PER_SEC);
+	for (i = 0; i < steps->len; i++)
+	{
+		PhotoBoothStartupStep *s = &g_array_index (steps, PhotoBoothStartupStep, i);
+		gchar *labels = g_strdup_printf ("step=\"%s\"", s->name);
+		if (s->end)
+		{
+			GST_INFO_OBJECT (startup, "%-12s %s %8.1f ms .. %8.1f ms (%7.1f ms)", s->name, s->main ? "main  " : "thread",
+				(s->start - startup->launch) / 1000.0, (s->end - startup->launch) / 1000.0, (s->end - s->start) / 1000.0);
+			photo_booth_metrics_gauge_set (metrics, "photobooth_startup_step_seconds", labels, (gdouble) (s->end - s->start) / G_USEC_PER_SEC);
+		}
+		else
+			GST_WARNING_OBJECT (startup, "%-12s %s %8.1f ms .. still running", s->name, s->main ? "main  " : "thread", (s->start - startup->launch) / 1000.0);
+		g_free (labels);
+	}
+	if (location)
+		photo_booth_startup_write (startup, steps, location);
+	g_array_free (steps, TRUE);
+	g_free (location);
+}
+
+static gboolean photo_booth_startup_report_timedout (PhotoBoothStartup *startup)
+{
+	startup->report_id = 0;
+	photo_booth_startup_report (startup);
+	return G_SOURCE_REMOVE;
+}
+
+/* main thread only. reports once the live view is up and nothing is running alongside anymore */
+static void photo_booth_startup_check_report (PhotoBoothStartup *startup)
+{
+	gboolean running = FALSE;
+	guint i;
+	g_mutex_lock (&startup->lock);
+	if (!startup->ready || startup->reported)
+	{
+		g_mutex_unlock (&startup->lock);
+		return;
+	}
+	for (i = 0; i < startup->steps->len && !running; i++)
+		running = !g_array_index (startup->steps, PhotoBoothStartupStep, i).end;
+	g_mutex_unlock (&startup->lock);
+	if (!running)
+		photo_booth_startup_report (startup);
+}
+
+/* the live view is on screen, guests can start. later calls are ignored */
+void photo_booth_startup_ready (PhotoBoothStartup *startup)
+{
+	g_mutex_lock (&startup->lock);
+	if (startup->ready)
+	{
+		g_mutex_unlock (&startup->lock);
+		return;
+	}
+	startup->ready = g_get_monotonic_time ();
+	g_mutex_unlock (&startup->lock);
+	startup->report_id = g_timeout_add_seconds (STARTUP_REPORT_TIMEOUT, (GSourceFunc) photo_booth_startup_report_timedout, startup);
+	photo_booth_startup_check_report (startup);
+}
+
+/* waits for the steps' threads, their results are thrown away. the booth calls this before it goes away */
+void photo_booth_startup_cancel (PhotoBoothStartup *startup)
+{
+	GPtrArray *threads;
+	g_mutex_lock (&startup->lock);
+	startup->cancelled = TRUE;
+	threads = startup->threads;
+	startup->threads = g_ptr_array_new ();
+	g_mutex_unlock (&startup->lock);
+	g_ptr_array_foreach (threads, (GFunc) g_thread_join, NULL);
+	g_ptr_array_free (threads, TRUE);
+	if (startup->report_id)
+		g_source_remove (startup->report_id);
+	startup->report_id = 0;
+}
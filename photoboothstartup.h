@@ -0,0 +1,70 @@
+/*
+ * GStreamer photoboothstartup.h
+ * Copyright 2019 Andreas Frisch <fraxinas@schaffenburg.org>
+ *
+ * This program is licensed under the Creative Commons
+ * Attribution-NonCommercial-ShareAlike 3.0 Unported
+ * License. To view a copy of this license, visit
+ * http://creativecommons.org/licenses/by-nc-sa/3.0/ or send a letter to
+ * Creative Commons,559 Nathan Abbott Way,Stanford,California 94305,USA.
+ *
+ * This program is NOT free software. It is open source, you are allowed
+ * to modify it (if you keep the license), but it may not be commercially
+ * distributed other than under the conditions noted above.
+ */
+
+#ifndef __PHOTO_BOOTH_STARTUP_H__
+#define __PHOTO_BOOTH_STARTUP_H__
+
+#include <glib-object.h>
+#include <glib.h>
+
+G_BEGIN_DECLS
+
+#define PHOTO_BOOTH_STARTUP_TYPE                (photo_booth_startup_get_type ())
+#define PHOTO_BOOTH_STARTUP(obj)                (G_TYPE_CHECK_INSTANCE_CAST ((obj),PHOTO_BOOTH_STARTUP_TYPE,PhotoBoothStartup))
+#define PHOTO_BOOTH_STARTUP_CLASS(klass)        (G_TYPE_CHECK_CLASS_CAST ((klass), PHOTO_BOOTH_STARTUP_TYPE,PhotoBoothStartupClass))
+#define IS_PHOTO_BOOTH_STARTUP(obj)             (G_TYPE_CHECK_INSTANCE_TYPE ((obj),PHOTO_BOOTH_STARTUP_TYPE))
+#define IS_PHOTO_BOOTH_STARTUP_CLASS(klass)     (G_TYPE_CHECK_CLASS_TYPE ((klass), PHOTO_BOOTH_STARTUP_TYPE))
+
+typedef struct _PhotoBoothStartup              PhotoBoothStartup;
+typedef struct _PhotoBoothStartupClass         PhotoBoothStartupClass;
+
+/* called in the main loop with whatever the step's thread function returned */
+typedef void (*PhotoBoothStartupDoneFunc) (gpointer result, gpointer user_data);
+
+struct _PhotoBoothStartup
+{
+	GObject parent;
+	GMutex lock;
+	gint64 launch;                   // monotonic time the process started, from its starttime in /proc/self/stat against CLOCK_BOOTTIME
+	gint64 ready;                    // 0 until the live view is up
+	GThread *main_thread;
+	GArray *steps;
+	GPtrArray *threads;
+	gboolean cancelled;
+	gboolean reported;
+	guint report_id;
+	gchar *location;
+};
+
+struct _PhotoBoothStartupClass
+{
+	GObjectClass parent_class;
+};
+
+/* the steps of bringing the booth up, from main () until the live view is on screen and until the last
+ * step that runs alongside it is done. step names are not copied and must be static strings */
+GType               photo_booth_startup_get_type       (void);
+PhotoBoothStartup  *photo_booth_startup_get_default    (void);
+void                photo_booth_startup_set_location   (PhotoBoothStartup *startup, const gchar *filename);
+void                photo_booth_startup_begin          (PhotoBoothStartup *startup, const gchar *step);
+void                photo_booth_startup_end            (PhotoBoothStartup *startup, const gchar *step);
+void                photo_booth_startup_add            (PhotoBoothStartup *startup, const gchar *step, gint64 start);
+void                photo_booth_startup_run            (PhotoBoothStartup *startup, const gchar *step, GThreadFunc func, PhotoBoothStartupDoneFunc done, GDestroyNotify free_result, gpointer user_data);
+void                photo_booth_startup_ready          (PhotoBoothStartup *startup);
+void                photo_booth_startup_cancel         (PhotoBoothStartup *startup);
+
+G_END_DECLS
+
+#endif /* __PHOTO_BOOTH_STARTUP_H__ */
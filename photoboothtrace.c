@@ -0,0 +1,275 @@
+/*
+ * GStreamer photoboothtrace.c
+ * Copyright 2019 Andreas Frisch <fraxinas@schaffenburg.org>
+ *
+ * This program is licensed under the Creative Commons
+ * Attribution-NonCommercial-ShareAlike 3.0 Unported
+ * License. To view a copy of this license, visit
+ * http://creativecommons.org/licenses/by-nc-sa/3.0/ or send a letter to
+ * Creative Commons,559 Nathan Abbott Way,Stanford,California 94305,USA.
+ *
+ * This program is NOT free software. It is open source, you are allowed
+ * to modify it (if you keep the license), but it may not be commercially
+ * distributed other than under the conditions noted above.
+ */
+
+#include <stdio.h>
+#include <errno.h>
+#include <time.h>
+#include <unistd.h>
+#include <glib/gstdio.h>
+#include <json-glib/json-glib.h>
+#include "photobooth.h"
+#include "photoboothtrace.h"
+#include "photoboothmemory.h"
+
+typedef struct
+{
+	gint64 time, cpu_time;
+	glong rss;
+	gboolean is_state;
+	const gchar *name;
+} PhotoBoothTraceEvent;
+
+struct _PhotoBoothTraceSession
+{
+	guint id;
+	gint refcount;
+	gint64 start_time;   // monotonic, all event times are relative to it
+	gint64 start_cpu_time;
+	GDateTime *start_date;
+	GArray *events;
+};
+
+G_DEFINE_TYPE (PhotoBoothTrace, photo_booth_trace, G_TYPE_OBJECT);
+
+GST_DEBUG_CATEGORY_STATIC (photo_booth_trace_debug);
+#define GST_CAT_DEFAULT photo_booth_trace_debug
+
+static void photo_booth_trace_finalize (GObject *object);
+
+static void photo_booth_trace_class_init (PhotoBoothTraceClass *klass)
+{
+	GObjectClass *gobject_class = G_OBJECT_CLASS (klass);
+
+	GST_DEBUG_CATEGORY_INIT (photo_booth_trace_debug, "photoboothtrace", GST_DEBUG_BOLD | GST_DEBUG_FG_BLACK | GST_DEBUG_BG_CYAN, "PhotoBoothTrace");
+
+	gobject_class->finalize = photo_booth_trace_finalize;
+}
+
+static void photo_booth_trace_init (PhotoBoothTrace *trace)
+{
+	g_mutex_init (&trace->lock);
+	trace->location = NULL;
+	trace->n_sessions = 0;
+	trace->current = NULL;
+}
+
+static void photo_booth_trace_finalize (GObject *object)
+{
+	PhotoBoothTrace *trace = PHOTO_BOOTH_TRACE (object);
+	photo_booth_trace_end_session (trace);
+	g_free (trace->location);
+	g_mutex_clear (&trace->lock);
+	G_OBJECT_CLASS (photo_booth_trace_parent_class)->finalize (object);
+}
+
+PhotoBoothTrace *photo_booth_trace_get_default (void)
+{
+	static gsize initialized = 0;
+	static PhotoBoothTrace *trace = NULL;
+	if (g_once_init_enter (&initialized))
+	{
+		trace = g_object_new (PHOTO_BOOTH_TRACE_TYPE, NULL);
+		g_once_init_leave (&initialized, 1);
+	}
+	return trace;
+}
+
+void photo_booth_trace_set_location (PhotoBoothTrace *trace, const gchar *filename)
+{
+	g_mutex_lock (&trace->lock);
+	g_free (trace->location);
+	trace->location = g_strdup (filename);
+	g_mutex_unlock (&trace->lock);
+	GST_INFO_OBJECT (trace, "writing session traces to '%s'", filename ? filename : "(nowhere)");
+}
+
+/* cpu time of all the booth's threads in us */
+static gint64 photo_booth_trace_cpu_time (void)
+{
+	struct timespec ts;
+	if (clock_gettime (CLOCK_PROCESS_CPUTIME_ID, &ts))
+		return 0;
+	return (gint64) ts.tv_sec * G_USEC_PER_SEC + ts.tv_nsec / 1000;
+}
+
+/* call with lock held */
+static void photo_booth_trace_session_add (PhotoBoothTraceSession *session, gboolean is_state, const gchar *name)
+{
+	PhotoBoothTraceEvent event;
+	event.time = g_get_monotonic_time () - session->start_time;
+	event.cpu_time = photo_booth_trace_cpu_time () - session->start_cpu_time;
+	event.rss = photo_booth_memory_rss ();
+	event.is_state = is_state;
+	event.name = name;
+	g_array_append_val (session->events, event);
+}
+
+// appending a single line at a time keeps the file readable while the booth is still running
+gboolean photo_booth_trace_append_json (gpointer owner, const gchar *location, JsonBuilder *builder, const gchar *what)
+{
+	JsonNode *root = json_builder_get_root (builder);
+	JsonGenerator *generator = json_generator_new ();
+	gchar *line;
+	FILE *file;
+
+	json_generator_set_root (generator, root);
+	line = json_generator_to_data (generator, NULL);
+	file = g_fopen (location, "a");
+	if (file)
+	{
+		fprintf (file, "%s\n", line);
+		fclose (file);
+	}
+	else
+		GST_WARNING_OBJECT (owner, "can't append %s to '%s': %s", what, location, g_strerror (errno));
+
+	g_free (line);
+	json_node_unref (root);
+	g_object_unref (generator);
+	return file != NULL;
+}
+
+/* call with lock held */
+static void photo_booth_trace_session_write (PhotoBoothTrace *trace, PhotoBoothTraceSession *session)
+{
+	JsonBuilder *builder = json_builder_new ();
+	gchar *start;
+	guint i;
+
+	start = g_date_time_format (session->start_date, "%FT%T%z");
+	json_builder_begin_object (builder);
+	json_builder_set_member_name (builder, "session");
+	json_builder_add_int_value (builder, session->id);
+	json_builder_set_member_name (builder, "start");
+	json_builder_add_string_value (builder, start);
+	json_builder_set_member_name (builder, "events");
+	json_builder_begin_array (builder);
+	for (i = 0; i < session->events->len; i++)
+	{
+		PhotoBoothTraceEvent *event = &g_array_index (session->events, PhotoBoothTraceEvent, i);
+		json_builder_begin_object (builder);
+		json_builder_set_member_name (builder, "t_ms");
+		json_builder_add_double_value (builder, event->time / 1000.0);
+		json_builder_set_member_name (builder, "cpu_ms");
+		json_builder_add_double_value (builder, event->cpu_time / 1000.0);
+		json_builder_set_member_name (builder, "rss_kb");
+		json_builder_add_int_value (builder, event->rss);
+		json_builder_set_member_name (builder, event->is_state ? "state" : "event");
+		json_builder_add_string_value (builder, event->name);
+		json_builder_end_object (builder);
+	}
+	json_builder_end_array (builder);
+	json_builder_end_object (builder);
+	g_free (start);
+
+	if (photo_booth_trace_append_json (trace, trace->location, builder, "a session"))
+		GST_DEBUG_OBJECT (trace, "session %u with %u events written", session->id, session->events->len);
+	g_object_unref (builder);
+}
+
+/* call with lock held */
+static void photo_booth_trace_session_unref (PhotoBoothTrace *trace, PhotoBoothTraceSession *session)
+{
+	if (--session->refcount > 0)
+		return;
+	if (trace->location)
+		photo_booth_trace_session_write (trace, session);
+	g_date_time_unref (session->start_date);
+	g_array_free (session->events, TRUE);
+	g_free (session);
+}
+
+void photo_booth_trace_begin_session (PhotoBoothTrace *trace)
+{
+	PhotoBoothTraceSession *session;
+	g_mutex_lock (&trace->lock);
+	if (trace->current)
+	{
+		GST_DEBUG_OBJECT (trace, "session %u wasn't ended, ending it now", trace->current->id);
+		photo_booth_trace_session_unref (trace, trace->current);
+		trace->current = NULL;
+	}
+	if (trace->location)
+	{
+		session = g_new0 (PhotoBoothTraceSession, 1);
+		session->id = ++trace->n_sessions;
+		session->refcount = 1;
+		session->start_time = g_get_monotonic_time ();
+		session->start_cpu_time = photo_booth_trace_cpu_time ();
+		session->start_date = g_date_time_new_now_local ();
+		session->events = g_array_new (FALSE, FALSE, sizeof (PhotoBoothTraceEvent));
+		trace->current = session;
+		GST_DEBUG_OBJECT (trace, "session %u begins", session->id);
+	}
+	g_mutex_unlock (&trace->lock);
+}
+
+void photo_booth_trace_end_session (PhotoBoothTrace *trace)
+{
+	g_mutex_lock (&trace->lock);
+	if (trace->current)
+	{
+		GST_DEBUG_OBJECT (trace, "session %u ends (%i holders)", trace->current->id, trace->current->refcount);
+		photo_booth_trace_session_unref (trace, trace->current);
+		trace->current = NULL;
+	}
+	g_mutex_unlock (&trace->lock);
+}
+
+void photo_booth_trace_state (PhotoBoothTrace *trace, const gchar *state)
+{
+	g_mutex_lock (&trace->lock);
+	if (trace->current)
+		photo_booth_trace_session_add (trace->current, TRUE, state);
+	g_mutex_unlock (&trace->lock);
+}
+
+void photo_booth_trace_mark (PhotoBoothTrace *trace, const gchar *event)
+{
+	g_mutex_lock (&trace->lock);
+	if (trace->current)
+		photo_booth_trace_session_add (trace->current, FALSE, event);
+	g_mutex_unlock (&trace->lock);
+}
+
+/* keeps the current session open for work that may outlive it, returns NULL when not tracing */
+PhotoBoothTraceSession *photo_booth_trace_hold (PhotoBoothTrace *trace)
+{
+	PhotoBoothTraceSession *session;
+	g_mutex_lock (&trace->lock);
+	session = trace->current;
+	if (session)
+		session->refcount++;
+	g_mutex_unlock (&trace->lock);
+	return session;
+}
+
+void photo_booth_trace_session_mark (PhotoBoothTrace *trace, PhotoBoothTraceSession *session, const gchar *event)
+{
+	if (!session)
+		return;
+	g_mutex_lock (&trace->lock);
+	photo_booth_trace_session_add (session, FALSE, event);
+	g_mutex_unlock (&trace->lock);
+}
+
+void photo_booth_trace_release (PhotoBoothTrace *trace, PhotoBoothTraceSession *session)
+{
+	if (!session)
+		return;
+	g_mutex_lock (&trace->lock);
+	photo_booth_trace_session_unref (trace, session);
+	g_mutex_unlock (&trace->lock);
+}
@@ -0,0 +1,70 @@
+/*
+ * GStreamer photoboothtrace.h
+ * Copyright 2019 Andreas Frisch <fraxinas@schaffenburg.org>
+ *
+ * This program is licensed under the Creative Commons
+ * Attribution-NonCommercial-ShareAlike 3.0 Unported
+ * License. To view a copy of this license, visit
+ * http://creativecommons.org/licenses/by-nc-sa/3.0/ or send a letter to
+ * Creative Commons,559 Nathan Abbott Way,Stanford,California 94305,USA.
+ *
+ * This program is NOT free software. It is open source, you are allowed
+ * to modify it (if you keep the license), but it may not be commercially
+ * distributed other than under the conditions noted above.
+ */
+
+#ifndef __PHOTO_BOOTH_TRACE_H__
+#define __PHOTO_BOOTH_TRACE_H__
+
+#include <glib-object.h>
+#include <glib.h>
+#include <json-glib/json-glib.h>
+
+G_BEGIN_DECLS
+
+#define PHOTO_BOOTH_TRACE_TYPE                (photo_booth_trace_get_type ())
+#define PHOTO_BOOTH_TRACE(obj)                (G_TYPE_CHECK_INSTANCE_CAST ((obj),PHOTO_BOOTH_TRACE_TYPE,PhotoBoothTrace))
+#define PHOTO_BOOTH_TRACE_CLASS(klass)        (G_TYPE_CHECK_CLASS_CAST ((klass), PHOTO_BOOTH_TRACE_TYPE,PhotoBoothTraceClass))
+#define IS_PHOTO_BOOTH_TRACE(obj)             (G_TYPE_CHECK_INSTANCE_TYPE ((obj),PHOTO_BOOTH_TRACE_TYPE))
+#define IS_PHOTO_BOOTH_TRACE_CLASS(klass)     (G_TYPE_CHECK_CLASS_TYPE ((klass), PHOTO_BOOTH_TRACE_TYPE))
+
+typedef struct _PhotoBoothTrace               PhotoBoothTrace;
+typedef struct _PhotoBoothTraceClass          PhotoBoothTraceClass;
+typedef struct _PhotoBoothTraceSession        PhotoBoothTraceSession;
+
+struct _PhotoBoothTrace
+{
+	GObject parent;
+	GMutex lock;
+	gchar *location;
+	guint n_sessions;
+	PhotoBoothTraceSession *current;
+};
+
+struct _PhotoBoothTraceClass
+{
+	GObjectClass parent_class;
+};
+
+/* a session runs from the guest's touch until the booth is back in preview and is written as one
+ * json line once its last holder (e.g. an upload thread still running) has released it.
+ * every event carries the wall and process cpu time since the touch and the resident set size.
+ * event and state names are not copied and must be static strings */
+GType                   photo_booth_trace_get_type        (void);
+PhotoBoothTrace        *photo_booth_trace_get_default     (void);
+void                    photo_booth_trace_set_location    (PhotoBoothTrace *trace, const gchar *filename);
+void                    photo_booth_trace_begin_session   (PhotoBoothTrace *trace);
+void                    photo_booth_trace_end_session     (PhotoBoothTrace *trace);
+void                    photo_booth_trace_state           (PhotoBoothTrace *trace, const gchar *state);
+void                    photo_booth_trace_mark            (PhotoBoothTrace *trace, const gchar *event);
+PhotoBoothTraceSession *photo_booth_trace_hold            (PhotoBoothTrace *trace);
+void                    photo_booth_trace_session_mark    (PhotoBoothTrace *trace, PhotoBoothTraceSession *session, const gchar *event);
+void                    photo_booth_trace_release         (PhotoBoothTrace *trace, PhotoBoothTraceSession *session);
+
+/* appends what builder holds to location as one json line, for every *.jsonl the booth writes.
+ * a file that can't be opened is logged against owner, naming what was to be written */
+gboolean                photo_booth_trace_append_json     (gpointer owner, const gchar *location, JsonBuilder *builder, const gchar *what);
+
+G_END_DECLS
+
+#endif /* __PHOTO_BOOTH_TRACE_H__ */
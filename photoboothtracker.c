@@ -0,0 +1,196 @@
+/*
+ * GStreamer photoboothtracker.c
+ * Copyright 2019 Andreas Frisch <fraxinas@schaffenburg.org>
+ *
+ * This program is licensed under the Creative Commons
+ * Attribution-NonCommercial-ShareAlike 3.0 Unported
+ * License. To view a copy of this license, visit
+ * http://creativecommons.org/licenses/by-nc-sa/3.0/ or send a letter to
+ * Creative Commons,559 Nathan Abbott Way,Stanford,California 94305,USA.
+ *
+ * This program is NOT free software. It is open source, you are allowed
+ * to modify it (if you keep the license), but it may not be commercially
+ * distributed other than under the conditions noted above.
+ */
+
+#include "photobooth.h"
+#include "photoboothtracker.h"
+
+/* detections are matched to the predicted tracks greedily by overlap, every match corrects
+ * the track with a constant-velocity alpha-beta filter */
+#define TRACKER_IOU_THRESHOLD   0.2
+#define TRACKER_POSITION_GAIN   0.6
+#define TRACKER_VELOCITY_GAIN   0.3
+#define TRACKER_SIZE_GAIN       0.4
+#define TRACKER_MAX_AGE         (700 * G_TIME_SPAN_MILLISECOND)
+#define TRACKER_MAX_PREDICTION  (400 * G_TIME_SPAN_MILLISECOND)
+
+G_DEFINE_TYPE (PhotoBoothTracker, photo_booth_tracker, G_TYPE_OBJECT);
+
+GST_DEBUG_CATEGORY_STATIC (photo_booth_tracker_debug);
+#define GST_CAT_DEFAULT photo_booth_tracker_debug
+
+static void photo_booth_tracker_finalize (GObject *object);
+
+static void photo_booth_tracker_class_init (PhotoBoothTrackerClass *klass)
+{
+	GObjectClass *gobject_class = G_OBJECT_CLASS (klass);
+
+	GST_DEBUG_CATEGORY_INIT (photo_booth_tracker_debug, "photoboothtracker", GST_DEBUG_BOLD | GST_DEBUG_FG_WHITE | GST_DEBUG_BG_BLUE, "PhotoBoothTracker");
+
+	gobject_class->finalize = photo_booth_tracker_finalize;
+}
+
+static void photo_booth_tracker_init (PhotoBoothTracker *tracker)
+{
+	tracker->tracks = g_array_new (FALSE, FALSE, sizeof (PhotoBoothTrack));
+	tracker->next_id = 1;
+	tracker->max_age = TRACKER_MAX_AGE;
+}
+
+static void photo_booth_tracker_finalize (GObject *object)
+{
+	PhotoBoothTracker *tracker = PHOTO_BOOTH_TRACKER (object);
+	g_array_free (tracker->tracks, TRUE);
+	G_OBJECT_CLASS (photo_booth_tracker_parent_class)->finalize (object);
+}
+
+PhotoBoothTracker *photo_booth_tracker_new (void)
+{
+	return g_object_new (PHOTO_BOOTH_TRACKER_TYPE, NULL);
+}
+
+void photo_booth_tracker_predict (const PhotoBoothTrack *track, gint64 timestamp, PhotoBoothBox *box)
+{
+	// don't extrapolate too far into a gap, a face that stopped moving shouldn't drift off
+	gdouble dt = (gdouble) CLAMP (timestamp - track->updated, 0, TRACKER_MAX_PREDICTION) / G_USEC_PER_SEC;
+	box->x = track->box.x + track->vx * dt;
+	box->y = track->box.y + track->vy * dt;
+	box->width = track->box.width;
+	box->height = track->box.height;
+}
+
+static gdouble _iou (const PhotoBoothBox *a, const PhotoBoothBox *b)
+{
+	gdouble ix = MIN (a->x + a->width, b->x + b->width) - MAX (a->x, b->x);
+	gdouble iy = MIN (a->y + a->height, b->y + b->height) - MAX (a->y, b->y);
+	gdouble intersection, area;
+	if (ix <= 0 || iy <= 0)
+		return 0.0;
+	intersection = ix * iy;
+	area = a->width * a->height + b->width * b->height - intersection;
+	return area > 0 ? intersection / area : 0.0;
+}
+
+static void photo_booth_track_correct (PhotoBoothTrack *track, const PhotoBoothBox *predicted, const PhotoBoothBox *measured, gint64 timestamp)
+{
+	gdouble dt = (gdouble) (timestamp - track->updated) / G_USEC_PER_SEC;
+	gdouble pcx = predicted->x + predicted->width / 2, pcy = predicted->y + predicted->height / 2;
+	gdouble rx = measured->x + measured->width / 2 - pcx;
+	gdouble ry = measured->y + measured->height / 2 - pcy;
+	gdouble width = predicted->width + TRACKER_SIZE_GAIN * (measured->width - predicted->width);
+	gdouble height = predicted->height + TRACKER_SIZE_GAIN * (measured->height - predicted->height);
+
+	if (dt > 0)
+	{
+		track->vx += TRACKER_VELOCITY_GAIN * rx / dt;
+		track->vy += TRACKER_VELOCITY_GAIN * ry / dt;
+	}
+	track->box.x = pcx + TRACKER_POSITION_GAIN * rx - width / 2;
+	track->box.y = pcy + TRACKER_POSITION_GAIN * ry - height / 2;
+	track->box.width = width;
+	track->box.height = height;
+	track->updated = timestamp;
+	track->hits++;
+	track->misses = 0;
+}
+
+void photo_booth_tracker_update (PhotoBoothTracker *tracker, const PhotoBoothBox *boxes, guint n_boxes, gint64 timestamp)
+{
+	guint n_tracks = tracker->tracks->len;
+	PhotoBoothBox *predicted = g_new (PhotoBoothBox, n_tracks + 1);
+	gboolean *track_matched = g_new0 (gboolean, n_tracks + 1);
+	gboolean *box_matched = g_new0 (gboolean, n_boxes + 1);
+	guint i, j;
+
+	for (i = 0; i < n_tracks; i++)
+		photo_booth_tracker_predict (&g_array_index (tracker->tracks, PhotoBoothTrack, i), timestamp, &predicted[i]);
+
+	// greedy assignment, best overlapping pair first. there are only ever a handful of faces
+	for (;;)
+	{
+		gdouble best = TRACKER_IOU_THRESHOLD;
+		gint best_track = -1, best_box = -1;
+		for (i = 0; i < n_tracks; i++)
+		{
+			if (track_matched[i])
+				continue;
+			for (j = 0; j < n_boxes; j++)
+			{
+				gdouble iou;
+				if (box_matched[j])
+					continue;
+				iou = _iou (&predicted[i], &boxes[j]);
+				if (iou > best)
+				{
+					best = iou;
+					best_track = i;
+					best_box = j;
+				}
+			}
+		}
+		if (best_track < 0)
+			break;
+		photo_booth_track_correct (&g_array_index (tracker->tracks, PhotoBoothTrack, best_track), &predicted[best_track], &boxes[best_box], timestamp);
+		g_array_index (tracker->tracks, PhotoBoothTrack, best_track).matched = best_box;
+		track_matched[best_track] = box_matched[best_box] = TRUE;
+	}
+
+	for (i = 0; i < n_tracks; i++)
+		if (!track_matched[i])
+		{
+			g_array_index (tracker->tracks, PhotoBoothTrack, i).misses++;
+			g_array_index (tracker->tracks, PhotoBoothTrack, i).matched = -1;
+		}
+
+	for (j = 0; j < n_boxes; j++)
+	{
+		PhotoBoothTrack track = { 0, };
+		if (box_matched[j])
+			continue;
+		track.id = tracker->next_id++;
+		track.box = boxes[j];
+		track.updated = timestamp;
+		track.hits = 1;
+		track.matched = j;
+		g_array_append_val (tracker->tracks, track);
+		GST_DEBUG_OBJECT (tracker, "new track %u at (%.0f,%.0f) %.0fx%.0f", track.id, track.box.x, track.box.y, track.box.width, track.box.height);
+	}
+
+	g_free (predicted);
+	g_free (track_matched);
+	g_free (box_matched);
+	photo_booth_tracker_expire (tracker, timestamp);
+}
+
+guint photo_booth_tracker_expire (PhotoBoothTracker *tracker, gint64 timestamp)
+{
+	guint i = 0;
+	while (i < tracker->tracks->len)
+	{
+		PhotoBoothTrack *track = &g_array_index (tracker->tracks, PhotoBoothTrack, i);
+		if (timestamp - track->updated > tracker->max_age)
+		{
+			GST_DEBUG_OBJECT (tracker, "lost track %u after %u misses", track->id, track->misses);
+			g_array_remove_index (tracker->tracks, i);
+		}
+		else
+			i++;
+	}
+	return tracker->tracks->len;
+}
+
+void photo_booth_tracker_reset (PhotoBoothTracker *tracker)
+{
+	g_array_set_size (tracker->tracks, 0);
+}
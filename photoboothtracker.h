@@ -0,0 +1,73 @@
+/*
+ * GStreamer photoboothtracker.h
+ * Copyright 2019 Andreas Frisch <fraxinas@schaffenburg.org>
+ *
+ * This program is licensed under the Creative Commons
+ * Attribution-NonCommercial-ShareAlike 3.0 Unported
+ * License. To view a copy of this license, visit
+ * http://creativecommons.org/licenses/by-nc-sa/3.0/ or send a letter to
+ * Creative Commons,559 Nathan Abbott Way,Stanford,California 94305,USA.
+ *
+ * This program is NOT free software. It is open source, you are allowed
+ * to modify it (if you keep the license), but it may not be commercially
+ * distributed other than under the conditions noted above.
+ */
+
+#ifndef __PHOTO_BOOTH_TRACKER_H__
+#define __PHOTO_BOOTH_TRACKER_H__
+
+#include <glib-object.h>
+#include <glib.h>
+
+G_BEGIN_DECLS
+
+#define PHOTO_BOOTH_TRACKER_TYPE                (photo_booth_tracker_get_type ())
+#define PHOTO_BOOTH_TRACKER(obj)                (G_TYPE_CHECK_INSTANCE_CAST ((obj),PHOTO_BOOTH_TRACKER_TYPE,PhotoBoothTracker))
+#define PHOTO_BOOTH_TRACKER_CLASS(klass)        (G_TYPE_CHECK_CLASS_CAST ((klass), PHOTO_BOOTH_TRACKER_TYPE,PhotoBoothTrackerClass))
+#define IS_PHOTO_BOOTH_TRACKER(obj)             (G_TYPE_CHECK_INSTANCE_TYPE ((obj),PHOTO_BOOTH_TRACKER_TYPE))
+#define IS_PHOTO_BOOTH_TRACKER_CLASS(klass)     (G_TYPE_CHECK_CLASS_TYPE ((klass), PHOTO_BOOTH_TRACKER_TYPE))
+
+typedef struct _PhotoBoothTracker              PhotoBoothTracker;
+typedef struct _PhotoBoothTrackerClass         PhotoBoothTrackerClass;
+
+typedef struct
+{
+	gdouble x, y, width, height;
+} PhotoBoothBox;
+
+/* a face followed across detections, the box and the velocity of its centre (px/s) are
+ * the filtered state at time 'updated'. 'matched' is the index of the box that corrected
+ * the track in the last update, -1 if it wasn't seen */
+typedef struct
+{
+	guint id;
+	PhotoBoothBox box;
+	gdouble vx, vy;
+	gint64 updated;
+	guint hits, misses;
+	gint matched;
+} PhotoBoothTrack;
+
+struct _PhotoBoothTracker
+{
+	GObject parent;
+	GArray *tracks;
+	guint next_id;
+	gint64 max_age;
+};
+
+struct _PhotoBoothTrackerClass
+{
+	GObjectClass parent_class;
+};
+
+GType              photo_booth_tracker_get_type      (void);
+PhotoBoothTracker *photo_booth_tracker_new           (void);
+void               photo_booth_tracker_update        (PhotoBoothTracker *tracker, const PhotoBoothBox *boxes, guint n_boxes, gint64 timestamp);
+guint              photo_booth_tracker_expire        (PhotoBoothTracker *tracker, gint64 timestamp);
+void               photo_booth_tracker_predict       (const PhotoBoothTrack *track, gint64 timestamp, PhotoBoothBox *box);
+void               photo_booth_tracker_reset         (PhotoBoothTracker *tracker);
+
+G_END_DECLS
+
+#endif /* __PHOTO_BOOTH_TRACKER_H__ */
@@ -0,0 +1,204 @@
+/*
+ * GStreamer photoboothwatchdog.c
+ * Copyright 2019 Andreas Frisch <fraxinas@schaffenburg.org>
+ *
+ * This program is licensed under the Creative Commons
+ * Attribution-NonCommercial-ShareAlike 3.0 Unported
+ * License. To view a copy of this license, visit
+ * http://creativecommons.org/licenses/by-nc-sa/3.0/ or send a letter to
+ * Creative Commons,559 Nathan Abbott Way,Stanford,California 94305,USA.
+ *
+ * This program is NOT free software. It is open source, you are allowed
+ * to modify it (if you keep the license), but it may not be commercially
+ * distributed other than under the conditions noted above.
+ */
+
+#include "photobooth.h"
+#include "photoboothmetrics.h"
+#include "photoboothwatchdog.h"
+
+typedef struct
+{
+	const gchar *name;
+	gint64 default_timeout, timeout;   // us
+	gboolean armed;
+	gint64 last_progress;              // monotonic
+	const gchar *where;
+	guint attempt;                     // stalls since the last progress
+	PhotoBoothWatchdogRecoverFunc recover;
+	gpointer user_data;
+} PhotoBoothWatchdogStage;
+
+typedef struct
+{
+	guint stage, attempt;
+	const gchar *where;
+} PhotoBoothWatchdogStall;
+
+G_DEFINE_TYPE (PhotoBoothWatchdog, photo_booth_watchdog, G_TYPE_OBJECT);
+
+GST_DEBUG_CATEGORY_STATIC (photo_booth_watchdog_debug);
+#define GST_CAT_DEFAULT photo_booth_watchdog_debug
+
+static void photo_booth_watchdog_finalize (GObject *object);
+
+static void photo_booth_watchdog_class_init (PhotoBoothWatchdogClass *klass)
+{
+	GObjectClass *gobject_class = G_OBJECT_CLASS (klass);
+
+	GST_DEBUG_CATEGORY_INIT (photo_booth_watchdog_debug, "photoboothwatchdog", GST_DEBUG_BOLD | GST_DEBUG_FG_WHITE | GST_DEBUG_BG_RED, "PhotoBoothWatchdog");
+
+	gobject_class->finalize = photo_booth_watchdog_finalize;
+}
+
+static void photo_booth_watchdog_init (PhotoBoothWatchdog *watchdog)
+{
+	g_mutex_init (&watchdog->lock);
+	watchdog->stages = g_array_new (FALSE, TRUE, sizeof (PhotoBoothWatchdogStage));
+	watchdog->check_id = 0;
+}
+
+static void photo_booth_watchdog_finalize (GObject *object)
+{
+	PhotoBoothWatchdog *watchdog = PHOTO_BOOTH_WATCHDOG (object);
+	photo_booth_watchdog_stop (watchdog);
+	g_array_free (watchdog->stages, TRUE);
+	g_mutex_clear (&watchdog->lock);
+	G_OBJECT_CLASS (photo_booth_watchdog_parent_class)->finalize (object);
+}
+
+PhotoBoothWatchdog *photo_booth_watchdog_new (void)
+{
+	return g_object_new (PHOTO_BOOTH_WATCHDOG_TYPE, NULL);
+}
+
+/* returns the id to arm and feed the stage with, stages are numbered in the order they are added */
+guint photo_booth_watchdog_add_stage (PhotoBoothWatchdog *watchdog, const gchar *name, gint timeout_ms, PhotoBoothWatchdogRecoverFunc recover, gpointer user_data)
+{
+	PhotoBoothWatchdogStage stage = { 0, };
+	guint id;
+
+	stage.name = name;
+	stage.default_timeout = stage.timeout = (gint64) MAX (timeout_ms, 1) * G_TIME_SPAN_MILLISECOND;
+	stage.recover = recover;
+	stage.user_data = user_data;
+
+	g_mutex_lock (&watchdog->lock);
+	g_array_append_val (watchdog->stages, stage);
+	id = watchdog->stages->len - 1;
+	g_mutex_unlock (&watchdog->lock);
+	GST_DEBUG_OBJECT (watchdog, "stage %u '%s' stalls after %i ms", id, name, timeout_ms);
+	return id;
+}
+
+void photo_booth_watchdog_arm (PhotoBoothWatchdog *watchdog, guint stage, const gchar *where)
+{
+	photo_booth_watchdog_arm_timeout (watchdog, stage, where, 0);
+}
+
+/* like arm but with a timeout other than the stage's default for this one piece of work, 0 is the default.
+ * arming doesn't count as progress, a stage that stalls again after a recovery gets the next attempt */
+void photo_booth_watchdog_arm_timeout (PhotoBoothWatchdog *watchdog, guint stage, const gchar *where, gint timeout_ms)
+{
+	PhotoBoothWatchdogStage *s;
+	g_return_if_fail (stage < watchdog->stages->len);
+
+	g_mutex_lock (&watchdog->lock);
+	s = &g_array_index (watchdog->stages, PhotoBoothWatchdogStage, stage);
+	s->armed = TRUE;
+	s->timeout = timeout_ms > 0 ? (gint64) timeout_ms * G_TIME_SPAN_MILLISECOND : s->default_timeout;
+	s->last_progress = g_get_monotonic_time ();
+	s->where = where;
+	g_mutex_unlock (&watchdog->lock);
+	GST_LOG_OBJECT (watchdog, "armed %s at %s", s->name, where);
+}
+
+void photo_booth_watchdog_disarm (PhotoBoothWatchdog *watchdog, guint stage)
+{
+	g_return_if_fail (stage < watchdog->stages->len);
+	g_mutex_lock (&watchdog->lock);
+	g_array_index (watchdog->stages, PhotoBoothWatchdogStage, stage).armed = FALSE;
+	g_mutex_unlock (&watchdog->lock);
+}
+
+/* the stage made progress, cheap enough to be called for every buffer */
+void photo_booth_watchdog_feed (PhotoBoothWatchdog *watchdog, guint stage, const gchar *where)
+{
+	PhotoBoothWatchdogStage *s;
+	guint attempt;
+	g_return_if_fail (stage < watchdog->stages->len);
+
+	g_mutex_lock (&watchdog->lock);
+	s = &g_array_index (watchdog->stages, PhotoBoothWatchdogStage, stage);
+	s->last_progress = g_get_monotonic_time ();
+	s->where = where;
+	attempt = s->attempt;
+	s->attempt = 0;
+	g_mutex_unlock (&watchdog->lock);
+	if (attempt)
+		GST_INFO_OBJECT (watchdog, "%s is making progress again at %s after %u stall(s)", s->name, where, attempt);
+}
+
+gboolean photo_booth_watchdog_is_stalled (PhotoBoothWatchdog *watchdog, guint stage)
+{
+	gboolean stalled;
+	g_return_val_if_fail (stage < watchdog->stages->len, FALSE);
+	g_mutex_lock (&watchdog->lock);
+	stalled = g_array_index (watchdog->stages, PhotoBoothWatchdogStage, stage).attempt > 0;
+	g_mutex_unlock (&watchdog->lock);
+	return stalled;
+}
+
+static gboolean photo_booth_watchdog_check (PhotoBoothWatchdog *watchdog)
+{
+	GArray *stalls = g_array_new (FALSE, FALSE, sizeof (PhotoBoothWatchdogStall));
+	gint64 now = g_get_monotonic_time ();
+	guint i;
+
+	g_mutex_lock (&watchdog->lock);
+	for (i = 0; i < watchdog->stages->len; i++)
+	{
+		PhotoBoothWatchdogStage *s = &g_array_index (watchdog->stages, PhotoBoothWatchdogStage, i);
+		if (s->armed && now - s->last_progress > s->timeout)
+		{
+			PhotoBoothWatchdogStall stall;
+			// the recovery gets another full timeout before it is tried again
+			s->last_progress = now;
+			s->attempt++;
+			stall.stage = i;
+			stall.attempt = s->attempt;
+			stall.where = s->where;
+			g_array_append_val (stalls, stall);
+		}
+	}
+	g_mutex_unlock (&watchdog->lock);
+
+	// the recovery functions arm and feed stages themselves
+	for (i = 0; i < stalls->len; i++)
+	{
+		PhotoBoothWatchdogStall *stall = &g_array_index (stalls, PhotoBoothWatchdogStall, i);
+		PhotoBoothWatchdogStage *s = &g_array_index (watchdog->stages, PhotoBoothWatchdogStage, stall->stage);
+		gchar *labels = g_strdup_printf ("stage=\"%s\"", s->name);
+		GST_WARNING_OBJECT (watchdog, "%s stalled at %s, recovery attempt %u", s->name, stall->where ? stall->where : "(start)", stall->attempt);
+		photo_booth_metrics_counter_add (photo_booth_metrics_get_default (), "photobooth_stalls_total", labels, 1);
+		g_free (labels);
+		if (s->recover)
+			s->recover (watchdog, stall->stage, stall->attempt, stall->where, s->user_data);
+	}
+	g_array_free (stalls, TRUE);
+	return G_SOURCE_CONTINUE;
+}
+
+/* checks the armed stages every interval_ms from the default main context */
+void photo_booth_watchdog_start (PhotoBoothWatchdog *watchdog, guint interval_ms)
+{
+	photo_booth_watchdog_stop (watchdog);
+	watchdog->check_id = g_timeout_add (MAX (interval_ms, 10), (GSourceFunc) photo_booth_watchdog_check, watchdog);
+}
+
+void photo_booth_watchdog_stop (PhotoBoothWatchdog *watchdog)
+{
+	if (watchdog->check_id)
+		g_source_remove (watchdog->check_id);
+	watchdog->check_id = 0;
+}
@@ -0,0 +1,67 @@
+/*
+ * GStreamer photoboothwatchdog.h
+ * Copyright 2019 Andreas Frisch <fraxinas@schaffenburg.org>
+ *
+ * This program is licensed under the Creative Commons
+ * Attribution-NonCommercial-ShareAlike 3.0 Unported
+ * License. To view a copy of this license, visit
+ * http://creativecommons.org/licenses/by-nc-sa/3.0/ or send a letter to
+ * Creative Commons,559 Nathan Abbott Way,Stanford,California 94305,USA.
+ *
+ * This program is NOT free software. It is open source, you are allowed
+ * to modify it (if you keep the license), but it may not be commercially
+ * distributed other than under the conditions noted above.
+ */
+
+#ifndef __PHOTO_BOOTH_WATCHDOG_H__
+#define __PHOTO_BOOTH_WATCHDOG_H__
+
+#include <glib-object.h>
+#include <glib.h>
+
+G_BEGIN_DECLS
+
+#define PHOTO_BOOTH_WATCHDOG_TYPE                (photo_booth_watchdog_get_type ())
+#define PHOTO_BOOTH_WATCHDOG(obj)                (G_TYPE_CHECK_INSTANCE_CAST ((obj),PHOTO_BOOTH_WATCHDOG_TYPE,PhotoBoothWatchdog))
+#define PHOTO_BOOTH_WATCHDOG_CLASS(klass)        (G_TYPE_CHECK_CLASS_CAST ((klass), PHOTO_BOOTH_WATCHDOG_TYPE,PhotoBoothWatchdogClass))
+#define IS_PHOTO_BOOTH_WATCHDOG(obj)             (G_TYPE_CHECK_INSTANCE_TYPE ((obj),PHOTO_BOOTH_WATCHDOG_TYPE))
+#define IS_PHOTO_BOOTH_WATCHDOG_CLASS(klass)     (G_TYPE_CHECK_CLASS_TYPE ((klass), PHOTO_BOOTH_WATCHDOG_TYPE))
+
+typedef struct _PhotoBoothWatchdog              PhotoBoothWatchdog;
+typedef struct _PhotoBoothWatchdogClass         PhotoBoothWatchdogClass;
+
+/* called from the main loop when an armed stage made no progress within its timeout.
+ * attempt counts the stalls since the stage last made progress, starting at 1, where is the
+ * last place progress was reported from */
+typedef void (*PhotoBoothWatchdogRecoverFunc) (PhotoBoothWatchdog *watchdog, guint stage, guint attempt, const gchar *where, gpointer user_data);
+
+struct _PhotoBoothWatchdog
+{
+	GObject parent;
+	GMutex lock;
+	GArray *stages;
+	guint check_id;
+};
+
+struct _PhotoBoothWatchdogClass
+{
+	GObjectClass parent_class;
+};
+
+/* a stage is any part of the booth that is expected to make progress while it is armed, e.g. the
+ * camera while a call into it is running or the video-bin while the live view is shown.
+ * arm, disarm and feed may be called from any thread, stage names must be static strings */
+GType                photo_booth_watchdog_get_type     (void);
+PhotoBoothWatchdog  *photo_booth_watchdog_new          (void);
+guint                photo_booth_watchdog_add_stage    (PhotoBoothWatchdog *watchdog, const gchar *name, gint timeout_ms, PhotoBoothWatchdogRecoverFunc recover, gpointer user_data);
+void                 photo_booth_watchdog_arm          (PhotoBoothWatchdog *watchdog, guint stage, const gchar *where);
+void                 photo_booth_watchdog_arm_timeout  (PhotoBoothWatchdog *watchdog, guint stage, const gchar *where, gint timeout_ms);
+void                 photo_booth_watchdog_disarm       (PhotoBoothWatchdog *watchdog, guint stage);
+void                 photo_booth_watchdog_feed         (PhotoBoothWatchdog *watchdog, guint stage, const gchar *where);
+gboolean             photo_booth_watchdog_is_stalled   (PhotoBoothWatchdog *watchdog, guint stage);
+void                 photo_booth_watchdog_start        (PhotoBoothWatchdog *watchdog, guint interval_ms);
+void                 photo_booth_watchdog_stop         (PhotoBoothWatchdog *watchdog);
+
+G_END_DECLS
+
+#endif /* __PHOTO_BOOTH_WATCHDOG_H__ */
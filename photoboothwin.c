@@ -28,7 +28,7 @@ struct _PhotoBoothWindowPrivate
 {
 	GtkWidget *overlay;
 	GtkWidget *spinner, *statusbar;
-	GtkLabel *countdown_label;
+	GtkLabel *countdown_label, *hud;
 	GtkScale *copies;
 	GtkProgressBar *upload_progress;
 	gint countdown;
@@ -134,6 +134,31 @@ void photo_booth_window_add_gtkgstwidget (PhotoBoothWindow *win, GtkWidget *gtkg
 	win->gtkgstwidget = gtkgstwidget;
 }
 
+/* a small diagnostics text in the top left corner of the live view, NULL hides it */
+void photo_booth_window_set_hud (PhotoBoothWindow *win, const gchar *text)
+{
+	PhotoBoothWindowPrivate *priv;
+	priv = photo_booth_window_get_instance_private (win);
+	if (!priv->hud)
+	{
+		if (!text)
+			return;
+		priv->hud = GTK_LABEL (gtk_label_new (NULL));
+		gtk_widget_set_halign (GTK_WIDGET (priv->hud), GTK_ALIGN_START);
+		gtk_widget_set_valign (GTK_WIDGET (priv->hud), GTK_ALIGN_START);
+		gtk_style_context_add_class (gtk_widget_get_style_context (GTK_WIDGET (priv->hud)), "hud");
+		gtk_overlay_add_overlay (GTK_OVERLAY (priv->overlay), GTK_WIDGET (priv->hud));
+		gtk_overlay_set_overlay_pass_through (GTK_OVERLAY (priv->overlay), GTK_WIDGET (priv->hud), TRUE);
+	}
+	if (text)
+	{
+		gtk_label_set_text (priv->hud, text);
+		gtk_widget_show (GTK_WIDGET (priv->hud));
+	}
+	else
+		gtk_widget_hide (GTK_WIDGET (priv->hud));
+}
+
 gboolean _pbw_clock_tick (GtkLabel *status_clock)
 {
 	if (!GTK_IS_LABEL (status_clock))
@@ -274,15 +299,27 @@ void photo_booth_window_init_masq_combobox (PhotoBoothWindow *win, GtkListStore
 	gtk_cell_layout_set_attributes (GTK_CELL_LAYOUT(win->combo_masquerade), renderer, "pixbuf", COL_ICON, NULL);
 }
 
-void photo_booth_window_upload_progress_show (PhotoBoothWindow *win, gint total, gint current)
+void photo_booth_window_upload_progress_show (PhotoBoothWindow *win, gint64 total, gint64 current, gdouble rate, gint eta)
 {
 	PhotoBoothWindowPrivate *priv;
 	priv = photo_booth_window_get_instance_private (win);
-	
+
 	if (total > 0) {
 		gdouble f = (gdouble) current / (gdouble) total;
 		gtk_progress_bar_set_fraction (priv->upload_progress, f);
-		GST_LOG ("set progess %f", f);
+		GST_LOG ("set progess %f rate %.0f B/s eta %i s", f, rate, eta);
+		if (rate > 0) {
+			gchar *text;
+			if (eta >= 0)
+				text = g_strdup_printf (_("%.0f kB/s, %d s left"), rate / 1024, eta);
+			else
+				text = g_strdup_printf (_("%.0f kB/s"), rate / 1024);
+			gtk_progress_bar_set_text (priv->upload_progress, text);
+			gtk_progress_bar_set_show_text (priv->upload_progress, TRUE);
+			g_free (text);
+		} else {
+			gtk_progress_bar_set_show_text (priv->upload_progress, FALSE);
+		}
 		gtk_widget_show (GTK_WIDGET (priv->upload_progress));
 	} else {
 		gtk_widget_hide (GTK_WIDGET (priv->upload_progress));
@@ -57,8 +57,9 @@ void                    photo_booth_window_hide_cursor      (PhotoBoothWindow *w
 void                    photo_booth_window_show_cursor      (PhotoBoothWindow *win);
 void                    photo_booth_window_set_copies_show  (PhotoBoothWindow *win, gint min, gint max, gint def);
 gint                    photo_booth_window_get_copies_hide  (PhotoBoothWindow *win);
-void 					photo_booth_window_upload_progress_show (PhotoBoothWindow *win, gint total, gint current);
+void                    photo_booth_window_upload_progress_show (PhotoBoothWindow *win, gint64 total, gint64 current, gdouble rate, gint eta);
 void                    photo_booth_window_init_masq_combobox (PhotoBoothWindow *win, GtkListStore *store);
+void                    photo_booth_window_set_hud          (PhotoBoothWindow *win, const gchar *text);
 
 G_END_DECLS
 
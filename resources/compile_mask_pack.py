@@ -0,0 +1,61 @@
+#!/usr/bin/env python3
+# -*- coding: utf-8 -*-
+
+# compiles a photobooth mask pack directory: renders an icon of every mask
+# to icons/ and writes manifest.json with the masks' sizes, so that photobooth
+# doesn't have to decode any of the masks at startup.
+#
+# the masks are read from masks.json in the pack directory (or the file given
+# as second argument), in the same format as the [masks] list in the ini file:
+# [["filename", x-offset, y-offset, "title", "anchor"]...]
+#
+# usage: compile_mask_pack.py <pack directory> [masks list]
+
+import sys, os, json
+import gi
+gi.require_version('GdkPixbuf', '2.0')
+from gi.repository import GdkPixbuf
+
+ICON_SIZE = 64  # MASK_ICON_SIZE in photoboothmasquerade.h
+MANIFEST_VERSION = 1  # MASK_PACK_VERSION in photoboothmasquerade.c
+ICON_DIR = 'icons'
+
+if len(sys.argv) < 2:
+	print('usage: %s <pack directory> [masks list]' % sys.argv[0])
+	sys.exit(1)
+
+pack_dir = sys.argv[1]
+list_file = sys.argv[2] if len(sys.argv) > 2 else os.path.join(pack_dir, 'masks.json')
+
+with open(list_file, 'r') as f:
+	masks_list = json.load(f)
+
+os.makedirs(os.path.join(pack_dir, ICON_DIR), exist_ok=True)
+masks = []
+
+for entry in masks_list:
+	filename, offset_x, offset_y, title = entry[:4]
+	anchor = entry[4] if len(entry) > 4 else 'face'
+	path = os.path.join(pack_dir, filename)
+	info = GdkPixbuf.Pixbuf.get_file_info(path)
+	if info[0] is None:
+		print('skipping %s: unknown image format' % path)
+		continue
+	icon = os.path.join(ICON_DIR, os.path.splitext(os.path.basename(filename))[0] + '.png')
+	GdkPixbuf.Pixbuf.new_from_file_at_size(path, ICON_SIZE, ICON_SIZE).savev(os.path.join(pack_dir, icon), 'png', [], [])
+	masks.append({
+		'file': filename,
+		'title': title,
+		'icon': icon,
+		'width': info[1],
+		'height': info[2],
+		'offset_x': offset_x,
+		'offset_y': offset_y,
+		'anchor': anchor,
+	})
+	print('%s: %dx%d "%s"' % (filename, info[1], info[2], title))
+
+with open(os.path.join(pack_dir, 'manifest.json'), 'w') as f:
+	json.dump({'version': MANIFEST_VERSION, 'masks': masks}, f, indent=1, ensure_ascii=False)
+
+print('%d masks written to %s' % (len(masks), os.path.join(pack_dir, 'manifest.json')))
@@ -0,0 +1,42 @@
+#!/bin/sh
+#
+# Stand-in for the gutenprint backend's status query (gutenprint_path -m),
+# so the print path can be exercised without a dye-sub printer attached.
+# The booth only passes BACKEND to the backend, so the printer's state is
+# picked with the backend name in the [printer] section:
+#   backend = fake           online, 350 of 400 prints (4x6) remaining
+#   backend = fake-empty     online, out of media
+#   backend = fake-low       online, 2 prints remaining
+#   backend = fake-offline   printer open failure
+#
+# Any printer goes off-line while a file named after it exists in
+# FAKE_PRINTER_DIR (default /tmp), so a pool can be made to fail over
+# while it prints:
+#   [printer]
+#   gutenprint_path = ./resources/fake_printer_backend.sh
+#   backend = fake-1;fake-2;fake-low
+#   touch /tmp/fake-1.offline ... rm /tmp/fake-1.offline
+
+if [ -e "${FAKE_PRINTER_DIR:-/tmp}/$BACKEND.offline" ]; then
+	BACKEND="$BACKEND-offline"
+fi
+
+case "$BACKEND" in
+	*-offline)
+		echo "ERROR: Printer open failure (No suitable printers found!)"
+		exit 1
+		;;
+	*-empty)
+		remain=000
+		;;
+	*-low)
+		remain=002
+		;;
+	*)
+		remain=350
+		;;
+esac
+
+echo "INFO: Media type                : 1 (4x6)"
+echo "INFO: Media remaining           : $remain/400"
+exit 0
@@ -0,0 +1,24 @@
+#!/bin/sh
+#
+# Writes the jpegs the simulated camera of bench.ini replays: 50 live view
+# frames at the preview size and a few photos at print resolution, made by
+# GStreamer's test source so nothing has to be checked in.
+#
+# usage: resources/generate_bench_fixtures.sh [directory, default ./simulated]
+# an existing directory is left alone, delete it to make new ones.
+
+DIR="${1:-./simulated}"
+
+if [ -d "$DIR/liveview" ] && [ -d "$DIR/photos" ]; then
+	exit 0
+fi
+
+set -e
+mkdir -p "$DIR/liveview" "$DIR/photos"
+gst-launch-1.0 -q videotestsrc pattern=ball num-buffers=50 \
+	! video/x-raw,width=640,height=424,framerate=25/1 ! videoconvert ! jpegenc quality=85 \
+	! multifilesink location="$DIR/liveview/frame_%03d.jpg"
+gst-launch-1.0 -q videotestsrc pattern=smpte num-buffers=4 \
+	! video/x-raw,width=3000,height=2000,framerate=1/1 ! videoconvert ! jpegenc quality=90 \
+	! multifilesink location="$DIR/photos/photo_%d.jpg"
+echo "wrote the simulated camera's jpegs to $DIR"
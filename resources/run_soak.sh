@@ -0,0 +1,30 @@
+#!/bin/sh
+#
+# What "ninja soak" runs: the bench with bench.ini from the source directory,
+# whose paths are relative to it, with the simulated camera's jpegs, the
+# upload stand-in on port 8080 and GTK's print-to-file printer. Without a
+# DISPLAY it runs under xvfb-run, which has to be installed then.
+#
+# usage: resources/run_soak.sh <photobooth-bench> <source directory> [bench options...]
+
+BENCH="$1"
+SOURCE_DIR="$2"
+shift 2
+
+cd "$SOURCE_DIR" || exit 1
+./resources/generate_bench_fixtures.sh || exit 1
+
+./resources/upload_standin_server.py 8080 &
+SERVER=$!
+trap 'kill $SERVER 2>/dev/null' EXIT INT TERM
+sleep 1
+
+export GTK_PRINT_BACKENDS=file
+if [ -n "$DISPLAY" ]; then
+	"$BENCH" "$@" bench.ini
+elif command -v xvfb-run >/dev/null; then
+	xvfb-run -a "$BENCH" "$@" bench.ini
+else
+	echo "the bench needs a display, set DISPLAY or install xvfb-run" >&2
+	exit 1
+fi
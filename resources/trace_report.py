@@ -0,0 +1,59 @@
+#!/usr/bin/env python3
+# -*- coding: utf-8 -*-
+
+# summarizes the session traces photobooth writes to [general] trace_file:
+# for every guest the time from the touch to a step is taken from the first
+# occurrence of that event or state, sessions that never reached a step are
+# left out of its percentiles.
+#
+# usage: trace_report.py <trace file>...
+
+import sys, json
+
+STEPS = [
+	('touch to shutter', 'control_photo_sent'),
+	('touch to capture', 'capture_returned'),
+	('touch to download', 'file_downloaded'),
+	('touch to review', 'photo_displayed'),
+	('touch to jpeg', 'jpeg_written'),
+	('touch to print buffer', 'print_buffer_caught'),
+	('touch to print', 'print_done'),
+	('touch to upload', 'upload_done'),
+	('touch to publish', 'publish_done'),
+	('touch to preview', 'PB_STATE_PREVIEW'),
+]
+QUANTILES = [0.5, 0.9, 0.95, 0.99]
+
+def quantile(sorted_values, q):
+	# nearest rank, same as photo_booth_metric_quantile
+	rank = max(1, min(len(sorted_values), int(q * len(sorted_values) + 0.999999)))
+	return sorted_values[rank - 1]
+
+if len(sys.argv) < 2:
+	print('usage: %s <trace file>...' % sys.argv[0])
+	sys.exit(1)
+
+sessions = 0
+durations = {name: [] for _, name in STEPS}
+
+for path in sys.argv[1:]:
+	with open(path, 'r') as f:
+		for line in f:
+			if not line.strip():
+				continue
+			session = json.loads(line)
+			sessions += 1
+			seen = set()
+			for event in session['events']:
+				name = event.get('event', event.get('state'))
+				if name in durations and name not in seen:
+					durations[name].append(event['t_ms'])
+					seen.add(name)
+
+print('%d sessions' % sessions)
+print('%-22s %6s %s' % ('', 'count', ' '.join('%9s' % ('p%g' % (q * 100)) for q in QUANTILES)))
+for title, name in STEPS:
+	values = sorted(durations[name])
+	if not values:
+		continue
+	print('%-22s %6d %s' % (title, len(values), ' '.join('%8.2fs' % (quantile(values, q) / 1000.0) for q in QUANTILES)))
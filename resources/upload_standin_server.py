@@ -0,0 +1,131 @@
+#! /usr/bin/python3
+# -*- coding: utf-8 -*-
+#
+# Local stand-in for the upload and publish servers.
+#
+# PUT: linx server, also exercising the resumable upload mode (linx_chunk_size > 0).
+# Chunks are PUT with Content-Range, Upload-Offset and Upload-Checksum headers,
+# the server answers with the offset it has stored. HEAD answers with that offset
+# too, a resumed upload asks it first. A chunk before the stored offset replaces
+# everything from there, the booth sends one again when the file doesn't match
+# the checksums of what it has uploaded any more.
+#
+# POST: publish targets. /3/upload answers like the imgur API, any other path
+# like a facebook_put_uri / webhook_uri endpoint. Point the [upload] section at it:
+#   imgur_upload_uri = http://localhost:8080/3/upload
+#   facebook_put_uri = http://localhost:8080/facebook
+#   webhook_uri = http://localhost:8080/hook1;http://localhost:8080/hook2
+#
+# usage: upload_standin_server.py [port] [drop-rate] [delay]
+#   drop-rate: probability (0..1) to cut a connection half way through a chunk
+#   delay: seconds each POST takes to answer, to check targets run concurrently
+
+import base64
+import hashlib
+import json
+import os
+import random
+import re
+import sys
+import time
+from email.parser import BytesParser
+from http.server import BaseHTTPRequestHandler, HTTPServer
+from socketserver import ThreadingMixIn
+
+PORT = int(sys.argv[1]) if len(sys.argv) > 1 else 8080
+DROP_RATE = float(sys.argv[2]) if len(sys.argv) > 2 else 0.0
+DELAY = float(sys.argv[3]) if len(sys.argv) > 3 else 0.0
+STORAGE = "standin_uploads"
+
+
+class ChunkHandler(BaseHTTPRequestHandler):
+    protocol_version = "HTTP/1.1"
+
+    def path_for(self):
+        name = os.path.basename(self.path.strip("/")) or "upload"
+        return os.path.join(STORAGE, name)
+
+    def reply(self, code, body=b"", offset=None):
+        self.send_response(code)
+        if offset is not None:
+            self.send_header("Upload-Offset", str(offset))
+        self.send_header("Content-Length", str(len(body)))
+        self.end_headers()
+        self.wfile.write(body)
+
+    def do_HEAD(self):
+        path = self.path_for()
+        self.reply(200, offset=os.path.getsize(path) if os.path.exists(path) else 0)
+
+    def do_PUT(self):
+        path = self.path_for()
+        length = int(self.headers.get("Content-Length", 0))
+        stored = os.path.getsize(path) if os.path.exists(path) else 0
+
+        if DROP_RATE and random.random() < DROP_RATE:
+            self.rfile.read(length // 2)
+            self.close_connection = True
+            return
+
+        data = self.rfile.read(length)
+        crange = self.headers.get("Content-Range")
+        if not crange:
+            with open(path, "wb") as f:
+                f.write(data)
+            return self.reply(200, ("http://localhost:%d/%s\n" % (PORT, os.path.basename(path))).encode())
+
+        m = re.match(r"bytes (\d+)-(\d+)/(\d+)", crange)
+        start, end, total = (int(x) for x in m.groups())
+        if start > stored:
+            return self.reply(409, b"offset mismatch\n", stored)
+
+        checksum = self.headers.get("Upload-Checksum", "")
+        if checksum.startswith("sha1 "):
+            digest = base64.b64encode(hashlib.sha1(data).digest()).decode()
+            if digest != checksum[5:]:
+                return self.reply(460, b"checksum mismatch\n", stored)
+
+        with open(path, "r+b" if os.path.exists(path) else "wb") as f:
+            f.seek(start)
+            f.truncate()
+            f.write(data)
+        stored = start + len(data)
+        if stored < total:
+            return self.reply(308, offset=stored)
+        return self.reply(201, ("http://localhost:%d/%s\n" % (PORT, os.path.basename(path))).encode(), stored)
+
+    def do_POST(self):
+        body = self.rfile.read(int(self.headers.get("Content-Length", 0)))
+        header = ("Content-Type: %s\r\n\r\n" % self.headers.get("Content-Type")).encode()
+        message = BytesParser().parsebytes(header + body)
+        fields = {}
+        for part in message.get_payload() if message.is_multipart() else []:
+            fields[part.get_param("name", header="content-disposition")] = part.get_payload(decode=True)
+        if "image" not in fields:
+            return self.reply(400, b"no image field\n")
+
+        if DELAY:
+            time.sleep(DELAY)
+        target = os.path.basename(self.path.strip("/")) or "publish"
+        name = "%s-%d.jpg" % (target, int(time.time() * 1000))
+        with open(os.path.join(STORAGE, name), "wb") as f:
+            f.write(fields["image"])
+        link = "http://localhost:%d/%s" % (PORT, name)
+        print("%s: %d bytes %s" % (self.path, len(fields["image"]), link))
+
+        if self.path.endswith("/3/upload"):
+            if not self.headers.get("Authorization", "").startswith("Bearer "):
+                return self.reply(403, b'{"success": false, "status": 403}')
+            data = {"data": {"link": link, "album": fields.get("album", b"").decode()}, "success": True, "status": 200}
+            return self.reply(200, json.dumps(data).encode())
+        return self.reply(200, (link + "\n").encode())
+
+
+class StandinServer(ThreadingMixIn, HTTPServer):
+    daemon_threads = True
+
+
+if __name__ == "__main__":
+    os.makedirs(STORAGE, exist_ok=True)
+    print("stand-in upload server on port %d, storing to ./%s" % (PORT, STORAGE))
+    StandinServer(("127.0.0.1", PORT), ChunkHandler).serve_forever()
@@ -1,39 +1,42 @@
 import tweepy
-import os
-import socket
-import urllib.request
- 
+import sys
+from email.parser import BytesParser
+from http.server import BaseHTTPRequestHandler, HTTPServer
+
 # Consumer keys and access tokens, used for OAuth
 consumer_key = ""
 consumer_secret = ""
 access_token = ""
 access_token_secret = ""
- 
+
+status = "Insert text to post here"
+
 auth = tweepy.OAuthHandler(consumer_key, consumer_secret)
 auth.set_access_token(access_token, access_token_secret)
- 
+
 api = tweepy.API(auth)
 
 # Creates the user object. The me() method returns the user whose authentication keys were used.
 user = api.me()
- 
-s = socket.socket(socket.AF_INET, socket.SOCK_STREAM)
-s.setsockopt(socket.SOL_SOCKET, socket.SO_REUSEADDR, 1)
-s.bind(('127.0.0.1', 3000))
-s.listen(1)
 
-while True:
- try:
-    os.remove("temp.jpg")
- except OSError:
-    pass
- connection, address = s.accept()
- buf = connection.recv(64)
- if len(buf) > 0:
-        buf = buf.strip()
-        buf = buf.decode()
-        urllib.request.urlretrieve(buf, "temp.jpg")
-        status = "Insert text to post here" 
-        api.update_with_media("temp.jpg", status)
-        print(buf)
-        del(buf)
+# Receives the photo directly from the photobooth's webhook publish target
+# (webhook_uri = http://127.0.0.1:3000/ in the [upload] section)
+class BridgeHandler(BaseHTTPRequestHandler):
+    def do_POST(self):
+        body = self.rfile.read(int(self.headers.get("Content-Length", 0)))
+        header = ("Content-Type: %s\r\n\r\n" % self.headers.get("Content-Type")).encode()
+        message = BytesParser().parsebytes(header + body)
+        for part in message.get_payload() if message.is_multipart() else []:
+            if part.get_param("name", header="content-disposition") == "image":
+                with open("temp.jpg", "wb") as f:
+                    f.write(part.get_payload(decode=True))
+                tweet = api.update_with_media("temp.jpg", status)
+                self.send_response(200)
+                self.end_headers()
+                self.wfile.write(("https://twitter.com/%s/status/%s\n" % (user.screen_name, tweet.id_str)).encode())
+                return
+        self.send_response(400)
+        self.end_headers()
+
+port = int(sys.argv[1]) if len(sys.argv) > 1 else 3000
+HTTPServer(("127.0.0.1", port), BridgeHandler).serve_forever()